@@ -13,10 +13,15 @@
 #include "solver.h"
 #include "debugTools.h"
 #include "combinatorics.h"
+#include "compiledExpression.h"
 #include "symbolicRing.h"
 #include "pythonCodeGen.h"
 #include "stringRoutines.h"
 
+#include <exception>
+#include <iterator>
+#include <memory>
+
 enum class Feasibility {
     FEASIBLE,
     INFEASIBLE,
@@ -72,9 +77,39 @@ public:
     AlgorithmFamily method() const {
         return method_;
     }
+
+    // used by the csdp methods
+    void setSdpEngine(SdpEngine engine) {
+        sdpEngine_ = engine;
+    }
+
+    SdpEngine getSdpEngine() const {
+        return sdpEngine_;
+    }
+
+    // if set, the csdp methods write the sdp to this file and do not solve it
+    void setDumpFile(const std::string& fileName) {
+        dumpFile_ = fileName;
+    }
+
+    const std::string& getDumpFile() const {
+        return dumpFile_;
+    }
+
+    // presolve of the sdp before it is handed to the backend, on by default
+    void setPresolve(bool presolve) {
+        presolve_ = presolve;
+    }
+
+    bool getPresolve() const {
+        return presolve_;
+    }
 private:
     int highMonomialDegree_ = -1;
     AlgorithmFamily method_;
+    SdpEngine sdpEngine_ = SdpEngine::CSDP;
+    std::string dumpFile_;
+    bool presolve_ = true;
     bool addAdditionalOneGeqZero_ = true;
 };
 
@@ -171,14 +206,182 @@ private:
             symbolicCoeffitients.push_back(coeff_sym);
         }
 
-        SymbolicPolynomial res = env.symbolicPolynomialZero();
+        SymbolicPolynomialAccumulator res(&env);
+        res.add(env.symbolicPolynomialZero());
 
         for (int i = 0; i < monomials.size(); i++) {
             const auto& lhs = symbolicCoeffitients[i];
             const auto& rhs = monomialsSym[i];
-            res = symbolic_ring::add(res, symbolic_ring::mul(lhs, rhs), true);
+            res.add(symbolic_ring::mul(lhs, rhs));
+        }
+        return std::move(res).build();
+    }
+
+    // Sos basis of an if-then: the monomials of degree <= maxDegree in the program variables that occur in its
+    // conditions or conclusions. Setting the other variables to zero turns a certificate over all variables into
+    // one over these, so the smaller gram blocks lose nothing.
+    std::vector<QMonomial> getIfThenSosBasis(const std::vector<SymbolicPolynomial>& conditions,
+                                             const std::vector<SymbolicPolynomial>& conclusions,
+                                             int maxDegree,
+                                             SymbolicEnvironment& env) {
+        std::set<int> occurringSymbols;
+        auto collectSymbols = [&occurringSymbols](const SymbolicPolynomial& polynomial) {
+            for (const auto& term: polynomial.getReducedMonomials()) {
+                const auto& exponents = term.getQmonomial().getExponents();
+                for (int i = 0; i < exponents.size(); i++) {
+                    occurringSymbols.insert(exponents.symbolIdAt(i));
+                }
+            }
+        };
+        for (const auto& it: conditions) {
+            collectSymbols(it);
+        }
+        for (const auto& it: conclusions) {
+            collectSymbols(it);
+        }
+
+        std::vector<QMonomial> variables;
+        for (const auto& variable: allRationalVariables) {
+            if (occurringSymbols.count(variable.getExponents().symbolIdAt(0)) != 0) {
+                variables.push_back(variable);
+            }
+        }
+
+        std::vector<QMonomial> basis;
+        std::vector<int> current(variables.size(), 0);
+        do {
+            QMonomial monomial = env.qmonomialOne();
+            for (int i = 0; i < variables.size(); i++) {
+                for (int power = 0; power < current[i]; power++)
+                    monomial = symbolic_ring::mul(monomial, variables[i]);
+            }
+            basis.push_back(monomial);
+        } while (getNextVectorBoundedSum(current, maxDegree));
+
+        return basis;
+    }
+
+    struct IfThenConditionSymbolic {
+        std::vector<SymbolicPolynomial> conditions;
+        std::vector<SymbolicPolynomial> conclusions;
+    };
+
+    // the if-thens are evaluated on the threads of openmp, every thread with a copy of ctx; the results are by the
+    // index of the if-then. The relations are compiled and run on stacks instead of walking the tree
+    std::vector<IfThenConditionSymbolic> evaluateIfThenConditions(std::vector<IfThenCondition>& ifthenConditions,
+                                                                  const EvaluationContext& ctx) {
+        std::vector<IfThenConditionSymbolic> result(ifthenConditions.size());
+        std::vector<std::exception_ptr> errors(ifthenConditions.size());
+#pragma omp parallel
+        {
+            EvaluationContext threadCtx = ctx;
+#pragma omp for schedule(dynamic)
+            for (int i = 0; i < static_cast<int>(ifthenConditions.size()); i++) {
+                try {
+                    for (auto& it : ifthenConditions[i].getConditions()) {
+                        result[i].conditions.push_back(CompiledExpression(*it, threadCtx).evaluate(threadCtx).getSymbolicPolynomial());
+                    }
+                    for (auto& it : ifthenConditions[i].getConclusions()) {
+                        result[i].conclusions.push_back(CompiledExpression(*it, threadCtx).evaluate(threadCtx).getSymbolicPolynomial());
+                    }
+                } catch (...) {
+                    errors[i] = std::current_exception();
+                }
+            }
+        }
+        rethrowFirst(errors);
+        return result;
+    }
+
+    // for each if-then condition create #conditions * #conclusion soses, the coefficient matching equalities are
+    // assembled directly from the gram matrix entries and the terms of the conditions. The soses are over commonGram,
+    // or over getIfThenSosBasis(..) of their if-then if it is nullptr. Every if-then gets an assembler of its own on a
+    // thread of openmp, the ids of its soses are known in advance, and the assemblers are appended in the order of the
+    // if-thens, so the system and sosBases do not depend on the threads. Fills sosBases
+    SparseConstraintSystem encodeIfThenConditions(const std::vector<IfThenConditionSymbolic>& ifThens,
+                                                  const GramTemplate* commonGram, int& maxSosDim) {
+        auto& env = *env_;
+        std::vector<int> firstSos(ifThens.size() + 1, 0);
+        for (int i = 0; i < ifThens.size(); i++) {
+            firstSos[i + 1] = firstSos[i] + ifThens[i].conditions.size() * ifThens[i].conclusions.size();
+        }
+
+        struct Encoding {
+            ConstraintAssembler assembler;
+            std::vector<std::vector<QMonomial>> sosBases;
+            std::vector<QMonomial> basis;
+        };
+        std::vector<Encoding> encodings(ifThens.size(), Encoding{ConstraintAssembler(&env), {}, {}});
+        std::vector<std::exception_ptr> errors(ifThens.size());
+
+#pragma omp parallel for schedule(dynamic)
+        for (int i = 0; i < static_cast<int>(ifThens.size()); i++) {
+            try {
+                const auto& ifThen = ifThens[i];
+                auto& encoding = encodings[i];
+                std::unique_ptr<GramTemplate> ownGram;
+                if (commonGram == nullptr) {
+                    ownGram = std::make_unique<GramTemplate>(getIfThenSosBasis(ifThen.conditions, ifThen.conclusions,
+                                                                               config_.getHighMonomialDegree(), env));
+                }
+                const auto& gramTemplate = commonGram == nullptr ? *ownGram : *commonGram;
+                encoding.basis = gramTemplate.getBasis();
+
+                int sosCounter = firstSos[i] - 1;
+                for (const auto& ifThenConclusion: ifThen.conclusions) {
+                    auto prunedBases = pruneSosBases(
+                            std::vector<std::vector<QMonomial>>(ifThen.conditions.size(), gramTemplate.getBasis()),
+                            ifThen.conditions, ifThenConclusion);
+
+                    encoding.assembler.startGroup();
+                    for (int condIdx = 0; condIdx < ifThen.conditions.size(); condIdx++) {
+                        sosCounter += 1;
+                        const auto& basis = prunedBases[condIdx];
+                        encoding.sosBases.push_back(basis);
+                        if (basis.empty()) {
+                            continue; // the sos has to be zero
+                        }
+                        if (basis.size() == gramTemplate.size()) {
+                            encoding.assembler.addSosProduct(sosCounter, gramTemplate, ifThen.conditions[condIdx]);
+                        } else {
+                            encoding.assembler.addSosProduct(sosCounter, GramTemplate(basis), ifThen.conditions[condIdx]);
+                        }
+                    }
+                    encoding.assembler.addPolynomial(ifThenConclusion, -1);
+                }
+            } catch (...) {
+                errors[i] = std::current_exception();
+            }
+        }
+        rethrowFirst(errors);
+
+        ConstraintAssembler assembler(&env);
+        sosBases.clear();
+        maxSosDim = 0;
+        for (auto& encoding: encodings) {
+#ifdef AUCOES_DEBUG
+            if (commonGram == nullptr) {
+                std::cout << "Sos basis of the if-then:";
+                for (auto& it: encoding.basis) {
+                    std::cout << " " << it;
+                }
+                std::cout << std::endl;
+            }
+#endif
+            maxSosDim = std::max(maxSosDim, static_cast<int>(encoding.basis.size()));
+            assembler.append(std::move(encoding.assembler));
+            std::move(encoding.sosBases.begin(), encoding.sosBases.end(), std::back_inserter(sosBases));
+        }
+        return assembler.build();
+    }
+
+    // an exception must not leave an openmp region, the loops keep them by iteration
+    static void rethrowFirst(const std::vector<std::exception_ptr>& errors) {
+        for (const auto& error: errors) {
+            if (error) {
+                std::rethrow_exception(error);
+            }
         }
-        return res;
     }
 
 public:
@@ -275,7 +478,8 @@ public:
 #endif
 
 
-        auto env = SymbolicEnvironment();
+        env_ = std::make_unique<SymbolicEnvironment>();
+        auto& env = *env_;
         auto ctx = EvaluationContext(&env);
 
         allRationalVariablesNames = programTable.getDeclaredVariables();
@@ -342,11 +546,6 @@ public:
 
 
         // using the context to evaluate all if-then conditions
-        struct IfThenConditionSymbolic {
-            std::vector<SymbolicPolynomial> conditions;
-            std::vector<SymbolicPolynomial> conclusions;
-        };
-
         auto pritntIfThenCondition = [](const IfThenConditionSymbolic& condition, std::string pref = "") {
             std::cout << pref << "Conditions: (" << condition.conditions.size() << ") \n";
             int cnt = 0;
@@ -361,20 +560,7 @@ public:
             }
         };
 
-        std::vector<IfThenConditionSymbolic> ifThenConditionsSymbolic;
-
-        for (auto& condition : ifthenConditions) {
-            IfThenConditionSymbolic conditionSymbolic;
-            for (auto& it : condition.getConditions()) {
-                conditionSymbolic.conditions.push_back(it->evaluate(ctx).getSymbolicPolynomial());
-            }
-            for (auto& it : condition.getConclusions()) {
-                conditionSymbolic.conclusions.push_back(it->evaluate(ctx).getSymbolicPolynomial());
-            }
-
-
-            ifThenConditionsSymbolic.push_back(conditionSymbolic);
-        }
+        auto ifThenConditionsSymbolic = evaluateIfThenConditions(ifthenConditions, ctx);
 
 #ifdef AUCOES_DEBUG
         std::cout << "\n================================\nAll registered if-then conditions: \n";
@@ -420,90 +606,32 @@ public:
         std::cout << "End of sos monomials\n================================\n";
 #endif
 
-        std::vector<std::vector<SymbolicPolynomial>> sosPolynomials;
-        std::vector<std::vector<SymbolicPolynomial>> symbolicPolynoimalRepresentation;
-
-
-        // for each if-then condition create #conditions * #conclusion soses
-        int sosCounter = -1;
-        for (auto& ifThen: ifThenConditionsSymbolic) {
-            sosPolynomials.emplace_back();
-            symbolicPolynoimalRepresentation.emplace_back();
-
-            for (auto ifThenConclusion: ifThen.conclusions) {
-                auto currentSymbolicPolynomialEncodingIfThen = env.symbolicPolynomialZero();
-                for (auto ifThenCondition: ifThen.conditions) {
-                    sosCounter += 1;
-                    std::cout << "getting sos: " << sosCounter << std::endl;
-                    auto toPush = getSos(sosMonomials, sosCounter);
-                    std::cout << "sos received." << std::endl;
-
-                    sosPolynomials.back().push_back(toPush);
-                    currentSymbolicPolynomialEncodingIfThen =
-                            symbolic_ring::add(currentSymbolicPolynomialEncodingIfThen,
-                                               symbolic_ring::mul(toPush, ifThenCondition), false);
-                }
-                currentSymbolicPolynomialEncodingIfThen = symbolic_ring::add(
-                        currentSymbolicPolynomialEncodingIfThen,
-                        symbolic_ring::mul(ifThenConclusion, -1), false);
-                currentSymbolicPolynomialEncodingIfThen.reduce();
-                symbolicPolynoimalRepresentation.back().push_back(currentSymbolicPolynomialEncodingIfThen);
-            }
-        }
-
-#ifdef AUCOES_DEBUG
-        std::cout << "\n================================\nAll sos polynomials: \n";
-        for (auto& it: sosPolynomials) {
-            for (auto& it2: it) {
-                std::cout << it2 << std::endl;
-            }
-        }
-        std::cout << "End of sos polynomials\n================================\n";
-#endif
-
-#ifdef AUCOES_DEBUG
-        std::cout << "\n================================\nAll symbolic polynomials: \n";
-        for (auto& it: symbolicPolynoimalRepresentation) {
-            for (auto& it2: it) {
-                std::cout << it2 << std::endl;
-            }
-        }
-        std::cout << "End of symbolic polynomials\n================================\n";
-#endif
-
-        std::vector<QPolynomial> linearPolynomialsShouldBeZero;
-        for (int i = 0; i < symbolicPolynoimalRepresentation.size(); i++) {
-            for (int j = 0; j < symbolicPolynoimalRepresentation[i].size(); j++) {
-                auto allMonomials = symbolicPolynoimalRepresentation[i][j].getReducedMonomials();
-                // iterating over monomials and setting the coefficients to zero
-                for (auto& it: allMonomials) {
-                    linearPolynomialsShouldBeZero.push_back(it.getQcoefficient());
-                }
-            }
-        }
+        // for each if-then condition create #conditions * #conclusion soses, the coefficient matching equalities
+        // are assembled directly from the gram matrix entries and the terms of the conditions
+        GramTemplate gramTemplate(sosMonomials);
+        int maxSosDim = 0;
+        auto linearSystem = encodeIfThenConditions(ifThenConditionsSymbolic, &gramTemplate, maxSosDim);
 
 #ifdef AUCOES_DEBUG
-        std::cout << "\n================================\nAll linear polynomials that should be zero: \n";
-        for (auto& it: linearPolynomialsShouldBeZero) {
-            std::cout << it << std::endl;
-        }
-        std::cout << "End of all linear polynomials that should be zero\n================================\n";
+        std::cout << "\n================================\nCoefficient matching system: \n";
+        std::cout << "soses: " << sosBases.size() << ", equalities: " << linearSystem.getNumberOfRows()
+                  << ", gram entries: " << linearSystem.gramEntries.size()
+                  << ", free entries: " << linearSystem.freeEntries.size() << std::endl;
+        std::cout << "End of coefficient matching system\n================================\n";
 #endif
 
 
-        solverCsdp_ = std::make_unique<SolverCsdp>(sosMonomials.size(), 0, instanceName_ + std::to_string(config_.getHighMonomialDegree()));
+        solver_ = std::make_unique<Solver>(sosMonomials.size(), config_.getSdpEngine());
+        solver_->setPresolve(config_.getPresolve());
+        solver_->addLinearEqualityConstraints(linearSystem);
 
-        int dbg_cnt = 0;
-        for (auto&it : linearPolynomialsShouldBeZero) {
-#ifdef AUCOES_DEBUG
-            std::cout << "Adding(3): " << it << std::endl;
-            dbg_cnt += 1;
-#endif
-            solverCsdp_->addLinearEqualityConstraint(it);
+        if (!config_.getDumpFile().empty()) {
+            solver_->dump(config_.getDumpFile());
+            std::cout << "The sdp is written to " << config_.getDumpFile() << std::endl;
+            return;
         }
 
-
-        auto feasibility = solverCsdp_->is_feasible();
+        auto feasibility = solver_->is_feasible();
         hasSolution = feasibility;
 
         if (feasibility) {
@@ -516,14 +644,9 @@ public:
         std::cout << "The system is feasible: " << (feasibility ? "YES" : "NO") << std::endl;
 
         if (feasibility) {
-            auto sol = solverCsdp_->getSolution2();
-            for (auto& it: sol) {
-                std::cout << it.first << " " << it.second << std::endl;
-            }
+            solution = solver_->getSolution();
+            solution.print(std::cout);
         }
-
-
-        solution = solverCsdp_->getSolution2();
     }
 
 
@@ -620,7 +743,8 @@ public:
 #endif
 
 
-        auto env = SymbolicEnvironment();
+        env_ = std::make_unique<SymbolicEnvironment>();
+        auto& env = *env_;
         auto ctx = EvaluationContext(&env);
 
         allRationalVariablesNames = programTable.getDeclaredVariables();
@@ -687,11 +811,6 @@ public:
 
 
         // using the context to evaluate all if-then conditions
-        struct IfThenConditionSymbolic {
-            std::vector<SymbolicPolynomial> conditions;
-            std::vector<SymbolicPolynomial> conclusions;
-        };
-
         auto pritntIfThenCondition = [](const IfThenConditionSymbolic& condition, std::string pref = "") {
             std::cout << pref << "Conditions: (" << condition.conditions.size() << ") \n";
             int cnt = 0;
@@ -706,20 +825,7 @@ public:
             }
         };
 
-        std::vector<IfThenConditionSymbolic> ifThenConditionsSymbolic;
-
-        for (auto& condition : ifthenConditions) {
-            IfThenConditionSymbolic conditionSymbolic;
-            for (auto& it : condition.getConditions()) {
-                conditionSymbolic.conditions.push_back(it->evaluate(ctx).getSymbolicPolynomial());
-            }
-            for (auto& it : condition.getConclusions()) {
-                conditionSymbolic.conclusions.push_back(it->evaluate(ctx).getSymbolicPolynomial());
-            }
-
-
-            ifThenConditionsSymbolic.push_back(conditionSymbolic);
-        }
+        auto ifThenConditionsSymbolic = evaluateIfThenConditions(ifthenConditions, ctx);
 
 #ifdef AUCOES_DEBUG
         std::cout << "\n================================\nAll registered if-then conditions: \n";
@@ -765,88 +871,24 @@ public:
         std::cout << "End of sos monomials\n================================\n";
 #endif
 
-        std::vector<std::vector<SymbolicPolynomial>> sosPolynomials;
-        std::vector<std::vector<SymbolicPolynomial>> symbolicPolynoimalRepresentation;
-
-
-        // for each if-then condition create #conditions * #conclusion soses
-        int sosCounter = -1;
-        for (auto& ifThen: ifThenConditionsSymbolic) {
-            sosPolynomials.emplace_back();
-            symbolicPolynoimalRepresentation.emplace_back();
-            // within this block the currentSymbolicPolynomialEncodingIfThen reduced only once to optimize the performance
-            for (auto ifThenConclusion: ifThen.conclusions) {
-                auto currentSymbolicPolynomialEncodingIfThen = env.symbolicPolynomialZero();
-                for (auto ifThenCondition: ifThen.conditions) {
-                    sosCounter += 1;
-                    std::cout << "getting sos: " << sosCounter << std::endl;
-                    auto toPush = getSos(sosMonomials, sosCounter);
-                    std::cout << "sos received." << std::endl;
-
-                    sosPolynomials.back().push_back(toPush);
-                    currentSymbolicPolynomialEncodingIfThen =
-                            symbolic_ring::add(currentSymbolicPolynomialEncodingIfThen,
-                                               symbolic_ring::mul(toPush, ifThenCondition), false);
-                }
-                currentSymbolicPolynomialEncodingIfThen = symbolic_ring::add(
-                        currentSymbolicPolynomialEncodingIfThen,
-                        symbolic_ring::mul(ifThenConclusion, -1), false);
-                currentSymbolicPolynomialEncodingIfThen.reduce();
-
-                symbolicPolynoimalRepresentation.back().push_back(currentSymbolicPolynomialEncodingIfThen);
-            }
-        }
+        // for each if-then condition create #conditions * #conclusion soses, the coefficient matching equalities
+        // are assembled directly from the gram matrix entries and the terms of the conditions
+        GramTemplate gramTemplate(sosMonomials);
+        int maxSosDim = 0;
+        auto linearSystem = encodeIfThenConditions(ifThenConditionsSymbolic, &gramTemplate, maxSosDim);
 
 #ifdef AUCOES_DEBUG
-        std::cout << "\n================================\nAll sos polynomials: \n";
-        for (auto& it: sosPolynomials) {
-            for (auto& it2: it) {
-                std::cout << it2 << std::endl;
-            }
-        }
-        std::cout << "End of sos polynomials\n================================\n";
-#endif
-
-#ifdef AUCOES_DEBUG
-        std::cout << "\n================================\nAll symbolic polynomials: \n";
-        for (auto& it: symbolicPolynoimalRepresentation) {
-            for (auto& it2: it) {
-                std::cout << it2 << std::endl;
-            }
-        }
-        std::cout << "End of symbolic polynomials\n================================\n";
-#endif
-
-        std::vector<QPolynomial> linearPolynomialsShouldBeZero;
-        for (int i = 0; i < symbolicPolynoimalRepresentation.size(); i++) {
-            for (int j = 0; j < symbolicPolynoimalRepresentation[i].size(); j++) {
-                auto allMonomials = symbolicPolynoimalRepresentation[i][j].getReducedMonomials();
-                // iterating over monomials and setting the coefficients to zero
-                for (auto& it: allMonomials) {
-                    linearPolynomialsShouldBeZero.push_back(it.getQcoefficient());
-                }
-            }
-        }
-
-#ifdef AUCOES_DEBUG
-        std::cout << "\n================================\nAll linear polynomials that should be zero: \n";
-        for (auto& it: linearPolynomialsShouldBeZero) {
-            std::cout << it << std::endl;
-        }
-        std::cout << "End of all linear polynomials that should be zero\n================================\n";
+        std::cout << "\n================================\nCoefficient matching system: \n";
+        std::cout << "soses: " << sosBases.size() << ", equalities: " << linearSystem.getNumberOfRows()
+                  << ", gram entries: " << linearSystem.gramEntries.size()
+                  << ", free entries: " << linearSystem.freeEntries.size() << std::endl;
+        std::cout << "End of coefficient matching system\n================================\n";
 #endif
 
 
-        solver_ = std::make_unique<SolverMosec>(sosMonomials.size(), 0, instanceName_ + std::to_string(config_.getHighMonomialDegree()));
-
-        int dbg_cnt = 0;
-        for (auto&it : linearPolynomialsShouldBeZero) {
-#ifdef AUCOES_DEBUG
-            std::cout << "Adding(4): " << it << std::endl;
-            dbg_cnt += 1;
-#endif
-            solver_->addLinearEqualityConstraint(it);
-        }
+        solver_ = std::make_unique<Solver>(sosMonomials.size(), SdpEngine::MOSEK);
+        solver_->setPresolve(config_.getPresolve());
+        solver_->addLinearEqualityConstraints(linearSystem);
 
 
         auto feasibility = solver_->is_feasible();
@@ -862,14 +904,10 @@ public:
         std::cout << "The system is feasible: " << (feasibility ? "YES" : "NO") << std::endl;
 
         if (feasibility) {
-            auto sol = solver_->getSolution2();
-            for (auto& it: sol) {
-                std::cout << it.first << " " << it.second << std::endl;
-            }
+            // there is no solution if presolve finds the system infeasible
+            solution = solver_->getSolution();
+            solution.print(std::cout);
         }
-
-
-        solution = solver_->getSolution2();
     }
 
     void solveWithPutinarCsdp() {
@@ -923,7 +961,8 @@ public:
         #endif
 
 
-        auto env = SymbolicEnvironment();
+        env_ = std::make_unique<SymbolicEnvironment>();
+        auto& env = *env_;
         auto ctx = EvaluationContext(&env);
 
         allRationalVariablesNames = programTable.getDeclaredVariables();
@@ -990,11 +1029,6 @@ public:
 
 
         // using the context to evaluate all if-then conditions
-        struct IfThenConditionSymbolic {
-            std::vector<SymbolicPolynomial> conditions;
-            std::vector<SymbolicPolynomial> conclusions;
-        };
-
         auto pritntIfThenCondition = [](const IfThenConditionSymbolic& condition, std::string pref = "") {
             std::cout << pref << "Conditions: (" << condition.conditions.size() << ") \n";
             int cnt = 0;
@@ -1009,20 +1043,7 @@ public:
             }
         };
 
-        std::vector<IfThenConditionSymbolic> ifThenConditionsSymbolic;
-
-        for (auto& condition : ifthenConditions) {
-            IfThenConditionSymbolic conditionSymbolic;
-            for (auto& it : condition.getConditions()) {
-                conditionSymbolic.conditions.push_back(it->evaluate(ctx).getSymbolicPolynomial());
-            }
-            for (auto& it : condition.getConclusions()) {
-                conditionSymbolic.conclusions.push_back(it->evaluate(ctx).getSymbolicPolynomial());
-            }
-
-
-            ifThenConditionsSymbolic.push_back(conditionSymbolic);
-        }
+        auto ifThenConditionsSymbolic = evaluateIfThenConditions(ifthenConditions, ctx);
 
         #ifdef AUCOES_DEBUG
         std::cout << "\n================================\nAll registered if-then conditions: \n";
@@ -1036,121 +1057,31 @@ public:
 
 
 
-        // create monomials for sos
-        std::vector<std::vector<int>> allCombinations;
-        auto current = std::vector<int>(allRationalVariablesNames.size(), 0);
-        do {
-            allCombinations.push_back(current);
-            for (auto& it : current) {
-                std::cout << it << " ";
-            }
-            std::cout << std::endl;
-        } while (getNextVectorBoundedSum(current, config_.getHighMonomialDegree()));
-
-
-        sosMonomials;
-
-        for (const auto& combination : allCombinations) {
-            QMonomial monomial = env.qmonomialOne();
-            for (int i = 0; i < allRationalVariablesNames.size(); i++) {
-                for (int power = 0; power < combination[i]; power++)
-                    monomial = symbolic_ring::mul(monomial, allRationalVariables[i]);
-            }
-            sosMonomials.push_back(monomial);
-        }
-
-        #ifdef AUCOES_DEBUG
-        std::cout << "\n================================\nAll sos monomials: \n";
-        for (auto& it: sosMonomials) {
-            std::cout << it << std::endl;
-        }
-        std::cout << "End of sos monomials\n================================\n";
-        #endif
-
-        std::vector<std::vector<SymbolicPolynomial>> sosPolynomials;
-        std::vector<std::vector<SymbolicPolynomial>> symbolicPolynoimalRepresentation;
-
-
-        // for each if-then condition create #conditions * #conclusion soses
-        int sosCounter = -1;
-        for (auto& ifThen: ifThenConditionsSymbolic) {
-            sosPolynomials.emplace_back();
-            symbolicPolynoimalRepresentation.emplace_back();
-
-            for (auto ifThenConclusion: ifThen.conclusions) {
-                auto currentSymbolicPolynomialEncodingIfThen = env.symbolicPolynomialZero();
-                for (auto ifThenCondition: ifThen.conditions) {
-                    sosCounter += 1;
-                    std::cout << "getting sos: " << sosCounter << std::endl;
-                    auto toPush = getSos(sosMonomials, sosCounter);
-                    std::cout << "sos received." << std::endl;
-
-                    sosPolynomials.back().push_back(toPush);
-                    currentSymbolicPolynomialEncodingIfThen =
-                            symbolic_ring::add(currentSymbolicPolynomialEncodingIfThen,
-                                               symbolic_ring::mul(toPush, ifThenCondition), true);
-                }
-                currentSymbolicPolynomialEncodingIfThen = symbolic_ring::add(
-                        currentSymbolicPolynomialEncodingIfThen,
-                        symbolic_ring::mul(ifThenConclusion, -1), true);
-
-                symbolicPolynoimalRepresentation.back().push_back(currentSymbolicPolynomialEncodingIfThen);
-            }
-        }
-
-        #ifdef AUCOES_DEBUG
-        std::cout << "\n================================\nAll sos polynomials: \n";
-        for (auto& it: sosPolynomials) {
-            for (auto& it2: it) {
-                std::cout << it2 << std::endl;
-            }
-        }
-        std::cout << "End of sos polynomials\n================================\n";
-        #endif
+        // for each if-then condition create #conditions * #conclusion soses over the basis of that if-then, the
+        // coefficient matching equalities are assembled directly from the gram matrix entries and the terms of the conditions
+        int maxSosDim = 0;
+        auto linearSystem = encodeIfThenConditions(ifThenConditionsSymbolic, nullptr, maxSosDim);
 
-        #ifdef AUCOES_DEBUG
-        std::cout << "\n================================\nAll symbolic polynomials: \n";
-        for (auto& it: symbolicPolynoimalRepresentation) {
-            for (auto& it2: it) {
-                std::cout << it2 << std::endl;
-            }
-        }
-        std::cout << "End of symbolic polynomials\n================================\n";
-        #endif
-
-        std::vector<QPolynomial> linearPolynomialsShouldBeZero;
-        for (int i = 0; i < symbolicPolynoimalRepresentation.size(); i++) {
-            for (int j = 0; j < symbolicPolynoimalRepresentation[i].size(); j++) {
-                auto allMonomials = symbolicPolynoimalRepresentation[i][j].getReducedMonomials();
-                // iterating over monomials and setting the coefficients to zero
-                for (auto& it: allMonomials) {
-                    linearPolynomialsShouldBeZero.push_back(it.getQcoefficient());
-                }
-            }
-        }
-
-        #ifdef AUCOES_DEBUG
-        std::cout << "\n================================\nAll linear polynomials that should be zero: \n";
-        for (auto& it: linearPolynomialsShouldBeZero) {
-            std::cout << it << std::endl;
-        }
-        std::cout << "End of all linear polynomials that should be zero\n================================\n";
-        #endif
+#ifdef AUCOES_DEBUG
+        std::cout << "\n================================\nCoefficient matching system: \n";
+        std::cout << "soses: " << sosBases.size() << ", equalities: " << linearSystem.getNumberOfRows()
+                  << ", gram entries: " << linearSystem.gramEntries.size()
+                  << ", free entries: " << linearSystem.freeEntries.size() << std::endl;
+        std::cout << "End of coefficient matching system\n================================\n";
+#endif
 
 
-        solverCsdp_ = std::make_unique<SolverCsdp>(sosMonomials.size(), 0, instanceName_ + std::to_string(config_.getHighMonomialDegree()));
+        solver_ = std::make_unique<Solver>(maxSosDim, config_.getSdpEngine());
+        solver_->setPresolve(config_.getPresolve());
+        solver_->addLinearEqualityConstraints(linearSystem);
 
-        int dbg_cnt = 0;
-        for (auto&it : linearPolynomialsShouldBeZero) {
-        #ifdef AUCOES_DEBUG
-            std::cout << "Adding(1): " << it << std::endl;
-            dbg_cnt += 1;
-        #endif
-            solverCsdp_->addLinearEqualityConstraint(it);
+        if (!config_.getDumpFile().empty()) {
+            solver_->dump(config_.getDumpFile());
+            std::cout << "The sdp is written to " << config_.getDumpFile() << std::endl;
+            return;
         }
 
-
-        auto feasibility = solverCsdp_->is_feasible();
+        auto feasibility = solver_->is_feasible();
         hasSolution = feasibility;
 
         if (feasibility) {
@@ -1163,14 +1094,9 @@ public:
         std::cout << "The system is feasible: " << (feasibility ? "YES" : "NO") << std::endl;
 
         if (feasibility) {
-            auto sol = solverCsdp_->getSolution2();
-            for (auto& it: sol) {
-                std::cout << it.first << " " << it.second << std::endl;
-            }
+            solution = solver_->getSolution();
+            solution.print(std::cout);
         }
-
-
-        solution = solverCsdp_->getSolution2();
     }
 
 
@@ -1225,7 +1151,8 @@ public:
 #endif
 
 
-        auto env = SymbolicEnvironment();
+        env_ = std::make_unique<SymbolicEnvironment>();
+        auto& env = *env_;
         auto ctx = EvaluationContext(&env);
 
         allRationalVariablesNames = programTable.getDeclaredVariables();
@@ -1292,11 +1219,6 @@ public:
 
 
         // using the context to evaluate all if-then conditions
-        struct IfThenConditionSymbolic {
-            std::vector<SymbolicPolynomial> conditions;
-            std::vector<SymbolicPolynomial> conclusions;
-        };
-
         auto pritntIfThenCondition = [](const IfThenConditionSymbolic& condition, std::string pref = "") {
             std::cout << pref << "Conditions: (" << condition.conditions.size() << ") \n";
             int cnt = 0;
@@ -1311,20 +1233,7 @@ public:
             }
         };
 
-        std::vector<IfThenConditionSymbolic> ifThenConditionsSymbolic;
-
-        for (auto& condition : ifthenConditions) {
-            IfThenConditionSymbolic conditionSymbolic;
-            for (auto& it : condition.getConditions()) {
-                conditionSymbolic.conditions.push_back(it->evaluate(ctx).getSymbolicPolynomial());
-            }
-            for (auto& it : condition.getConclusions()) {
-                conditionSymbolic.conclusions.push_back(it->evaluate(ctx).getSymbolicPolynomial());
-            }
-
-
-            ifThenConditionsSymbolic.push_back(conditionSymbolic);
-        }
+        auto ifThenConditionsSymbolic = evaluateIfThenConditions(ifthenConditions, ctx);
 
 #ifdef AUCOES_DEBUG
         std::cout << "\n================================\nAll registered if-then conditions: \n";
@@ -1338,120 +1247,23 @@ public:
 
 
 
-        // create monomials for sos
-        std::vector<std::vector<int>> allCombinations;
-        auto current = std::vector<int>(allRationalVariablesNames.size(), 0);
-        do {
-            allCombinations.push_back(current);
-            for (auto& it : current) {
-                std::cout << it << " ";
-            }
-            std::cout << std::endl;
-        } while (getNextVectorBoundedSum(current, config_.getHighMonomialDegree()));
-
-
-        sosMonomials;
-
-        for (const auto& combination : allCombinations) {
-            QMonomial monomial = env.qmonomialOne();
-            for (int i = 0; i < allRationalVariablesNames.size(); i++) {
-                for (int power = 0; power < combination[i]; power++)
-                    monomial = symbolic_ring::mul(monomial, allRationalVariables[i]);
-            }
-            sosMonomials.push_back(monomial);
-        }
-
-#ifdef AUCOES_DEBUG
-        std::cout << "\n================================\nAll sos monomials: \n";
-        for (auto& it: sosMonomials) {
-            std::cout << it << std::endl;
-        }
-        std::cout << "End of sos monomials\n================================\n";
-#endif
-
-        std::vector<std::vector<SymbolicPolynomial>> sosPolynomials;
-        std::vector<std::vector<SymbolicPolynomial>> symbolicPolynoimalRepresentation;
-
-
-        // for each if-then condition create #conditions * #conclusion soses
-        int sosCounter = -1;
-        for (auto& ifThen: ifThenConditionsSymbolic) {
-            sosPolynomials.emplace_back();
-            symbolicPolynoimalRepresentation.emplace_back();
-
-            for (auto ifThenConclusion: ifThen.conclusions) {
-                auto currentSymbolicPolynomialEncodingIfThen = env.symbolicPolynomialZero();
-                for (auto ifThenCondition: ifThen.conditions) {
-                    sosCounter += 1;
-                    std::cout << "getting sos: " << sosCounter << std::endl;
-                    auto toPush = getSos(sosMonomials, sosCounter);
-                    std::cout << "sos received." << std::endl;
-
-                    sosPolynomials.back().push_back(toPush);
-                    currentSymbolicPolynomialEncodingIfThen =
-                            symbolic_ring::add(currentSymbolicPolynomialEncodingIfThen,
-                                               symbolic_ring::mul(toPush, ifThenCondition), false);
-                }
-                currentSymbolicPolynomialEncodingIfThen = symbolic_ring::add(
-                        currentSymbolicPolynomialEncodingIfThen,
-                        symbolic_ring::mul(ifThenConclusion, -1), false);
-
-                currentSymbolicPolynomialEncodingIfThen.reduce();
-
-                symbolicPolynoimalRepresentation.back().push_back(currentSymbolicPolynomialEncodingIfThen);
-            }
-        }
-
-#ifdef AUCOES_DEBUG
-        std::cout << "\n================================\nAll sos polynomials: \n";
-        for (auto& it: sosPolynomials) {
-            for (auto& it2: it) {
-                std::cout << it2 << std::endl;
-            }
-        }
-        std::cout << "End of sos polynomials\n================================\n";
-#endif
-
-#ifdef AUCOES_DEBUG
-        std::cout << "\n================================\nAll symbolic polynomials: \n";
-        for (auto& it: symbolicPolynoimalRepresentation) {
-            for (auto& it2: it) {
-                std::cout << it2 << std::endl;
-            }
-        }
-        std::cout << "End of symbolic polynomials\n================================\n";
-#endif
-
-        std::vector<QPolynomial> linearPolynomialsShouldBeZero;
-        for (int i = 0; i < symbolicPolynoimalRepresentation.size(); i++) {
-            for (int j = 0; j < symbolicPolynoimalRepresentation[i].size(); j++) {
-                auto allMonomials = symbolicPolynoimalRepresentation[i][j].getReducedMonomials();
-                // iterating over monomials and setting the coefficients to zero
-                for (auto& it: allMonomials) {
-                    linearPolynomialsShouldBeZero.push_back(it.getQcoefficient());
-                }
-            }
-        }
+        // for each if-then condition create #conditions * #conclusion soses over the basis of that if-then, the
+        // coefficient matching equalities are assembled directly from the gram matrix entries and the terms of the conditions
+        int maxSosDim = 0;
+        auto linearSystem = encodeIfThenConditions(ifThenConditionsSymbolic, nullptr, maxSosDim);
 
 #ifdef AUCOES_DEBUG
-        std::cout << "\n================================\nAll linear polynomials that should be zero: \n";
-        for (auto& it: linearPolynomialsShouldBeZero) {
-            std::cout << it << std::endl;
-        }
-        std::cout << "End of all linear polynomials that should be zero\n================================\n";
+        std::cout << "\n================================\nCoefficient matching system: \n";
+        std::cout << "soses: " << sosBases.size() << ", equalities: " << linearSystem.getNumberOfRows()
+                  << ", gram entries: " << linearSystem.gramEntries.size()
+                  << ", free entries: " << linearSystem.freeEntries.size() << std::endl;
+        std::cout << "End of coefficient matching system\n================================\n";
 #endif
 
 
-        solver_ = std::make_unique<SolverMosec>(sosMonomials.size(), 0, instanceName_ + std::to_string(config_.getHighMonomialDegree()));
-
-        int dbg_cnt = 0;
-        for (auto&it : linearPolynomialsShouldBeZero) {
-#ifdef AUCOES_DEBUG
-            std::cout << "Adding(2): " << it << std::endl;
-            dbg_cnt += 1;
-#endif
-            solver_->addLinearEqualityConstraint(it);
-        }
+        solver_ = std::make_unique<Solver>(maxSosDim, SdpEngine::MOSEK);
+        solver_->setPresolve(config_.getPresolve());
+        solver_->addLinearEqualityConstraints(linearSystem);
 
 
         auto feasibility = solver_->is_feasible();
@@ -1467,13 +1279,10 @@ public:
         std::cout << "The system is feasible: " << (feasibility ? "YES" : "NO") << std::endl;
 
         if (feasibility) {
-            auto sol = solver_->getSolution2();
-            for (auto& it: sol) {
-                std::cout << it.first << " " << it.second << std::endl;
-            }
+            // there is no solution if presolve finds the system infeasible
+            solution = solver_->getSolution();
+            solution.print(std::cout);
         }
-
-        solution = solver_->getSolution2();
     }
 
     void IAdmitThatThisIsUnsafeAndShouldBeUsedOnlyWithTrustedInput() {
@@ -1503,24 +1312,22 @@ public:
         std::map<std::string, doubleMatrix> sosNameToMatrix;
         std::map<std::string, double> variableNameToDouble;
 
-        auto sosDim = sosMonomials.size();
-
-        for (auto& it: solution) {
-            if (isLVar(it.first)) {
-                auto ijk = parseLVarName(it.first);
-                auto sosId = ijk[0];
-                auto rowIdx = ijk[1];
-                auto colIdx = ijk[2];
-
-                auto sosName = "l_" + std::to_string(sosId);
-
-                if (sosNameToMatrix.find(sosName) == sosNameToMatrix.end()) {
-                    sosNameToMatrix[sosName] = doubleMatrix(sosDim, std::vector<double>(sosDim, 0.0));
+        // the gram matrices come by their sos index
+        for (const auto& sosId_matrix: solution.matrices) {
+            const auto& values = sosId_matrix.second;
+            auto& matrix = sosNameToMatrix["l_" + std::to_string(sosId_matrix.first)];
+            matrix = doubleMatrix(values.size(), std::vector<double>(values.size(), 0.0));
+            for (int i = 0; i < values.size(); i++) {
+                for (int j = 0; j < values.size(); j++) {
+                    // added to 0.0, so a -0 of the solver is printed as 0
+                    matrix[i][j] += values[i][j];
                 }
-
-                sosNameToMatrix[sosName][rowIdx][colIdx] += it.second;
-                continue;
             }
+        }
+        for (const auto& it: solution.unconstrainedVariables) {
+            variableNameToDouble[it.first] = it.second;
+        }
+        for (const auto& it: solution.nonnegativeVariables) {
             variableNameToDouble[it.first] = it.second;
         }
 
@@ -1568,9 +1375,13 @@ public:
         // generate sos code
         std::vector<std::string> allSosNames;
 
-        int sosNameToMatrixSize = sosNameToMatrix.size();
-        for (int sosNameIdx = 0; sosNameIdx < sosNameToMatrixSize; sosNameIdx++) {
+        for (int sosNameIdx = 0; sosNameIdx < sosBases.size(); sosNameIdx++) {
             auto sosName = "l_" + std::to_string(sosNameIdx);
+            if (sosNameToMatrix.find(sosName) == sosNameToMatrix.end()) {
+                // the sos does not occur in the system (e.g. its basis was pruned away), so it is zero
+                auto sosDim = std::max<size_t>(sosBases[sosNameIdx].size(), 1);
+                sosNameToMatrix[sosName] = doubleMatrix(sosDim, std::vector<double>(sosDim, 0.0));
+            }
             allSosNames.push_back(sosName);
             os << codegen.generate_matrix(sosName, sosNameToMatrix[sosName]) << std::endl;
         }
@@ -1618,30 +1429,40 @@ public:
             os << codegen.arbitrary_code(it + " = " + "check." + it) << std::endl;
         }
 
-        // generate monomial vector
-        std::vector<std::string> monomialVectorString;
-        for (auto& it: sosMonomials) {
-            monomialVectorString.push_back(codegen.to_str(QPolynomial(it)));
-        }
+        // generate monomial vectors, one per sos in the order of l_all
+        std::stringstream monomialVectorsCommaSeparated;
+        for (int sosIdx = 0; sosIdx < allSosNames.size(); sosIdx++) {
+            std::vector<std::string> monomialVectorString;
+            for (auto& it: sosBases.at(sosIdx)) {
+                monomialVectorString.push_back(codegen.to_str(QPolynomial(it)));
+            }
+            if (monomialVectorString.empty()) {
+                monomialVectorString.push_back("1");
+            }
 
-        std::stringstream monomialVectorStringCommaSeparated;
-        for (int i = 0; i < monomialVectorString.size(); i++) {
-            monomialVectorStringCommaSeparated << monomialVectorString[i];
-            if (i != monomialVectorString.size() - 1) {
-                monomialVectorStringCommaSeparated << ", ";
+            monomialVectorsCommaSeparated << "sp.matrices.Matrix([";
+            for (int i = 0; i < monomialVectorString.size(); i++) {
+                monomialVectorsCommaSeparated << monomialVectorString[i];
+                if (i != monomialVectorString.size() - 1) {
+                    monomialVectorsCommaSeparated << ", ";
+                }
+            }
+            monomialVectorsCommaSeparated << "])";
+            if (sosIdx != allSosNames.size() - 1) {
+                monomialVectorsCommaSeparated << ", ";
             }
         }
 
         os << codegen.new_line() << std::endl;
-        os << codegen.arbitrary_code("check.monomial_vector = sp.matrices.Matrix([" + monomialVectorStringCommaSeparated.str() + "])")
+        os << codegen.arbitrary_code("check.monomial_vectors = [" + monomialVectorsCommaSeparated.str() + "]")
         << std::endl;
         os << codegen.new_line() << std::endl;
 
         // generate all sos polynomials
         os << codegen.block_of_code({
             "check.sos_all = []",
-            "for l in check.l_all:",
-            "    check.sos_all.append((check.monomial_vector.transpose() * l * check.monomial_vector)[0, 0])",
+            "for l, monomial_vector in zip(check.l_all, check.monomial_vectors):",
+            "    check.sos_all.append((monomial_vector.transpose() * l * monomial_vector)[0, 0])",
             ""
         });
 
@@ -1737,8 +1558,9 @@ private:
 
     Program& program_;
 
-    std::unique_ptr<SolverMosec> solver_;
-    std::unique_ptr<SolverCsdp> solverCsdp_;
+    // monomials keep symbol ids only, so the environment has to outlive the polynomials stored below
+    std::unique_ptr<SymbolicEnvironment> env_;
+    std::unique_ptr<Solver> solver_;
 
     Solution solution_;
     bool hasSolution = false;
@@ -1746,6 +1568,8 @@ private:
 
     SolverConfig config_;
     std::vector<QMonomial> sosMonomials;
+    // basis of every sos, by sos index
+    std::vector<std::vector<QMonomial>> sosBases;
     std::vector<QMonomial> allRationalVariables;
     std::vector<std::string> allRationalVariablesNames;
 
@@ -1755,7 +1579,7 @@ private:
 
     std::string instanceName_;
 
-    std::map<std::string, double> solution;
+    SdpProblem::Solution solution;
 };
 
 #endif //MYPROJECT_AUTOMAITCCOMPLEXITYESTIMATOR_H
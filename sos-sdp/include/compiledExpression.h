@@ -0,0 +1,75 @@
+//
+// Created by sergey on 27.08.23.
+//
+// an ExpressionElement compiled to postfix code. The types of the nodes are resolved and the names are looked up once,
+// evaluate(..) runs the code on a stack of QPolynomial and a stack of SymbolicPolynomial, without virtual calls or an
+// EvaluationResult per node. It gives the same polynomials as ExpressionElement::evaluate(..)
+//
+
+#ifndef MYPROJECT_COMPILEDEXPRESSION_H
+#define MYPROJECT_COMPILEDEXPRESSION_H
+
+#include <string>
+#include <vector>
+
+#include "programExpression.h"
+
+class CompiledExpression {
+public:
+    // the names are interned in context, the code runs with it and with its copies
+    CompiledExpression(const ExpressionElement& expression, EvaluationContext& context);
+
+    // QPOLYNOMIAL or SYMBOLIC_POLYNOMIAL, a relation gives the symbolic polynomial that has to be >= 0, > 0 or == 0
+    TypeTag getTypeTag() const {
+        return typeTag;
+    }
+
+    // may run on several threads at once
+    EvaluationResult evaluate(EvaluationContext& context) const;
+
+private:
+    enum class OpCode {
+        CONSTANT, // pushes value
+        VARIABLE, // pushes the variable nameId
+        CALL, // pops count arguments, pushes the value of the function nameId at them
+        ADD,
+        SUB,
+        MUL,
+        DIV, // by a constant
+        NEGATE,
+        RELATION, // left - right, right - left if swapped
+        FAIL // throws messages[nameId]
+    };
+
+    struct Instruction {
+        OpCode code;
+        bool symbolic = false; // the result is on the symbolic stack
+        // of a symbolic operation: the operand is still a QPolynomial on its stack and is cast when it is popped
+        bool leftQ = false;
+        bool rightQ = false;
+        bool swapped = false;
+        int nameId = -1;
+        int count = 0;
+        long long value = 0;
+    };
+
+    // returns the type of the value the code of the node leaves on the stack, the types of the children are the ones
+    // their code returned, so every node is typed once
+    TypeTag compile(const ExpressionElement& expression, EvaluationContext& context);
+
+    // an operation on two symbolic operands, the QPolynomial ones are cast by it
+    void emitSymbolic(OpCode code, TypeTag left, TypeTag right);
+
+    void emit(Instruction instruction, int pushedQ, int pushedSymbolic);
+
+    std::vector<Instruction> code;
+    std::vector<std::string> messages;
+    TypeTag typeTag = QPOLYNOMIAL;
+    // the depth of the stacks, they are reserved before the run
+    int depthQ = 0;
+    int depthSymbolic = 0;
+    int maxDepthQ = 0;
+    int maxDepthSymbolic = 0;
+};
+
+#endif //MYPROJECT_COMPILEDEXPRESSION_H
@@ -0,0 +1,19 @@
+//
+// Created by sergey on 21.08.23.
+//
+// csdp called in process through easy_sdp, available when the project is built with the csdp library
+// (USE_CSDP_LIBRARY, see CMakeLists.txt); otherwise CsdpSdpBackend runs the csdp binary
+//
+
+#ifndef MYPROJECT_CSDPLIBRARY_H
+#define MYPROJECT_CSDPLIBRARY_H
+
+#include "nativeSdpSolver.h"
+
+bool csdpLibraryAvailable();
+
+// the blocks are laid out by SdpaLayout, as in the .dat-s file; y follows the sign convention of NativeSdpResult
+// (A^T y in -K)
+NativeSdpResult solveWithCsdpLibrary(const NativeSdpProblem& problem);
+
+#endif //MYPROJECT_CSDPLIBRARY_H
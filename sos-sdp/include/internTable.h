@@ -0,0 +1,139 @@
+//
+// Created by sergey on 27.08.23.
+//
+// interns names: every name gets a dense id in the order of creation, and the Value given when it is inserted.
+// Any number of threads may look up and insert at once. The name and the value of an id are read without a lock, the
+// slots are in chunks that never move; a lookup by name takes one of the shards for reading, an insertion takes it for
+// writing. The ids do not depend on the threads as long as the new names are made by one thread
+//
+
+#ifndef MYPROJECT_INTERNTABLE_H
+#define MYPROJECT_INTERNTABLE_H
+
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <shared_mutex>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+struct NoInternValue {
+};
+
+template<class Value = NoInternValue>
+class InternTable {
+public:
+    InternTable() {
+        for (auto& chunk: chunks) {
+            chunk.store(nullptr, std::memory_order_relaxed);
+        }
+    }
+
+    ~InternTable() {
+        for (auto& chunk: chunks) {
+            delete[] chunk.load(std::memory_order_relaxed);
+        }
+    }
+
+    InternTable(const InternTable&) = delete;
+    InternTable& operator=(const InternTable&) = delete;
+
+    // the id of name and true if it is new. A new name gets value, it is stored before the id can be found by the
+    // others; an existing name keeps the value it has
+    std::pair<int, bool> insert(const std::string& name, Value value = Value()) {
+        auto& shard = getShard(name);
+        {
+            std::shared_lock<std::shared_timed_mutex> lock(shard.mutex);
+            auto it = shard.ids.find(name);
+            if (it != shard.ids.end()) {
+                return {it->second, false};
+            }
+        }
+        std::unique_lock<std::shared_timed_mutex> lock(shard.mutex);
+        auto it = shard.ids.find(name);
+        if (it != shard.ids.end()) {
+            return {it->second, false};
+        }
+        int id = count.fetch_add(1);
+        auto& slot = getSlot(id, true);
+        slot.name = name;
+        slot.value = std::move(value);
+        shard.ids.emplace(name, id);
+        return {id, true};
+    }
+
+    int intern(const std::string& name) {
+        return insert(name).first;
+    }
+
+    // -1 if there is no such name
+    int find(const std::string& name) const {
+        auto& shard = getShard(name);
+        std::shared_lock<std::shared_timed_mutex> lock(shard.mutex);
+        auto it = shard.ids.find(name);
+        return it == shard.ids.end() ? -1 : it->second;
+    }
+
+    // the reference stays valid as long as the table
+    const std::string& getName(int id) const {
+        return getSlot(id).name;
+    }
+
+    // set by insert(..) and never changed after it
+    const Value& getValue(int id) const {
+        return getSlot(id).value;
+    }
+
+    // the number of ids given out; with concurrent insertions the last ones may still be being written
+    int size() const {
+        return count.load();
+    }
+
+private:
+    struct Slot {
+        std::string name;
+        Value value{};
+    };
+
+    struct Shard {
+        mutable std::shared_timed_mutex mutex;
+        std::unordered_map<std::string, int> ids;
+    };
+
+    // chunk k has firstChunkSize << k slots, so 32 of them are enough for any int id
+    static constexpr int firstChunkBits = 6;
+    static constexpr int maxChunks = 32;
+    static constexpr int shardCount = 16;
+
+    Shard& getShard(const std::string& name) const {
+        return shards[std::hash<std::string>()(name) % shardCount];
+    }
+
+    // of id + firstChunkSize, the highest bit tells the chunk, the rest the slot in it
+    Slot& getSlot(int id, bool create = false) const {
+        if (id < 0 || id >= count.load()) {
+            throw std::out_of_range("no symbol with id " + std::to_string(id));
+        }
+        unsigned shifted = static_cast<unsigned>(id) + (1u << firstChunkBits);
+        int bit = 31 - __builtin_clz(shifted);
+        int chunk = bit - firstChunkBits;
+        Slot* slots = chunks[chunk].load(std::memory_order_acquire);
+        if (slots == nullptr && create) {
+            auto* allocated = new Slot[static_cast<size_t>(1) << bit];
+            if (chunks[chunk].compare_exchange_strong(slots, allocated, std::memory_order_acq_rel)) {
+                slots = allocated;
+            } else {
+                delete[] allocated;
+            }
+        }
+        return slots[shifted - (1u << bit)];
+    }
+
+    mutable Shard shards[shardCount];
+    mutable std::atomic<Slot*> chunks[maxChunks];
+    std::atomic<int> count{0};
+};
+
+#endif //MYPROJECT_INTERNTABLE_H
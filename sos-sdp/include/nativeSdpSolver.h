@@ -0,0 +1,206 @@
+//
+// Created by sergey on 14.08.23.
+//
+// primal-dual interior point method (HKM direction, Mehrotra predictor-corrector) for
+//     min 0  s.t.  <A_i, X> + f_i^T u == b_i,  X is block diagonal and X >= 0, u is free
+// the blocks of X are either psd blocks or diagonal ones (nonnegative orthants), as in SDPA
+//
+// NativeAdmmSolver is a first-order method for the same problems: douglas-rachford splitting between the affine set
+// and the cone, it needs one sparse factorization and per-block eigendecompositions instead of the dense m x m schur
+// complement, so it fits the large encodings at the price of a lower accuracy
+//
+
+#ifndef MYPROJECT_NATIVESDPSOLVER_H
+#define MYPROJECT_NATIVESDPSOLVER_H
+
+#include <vector>
+#include <utility>
+#include <cstddef>
+#include <atomic>
+
+struct NativeSdpProblem {
+    // upper triangle entry of A_i, zero-based; entries of a diagonal block have row == col
+    struct Entry {
+        int block;
+        int row;
+        int col;
+        double value;
+    };
+
+    struct Constraint {
+        std::vector<Entry> entries;
+        std::vector<std::pair<int, double>> freeEntries; // (free variable, coefficient)
+        double rhs = 0.0;
+    };
+
+    std::vector<int> blockSizes; // d > 0 for a d x d psd block, d < 0 for a diagonal block of size -d
+    int numberOfFreeVariables = 0;
+    std::vector<Constraint> constraints;
+};
+
+struct NativeSdpSettings {
+    double tolerance = 1e-8;
+    double acceptableTolerance = 1e-5; // the best iterate is still returned if it is this close, like a partial success of csdp
+    int maxIterations = 100;
+    double stepFraction = 0.95; // of the distance to the boundary of the cone
+    bool verbose = false;
+    const std::atomic<bool>* cancel = nullptr; // once it is set, the solver stops as if it ran out of iterations
+};
+
+enum class NativeSdpStatus {
+    SOLVED,
+    SOLVED_INACCURATE, // the residual stalled between acceptableTolerance and tolerance
+    PRIMAL_INFEASIBLE,
+    NOT_CONVERGED
+};
+
+struct NativeSdpResult {
+    NativeSdpStatus status = NativeSdpStatus::NOT_CONVERGED;
+    int iterations = 0;
+    std::vector<std::vector<double>> blocks; // X, a psd block is stored row by row, a diagonal one as its diagonal
+    std::vector<double> freeVariables;
+    std::vector<double> y;
+    double primalInfeasibility = 0.0;
+    double dualInfeasibility = 0.0;
+    double gap = 0.0;
+};
+
+class NativeSdpSolver {
+public:
+    explicit NativeSdpSolver(const NativeSdpProblem& problem, const NativeSdpSettings& settings = NativeSdpSettings());
+
+    NativeSdpResult solve();
+
+private:
+    typedef std::vector<std::vector<double>> BlockMatrix; // one vector per block, the layout of NativeSdpResult::blocks
+
+    struct BlockEntry {
+        int row;
+        int col;
+        double value;
+    };
+
+    // the part of A_i that lies in one block
+    struct BlockRow {
+        int constraint;
+        std::vector<BlockEntry> entries;
+    };
+
+    struct Direction {
+        BlockMatrix dX;
+        BlockMatrix dZ;
+        std::vector<double> dy;
+        std::vector<double> du;
+    };
+
+    bool isPsd(int block) const {
+        return blockSizes[block] > 0;
+    }
+
+    int dim(int block) const {
+        return blockSizes[block] > 0 ? blockSizes[block] : -blockSizes[block];
+    }
+
+    BlockMatrix zeroBlocks() const;
+    BlockMatrix identityBlocks(double scale) const;
+
+    std::vector<double> applyA(const BlockMatrix& X) const; // <A_i, X>, X need not be symmetric
+    BlockMatrix applyAT(const std::vector<double>& y) const; // sum y_i A_i
+    std::vector<double> applyF(const std::vector<double>& u) const;
+    std::vector<double> applyFT(const std::vector<double>& y) const;
+
+    void assembleSchurComplement();
+    bool factorSchurComplement();
+    void solveSchurComplement(std::vector<double>& rhs) const;
+    void solveFactored(const std::vector<double>& r1, const std::vector<double>& r2,
+                       std::vector<double>& dy, std::vector<double>& du) const;
+    void solveNewtonSystem(const std::vector<double>& r1, const std::vector<double>& r2,
+                           std::vector<double>& dy, std::vector<double>& du) const;
+
+    // the newton direction for the complementarity residual X Z -> rc, given as rc Z^{-1}
+    Direction computeDirection(const BlockMatrix& rcZinv);
+    double maxStep(const BlockMatrix& V, const BlockMatrix& dV) const;
+
+    int m;
+    int numberOfFree;
+    int n; // the sum of block dimensions
+    std::vector<int> blockSizes;
+    std::vector<std::vector<BlockRow>> blockRows;
+    std::vector<std::vector<std::pair<int, double>>> freeColumns; // (constraint, coefficient) for every free variable
+    std::vector<double> b;
+    NativeSdpSettings settings;
+
+    BlockMatrix X, Z, Zinv;
+    std::vector<double> y, u;
+    std::vector<double> rp, rf;
+    BlockMatrix Rd;
+
+    std::vector<double> schur; // m x m, row major, the lower triangle holds the cholesky factor, the upper one M
+    std::vector<double> schurDiagonal;
+    std::vector<double> schurFreeFactor; // cholesky factor of F^T M^{-1} F
+    std::vector<std::vector<double>> MinvF; // M^{-1} f_k for every free variable
+};
+
+struct NativeAdmmSettings {
+    double tolerance = 1e-7;
+    int maxIterations = 20000;
+    double relaxation = 1.6; // of the douglas-rachford step, in (0, 2)
+    int checkInterval = 10; // the infeasibility check needs a factor solve and a projection of its own
+    double regularization = 1e-8; // -delta I in the lower right corner of the kkt matrix
+    bool verbose = false;
+    const std::atomic<bool>* cancel = nullptr; // once it is set, the solver stops with NOT_CONVERGED
+};
+
+class NativeAdmmSolver {
+public:
+    explicit NativeAdmmSolver(const NativeSdpProblem& problem, const NativeAdmmSettings& settings = NativeAdmmSettings());
+
+    NativeSdpResult solve();
+    // starts from X, u and y of a previous result of the same problem, from either solver
+    NativeSdpResult solve(const NativeSdpResult& warmStart);
+
+    size_t getFactorNonzeros() const {
+        return factorRowIndex.size();
+    }
+
+private:
+    // the variables are stacked into one vector: svec of every psd block (the upper triangle row by row, off-diagonal
+    // entries scaled by sqrt(2), so that the euclidean inner product is the trace one), the diagonal blocks and the
+    // free variables
+    NativeSdpResult run(std::vector<double> z);
+
+    void factorKkt();
+    void solveKkt(std::vector<double>& rhs) const; // [I A^T; A -delta I], refined against delta == 0
+    void solveFactoredKkt(std::vector<double>& rhs) const;
+
+    std::vector<double> multiplyA(const std::vector<double>& x) const;
+    std::vector<double> multiplyAT(const std::vector<double>& y) const;
+    void projectCone(std::vector<double>& v) const;
+
+    std::vector<double> packResult(const NativeSdpResult& result) const;
+    void unpackResult(const std::vector<double>& x, NativeSdpResult& result) const;
+
+    int m;
+    int numberOfVariables;
+    int numberOfFree;
+    std::vector<int> blockSizes;
+    std::vector<int> blockOffsets; // the first variable of every block, the free ones start at the last offset
+    NativeAdmmSettings settings;
+
+    // the rows of A are scaled to unit norm, the residuals are reported for the original ones
+    std::vector<double> rowScale;
+    std::vector<size_t> rowStart;
+    std::vector<int> columns;
+    std::vector<double> values;
+    std::vector<double> b;
+    std::vector<int> infeasibleRows; // zero rows with a nonzero right hand side
+
+    // L D L^T of the permuted kkt matrix, L is unit lower triangular, stored by columns without the diagonal
+    std::vector<int> permutation; // the position of every kkt node in the elimination order
+    std::vector<size_t> factorColumnStart;
+    std::vector<int> factorRowIndex;
+    std::vector<double> factorValues;
+    std::vector<double> factorDiagonal;
+};
+
+#endif //MYPROJECT_NATIVESDPSOLVER_H
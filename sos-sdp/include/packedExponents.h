@@ -0,0 +1,207 @@
+//
+// Created by sergey on 14.10.23.
+//
+// exponent vector of a monomial: a sorted list of (symbol id, power) pairs packed into 32-bit words
+//
+
+#ifndef MYPROJECT_PACKEDEXPONENTS_H
+#define MYPROJECT_PACKEDEXPONENTS_H
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+namespace symbolic_ring {
+
+    // Each word stores (symbolId << POWER_BITS) | power, the words are kept sorted by symbol id,
+    // so equality and ordering are plain integer comparisons of the word arrays.
+    // Up to INLINE_CAPACITY variables are stored inline, larger monomials spill to the heap.
+    class PackedExponents {
+    public:
+        static const int INLINE_CAPACITY = 6;
+        static const int POWER_BITS = 8;
+        static const uint32_t POWER_MASK = (1u << POWER_BITS) - 1;
+        static const uint32_t MAX_SYMBOL_ID = (1u << (32 - POWER_BITS)) - 1;
+
+        PackedExponents() = default;
+
+        static PackedExponents single(int symbolId, int power) {
+            PackedExponents result;
+            if (power != 0) {
+                result.pushBack(pack(symbolId, power));
+            }
+            return result;
+        }
+
+        // accepts unsorted pairs, the powers of repeated symbols are summed up
+        static PackedExponents fromPairs(std::vector<std::pair<int, int>> idsAndPowers) {
+            std::sort(idsAndPowers.begin(), idsAndPowers.end());
+            PackedExponents result;
+            for (int i = 0; i < idsAndPowers.size(); ++i) {
+                int power = idsAndPowers[i].second;
+                while (i + 1 < idsAndPowers.size() && idsAndPowers[i + 1].first == idsAndPowers[i].first) {
+                    ++i;
+                    power += idsAndPowers[i].second;
+                }
+                if (power != 0) {
+                    result.pushBack(pack(idsAndPowers[i].first, power));
+                }
+            }
+            return result;
+        }
+
+        int size() const {
+            return count;
+        }
+
+        bool isEmpty() const {
+            return count == 0;
+        }
+
+        int symbolIdAt(int i) const {
+            return static_cast<int>(words()[i] >> POWER_BITS);
+        }
+
+        int powerAt(int i) const {
+            return static_cast<int>(words()[i] & POWER_MASK);
+        }
+
+        int powerOf(int symbolId) const {
+            const uint32_t *begin = words();
+            const uint32_t *end = begin + count;
+            const uint32_t key = static_cast<uint32_t>(symbolId) << POWER_BITS;
+            const uint32_t *it = std::lower_bound(begin, end, key);
+            if (it != end && (*it >> POWER_BITS) == static_cast<uint32_t>(symbolId)) {
+                return static_cast<int>(*it & POWER_MASK);
+            }
+            return 0;
+        }
+
+        PackedExponents withoutSymbol(int symbolId) const {
+            PackedExponents result;
+            const uint32_t *w = words();
+            for (int i = 0; i < count; ++i) {
+                if ((w[i] >> POWER_BITS) != static_cast<uint32_t>(symbolId)) {
+                    result.pushBack(w[i]);
+                }
+            }
+            return result;
+        }
+
+        unsigned int getDegree() const {
+            return degree;
+        }
+
+        size_t getHash() const {
+            return hash;
+        }
+
+        friend PackedExponents mul(const PackedExponents &l, const PackedExponents &r) {
+            if (l.count == 0) {
+                return r;
+            }
+            if (r.count == 0) {
+                return l;
+            }
+            PackedExponents result;
+            result.reserve(l.count + r.count);
+            const uint32_t *lw = l.words();
+            const uint32_t *rw = r.words();
+            int i = 0, j = 0;
+            while (i < l.count && j < r.count) {
+                uint32_t lid = lw[i] >> POWER_BITS;
+                uint32_t rid = rw[j] >> POWER_BITS;
+                if (lid < rid) {
+                    result.pushBack(lw[i++]);
+                } else if (rid < lid) {
+                    result.pushBack(rw[j++]);
+                } else {
+                    result.pushBack(pack(static_cast<int>(lid),
+                                         static_cast<int>((lw[i] & POWER_MASK) + (rw[j] & POWER_MASK))));
+                    ++i;
+                    ++j;
+                }
+            }
+            while (i < l.count) {
+                result.pushBack(lw[i++]);
+            }
+            while (j < r.count) {
+                result.pushBack(rw[j++]);
+            }
+            return result;
+        }
+
+        bool operator==(const PackedExponents &rhs) const {
+            return count == rhs.count && hash == rhs.hash &&
+                   std::memcmp(words(), rhs.words(), count * sizeof(uint32_t)) == 0;
+        }
+
+        bool operator!=(const PackedExponents &rhs) const {
+            return !(*this == rhs);
+        }
+
+        bool operator<(const PackedExponents &rhs) const {
+            return std::lexicographical_compare(words(), words() + count, rhs.words(), rhs.words() + rhs.count);
+        }
+
+    private:
+        static uint32_t pack(int symbolId, int power) {
+            if (symbolId < 0 || static_cast<uint32_t>(symbolId) > MAX_SYMBOL_ID) {
+                throw std::runtime_error("PackedExponents: symbol id " + std::to_string(symbolId) + " is out of range");
+            }
+            if (power < 0 || static_cast<uint32_t>(power) > POWER_MASK) {
+                throw std::runtime_error("PackedExponents: power " + std::to_string(power) + " is out of range");
+            }
+            return (static_cast<uint32_t>(symbolId) << POWER_BITS) | static_cast<uint32_t>(power);
+        }
+
+        static size_t mixHash(size_t hash, uint32_t word) {
+            hash ^= word + 0x9e3779b97f4a7c15ULL + (hash << 6) + (hash >> 2);
+            return hash;
+        }
+
+        const uint32_t *words() const {
+            return count <= INLINE_CAPACITY ? inlineWords : heapWords.data();
+        }
+
+        void reserve(int capacity) {
+            if (capacity > INLINE_CAPACITY) {
+                heapWords.reserve(capacity);
+            }
+        }
+
+        // words must be pushed in increasing order of symbol ids
+        void pushBack(uint32_t word) {
+            if (count < INLINE_CAPACITY) {
+                inlineWords[count] = word;
+            } else {
+                if (count == INLINE_CAPACITY) {
+                    heapWords.insert(heapWords.end(), inlineWords, inlineWords + INLINE_CAPACITY);
+                }
+                heapWords.push_back(word);
+            }
+            ++count;
+            degree += word & POWER_MASK;
+            hash = mixHash(hash, word);
+        }
+
+        uint32_t inlineWords[INLINE_CAPACITY] = {};
+        std::vector<uint32_t> heapWords;
+        int count = 0;
+        unsigned int degree = 0;
+        size_t hash = 0;
+    };
+
+    struct PackedExponentsHash {
+        size_t operator()(const PackedExponents &exponents) const {
+            return exponents.getHash();
+        }
+    };
+
+} // end of symbolic_ring namespace
+
+#endif //MYPROJECT_PACKEDEXPONENTS_H
@@ -110,67 +110,95 @@ private:
     std::string name;
 };
 
+// the declarations by the id of their name, see InternTable
 class ProgramTable {
 public:
     void declareReal(const std::string& name) {
-        if (_variables.find(name) != _variables.end()) {
+        if (!declare(_variables, name, ProgramVariable(name))) {
             throw std::runtime_error("variable already declared");
         }
-        _variables.insert(std::make_pair(name, ProgramVariable(name)));
     }
 
     void declareFunction(const std::string& name, int arity, int highestDegree=-1) {
-        if (_functions.find(name) != _functions.end()) {
+        if (!declare(_functions, name, ProgramFunction(name, arity, highestDegree))) {
             throw std::runtime_error("function already declared");
         }
-        _functions.insert(std::make_pair(name, ProgramFunction(name, arity, highestDegree)));
     }
 
     bool isFunctionDeclared(const std::string& name) const {
-        return _functions.find(name) != _functions.end();
+        return find(_functions, name) != nullptr;
     }
 
     bool isVariableDeclared(const std::string& name) const {
-        return _variables.find(name) != _variables.end();
+        return find(_variables, name) != nullptr;
     }
 
+    // sorted by name
     std::vector<std::string> getDeclaredVariables() const {
-        std::vector<std::string> result;
-        for (const auto& pair : _variables) {
-            result.push_back(pair.first);
-        }
-        return result;
+        return getDeclared(_variables);
     }
 
     std::vector<std::string> getDeclaredFunctions() const {
-        std::vector<std::string> result;
-        for (const auto& pair : _functions) {
-            result.push_back(pair.first);
-        }
-        return result;
+        return getDeclared(_functions);
     }
 
     ProgramFunction getFunction(const std::string& name) {
-        if (!isFunctionDeclared(name)) {
+        const auto* function = find(_functions, name);
+        if (function == nullptr) {
             throw std::runtime_error("function not declared");
         }
-        return _functions.at(name);
+        return *function;
     }
 
     ProgramVariable getVariable(const std::string& name) {
-        if (!isVariableDeclared(name)) {
+        const auto* variable = find(_variables, name);
+        if (variable == nullptr) {
             throw std::runtime_error("variable not declared");
         }
-        return _variables.at(name);
+        return *variable;
     }
 
 
 private:
-    std::map<std::string, ProgramVariable> _variables;
-    std::map<std::string, ProgramFunction> _functions;
+    template<class T>
+    using Declarations = std::vector<std::shared_ptr<const T>>;
+
+    template<class T>
+    bool declare(Declarations<T>& declarations, const std::string& name, T declaration) {
+        int id = _names->intern(name);
+        if (id >= declarations.size()) {
+            declarations.resize(id + 1);
+        }
+        if (declarations[id]) {
+            return false;
+        }
+        declarations[id] = std::make_shared<const T>(std::move(declaration));
+        return true;
+    }
 
-};
+    template<class T>
+    const T* find(const Declarations<T>& declarations, const std::string& name) const {
+        int id = _names->find(name);
+        return id < 0 || id >= declarations.size() ? nullptr : declarations[id].get();
+    }
 
+    template<class T>
+    std::vector<std::string> getDeclared(const Declarations<T>& declarations) const {
+        std::vector<std::string> result;
+        for (int id = 0; id < declarations.size(); id++) {
+            if (declarations[id]) {
+                result.push_back(_names->getName(id));
+            }
+        }
+        std::sort(result.begin(), result.end());
+        return result;
+    }
+
+    std::shared_ptr<InternTable<>> _names = std::make_shared<InternTable<>>();
+    Declarations<ProgramVariable> _variables;
+    Declarations<ProgramFunction> _functions;
+
+};
 
 class IfThenCondition {
 public:
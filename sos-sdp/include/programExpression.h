@@ -11,8 +11,13 @@
 #include <map>
 #include <set>
 #include <iostream>
+#include <atomic>
+#include <functional>
+#include <shared_mutex>
+#include <unordered_map>
 
 #include "symbolicRing.h"
+#include "internTable.h"
 
 using namespace symbolic_ring;
 
@@ -22,7 +27,7 @@ SymbolicPolynomialWithOrderedArguments(SymbolicPolynomial symbolicPolynomial, st
             symbolicPolynomial(symbolicPolynomial),
             orderedArguments(std::move(orderedArguments)) {}
 
-    SymbolicPolynomial getSymbolicPolynomial() const {
+    const SymbolicPolynomial& getSymbolicPolynomial() const {
         return symbolicPolynomial;
     }
 
@@ -34,6 +39,87 @@ private:
     std::vector<std::string> orderedArguments;
 };
 
+// the results of the function calls by the function and the reduced arguments. The same call is made by several
+// implications, by the duplicated ones and by the twins of an equality. Safe to use from several threads; an entry keeps
+// its function alive, so the address of a function is not reused while it is in a key
+class FunctionCallCache {
+public:
+    struct Key {
+        std::shared_ptr<const SymbolicPolynomialWithOrderedArguments> function;
+        std::vector<symbolic_ring::QPolynomial> arguments;
+
+        bool operator==(const Key& rhs) const {
+            if (function != rhs.function || arguments.size() != rhs.arguments.size()) {
+                return false;
+            }
+            for (int i = 0; i < arguments.size(); i++) {
+                if (arguments[i].getMonomials() != rhs.arguments[i].getMonomials()) {
+                    return false;
+                }
+            }
+            return true;
+        }
+    };
+
+    // the monomials only, the coefficients are compared by ==
+    struct KeyHash {
+        size_t operator()(const Key& key) const {
+            size_t hash = std::hash<const void*>()(key.function.get());
+            for (const auto& argument: key.arguments) {
+                for (const auto& monomial: argument.getMonomials()) {
+                    hash ^= monomial.getExponents().getHash() + 0x9e3779b97f4a7c15ULL + (hash << 6) + (hash >> 2);
+                }
+                hash = hash * 31 + argument.getMonomials().size();
+            }
+            return hash;
+        }
+    };
+
+    // nullptr if the call is not there
+    std::shared_ptr<const symbolic_ring::SymbolicPolynomial> find(const Key& key) {
+        size_t hash = KeyHash()(key);
+        auto& shard = shards[hash % shardCount];
+        std::shared_lock<std::shared_timed_mutex> lock(shard.mutex);
+        auto it = shard.results.find(key);
+        if (it == shard.results.end()) {
+            misses++;
+            return nullptr;
+        }
+        hits++;
+        return it->second;
+    }
+
+    void insert(Key key, symbolic_ring::SymbolicPolynomial result) {
+        size_t hash = KeyHash()(key);
+        auto& shard = shards[hash % shardCount];
+        auto value = std::make_shared<const symbolic_ring::SymbolicPolynomial>(std::move(result));
+        std::unique_lock<std::shared_timed_mutex> lock(shard.mutex);
+        shard.results.emplace(std::move(key), std::move(value));
+    }
+
+    long long getHits() const {
+        return hits;
+    }
+
+    long long getMisses() const {
+        return misses;
+    }
+
+private:
+    static constexpr int shardCount = 16;
+
+    struct Shard {
+        std::shared_timed_mutex mutex;
+        std::unordered_map<Key, std::shared_ptr<const symbolic_ring::SymbolicPolynomial>, KeyHash> results;
+    };
+
+    Shard shards[shardCount];
+    std::atomic<long long> hits{0};
+    std::atomic<long long> misses{0};
+};
+
+// the values of the variables and the functions, by the id of their name. The names are interned in a table that the
+// copies of a context share, the values are shared until a copy sets its own
 class EvaluationContext {
 public:
     EvaluationContext(SymbolicEnvironment *const environment): environment(environment) {}
@@ -42,42 +128,109 @@ public:
         return *environment;
     }
 
-    symbolic_ring::QPolynomial getVariableQPolynomial(const std::string& variable) const {
-        if (variableValues.find(variable) == variableValues.end()) {
+    // the same id for the same name in every copy of the context
+    int getNameId(const std::string& name) {
+        return names->intern(name);
+    }
+
+    const symbolic_ring::QPolynomial& getVariableQPolynomial(int nameId) const {
+        if (nameId >= variableValues.size() || !variableValues[nameId]) {
+            throw std::runtime_error("Variable " + names->getName(nameId) + " not found");
+        }
+        return *variableValues[nameId];
+    }
+
+    const symbolic_ring::QPolynomial& getVariableQPolynomial(const std::string& variable) const {
+        int nameId = names->find(variable);
+        if (nameId < 0) {
             throw std::runtime_error("Variable " + variable + " not found");
         }
-        return variableValues.at(variable);
+        return getVariableQPolynomial(nameId);
     }
 
     symbolic_ring::Symbol getSymobol(const std::string& variable) {
         return environment->getOrCreate(variable);
     }
 
+    const SymbolicPolynomialWithOrderedArguments& getSymbolicPolynomialWithOrderedArguments(int nameId) const {
+        if (nameId >= functionValues.size() || !functionValues[nameId]) {
+            throw std::runtime_error("Function " + names->getName(nameId) + "not found");
+        }
+        return *functionValues[nameId];
+    }
+
+    const SymbolicPolynomialWithOrderedArguments& getSymbolicPolynomialWithOrderedArguments(const std::string& functionName) const {
+        int nameId = names->find(functionName);
+        if (nameId < 0) {
+            throw std::runtime_error("Function " + functionName + "not found");
+        }
+        return getSymbolicPolynomialWithOrderedArguments(nameId);
+    }
 
-    SymbolicPolynomialWithOrderedArguments getSymbolicPolynomialWithOrderedArguments(const std::string& functionName) const {
-        if (functionValues.find(functionName) == functionValues.end()) {
+    // the template of the function with the arguments substituted. The result is shared by the copies of the context
+    // through the cache, by the value of the function and the arguments
+    symbolic_ring::SymbolicPolynomial evaluateFunctionCall(const std::string& functionName,
+                                                           std::vector<symbolic_ring::QPolynomial> arguments) {
+        int nameId = names->find(functionName);
+        if (nameId < 0) {
             throw std::runtime_error("Function " + functionName + "not found");
         }
-        return functionValues.at(functionName);
+        return evaluateFunctionCall(nameId, std::move(arguments));
     }
 
+    symbolic_ring::SymbolicPolynomial evaluateFunctionCall(int nameId, std::vector<symbolic_ring::QPolynomial> arguments) {
+        if (nameId >= functionValues.size() || !functionValues[nameId]) {
+            throw std::runtime_error("Function " + names->getName(nameId) + "not found");
+        }
+        FunctionCallCache::Key key{functionValues[nameId], std::move(arguments)};
+        for (auto& argument: key.arguments) {
+            argument.reduce();
+        }
+        if (auto cached = functionCalls->find(key)) {
+            return *cached;
+        }
+
+        const auto& argumentNames = key.function->getOrderedArguments();
+        std::vector<symbolic_ring::Symbol> symbols;
+        for (const auto& argumentName: argumentNames) {
+            symbols.push_back(environment->getOrCreate(argumentName));
+        }
+        auto result = composeInBase(key.function->getSymbolicPolynomial(), symbols, key.arguments);
+        functionCalls->insert(std::move(key), result);
+        return result;
+    }
+
+    const FunctionCallCache& getFunctionCallCache() const {
+        return *functionCalls;
+    }
+
+    // the first value set stays
     void setVariableQPolynomial(const std::string& variable, const symbolic_ring::QPolynomial& qPolynomial) {
-        variableValues.insert({variable, qPolynomial});
+        set(variableValues, getNameId(variable), qPolynomial);
     }
 
     void setSymbolicPolynomial(const std::string& functionName, const symbolic_ring::SymbolicPolynomial& symbolicPolynomial,
                                const std::vector<std::string>& orderedArguments) {
-        functionValues.insert({functionName, {symbolicPolynomial, orderedArguments}});
+        set(functionValues, getNameId(functionName), SymbolicPolynomialWithOrderedArguments(symbolicPolynomial, orderedArguments));
     }
 
 private:
-    SymbolicEnvironment *const environment;
+    template<class T>
+    static void set(std::vector<std::shared_ptr<const T>>& values, int id, T value) {
+        if (id >= values.size()) {
+            values.resize(id + 1);
+        }
+        if (!values[id]) {
+            values[id] = std::make_shared<const T>(std::move(value));
+        }
+    }
 
-    std::set<std::string> variables;
-    std::set<std::string> functions;
+    SymbolicEnvironment *const environment;
 
-    std::map<std::string, symbolic_ring::QPolynomial> variableValues;
-    std::map<std::string, SymbolicPolynomialWithOrderedArguments> functionValues;
+    std::shared_ptr<InternTable<>> names = std::make_shared<InternTable<>>();
+    std::vector<std::shared_ptr<const symbolic_ring::QPolynomial>> variableValues;
+    std::vector<std::shared_ptr<const SymbolicPolynomialWithOrderedArguments>> functionValues;
+    std::shared_ptr<FunctionCallCache> functionCalls = std::make_shared<FunctionCallCache>();
 
 };
 
@@ -109,6 +262,12 @@ public:
     EvaluationResult(const symbolic_ring::SymbolicPolynomial& symbolicPolynomial):
         symbolicPolynomial(std::make_unique<symbolic_ring::SymbolicPolynomial>(symbolicPolynomial)),
         typeTag(SYMBOLIC_POLYNOMIAL) {}
+    EvaluationResult(symbolic_ring::QPolynomial&& qPolynomial):
+        typeTag(QPOLYNOMIAL),
+        qPolynomial(std::make_unique<symbolic_ring::QPolynomial>(std::move(qPolynomial))) {}
+    EvaluationResult(symbolic_ring::SymbolicPolynomial&& symbolicPolynomial):
+        typeTag(SYMBOLIC_POLYNOMIAL),
+        symbolicPolynomial(std::make_unique<symbolic_ring::SymbolicPolynomial>(std::move(symbolicPolynomial))) {}
 
     TypeTag getTypeTag() const {
         return typeTag;
@@ -128,6 +287,21 @@ public:
         return *symbolicPolynomial;
     }
 
+    // moves the polynomial out, the result must not be used afterwards
+    symbolic_ring::QPolynomial takeQPolynomial() {
+        if (typeTag != QPOLYNOMIAL) {
+            throw std::runtime_error("Wrong type tag");
+        }
+        return std::move(*qPolynomial);
+    }
+
+    symbolic_ring::SymbolicPolynomial takeSymbolicPolynomial() {
+        if (typeTag != SYMBOLIC_POLYNOMIAL) {
+            throw std::runtime_error("Wrong type tag");
+        }
+        return std::move(*symbolicPolynomial);
+    }
+
     bool isBoolean() const {
         if (typeTag != BOOLEAN) {
             throw std::runtime_error("Wrong type tag");
@@ -189,6 +363,10 @@ public:
         return QPOLYNOMIAL;
     }
 
+    long long getValue() const {
+        return value;
+    }
+
     EvaluationResult evaluate(EvaluationContext &context)  override {
         return {mul(context.getEnvironment().qPolynomialOne(), value)};
     }
@@ -302,13 +480,12 @@ public:
     }
 
     EvaluationResult evaluate(EvaluationContext &context) override {
-        auto env = context.getEnvironment();
-        auto ans = context.getSymbolicPolynomialWithOrderedArguments(functionName).getSymbolicPolynomial();
-        auto args_ordering = context.getSymbolicPolynomialWithOrderedArguments(functionName).getOrderedArguments();
-        for (int i = 0; i < args_ordering.size(); ++i) {
-            ans = substituteInBase(ans, context.getSymobol(args_ordering[i]), children[i]->evaluate(context).getQPolynomial());
+        auto arity = context.getSymbolicPolynomialWithOrderedArguments(functionName).getOrderedArguments().size();
+        std::vector<QPolynomial> values;
+        for (int i = 0; i < arity; ++i) {
+            values.push_back(children[i]->evaluate(context).takeQPolynomial());
         }
-        return EvaluationResult(ans);
+        return EvaluationResult(context.evaluateFunctionCall(functionName, std::move(values)));
     }
 
     std::unique_ptr<ExpressionElement> clone() const override {
@@ -390,9 +567,13 @@ public:
         auto currentType = this->getTypeTag();
         if (currentType == QPOLYNOMIAL) {
             if (operationName == "+") {
-                return {add(leftResult.getQPolynomial(), rightResult.getQPolynomial())};
+                auto result = leftResult.takeQPolynomial();
+                result += rightResult.getQPolynomial();
+                return {std::move(result)};
             } else if (operationName == "-") {
-                return {add(leftResult.getQPolynomial(), mul(rightResult.getQPolynomial(), -1))};
+                auto result = leftResult.takeQPolynomial();
+                result -= rightResult.getQPolynomial();
+                return {std::move(result)};
             } else if (operationName == "*") {
                 return {mul(leftResult.getQPolynomial(), rightResult.getQPolynomial())};
             } else if (operationName == "/") {
@@ -404,28 +585,27 @@ public:
                     throw std::runtime_error("Division by non-constant");
                 }
                 auto monomial = monomials[0];
-                auto leftQPolynomial = leftResult.getQPolynomial();
-                auto leftQPolynomislMultEnum = mul(leftQPolynomial, monomial.getDenominator());
-                auto leftQPolynomialDivDenom = div(leftQPolynomislMultEnum, monomial.getEnumerator());
-                return {leftQPolynomialDivDenom};
+                return {div(leftResult.getQPolynomial(), monomial.getCoefficient())};
             }
         } else if (currentType == SYMBOLIC_POLYNOMIAL) {
             auto leftResultCastToSymbolicPolynomial = context.getEnvironment().symbolicPolynomialZero();
             if (leftResult.getTypeTag() == SYMBOLIC_POLYNOMIAL) {
-                leftResultCastToSymbolicPolynomial = leftResult.getSymbolicPolynomial();
+                leftResultCastToSymbolicPolynomial = leftResult.takeSymbolicPolynomial();
             } else if (leftResult.getTypeTag() == QPOLYNOMIAL) {
                 leftResultCastToSymbolicPolynomial = symbolicPolynomialfromQPolynomialAsBase(leftResult.getQPolynomial());
             }
             auto rightResultCastToSymbolicPolynomial = context.getEnvironment().symbolicPolynomialZero();
             if (rightResult.getTypeTag() == SYMBOLIC_POLYNOMIAL) {
-                rightResultCastToSymbolicPolynomial = rightResult.getSymbolicPolynomial();
+                rightResultCastToSymbolicPolynomial = rightResult.takeSymbolicPolynomial();
             } else if (rightResult.getTypeTag() == QPOLYNOMIAL) {
                 rightResultCastToSymbolicPolynomial = symbolicPolynomialfromQPolynomialAsBase(rightResult.getQPolynomial());
             }
             if (operationName == "+") {
-                return {add(leftResultCastToSymbolicPolynomial, rightResultCastToSymbolicPolynomial, true)};
+                leftResultCastToSymbolicPolynomial += rightResultCastToSymbolicPolynomial;
+                return {std::move(leftResultCastToSymbolicPolynomial)};
             } else if (operationName == "-") {
-                return {add(leftResultCastToSymbolicPolynomial, mul(rightResultCastToSymbolicPolynomial, -1), true)};
+                leftResultCastToSymbolicPolynomial -= rightResultCastToSymbolicPolynomial;
+                return {std::move(leftResultCastToSymbolicPolynomial)};
             } else if (operationName == "*") {
                 return {mul(leftResultCastToSymbolicPolynomial, rightResultCastToSymbolicPolynomial)};
             } else if (operationName == "/") {
@@ -437,7 +617,7 @@ public:
                     throw std::runtime_error("Division by non-constant");
                 }
                 auto monomial = monomials[0];
-                return {div(mul(leftResult.getQPolynomial(), monomial.getDenominator()), monomial.getEnumerator())};
+                return {div(leftResult.getQPolynomial(), monomial.getCoefficient())};
             }
         }
         throw std::runtime_error("Cannot evaluate binary operation with type tag " + std::to_string(currentType));
@@ -503,21 +683,22 @@ public:
         auto currentType = this->getTypeTag();
         if (currentType == QPOLYNOMIAL) {
             if (operationName == "-") {
-                return {mul(childResult.getQPolynomial(), -1)};
+                return {mul(childResult.takeQPolynomial(), -1)};
             } else if (operationName == "+") {
-                return {childResult.getQPolynomial()};
+                return {childResult.takeQPolynomial()};
             }
         } else if (currentType == SYMBOLIC_POLYNOMIAL) {
             auto childResultCastToSymbolicPolynomial = context.getEnvironment().symbolicPolynomialZero();
             if (childResult.getTypeTag() == SYMBOLIC_POLYNOMIAL) {
-                childResultCastToSymbolicPolynomial = childResult.getSymbolicPolynomial();
+                childResultCastToSymbolicPolynomial = childResult.takeSymbolicPolynomial();
             } else if (childResult.getTypeTag() == QPOLYNOMIAL) {
                 childResultCastToSymbolicPolynomial = symbolicPolynomialfromQPolynomialAsBase(childResult.getQPolynomial());
             }
             if (operationName == "-") {
-                return {mul(childResultCastToSymbolicPolynomial, -1)};
+                childResultCastToSymbolicPolynomial.negate();
+                return {std::move(childResultCastToSymbolicPolynomial)};
             } else if (operationName == "+") {
-                return {childResultCastToSymbolicPolynomial};
+                return {std::move(childResultCastToSymbolicPolynomial)};
             }
         }
         throw std::runtime_error("Cannot evaluate unary operation with type tag " + std::to_string(currentType));
@@ -583,27 +764,23 @@ public:
         if (currentType == QPOLYNOMIAL) {
             auto leftResultCastToQPolynomial = context.getEnvironment().symbolicPolynomialZero();
             if (leftResult.getTypeTag() == SYMBOLIC_POLYNOMIAL) {
-                leftResultCastToQPolynomial = leftResult.getSymbolicPolynomial();
+                leftResultCastToQPolynomial = leftResult.takeSymbolicPolynomial();
             } else if (leftResult.getTypeTag() == QPOLYNOMIAL) {
                 leftResultCastToQPolynomial = symbolicPolynomialfromQPolynomialAsBase(leftResult.getQPolynomial());
             }
             auto rightResultCastToQPolynomial = context.getEnvironment().symbolicPolynomialZero();
             if (rightResult.getTypeTag() == SYMBOLIC_POLYNOMIAL) {
-                rightResultCastToQPolynomial = rightResult.getSymbolicPolynomial();
+                rightResultCastToQPolynomial = rightResult.takeSymbolicPolynomial();
             } else if (rightResult.getTypeTag() == QPOLYNOMIAL) {
                 rightResultCastToQPolynomial = symbolicPolynomialfromQPolynomialAsBase(rightResult.getQPolynomial());
             }
 
-            if (operationName == "<") {
-                return {add(rightResultCastToQPolynomial, mul(leftResultCastToQPolynomial, -1), true)};
-            } else if (operationName == ">") {
-                return {add(leftResultCastToQPolynomial, mul(rightResultCastToQPolynomial, -1), true)};
-            } else if (operationName == "<=") {
-                return {add(rightResultCastToQPolynomial, mul(leftResultCastToQPolynomial, -1), true)};
-            } else if (operationName == ">=") {
-                return {add(leftResultCastToQPolynomial, mul(rightResultCastToQPolynomial, -1), true)};
-            } else if (operationName == "==") {
-                return {add(leftResultCastToQPolynomial, mul(rightResultCastToQPolynomial, -1), true)};
+            if (operationName == "<" || operationName == "<=") {
+                rightResultCastToQPolynomial -= leftResultCastToQPolynomial;
+                return {std::move(rightResultCastToQPolynomial)};
+            } else if (operationName == ">" || operationName == ">=" || operationName == "==") {
+                leftResultCastToQPolynomial -= rightResultCastToQPolynomial;
+                return {std::move(leftResultCastToQPolynomial)};
             }
         }
         throw std::runtime_error("Cannot evaluate binary relation with type tag " + std::to_string(currentType));
@@ -0,0 +1,210 @@
+//
+// Created by sergey on 16.10.23.
+//
+// exact rational numbers: int64 fast path with 128-bit intermediates, arbitrary precision on overflow
+//
+
+#ifndef MYPROJECT_RATIONAL_H
+#define MYPROJECT_RATIONAL_H
+
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace symbolic_ring {
+
+    // Signed arbitrary precision integer, only used when a Rational does not fit into 64 bits.
+    class BigInt {
+    public:
+        BigInt() = default;
+
+        BigInt(__int128 value);
+
+        bool isZero() const {
+            return limbs.empty();
+        }
+
+        bool isNegative() const {
+            return negative;
+        }
+
+        bool fitsInInt64() const;
+
+        int64_t toInt64() const;
+
+        double toDouble() const;
+
+        std::string toString() const;
+
+        BigInt operator-() const;
+
+        friend BigInt operator+(const BigInt &l, const BigInt &r);
+
+        friend BigInt operator-(const BigInt &l, const BigInt &r);
+
+        friend BigInt operator*(const BigInt &l, const BigInt &r);
+
+        // truncating division, the remainder has the sign of l
+        friend void divMod(const BigInt &l, const BigInt &r, BigInt &quotient, BigInt &remainder);
+
+        friend BigInt operator/(const BigInt &l, const BigInt &r);
+
+        // non-negative
+        friend BigInt gcd(BigInt l, BigInt r);
+
+        friend int compare(const BigInt &l, const BigInt &r);
+
+    private:
+        static int compareMagnitude(const std::vector<uint32_t> &l, const std::vector<uint32_t> &r);
+
+        static std::vector<uint32_t> addMagnitude(const std::vector<uint32_t> &l, const std::vector<uint32_t> &r);
+
+        // requires l >= r
+        static std::vector<uint32_t> subMagnitude(const std::vector<uint32_t> &l, const std::vector<uint32_t> &r);
+
+        static void trim(std::vector<uint32_t> &limbs);
+
+        bool negative = false;
+        std::vector<uint32_t> limbs; // magnitude, least significant limb first, no leading zero limbs
+    };
+
+
+    // Exact rational number. The value is kept inline as int64 enumerator and positive int64 denominator,
+    // arithmetic is done with 128-bit intermediates and the gcd is taken only when an intermediate does not fit
+    // or the canonical form is requested (printing, getEnumerator/getDenominator). Values that do not fit even
+    // after the reduction are promoted to BigInt and demoted back as soon as they fit again.
+    class Rational {
+    public:
+        Rational(long long value = 0) : num(value), den(1), reduced(true) {}
+
+        Rational(long long enumerator, long long denominator) : Rational(fromWide(enumerator, denominator)) {}
+
+        bool isZero() const {
+            return big ? big->num.isZero() : num == 0;
+        }
+
+        int sign() const {
+            if (big) {
+                return big->num.isZero() ? 0 : (big->num.isNegative() ? -1 : 1);
+            }
+            return num == 0 ? 0 : (num < 0 ? -1 : 1);
+        }
+
+        bool isBig() const {
+            return big != nullptr;
+        }
+
+        bool isOne() const {
+            return !big && num == den;
+        }
+
+        // gcd-reduced form with positive denominator
+        Rational normalized() const;
+
+        // canonical enumerator and denominator, throw if the value does not fit into long long
+        long long getEnumerator() const;
+
+        long long getDenominator() const;
+
+        double toDouble() const;
+
+        // canonical "enumerator/denominator"
+        std::string toString() const;
+
+        Rational operator-() const;
+
+        friend Rational operator+(const Rational &l, const Rational &r) {
+            if (l.big || r.big) {
+                return addBig(l, r);
+            }
+            if (l.den == r.den) {
+                return fromWide((__int128) l.num + r.num, l.den);
+            }
+            return fromWide((__int128) l.num * r.den + (__int128) r.num * l.den, (__int128) l.den * r.den);
+        }
+
+        friend Rational operator-(const Rational &l, const Rational &r) {
+            return l + (-r);
+        }
+
+        friend Rational operator*(const Rational &l, const Rational &r) {
+            if (l.big || r.big) {
+                return mulBig(l, r);
+            }
+            return fromWide((__int128) l.num * r.num, (__int128) l.den * r.den);
+        }
+
+        friend Rational operator/(const Rational &l, const Rational &r) {
+            if (r.isZero()) {
+                throw std::runtime_error("Division by zero");
+            }
+            if (l.big || r.big) {
+                return divBig(l, r);
+            }
+            return fromWide((__int128) l.num * r.den, (__int128) l.den * r.num);
+        }
+
+        Rational &operator+=(const Rational &r) {
+            return *this = *this + r;
+        }
+
+        Rational &operator*=(const Rational &r) {
+            return *this = *this * r;
+        }
+
+        friend bool operator==(const Rational &l, const Rational &r) {
+            if (l.big || r.big) {
+                return compareBig(l, r) == 0;
+            }
+            return (__int128) l.num * r.den == (__int128) r.num * l.den;
+        }
+
+        friend bool operator!=(const Rational &l, const Rational &r) {
+            return !(l == r);
+        }
+
+        friend bool operator<(const Rational &l, const Rational &r) {
+            if (l.big || r.big) {
+                return compareBig(l, r) < 0;
+            }
+            return (__int128) l.num * r.den < (__int128) r.num * l.den;
+        }
+
+        friend std::ostream &operator<<(std::ostream &os, const Rational &value) {
+            return os << value.toString();
+        }
+
+    private:
+        struct Big {
+            BigInt num;
+            BigInt den;
+        };
+
+        // builds a rational from 128-bit intermediates, reduces only if they do not fit into 64 bits
+        static Rational fromWide(__int128 enumerator, __int128 denominator);
+
+        // reduces and demotes to the inline representation if possible
+        static Rational fromBig(BigInt enumerator, BigInt denominator);
+
+        Big toBig() const;
+
+        static Rational addBig(const Rational &l, const Rational &r);
+
+        static Rational mulBig(const Rational &l, const Rational &r);
+
+        static Rational divBig(const Rational &l, const Rational &r);
+
+        static int compareBig(const Rational &l, const Rational &r);
+
+        int64_t num;
+        int64_t den;
+        bool reduced;
+        std::shared_ptr<const Big> big;
+    };
+
+} // end of symbolic_ring namespace
+
+#endif //MYPROJECT_RATIONAL_H
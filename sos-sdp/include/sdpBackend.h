@@ -0,0 +1,234 @@
+//
+// Created by sergey on 27.08.23.
+//
+// the engines that solve an SdpProblem. A backend does not touch the solution of the problem, it returns the values of
+// the variables by their inner indices, Solver checks them with setSolution. A new engine is one more subclass and one
+// more SdpEngine
+//
+
+#ifndef MYPROJECT_SDPBACKEND_H
+#define MYPROJECT_SDPBACKEND_H
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "sdpProblem.h"
+#include "nativeSdpSolver.h"
+
+enum class SdpEngine {
+    MOSEK, // mosek fusion
+    CSDP, // csdp, linked in or the external binary
+    NATIVE, // NativeSdpSolver, in process
+    ADMM, // NativeAdmmSolver, in process, for the encodings that are too large for NATIVE
+    PORTFOLIO // all of the above at once, see PortfolioSdpBackend
+};
+
+enum class SdpBackendStatus {
+    SOLVED,
+    INFEASIBLE,
+    FAILED // no answer: the iteration limit, numerical trouble, an engine that is not there
+};
+
+struct SdpBackendResult {
+    SdpBackendStatus status = SdpBackendStatus::FAILED;
+    SdpProblem::RawSolution solution; // the primal blocks, the free and the nonnegative variables; empty unless SOLVED
+    int iterations = 0; // 0 if the engine does not report them
+    double setupMilliseconds = 0.0; // the problem translated for the engine
+    double solveMilliseconds = 0.0;
+
+    bool isSolved() const {
+        return status == SdpBackendStatus::SOLVED;
+    }
+};
+
+class SdpBackend {
+public:
+    virtual ~SdpBackend() = default;
+
+    virtual std::string getName() const = 0;
+
+    // how Solver ends a coefficient matching condition: the engines of getNativeProblem() take only EQ, mosek is given
+    // IN_RANGE(getConditionRange())
+    virtual LinearMatrixExpressionType getConditionType() const {
+        return LinearMatrixExpressionType::EQ;
+    }
+
+    virtual double getConditionRange() const {
+        return 0.0;
+    }
+
+    // the error setSolution allows for the solutions of this engine
+    virtual double getAllowedError() const {
+        return 1e-6;
+    }
+
+    // may run on several threads at once for the same problem, the problem is only read
+    virtual SdpBackendResult solve(SdpProblem& problem) = 0;
+
+    // asks a running solve() to stop as soon as the engine lets it, it returns FAILED then; may be called from
+    // another thread, the request stays until clearCancel()
+    void cancel() {
+        cancelled = true;
+        interrupt();
+    }
+
+    void clearCancel() {
+        cancelled = false;
+    }
+
+    // the threads the engine may use, 0 leaves it to the engine
+    void setThreads(int threads) {
+        this->threads = threads;
+    }
+
+protected:
+    // for the engines that do not look at cancelled themselves
+    virtual void interrupt() {
+    }
+
+    std::atomic<bool> cancelled{false};
+    int threads = 0;
+};
+
+class MosekSdpBackend : public SdpBackend {
+public:
+    explicit MosekSdpBackend(bool verbose = true) : verbose(verbose) {
+    }
+
+    std::string getName() const override {
+        return "mosek";
+    }
+
+    LinearMatrixExpressionType getConditionType() const override {
+        return LinearMatrixExpressionType::IN_RANGE;
+    }
+
+    double getConditionRange() const override {
+        return 1e-6;
+    }
+
+    // every condition type is supported; mosek's own presolve is off, see SdpPresolve
+    SdpBackendResult solve(SdpProblem& problem) override;
+
+protected:
+    void interrupt() override;
+
+private:
+    bool verbose;
+    std::mutex modelMutex;
+    std::function<void()> breakModel; // breaks the solve of the model that is running, if there is one
+};
+
+// in process if csdpLibraryAvailable() and useLibrary, otherwise the csdp binary on the files .csdp.XXXXXX.dat-s and
+// .result of the run, which are removed after it; only the binary can be cancelled, the linked csdp runs to the end
+class CsdpSdpBackend : public SdpBackend {
+public:
+    explicit CsdpSdpBackend(bool verbose = true, bool useLibrary = true) : verbose(verbose), useLibrary(useLibrary) {
+    }
+
+    std::string getName() const override {
+        return "csdp";
+    }
+
+    // TODO: increase precision
+    double getAllowedError() const override {
+        return 1e-4;
+    }
+
+    SdpBackendResult solve(SdpProblem& problem) override;
+
+private:
+    bool verbose;
+    bool useLibrary;
+};
+
+class NativeSdpBackend : public SdpBackend {
+public:
+    explicit NativeSdpBackend(const NativeSdpSettings& settings = NativeSdpSettings()) : settings(settings) {
+    }
+
+    std::string getName() const override {
+        return "native";
+    }
+
+    SdpBackendResult solve(SdpProblem& problem) override;
+
+private:
+    NativeSdpSettings settings;
+};
+
+// starts from the last iterate of the previous solve, or from setWarmStart(..), when it has the shape of the problem;
+// the problem of the next solve is usually the one of the last with a few rows changed
+class AdmmSdpBackend : public SdpBackend {
+public:
+    explicit AdmmSdpBackend(const NativeAdmmSettings& settings = NativeAdmmSettings()) : settings(settings) {
+    }
+
+    std::string getName() const override {
+        return "admm";
+    }
+
+    SdpBackendResult solve(SdpProblem& problem) override;
+
+    // X, u and y of the native problem, see NativeAdmmSolver::solve(warmStart); an empty result is a cold start
+    void setWarmStart(NativeSdpResult warmStart) {
+        std::lock_guard<std::mutex> lock(warmStartMutex);
+        this->warmStart = std::move(warmStart);
+    }
+
+    NativeSdpResult getWarmStart() const {
+        std::lock_guard<std::mutex> lock(warmStartMutex);
+        return warmStart;
+    }
+
+private:
+    NativeAdmmSettings settings;
+    mutable std::mutex warmStartMutex;
+    NativeSdpResult warmStart;
+};
+
+// races its backends on the same problem, every one on a thread of its own with an equal share of the threads. The
+// first solution that is within the allowed error of its backend, or the first proof of infeasibility, ends the race
+// and the others are cancelled, the race waits for them to stop. If no solution gets there, the race is FAILED, the
+// violations are only printed. The conditions are EQ, so mosek solves the same problem as the others
+class PortfolioSdpBackend : public SdpBackend {
+public:
+    explicit PortfolioSdpBackend(std::vector<std::unique_ptr<SdpBackend>> backends) : backends(std::move(backends)) {
+    }
+
+    std::string getName() const override {
+        return "portfolio";
+    }
+
+    // of the backend that won the last race
+    double getAllowedError() const override {
+        return winner < 0 ? SdpBackend::getAllowedError() : backends[winner]->getAllowedError();
+    }
+
+    SdpBackendResult solve(SdpProblem& problem) override;
+
+    // the name of the backend that won the last race, empty if there was no answer
+    std::string getWinner() const {
+        return winner < 0 ? "" : backends[winner]->getName();
+    }
+
+protected:
+    void interrupt() override {
+        for (auto& backend : backends) {
+            backend->cancel();
+        }
+    }
+
+private:
+    std::vector<std::unique_ptr<SdpBackend>> backends;
+    int winner = -1;
+};
+
+// the backend of the engine with the settings the estimator uses
+std::unique_ptr<SdpBackend> createSdpBackend(SdpEngine engine);
+
+#endif //MYPROJECT_SDPBACKEND_H
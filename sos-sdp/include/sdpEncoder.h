@@ -8,61 +8,153 @@
 #include "symbolicRing.h"
 #include <vector>
 #include <iostream>
+#include <unordered_map>
+#include <map>
 
 using namespace symbolic_ring;
 
-inline SymbolicPolynomial getSos(const std::vector<QMonomial>& monomials, int id) {
-    if (monomials.empty()) {
-        throw std::runtime_error("Empty list");
-    }
-    auto env = monomials[0].viewEnvironment();
-    auto n = monomials.size();
+// Upper triangle of the gram matrix over a monomial basis: the entry (i, j), i <= j, contributes
+// coefficient * l_<id>_i_j to the monomial productMonomials[productIndex]. It is computed once per basis and shared
+// by all soses over it, only the id of the gram matrix differs between them.
+class GramTemplate {
+public:
+    struct Entry {
+        int row;
+        int col;
+        int productIndex;
+        // the multiplicity (1 on the diagonal, 2 off it) times the coefficients of both basis monomials
+        Rational coefficient;
+    };
 
-    auto monomials_as_symbolic_polynomials = std::vector<SymbolicPolynomial>();
+    explicit GramTemplate(const std::vector<QMonomial> &basis);
 
-    for (const auto& monomial: monomials) {
-        monomials_as_symbolic_polynomials.push_back(SymbolicPolynomial(SymbolicMonomial(monomial)));
+    int size() const {
+        return static_cast<int>(basis.size());
     }
 
-    auto x = std::vector<SymbolicPolynomial>();
-
-    for (auto i = 0; i < n; i++) {
-        for (auto j = 0; j < n; j++) {
-            auto l_ij = QPolynomial(env->getOrCreate(
-                    "l_" + std::to_string(id) + "_" +
-                    std::to_string(std::min(i, j)) + "_" +
-                    std::to_string(std::max(i, j))));
-            auto q_ij = SymbolicMonomial(l_ij);
-            auto s_ij = SymbolicPolynomial(q_ij);
-            x.push_back(s_ij);
-        }
+    SymbolicEnvironment *viewEnvironment() const {
+        return basis[0].viewEnvironment();
     }
 
+    const std::vector<QMonomial> &getBasis() const {
+        return basis;
+    }
 
-    // TODO: can we optimize it with openmp?
-    auto row_matrix = std::vector<SymbolicPolynomial>();
-    for (int col = 0; col < n; col++) {
-        auto new_term = env->symbolicPolynomialZero();
-        for (int row = 0; row < n; row++) {
-            new_term = add(new_term, mul(monomials_as_symbolic_polynomials[row], x[row * n + col]), false);
-        }
-        new_term.reduce();
+    // distinct unitary products b_i * b_j
+    const std::vector<QMonomial> &getProductMonomials() const {
+        return productMonomials;
+    }
 
-        row_matrix.push_back(new_term);
+    // row-major over the upper triangle
+    const std::vector<Entry> &getEntries() const {
+        return entries;
     }
 
-//    for (auto& it: row_matrix) {
-//        std::cout << "row_matrix: " << it << std::endl;
-//    }
+private:
+    std::vector<QMonomial> basis;
+    std::vector<QMonomial> productMonomials;
+    std::vector<Entry> entries;
+};
 
+// basis^T * G * basis with G_ij = l_<id>_min(i,j)_max(i,j)
+SymbolicPolynomial getSos(const GramTemplate &gram, int id);
 
-    auto result = env->symbolicPolynomialZero();
-    for (int row = 0; row < n; row++) {
-        result = add(result, mul(row_matrix[row], monomials_as_symbolic_polynomials[row]), false);
-//        std::cout << "result it(" << row << "):" << result << std::endl;
-    }
-    result.reduce();
-    return result;
+inline SymbolicPolynomial getSos(const std::vector<QMonomial>& monomials, int id) {
+    return getSos(GramTemplate(monomials), id);
 }
 
+// Shrinks the bases of the soses in sum_k sos_k * multipliers[k] == target before anything is encoded.
+// A coefficient-matching row that only gets diagonal gram entries, all with the same sign, and is zero in the target
+// forces these diagonal entries to zero, so the basis monomials go away together with their rows and columns of the
+// psd gram matrices. Removing them may leave more such rows, the pass is repeated until nothing changes. For a single
+// sos (multiplier 1) the vertices of the remaining basis all have their squares in the target, i.e. the basis ends
+// up inside the half Newton polytope of the target. A basis may become empty, the sos is zero then.
+std::vector<std::vector<QMonomial>> pruneSosBases(const std::vector<std::vector<QMonomial>> &bases,
+                                                  const std::vector<SymbolicPolynomial> &multipliers,
+                                                  const SymbolicPolynomial &target);
+
+// Linear equalities in CSR form, row r reads
+//     sum_e e.coefficient * l_{e.block}_{e.row}_{e.col} + sum_f f.coefficient * u_{f.symbolId} + constants[r] == 0,
+// where l_k_i_j (i <= j) is the gram matrix entry of the k-th sos, the same unknown getSos(..) creates, so the
+// coefficient of an off-diagonal entry already accounts for both (i, j) and (j, i), and u are the free unknowns.
+struct SparseConstraintSystem {
+    struct GramEntry {
+        int block;
+        int row;
+        int col;
+        Rational coefficient;
+    };
+
+    struct FreeEntry {
+        int symbolId;
+        Rational coefficient;
+    };
+
+    int getNumberOfRows() const {
+        return static_cast<int>(constants.size());
+    }
+
+    // resolves the symbol ids of the free unknowns
+    SymbolicEnvironment *environment = nullptr;
+
+    // block -> size of its gram matrix, the bases of different soses may differ
+    std::map<int, int> blockSizes;
+
+    // the entries of row r are [gramRowStart[r], gramRowStart[r + 1]), the same for freeRowStart
+    std::vector<size_t> gramRowStart;
+    std::vector<GramEntry> gramEntries;
+    std::vector<size_t> freeRowStart;
+    std::vector<FreeEntry> freeEntries;
+    std::vector<Rational> constants;
+};
+
+// Assembles "every coefficient of sum_k sos_k * condition_k - conclusion is zero" without expanding the products
+// symbolically: for each term of the condition the rows of the distinct gram products are looked up in a hash map,
+// then a triplet is appended for every gram entry (i, j). build() orders the rows of every group by monomial, which is
+// the order getReducedMonomials() of the expanded polynomial has, and the entries of every row by (block, i, j)
+// and symbol id.
+class ConstraintAssembler {
+public:
+    explicit ConstraintAssembler(SymbolicEnvironment *environment) : environment(environment) {}
+
+    // rows are matched by monomial within a group, one group per conclusion of an if-then
+    void startGroup();
+
+    // adds sos_block * multiplier with sos_block = basis^T * G_block * basis, throws if a coefficient of the
+    // multiplier is not constant
+    void addSosProduct(int block, const GramTemplate &gram, const SymbolicPolynomial &multiplier);
+
+    // adds factor * polynomial
+    void addPolynomial(const SymbolicPolynomial &polynomial, const Rational &factor = 1);
+
+    // appends the groups of other after the groups of this one, as if its calls had been made here; the blocks of the
+    // two must differ. The if-thens are assembled on threads of their own and appended in order, so the system does not
+    // depend on the threads
+    void append(ConstraintAssembler &&other);
+
+    SparseConstraintSystem build() const;
+
+private:
+    struct GramTriplet {
+        int row;
+        SparseConstraintSystem::GramEntry entry;
+    };
+
+    struct FreeTriplet {
+        int row;
+        SparseConstraintSystem::FreeEntry entry;
+    };
+
+    int getOrCreateRow(const PackedExponents &monomial);
+
+    SymbolicEnvironment *environment;
+    std::unordered_map<PackedExponents, int, PackedExponentsHash> currentGroupRows;
+    std::vector<int> groupStarts = {0};
+    std::vector<PackedExponents> rowMonomials;
+    std::vector<Rational> rowConstants;
+    std::vector<GramTriplet> gramTriplets;
+    std::vector<FreeTriplet> freeTriplets;
+    std::map<int, int> blockSizes;
+};
+
 #endif //MYPROJECT_SDPENCODER_H
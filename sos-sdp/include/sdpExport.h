@@ -0,0 +1,39 @@
+//
+// Created by sergey on 24.08.23.
+//
+// sparse SDPA (.dat-s, the input of csdp) and CBF writers for NativeSdpProblem, and a reader for the solution
+// files of csdp; numbers are written with 17 significant digits, so they read back exactly
+//
+
+#ifndef MYPROJECT_SDPEXPORT_H
+#define MYPROJECT_SDPEXPORT_H
+
+#include <istream>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "nativeSdpSolver.h"
+
+// sdpa has neither free variables nor a distinction of the blocks we need, so the free variables become a diagonal
+// block of (+v, -v) pairs, placed before the first diagonal block of the problem
+struct SdpaLayout {
+    explicit SdpaLayout(const NativeSdpProblem& problem);
+
+    std::vector<int> blockSizes; // of the sdpa blocks, block b is blockSizes[b - 1]
+    std::vector<int> blockNumbers; // the sdpa block of every block of the problem
+    int freeBlock = 0; // 0 if there are no free variables
+};
+
+void writeSdpa(const NativeSdpProblem& problem, std::ostream& os);
+void writeCbf(const NativeSdpProblem& problem, std::ostream& os);
+
+// a csdp solution file: y, then "matrix block row col value" lines with matrix 1 for Z and 2 for X;
+// the status is SOLVED, the file does not tell more; as with the stream parser it replaces, what is missing stays
+// zero, and a missing file reads as an empty one
+NativeSdpResult readSdpaSolution(const NativeSdpProblem& problem, const char* begin, const char* end);
+NativeSdpResult readSdpaSolution(const NativeSdpProblem& problem, std::istream& inp);
+// memory maps the file where it is possible
+NativeSdpResult readSdpaSolutionFile(const NativeSdpProblem& problem, const std::string& fileName);
+
+#endif //MYPROJECT_SDPEXPORT_H
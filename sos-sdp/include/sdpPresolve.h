@@ -0,0 +1,116 @@
+//
+// Created by sergey on 27.08.23.
+//
+// presolve of the encoded sdp: empty and duplicate rows are removed, variables fixed by singleton rows are substituted,
+// a gram diagonal entry fixed to zero removes its row and column of the matrix, and a free variable that is met in one
+// row only takes that row with it. The reduced system is an SdpProblem of its own with the same matrix indices and
+// variable names, so every backend solves it; postsolve() restores the solution of the full one
+//
+
+#ifndef MYPROJECT_SDPPRESOLVE_H
+#define MYPROJECT_SDPPRESOLVE_H
+
+#include <memory>
+#include <ostream>
+#include <utility>
+#include <vector>
+
+#include "sdpProblem.h"
+
+class SdpPresolve {
+public:
+    struct Statistics {
+        int rows = 0;
+        int emptyRows = 0;
+        int duplicateRows = 0;
+        int fixedVariables = 0;
+        int substitutedVariables = 0;
+        int removedGramLines = 0; // rows and columns of the gram matrices fixed to zero
+    };
+
+    explicit SdpPresolve(SdpProblem& problem, double tolerance = 1e-9);
+
+    // presolve found a row that no solution satisfies, the reduced problem is not built
+    bool isInfeasible() const {
+        return infeasible;
+    }
+
+    // nothing is left to solve, postsolve() works without a solution of the reduced problem
+    bool isSolved() const {
+        return !infeasible && reduced->getNumberOfConditions() == 0;
+    }
+
+    SdpProblem& getReduced() {
+        return *reduced;
+    }
+
+    // sets the solution of the full problem, the reduced problem has to be solved unless isSolved()
+    void postsolve();
+
+    const Statistics& getStatistics() const {
+        return statistics;
+    }
+
+    void printStatistics(std::ostream& os) const;
+
+private:
+    enum class ColumnKind {
+        MATRIX,
+        FREE,
+        NONNEGATIVE
+    };
+
+    // a scalar of the system: an upper triangle entry of a matrix, a free or a nonnegative variable
+    struct Column {
+        ColumnKind kind;
+        int index; // inner index of the matrix or of the variable
+        int row;
+        int col;
+    };
+
+    // terms are sorted by column, the coefficient of a matrix column is the one of X_rc in <A, X>, so an off-diagonal
+    // entry counts twice
+    struct Row {
+        std::vector<std::pair<int, double>> terms;
+        double constant;
+        LinearMatrixExpressionType type;
+        double withinRange;
+        bool removed = false;
+    };
+
+    // column = -(constant + sum of terms) / coefficient, applied in the reverse order
+    struct PostsolveStep {
+        int column;
+        double coefficient;
+        double constant;
+        std::vector<std::pair<int, double>> terms;
+    };
+
+    void collectRows();
+    bool presolveRow(int row);
+    bool substituteColumnSingletons();
+    bool removeDuplicateRows();
+    void fixColumn(int column, double value);
+    void zeroGramLine(int matrix, int line);
+    void removeRow(int row);
+    void buildReduced();
+
+    SdpProblem& problem;
+    double tolerance;
+    bool infeasible = false;
+    Statistics statistics;
+
+    std::vector<Column> columns;
+    std::vector<Row> rows;
+    std::vector<std::vector<int>> columnRows; // all rows a column has been in, the removed ones included
+    std::vector<int> columnCount; // of the rows that are left
+    std::vector<bool> columnRemoved;
+    std::vector<std::vector<std::vector<int>>> gramLineColumns; // the columns of every matrix row
+    std::vector<std::vector<bool>> gramLineRemoved;
+    std::vector<PostsolveStep> steps;
+
+    std::unique_ptr<SdpProblem> reduced;
+    std::vector<std::vector<int>> reducedLine; // the row of the reduced matrix for every matrix row, -1 if removed
+};
+
+#endif //MYPROJECT_SDPPRESOLVE_H
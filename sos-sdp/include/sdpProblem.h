@@ -13,16 +13,18 @@
 #include <string>
 #include <memory>
 #include <sstream>
+#include <iostream>
+#include <fstream>
+#include <algorithm>
+#include <cmath>
+#include <limits>
 
-#include "fusion.h"
+#include "nativeSdpSolver.h"
+#include "sdpExport.h"
 
 
  #define SUPPRESSCHECKS 1
 
-// use mosek::fusion as fus:
-
-namespace fus = mosek::fusion;
-using namespace monty;
 
 
 //#define SDP_PROBLEM_DEBUG 1
@@ -35,16 +37,72 @@ enum class LinearMatrixExpressionType {
     UNKNOWN
 };
 
+// symmetric matrix stored as the triplets of its upper triangle, value is the (row, col) entry of the matrix
+struct SparseSymmetricMatrix {
+    struct Entry {
+        int row;
+        int col;
+        double value;
+    };
+
+    explicit SparseSymmetricMatrix(int size = 0) : size(size) {
+    }
+
+    void add(int row, int col, double value) {
+        if (row > col) {
+            std::swap(row, col);
+        }
+        entries.push_back({row, col, value});
+    }
+
+    // sorts the entries and merges the ones with the same position, the addition order is kept
+    void compress() {
+        std::stable_sort(entries.begin(), entries.end(), [](const Entry& l, const Entry& r) {
+            return l.row < r.row || (l.row == r.row && l.col < r.col);
+        });
+        size_t last = 0;
+        for (size_t k = 0; k < entries.size(); ++k) {
+            if (last > 0 && entries[last - 1].row == entries[k].row && entries[last - 1].col == entries[k].col) {
+                entries[last - 1].value += entries[k].value;
+            } else {
+                entries[last++] = entries[k];
+            }
+        }
+        entries.resize(last);
+    }
+
+    // <this, matrix>
+    double dot(const std::vector<std::vector<double>>& matrix) const {
+        double result = 0.0;
+        for (const auto& entry : entries) {
+            result += entry.value * matrix[entry.row][entry.col];
+            if (entry.row != entry.col) {
+                result += entry.value * matrix[entry.col][entry.row];
+            }
+        }
+        return result;
+    }
+
+    int size;
+    std::vector<Entry> entries;
+};
+
 struct LinearMatrixExpression {
     explicit LinearMatrixExpression(int matrixSize): matrixSize(matrixSize), type(LinearMatrixExpressionType::UNKNOWN) {
     }
 
     void addMatrixEntry(int matrixIndex, int row, int col, double coefficient) {
-        if (matrixCoefficients.find(matrixIndex) == matrixCoefficients.end()) {
-            matrixCoefficients[matrixIndex] = std::vector<std::vector<double>>(matrixSize, std::vector<double>(matrixSize, 0.0));
+        addMatrixEntry(matrixIndex, matrixSize, row, col, coefficient);
+    }
+
+    // the size is used when the matrix is met for the first time in this expression
+    void addMatrixEntry(int matrixIndex, int size, int row, int col, double coefficient) {
+        auto matrix = matrixCoefficients.find(matrixIndex);
+        if (matrix == matrixCoefficients.end()) {
+            matrix = matrixCoefficients.emplace(matrixIndex, SparseSymmetricMatrix(size)).first;
         }
-        matrixCoefficients[matrixIndex][row][col] += coefficient / 2;
-        matrixCoefficients[matrixIndex][col][row] += coefficient / 2;
+        // the coefficient is split between (row, col) and (col, row)
+        matrix->second.add(row, col, row == col ? coefficient : coefficient / 2);
     }
 
     void addFreeCoefficients(int matrixIndex, double coefficient) {
@@ -54,6 +112,10 @@ struct LinearMatrixExpression {
         freeCoefficients[matrixIndex] += coefficient;
     }
 
+    void addNonnegativeCoefficients(int variableIndex, double coefficient) {
+        nonnegativeCoefficients[variableIndex] += coefficient;
+    }
+
     void addToConstantPart(double coefficient) {
         constantPart += coefficient;
     }
@@ -65,12 +127,17 @@ struct LinearMatrixExpression {
 
         this->type = type;
         this->withinRange = withinRange;
+
+        for (auto& matrix : matrixCoefficients) {
+            matrix.second.compress();
+        }
     }
 
 
     int matrixSize;
-    std::map<int, std::vector<std::vector<double>>> matrixCoefficients;
+    std::map<int, SparseSymmetricMatrix> matrixCoefficients;
     std::map<int, double> freeCoefficients;
+    std::map<int, double> nonnegativeCoefficients;
     double constantPart = 0.0;
     double withinRange = 0.0; // used only for IN_RANGE type
 
@@ -82,15 +149,6 @@ struct LinearMatrixExpression {
 class SdpProblem {
 public:
     explicit SdpProblem(int allMatricesSize) : allMatricesSize(allMatricesSize), objective(allMatricesSize) {
-        M = new fus::Model("temp");
-    }
-
-    ~SdpProblem() {
-        M->dispose();
-    }
-
-    fus::Model::t& getModel() {
-        return M;
     }
 
 
@@ -109,7 +167,7 @@ public:
         }
 
         auto innerMatrixIndex = encodeOrCreateMatrixIndexAsInner(matrixIndex);
-        conditions.back().addMatrixEntry(innerMatrixIndex, row, col, coefficient);
+        conditions.back().addMatrixEntry(innerMatrixIndex, innerMatrixSizes[innerMatrixIndex], row, col, coefficient);
 
     }
 
@@ -122,6 +180,38 @@ public:
         conditions.back().addFreeCoefficients(innerIndex, coefficient);
     }
 
+    // the same as addUnconstrainedVariable(..) for a variable that is registered already, without the name lookup
+    void addUnconstrainedVariableByIndex(int innerIndex, double coefficient) {
+        if (state != READY_TO_ADD) {
+            throw std::runtime_error("Cannot add sdp constrained variable");
+        }
+        conditions.back().addFreeCoefficients(innerIndex, coefficient);
+    }
+
+    // the entry of a 1x1 sdp matrix, a nonnegative variable that is reported as the matrix
+    void addGramScalar(int matrixIndex, double coefficient) {
+        if (state != READY_TO_ADD) {
+            throw std::runtime_error("Cannot add nonnegative variable");
+        }
+
+        auto inserted = gramScalarToInnerIndex.emplace(matrixIndex, nonnegativeVariableNames.size());
+        if (inserted.second) {
+            nonnegativeVariableNames.push_back("l_" + std::to_string(matrixIndex) + "_0_0");
+            nonnegativeVariableGramIndex.push_back(matrixIndex);
+        }
+        conditions.back().addNonnegativeCoefficients(inserted.first->second, coefficient);
+    }
+
+    // a scalar variable >= 0, the same as a 1x1 sdp matrix but without a block of its own
+    void addNonnegativeVariable(std::string variableName, double coefficient) {
+        if (state != READY_TO_ADD) {
+            throw std::runtime_error("Cannot add nonnegative variable");
+        }
+
+        auto innerIndex = encodeOrCreateNonnegativeVariableNameAsInner(variableName);
+        conditions.back().addNonnegativeCoefficients(innerIndex, coefficient);
+    }
+
     void addConstant(double constant) {
         if (state != READY_TO_ADD) {
             throw std::runtime_error("Cannot add sdp constrained variable");
@@ -148,11 +238,21 @@ public:
     }
 
 
+    // matrices are allMatricesSize x allMatricesSize unless their size is set before they are used
+    void setMatrixSize(int matrixIndex, int size) {
+        if (matrixIndices.count(matrixIndex) != 0 && innerMatrixSizes[outerMatrixIndexToInnerMatrixIndex[matrixIndex]] != size) {
+            throw std::runtime_error("Matrix " + std::to_string(matrixIndex) + " is already used with another size");
+        }
+        outerMatrixIndexToSize[matrixIndex] = size;
+    }
+
     int encodeOrCreateMatrixIndexAsInner(int index) {
         if (matrixIndices.count(index) == 0) {
             matrixIndices.insert(index);
             outerMatrixIndexToInnerMatrixIndex[index] = maxMatrixIndex;
             innerMatrixIndexToOuterMatrixIndex[maxMatrixIndex] = index;
+            auto size = outerMatrixIndexToSize.find(index);
+            innerMatrixSizes.push_back(size == outerMatrixIndexToSize.end() ? allMatricesSize : size->second);
             maxMatrixIndex++;
         }
         return outerMatrixIndexToInnerMatrixIndex[index];
@@ -182,6 +282,24 @@ public:
         return innerIndexToUnconstrainedVariableName[index];
     }
 
+    int encodeOrCreateNonnegativeVariableNameAsInner(const std::string& variableName) {
+        auto inserted = nonnegativeVariableNameToInnerIndex.emplace(variableName, nonnegativeVariableNames.size());
+        if (inserted.second) {
+            nonnegativeVariableNames.push_back(variableName);
+            nonnegativeVariableGramIndex.push_back(-1);
+        }
+        return inserted.first->second;
+    }
+
+    const std::string& getNonnegativeVariableName(int index) const {
+        return nonnegativeVariableNames.at(index);
+    }
+
+    // the matrix of a variable added with addGramScalar(..), -1 for the named ones
+    int getNonnegativeVariableGramIndex(int index) const {
+        return nonnegativeVariableGramIndex.at(index);
+    }
+
     void printLinearMatrixExpression(std::ostream& os, const LinearMatrixExpression& expr, bool trueIndex = false) {
         for (const auto& matrixIndex_matrix : expr.matrixCoefficients) {
             auto matrixIndex = matrixIndex_matrix.first;
@@ -190,12 +308,9 @@ public:
             }
             const auto& matrix = matrixIndex_matrix.second;
 
-            os << "X_" << matrixIndex << std::endl << "@" << std::endl;
-            for (int i = 0; i < expr.matrixSize; ++i) {
-                for (int j = 0; j < expr.matrixSize; ++j) {
-                    os << matrix[i][j] << " ";
-                }
-                os << std::endl;
+            os << "X_" << matrixIndex << " (" << matrix.size << "x" << matrix.size << ")" << std::endl << "@" << std::endl;
+            for (const auto& entry : matrix.entries) {
+                os << "[" << entry.row << ", " << entry.col << "] " << entry.value << std::endl;
             }
         }
 
@@ -206,6 +321,9 @@ public:
 
             os << " + (" << freeCoefficient << ") * " << "coef_" << matrixIndex;
         }
+        for (const auto& index_coefficient : expr.nonnegativeCoefficients) {
+            os << " + (" << index_coefficient.second << ") * " << "nonneg_" << index_coefficient.first;
+        }
         os << " + " << expr.constantPart;
 
         switch (expr.type) {
@@ -238,6 +356,10 @@ public:
         return unconstrainedVariables.size();
     }
 
+    int getNumberOfNonnegativeVariables() {
+        return nonnegativeVariableNames.size();
+    }
+
     int getNumberOfConditions() {
         return conditions.size();
     }
@@ -246,20 +368,33 @@ public:
         return allMatricesSize;
     }
 
+    // size of the matrix with the given inner index
+    int getMatrixSize(int innerIndex) {
+        return innerMatrixSizes.at(innerIndex);
+    }
+
     const std::vector<LinearMatrixExpression>& getConditions() {
         return conditions;
     }
 
+    // values of all variables by their inner indices
+    struct RawSolution {
+        std::vector<std::vector<std::vector<double>>> matrices;
+        std::vector<double> unconstrainedVariables;
+        std::vector<double> nonnegativeVariables;
+    };
+
     static double
     evaluateLhsForLinearMatrixExpression(
             const std::vector<std::vector<std::vector<double>>>& matrices,
-            const std::vector<double>& unconstrainedVariables, const LinearMatrixExpression& expr) {
+            const std::vector<double>& unconstrainedVariables,
+            const std::vector<double>& nonnegativeVariables, const LinearMatrixExpression& expr) {
         double result = 0.0;
 
-        for (auto matrixIndex_matrix : expr.matrixCoefficients) {
+        for (const auto& matrixIndex_matrix : expr.matrixCoefficients) {
             auto matrixIndex = matrixIndex_matrix.first;
             const auto& matrix = matrixIndex_matrix.second;
-            result += twoMatricesProduct(matrices[matrixIndex], matrix);
+            result += matrix.dot(matrices[matrixIndex]);
         }
 
         for (auto coeffIndex_freeCoefficient : expr.freeCoefficients) {
@@ -268,23 +403,73 @@ public:
             result += freeCoefficient * unconstrainedVariables[coeffIndex];
         }
 
+        for (const auto& index_coefficient : expr.nonnegativeCoefficients) {
+            result += index_coefficient.second * nonnegativeVariables[index_coefficient.first];
+        }
+
         result += expr.constantPart;
         return result;
     }
 
+    void setSolution(const RawSolution& raw) {
+        setSolution(raw.matrices, raw.unconstrainedVariables, raw.nonnegativeVariables);
+    }
+
+    // the largest violation of a condition, the checks of setSolution accept the solution if it is within the allowed
+    // error; this one works with SUPPRESSCHECKS as well and does not throw
+    double getMaxViolation(const RawSolution& raw) const {
+        if (raw.matrices.size() != matrixIndices.size() ||
+            raw.unconstrainedVariables.size() != unconstrainedVariables.size() ||
+            raw.nonnegativeVariables.size() != nonnegativeVariableNames.size()) {
+            return std::numeric_limits<double>::infinity();
+        }
+        for (int i = 0; i < raw.matrices.size(); ++i) {
+            if (raw.matrices[i].size() != innerMatrixSizes[i]) {
+                return std::numeric_limits<double>::infinity();
+            }
+        }
+
+        double result = 0.0;
+        for (const auto& condition : conditions) {
+            auto value = evaluateLhsForLinearMatrixExpression(raw.matrices, raw.unconstrainedVariables,
+                                                              raw.nonnegativeVariables, condition);
+            if (std::isnan(value)) {
+                return std::numeric_limits<double>::infinity();
+            }
+            switch (condition.type) {
+                case LinearMatrixExpressionType::GEQ:
+                    result = std::max(result, -value);
+                    break;
+                case LinearMatrixExpressionType::EQ:
+                    result = std::max(result, std::abs(value));
+                    break;
+                case LinearMatrixExpressionType::IN_RANGE:
+                    result = std::max(result, std::abs(value) - condition.withinRange);
+                    break;
+                case LinearMatrixExpressionType::UNKNOWN:
+                    return std::numeric_limits<double>::infinity();
+            }
+        }
+        return result;
+    }
+
     void setSolution(const std::vector<std::vector<std::vector<double>>>& matrices,
-                     const std::vector<double>& unconstrainedVariables) {
+                     const std::vector<double>& unconstrainedVariables,
+                     const std::vector<double>& nonnegativeVariables = {}) {
         if (matrices.size() != getNumberOfSdpMatrices()) {
             throw std::runtime_error("Wrong number of matrices");
         }
         if (unconstrainedVariables.size() != getNumberOfUnconstrainedVariables()) {
             throw std::runtime_error("Wrong number of unconstrained variables");
         }
+        if (nonnegativeVariables.size() != getNumberOfNonnegativeVariables()) {
+            throw std::runtime_error("Wrong number of nonnegative variables");
+        }
 
         int conditionCounter = 0;
         for (auto& condition : conditions) {
             conditionCounter++;
-            auto evaluationResult = evaluateLhsForLinearMatrixExpression(matrices, unconstrainedVariables, condition);
+            auto evaluationResult = evaluateLhsForLinearMatrixExpression(matrices, unconstrainedVariables, nonnegativeVariables, condition);
 #ifndef SUPPRESSCHECKS
             switch (condition.type) {
                 case LinearMatrixExpressionType::GEQ:
@@ -316,317 +501,119 @@ public:
 
         solutionMatrices = matrices;
         solutionUnconstrainedVariables = unconstrainedVariables;
+        solutionNonnegativeVariables = nonnegativeVariables;
 
         setupSolution();
     }
 
-    std::map<int, int> csdpSosIdxToBlock;
-    std::map<int, int> csdpUnconstrainedIdxToBlock;
-
-    bool doubleIsZero(double x) {
-        return x == 0.0;
+    // the layout is the one of SdpaLayout: the matrices, the free variables as one diagonal block of pairs,
+    // the nonnegative variables
+    void writeCsdp(std::ostream& os) {
+        writeSdpa(getNativeProblem(), os);
     }
 
-    void writeCsdpHeader(std::ostream& os) {
-        // writing number of constraints
-        int numberOfConstraints = 0;
-        for (const auto& condition : conditions) {
-            if (condition.type != LinearMatrixExpressionType::EQ) {
-                throw std::runtime_error("Only EQ conditions are supported for csdp");
-            }
-            numberOfConstraints += 1;
-        }
-
-        os << numberOfConstraints << std::endl;
-        os << getNumberOfSdpMatrices() + getNumberOfUnconstrainedVariables() << std::endl; // number of blocks
-
-        // block matrices for each sdp
-        int blockCnt = 1;
-        for (int i = 0; i < getNumberOfSdpMatrices(); ++i) {
-            os <<  getMatrixSize() << " ";
-            csdpSosIdxToBlock[i] = blockCnt;
-            blockCnt += 1;
-        }
-
-        // 2x2 matrix for each unconstrained variable
-        for (int i = 0; i < getNumberOfUnconstrainedVariables(); ++i) {
-            os << -2 << " ";
-            csdpUnconstrainedIdxToBlock[i] = blockCnt;
-            blockCnt += 1;
-        }
-        os << std::endl;
-
+    RawSolution readCsdp(std::istream& inp) {
+        return toRawSolution(readSdpaSolution(getNativeProblem(), inp));
     }
 
-    void writeCsdpCmatrix(std::ostream& os) {
-        for (const auto& condition : conditions) {
-            os << doubleToString(-condition.constantPart) << " ";
-        }
-        os << std::endl;
+    RawSolution readCsdpFile(const std::string& fileName) {
+        return toRawSolution(readSdpaSolutionFile(getNativeProblem(), fileName));
     }
 
-    void writeCsdpLinearMatrixExpression(std::ostream& os, const LinearMatrixExpression& expr, int expressionIdx) {
-        for (const auto& index_doubleMatrix : expr.matrixCoefficients) {
-            const auto& index = index_doubleMatrix.first;
-            const auto& matrix = index_doubleMatrix.second;
-
-            for (int i = 0; i < getMatrixSize(); ++i) {
-                for (int j = i; j < getMatrixSize(); ++j) {
-                    if (doubleIsZero(matrix[i][j]))
-                        continue;
-                    os << expressionIdx + 1 << " " // A_i index
-                    << csdpSosIdxToBlock[index] << " " // block index
-                    << i + 1 << " " // row index
-                    << j + 1 << " " // column index
-                    << doubleToString(matrix[i][j]) << std::endl;
-                }
-            }
+    // sdpa unless the name ends with .cbf
+    void writeProblem(const std::string& fileName) {
+        std::ofstream os(fileName);
+        if (!os) {
+            throw std::runtime_error("Cannot open " + fileName);
         }
-
-        for (const auto& index_Value: expr.freeCoefficients) {
-            const auto& index = index_Value.first;
-            const auto& value = index_Value.second;
-
-            if (doubleIsZero(value))
-                continue;
-
-            os << expressionIdx + 1 << " " //
-            << csdpUnconstrainedIdxToBlock[index] << " " // block index
-            << 1 << " " // row index
-            << 1 << " " // column index
-            << doubleToString(value) << std::endl;
-            os << expressionIdx + 1 << " " //
-               << csdpUnconstrainedIdxToBlock[index] << " " // block index
-               << 2 << " " // row index
-               << 2 << " " // column index
-               << doubleToString(-value) << std::endl;
-        }
-    }
-
-    void writeCsdp(std::ostream& os) {
-        writeCsdpHeader(os);
-        writeCsdpCmatrix(os);
-
-        int conditionIdx = 0;
-        for (const auto& condition : conditions) {
-            writeCsdpLinearMatrixExpression(os, condition, conditionIdx);
-            conditionIdx += 1;
+        const std::string cbf = ".cbf";
+        if (fileName.size() >= cbf.size() && fileName.compare(fileName.size() - cbf.size(), cbf.size(), cbf) == 0) {
+            writeCbf(getNativeProblem(), os);
+        } else {
+            writeSdpa(getNativeProblem(), os);
         }
     }
 
-    std::pair<std::vector<std::vector<std::vector<double>>>, std::vector<double> > readCsdp(std::istream& inp) {
-//        std::map<int, int> csdpSosIdxToBlock;
-//        std::map<int, int> csdpUnconstrainedIdxToBlock;
-        std::map<int, int> blockIdxToCsdpSosIdx;
-        std::map<int, int> blockIdxToCsdpUnconstrainedIdx;
-        std::set<int> inMatrix;
-        std::set<int> inUnconstrained;
 
-        // reversing maps
-        for (const auto& idx_block : csdpSosIdxToBlock) {
-            blockIdxToCsdpSosIdx[idx_block.second] = idx_block.first;
-            inMatrix.insert(idx_block.second);
-        }
-        for (const auto& idx_block : csdpUnconstrainedIdxToBlock) {
-            blockIdxToCsdpUnconstrainedIdx[idx_block.second] = idx_block.first;
-            inUnconstrained.insert(idx_block.second);
-        }
-
-        std::vector<std::vector<std::vector<double>>> matrices(getNumberOfSdpMatrices());
-        for (auto& matrix: matrices) {
-            matrix = std::vector<std::vector<double>>(getMatrixSize(), std::vector<double>(getMatrixSize(), 0.0));
-        }
-        std::vector<double> variables = std::vector<double>(getNumberOfUnconstrainedVariables(), 0.0);
-
-        std::vector<double> dualsY = std::vector<double>(getNumberOfConditions(), 0.0);
-
-        for (auto& dual: dualsY) {
-            inp >> dual;
+    // the matrices are the psd blocks, the nonnegative variables make one diagonal block, the free ones stay free
+    NativeSdpProblem getNativeProblem() {
+        NativeSdpProblem problem;
+        for (int i = 0; i < getNumberOfSdpMatrices(); ++i) {
+            problem.blockSizes.push_back(getMatrixSize(i));
         }
-
-        int option;
-        const int optionIgnore = 1;
-        const int optionToMatrix = 2;
-        int blockIdx, rowIdx, colIdx;
-        double entryVal;
-
-        while (inp >> option >> blockIdx >> rowIdx >> colIdx >> entryVal) {
-            if (option == optionIgnore)
-                continue;
-
-            if (inMatrix.find(blockIdx) != inMatrix.end()) { // we are sos entry
-                int rowIdxZeroBased = rowIdx - 1;
-                int colIdxZeroBased = colIdx - 1;
-                int sosIdx = blockIdxToCsdpSosIdx[blockIdx];
-                matrices[sosIdx][rowIdxZeroBased][colIdxZeroBased] = entryVal;
-                if (rowIdx != colIdx) {
-                    matrices[sosIdx][colIdxZeroBased][rowIdxZeroBased] = entryVal;
-                }
-            } else {
-                int unconstrainedIdx = blockIdxToCsdpUnconstrainedIdx[blockIdx];
-                if (rowIdx == 1 && colIdx == 1) {
-                    variables[unconstrainedIdx] += entryVal;
-                } else if (rowIdx == 2 && colIdx == 2) {
-                    variables[unconstrainedIdx] -= entryVal;
-                } else {
-                    throw std::runtime_error("unexpected rowIdx and colIdx");
-                }
-            }
+        int nonnegativeBlock = problem.blockSizes.size();
+        if (getNumberOfNonnegativeVariables() > 0) {
+            problem.blockSizes.push_back(-getNumberOfNonnegativeVariables());
         }
+        problem.numberOfFreeVariables = getNumberOfUnconstrainedVariables();
 
-        return std::make_pair(matrices, variables);
-
-    }
-
-
-    fus::Variable::t slice(fus::Variable::t X, int d, int j) {
-        return
-                X->slice(new_array_ptr<int,1>({j,0,0}), new_array_ptr<int,1>({j+1,d,d}))
-                        ->reshape(new_array_ptr<int,1>({d,d}));
-    }
-    void solveWithMosek() {
-        // the code taken from https://docs.mosek.com/latest/cxxfusion/tutorial-sdo-shared.html and modified
-
-        const auto& conditions = getConditions();
-
-        int n = getNumberOfSdpMatrices(), d = getMatrixSize(), k = getNumberOfConditions();
-
-        std::vector<double> b(k, 0.0);
-        for (int i = 0; i < k; ++i) {
-            if (conditions[i].type == LinearMatrixExpressionType::IN_RANGE) {
-                b[i] = conditions[i].withinRange;
+        for (const auto& condition : conditions) {
+            if (condition.type != LinearMatrixExpressionType::EQ) {
+                throw std::runtime_error("Only EQ conditions are supported for csdp and the native solvers");
             }
-        }
-
-//        std::map<std::pair<int, int>, std::shared_ptr<ndarray<double,2>>> A;
-        std::vector<std::map<int, std::shared_ptr<ndarray<double,2>>>> A;
-        for (int coditionIndex = 0; coditionIndex < k; ++coditionIndex) {
-            A.emplace_back();
-
-            for (auto matrixIndex_matrix : conditions[coditionIndex].matrixCoefficients) {
-                auto matrixIndex = matrixIndex_matrix.first;
-                const auto& matrix = matrixIndex_matrix.second;
-
-                auto A_ij = std::make_shared<ndarray<double,2>>(shape(d,d));
-                for (int i = 0; i < d; ++i) {
-                    for (int j = 0; j < d; ++j) {
-                        (*A_ij)(i,j) = matrix[i][j];
-                    }
+            problem.constraints.emplace_back();
+            auto& constraint = problem.constraints.back();
+            for (const auto& index_matrix : condition.matrixCoefficients) {
+                for (const auto& entry : index_matrix.second.entries) {
+                    constraint.entries.push_back({index_matrix.first, entry.row, entry.col, entry.value});
                 }
-                A.back()[matrixIndex] = A_ij;
             }
-        }
-
-
-        // Create a model with n semidefinite variables of dimension d x d
-
-
-        fus::Variable::t X = M->variable(fus::Domain::inPSDCone(d, n));
-        fus::Variable::t unconstrained = M->variable(fus::Domain::unbounded(getNumberOfUnconstrainedVariables()));
-
-
-
-        // Each constraint is a sum of inner products
-        // Each semidefinite variable is a slice of X
-        for(int i=0; i<k; i++) {
-            std::vector<fus::Expression::t> sumlist;
-
-            for (auto matrixIndex_matrix : A[i]) {
-                auto matrixIndex = matrixIndex_matrix.first;
-                const auto& matrix = matrixIndex_matrix.second;
-                sumlist.push_back(fus::Expr::dot(matrix, slice(X, d, matrixIndex)));
+            for (const auto& index_coefficient : condition.nonnegativeCoefficients) {
+                constraint.entries.push_back({nonnegativeBlock, index_coefficient.first, index_coefficient.first,
+                                              index_coefficient.second});
             }
-
-            for (auto coeffIndex_freeCoefficient : conditions[i].freeCoefficients) {
-                auto coeffIndex = coeffIndex_freeCoefficient.first;
-                auto freeCoefficient = coeffIndex_freeCoefficient.second;
-                sumlist.push_back(fus::Expr::mul(unconstrained->index(coeffIndex), freeCoefficient));
+            for (const auto& index_coefficient : condition.freeCoefficients) {
+                constraint.freeEntries.emplace_back(index_coefficient.first, index_coefficient.second);
             }
-
-            sumlist.push_back(fus::Expr::constTerm(conditions[i].constantPart));
-
-            if (conditions[i].type == LinearMatrixExpressionType::GEQ)
-                M->constraint(fus::Expr::add(new_array_ptr(sumlist)), fus::Domain::greaterThan(b[i]));
-            else if (conditions[i].type == LinearMatrixExpressionType::EQ)
-                M->constraint(fus::Expr::add(new_array_ptr(sumlist)), fus::Domain::equalsTo(b[i]));
-            else if (conditions[i].type == LinearMatrixExpressionType::IN_RANGE)
-                M->constraint(fus::Expr::add(new_array_ptr(sumlist)), fus::Domain::inRange(-b[i], b[i]));
-        }
-
-        // set all unconstrained variavles less than the objectiveVariable
-
-//        fus::Variable::t objectiveVariable = M->variable(fus::Domain::unbounded(1));
-//        for (int i = 0; i < getNumberOfUnconstrainedVariables(); ++i) {
-//            M->constraint(fus::Expr::sub(unconstrained->index(i), objectiveVariable), fus::Domain::lessThan(0.0));
-//            M->constraint(fus::Expr::sub(fus::Expr::mul(unconstrained->index(i), -1.0), objectiveVariable), fus::Domain::lessThan(0.0));
-//        }
-
-
-//        M->objective(fus::ObjectiveSense::Minimize, objectiveVariable);
-        M->objective(fus::ObjectiveSense::Minimize, fus::Expr::constTerm(0.0));
-
-        // Solve
-        M->setLogHandler([ = ](const std::string & msg) { std::cout << msg << std::flush; } );            // Add logging
-        M->writeTask("sdosdo.ptf");                // Save problem in readable format
-
-//        printSystem(std::cerr, true);
-
-
-        M->setSolverParam("presolveUse", "off");
-        M->solve();
-
-#ifdef SDP_PROBLEM_DEBUG
-        // print inner to outer
-
-        outerMatrixIndexToInnerMatrixIndex;
-        innerMatrixIndexToOuterMatrixIndex;
-        std::cout << "Inner to Outer:" << std::endl;
-        for (auto inner_outer : innerMatrixIndexToOuterMatrixIndex) {
-            std::cout << inner_outer.first << " -> " << inner_outer.second << std::endl;
-        }
-        std::cout << "Outer to Inner:" << std::endl;
-        for (auto outer_inner : outerMatrixIndexToInnerMatrixIndex) {
-            std::cout << outer_inner.first << " -> " << outer_inner.second << std::endl;
+            constraint.rhs = -condition.constantPart;
         }
-#endif
-
-        // Get results. Each variable is a slice of X
-
-        std::vector<std::vector<std::vector<double>>> matrices(n, std::vector<std::vector<double>>(d, std::vector<double>(d)));
-        std::vector<double> unconstrainedVariables(getNumberOfUnconstrainedVariables());
+        return problem;
+    }
 
-        for(int j=0; j<n; j++) {
-            auto Xj = *(slice(X, d, j)->level());
-            for(int s1=0; s1<d; s1++) {
-                for(int s2=0; s2<d; s2++) {
-                    matrices[j][s1][s2] = Xj[s1*d+s2];
+    RawSolution toRawSolution(const NativeSdpResult& result) {
+        RawSolution raw;
+        for (int i = 0; i < getNumberOfSdpMatrices(); ++i) {
+            int d = getMatrixSize(i);
+            raw.matrices.emplace_back(d, std::vector<double>(d));
+            for (int row = 0; row < d; ++row) {
+                for (int col = 0; col < d; ++col) {
+                    raw.matrices.back()[row][col] = result.blocks[i][row * d + col];
                 }
             }
         }
-
-        for (int i = 0; i < getNumberOfUnconstrainedVariables(); ++i) {
-            unconstrainedVariables[i] = (*unconstrained->level())[i];
+        raw.unconstrainedVariables = result.freeVariables;
+        if (getNumberOfNonnegativeVariables() > 0) {
+            raw.nonnegativeVariables = result.blocks[getNumberOfSdpMatrices()];
         }
-
-        setSolution(matrices, unconstrainedVariables);
-        setupSolution();
-
-#ifdef SDP_PROBLEM_DEBUG
-        std::cerr << "Solution, form spdProblem.h:" << std::endl;
-        printSolution(std::cout);
-#endif
+        return raw;
     }
 
 
-
-
     struct Solution {
-        std::map<int, std::vector<std::vector<double>>> matrices;
+        std::map<int, std::vector<std::vector<double>>> matrices; // by outer matrix index
         std::map<std::string, double> unconstrainedVariables;
+        std::map<std::string, double> nonnegativeVariables;
 
         std::map<int, int> innerMatrixIndexToOuterMatrixIndex;
         std::map<int, int> outerMatrixIndexToInnerMatrixIndex;
 
+        // "name value" lines, the matrix entries are l_<matrix index>_<row>_<col>
+        void print(std::ostream& os) const {
+            for (const auto& index_matrix : matrices) {
+                for (int i = 0; i < index_matrix.second.size(); ++i) {
+                    for (int j = 0; j < index_matrix.second[i].size(); ++j) {
+                        os << "l_" << index_matrix.first << '_' << i << '_' << j << ' ' << index_matrix.second[i][j] << '\n';
+                    }
+                }
+            }
+            for (const auto& name_value : unconstrainedVariables) {
+                os << name_value.first << ' ' << name_value.second << '\n';
+            }
+            for (const auto& name_value : nonnegativeVariables) {
+                os << name_value.first << ' ' << name_value.second << '\n';
+            }
+            os << std::flush;
+        }
     };
 
     const Solution& getSolution() {
@@ -650,14 +637,9 @@ public:
 
         std::map<std::string, double> answer;
         for (auto matrixIndex_Matrix2d: solution.matrices) {
+            // keyed by the outer index already
             auto matrixIndex = matrixIndex_Matrix2d.first;
 
-            // TODO(@Sergei): wtf
-            matrixIndex = solution.innerMatrixIndexToOuterMatrixIndex[matrixIndex];
-            matrixIndex = solution.innerMatrixIndexToOuterMatrixIndex[matrixIndex];
-
-//            matrixIndex = solution.outerMatrixIndexToInnerMatrixIndex[matrixIndex];
-
             auto matrixName = matrixIndex_Matrix2d.second;
             auto prefix = "l_" + std::to_string(matrixIndex) + "_";
             for (int i = 0; i < matrixName.size(); ++i) {
@@ -671,6 +653,9 @@ public:
             auto value = unconstrainedVariableName_value.second;
             answer[unconstrainedVariableName] = value;
         }
+        for (const auto& name_value : solution.nonnegativeVariables) {
+            answer[name_value.first] = name_value.second;
+        }
 
         // delete ignored variables from the answer
         for (auto ignoredVariable : igoredVariables) {
@@ -706,6 +691,10 @@ public:
 
             os << "Unconstrained variable " << unconstrainedVariableName << ": " << value << "\n";
         }
+
+        for (const auto& name_value : solution.nonnegativeVariables) {
+            os << "Nonnegative variable " << name_value.first << ": " << name_value.second << "\n";
+        }
     }
 
     void setAllowedError(double allowedError) {
@@ -717,8 +706,8 @@ private:
     void setupSolution() {
         solutionState = SOLVED;
 
-        for (auto matrixIndex : matrixIndices) {
-            solution.matrices[matrixIndex] = solutionMatrices[decodeMatrixIndexFromInner(matrixIndex)];
+        for (const auto& inner_outer : innerMatrixIndexToOuterMatrixIndex) {
+            solution.matrices[inner_outer.second] = solutionMatrices[inner_outer.first];
         }
 
         for (auto unconstrainedVariableName : unconstrainedVariables) {
@@ -726,6 +715,14 @@ private:
                     solutionUnconstrainedVariables[unconstrainedVariableNameToInnerIndex[unconstrainedVariableName]];
         }
 
+        for (int i = 0; i < nonnegativeVariableNames.size(); ++i) {
+            if (nonnegativeVariableGramIndex[i] >= 0) {
+                solution.matrices[nonnegativeVariableGramIndex[i]] = {{solutionNonnegativeVariables[i]}};
+            } else {
+                solution.nonnegativeVariables[nonnegativeVariableNames[i]] = solutionNonnegativeVariables[i];
+            }
+        }
+
         solution.innerMatrixIndexToOuterMatrixIndex = innerMatrixIndexToOuterMatrixIndex;
         solution.outerMatrixIndexToInnerMatrixIndex = outerMatrixIndexToInnerMatrixIndex;
 
@@ -740,6 +737,8 @@ private:
     std::set<int> matrixIndices;
     std::map<int, int> outerMatrixIndexToInnerMatrixIndex;
     std::map<int, int> innerMatrixIndexToOuterMatrixIndex;
+    std::map<int, int> outerMatrixIndexToSize;
+    std::vector<int> innerMatrixSizes;
     int maxMatrixIndex = 0;
 
     std::set<std::string> unconstrainedVariables;
@@ -747,6 +746,11 @@ private:
     std::map<int, std::string> innerIndexToUnconstrainedVariableName;
     int maxUnconstrainedVariableIndex = 0;
 
+    std::vector<std::string> nonnegativeVariableNames;
+    std::map<std::string, int> nonnegativeVariableNameToInnerIndex;
+    std::vector<int> nonnegativeVariableGramIndex;
+    std::map<int, int> gramScalarToInnerIndex;
+
     static const int READY_TO_START = -1;
     static const int READY_TO_ADD = 0;
 
@@ -761,24 +765,13 @@ private:
 
     std::vector<std::vector<std::vector<double>>> solutionMatrices;
     std::vector<double> solutionUnconstrainedVariables;
+    std::vector<double> solutionNonnegativeVariables;
 
 
-    static double twoMatricesProduct(const std::vector<std::vector<double>>& matrix1, const std::vector<std::vector<double>>& matrix2) {
-        double result = 0;
-        for (int i = 0; i < matrix1.size(); ++i) {
-            for (int j = 0; j < matrix1[i].size(); ++j) {
-                result += matrix1[i][j] * matrix2[i][j];
-            }
-        }
-        return result;
-    }
-
     double allowedError = 1e-6;
 
     std::set<std::string> ignoredInnerVariables;
 
-    fus::Model::t M;
-
 };
 
 #endif //MYPROJECT_SDPPROBLEM_H
@@ -9,12 +9,14 @@
 #include "symbolicRing.h"
 #include "stringRoutines.h"
 #include "sdpProblem.h"
+#include "sdpPresolve.h"
+#include "sdpBackend.h"
 
 #include <iostream>
 #include <vector>
-#include <fusion.h>
 #include <chrono>
 #include <fstream>
+#include <unordered_map>
 
 #include "debugTools.h"
 
@@ -24,652 +26,243 @@
 //#define SOLVER_DEBUG 1
 //#define SOLVER_PRINT_SYSTEM 1
 
-namespace fus = mosek::fusion;
-using namespace monty;
-
-// TODO: move to separate file
-inline fus::Variable::t slice(fus::Variable::t X, int d, int j) {
-    return
-            X->slice(new_array_ptr<int,1>({j,0,0}), new_array_ptr<int,1>({j+1,d,d}))
-                    ->reshape(new_array_ptr<int,1>({d,d}));
-}
-
-
-class SolverMosec {
-
-private:
-    struct LinearScalarExpression {
-
-        static long long gcdll(long long a, long long b) {
-            if (a == 0) {
-                return b;
-            }
-            return gcdll(b % a, a);
-        }
-
-        static std::pair<long long, long long> addTwoFractions(std::pair<long long, long long> a, std::pair<long long, long long> b) {
-            long long newEnumer = a.first * b.second + b.first * a.second;
-            long long newDenom = a.second * b.second;
-            long long gcd = gcdll(newEnumer, newDenom);
-            return std::make_pair(newEnumer / gcd, newDenom / gcd);
-        }
-
-        int getVariableIndexOrCreate(std::string varName) {
-            if (variableNameToCoefficient.find(varName) == variableNameToCoefficient.end()) {
-                variableNameToCoefficient[varName] = variableNames.size();
-                variableNames.push_back(varName);
-                coefficients.push_back(std::make_pair(0, 1));
-            }
-            return variableNameToCoefficient[varName];
-        }
-
-        std::vector<std::string> getAllUsedVariables() {
-            return variableNames;
-        }
-
-        std::pair<long long, long long> getCoefficientByVariableName(std::string varName) {
-            return coefficients[variableNameToCoefficient[varName]];
-        }
-
-        void addCoeff(std::string varName, long long enumer, long long demon) {
-            int varIdx = getVariableIndexOrCreate(varName);
-            coefficients[varIdx] = addTwoFractions(coefficients[varIdx], std::make_pair(enumer, demon));
-        }
-
-        std::map<std::string, long long> variableNameToCoefficient;
-        std::vector<std::string> variableNames;
-        std::vector<std::pair<long long, long long>> coefficients;
-    };
-
 
+// dense ids of the free variables of the solvers; the gram entries are not here, they come with their indices
+class FreeVariableRegistry {
 public:
-    SolverMosec(int sos_dim, int linear_var_number, const std::string& instance_name) : sos_dim(sos_dim),
-                                                                                                        linear_var_number(linear_var_number) {
-//        M = new fus::Model(instance_name);
-    }
-
-    ~SolverMosec() {
-//        M->dispose();
-    }
-
-
-
-
-    int getMaxLvarIndex(const QPolynomial& qpoly) {
-        int maxLvarIndex = -1;
-
-        for (const auto& monom: qpoly.getMonomials()) {
-            if (monom.isConstant()) {
-                continue;
-            }
-            if (!monom.isLinear()) {
-                throw std::runtime_error("Not a linear variable");
-            }
-
-            std::string const name = monom.getNameIfLinear();
-            if (name[0] != 'l' or name[1] != '_') {
-                continue;
-            }
-
-            auto tokens = parseLVarName(name);
-            maxLvarIndex = std::max(maxLvarIndex, tokens[0]);
-        }
-
-        if (maxLvarIndex == -1) {
-            throw std::runtime_error("No linear variables");
+    int getOrCreate(const std::string& name) {
+        auto inserted = nameToId.emplace(name, names.size());
+        if (inserted.second) {
+            names.push_back(name);
         }
-        return maxLvarIndex;
+        return inserted.first->second;
     }
 
-
-
-    void addLinearEqualityConstraint(const QPolynomial& lhs) {
-        // TODO(@sergey): add auto remapping of lvars to not waste a space
-
-
-
-        double total_rhs = 0;
-        linear_vars_name_to_coefficients.emplace_back();
-        linearMatrixCoefficients.emplace_back(sos_dim);
-        linearScalarCoefficients.emplace_back();
-
-
-
-
-        for (const auto& monom: lhs.getMonomials()) {
-            if (monom.isConstant()) {
-                total_rhs -= monom.getEnumerator() * 1.0 / monom.getDenominator();
-                continue;
-            }
-            if (!monom.isLinear()) {
-                throw std::runtime_error("Not a linear variable");
-            }
-
-            std::string const name = monom.getNameIfLinear();
-
-
-            auto enumer = monom.getEnumerator();
-            auto denom = monom.getDenominator();
-
-
-            if (name[0] != 'l' or name[1] != '_') { // non-constrained variable (e.g. a), will be encoded as a_p - a_n = a, a_p >= 0, a_n >= 0
-//                auto x  = std::make_shared<Variable::t>(M->variable(std::string(name)));
-//                linear_vars.push_back(x);
-//                linear_vars_name_to_var[name] = x;
-                linear_vars_name_to_coefficients.back()[name] = {monom.getEnumerator(), monom.getDenominator()};
-                linear_vars_names.insert(name);
-                linearScalarCoefficients.back().addCoeff(name, enumer, denom);
-                continue;
-            }
-
-
-            auto tokens = parseLVarName(name);
-
-            debugStream << "name: " << name << std::endl;
-
-
-            // TODO(@Sergei) multiply RHS by it
-//            if (denom != 1) {
-//                throw std::runtime_error("Not a linear variable");
-//            }
-
-            debugStream << "\nadding constraint " << tokens[0] << " " << tokens[1] << " " << tokens[2] << " " << enumer << std::endl;
-            linearMatrixCoefficients.back().addToMatrix(tokens[0], tokens[1], tokens[2], enumer * 1.0 / denom);
-            debugStream << "constraint added\n" << std::endl;
-
+    // the name of a symbol is looked up once
+    int getOrCreate(const SymbolicEnvironment& environment, int symbolId) {
+        if (&environment != this->environment) {
+            this->environment = &environment;
+            symbolToId.clear();
         }
-        rhss.push_back(total_rhs);
-    }
-
-
-
-    bool is_feasible() {
-        build();
-//        M->setLogHandler([=](const std::string & msg) { std::cout << msg << std::flush; });
-
-        std::cout << "Solver started" << std::endl;
-        auto t_start = std::chrono::high_resolution_clock::now();
-
-//        M->writeTask(M->getName() + ".cbf");
-//        M->writeTask(M->getName() + ".ptf");
-
-        //        M->writeTask(M->getName() + ".cplex");
-
-
-
-//        M->solve();
-
-        // TODO: eliminate double job
-        sdpProblemRef->solveWithMosek();
-
-        auto solutionMap = sdpProblemRef->getSolutionAsMap();
-
-        for (auto varName_varValue: solutionMap) {
-            std::cout << varName_varValue.first << " " << varName_varValue.second << std::endl;
+        if (symbolId >= symbolToId.size()) {
+            symbolToId.resize(symbolId + 1, -1);
         }
-
-
-        auto t_end = std::chrono::high_resolution_clock::now();
-        double elapsed_time_ms = std::chrono::duration<double, std::milli>(t_end-t_start).count();
-        std::cout << "Solved: " << elapsed_time_ms << "ms" << std::endl;
-
-//        M->writeTask("cancellation.ptf");
-
-        return (sdpProblemRef->getModel()->getProblemStatus() == fus::ProblemStatus::PrimalAndDualFeasible) || (sdpProblemRef->getModel()->getProblemStatus() == fus::ProblemStatus::PrimalFeasible);
-    }
-
-    void print() {
-        for (int displacement = 0; displacement < rhss.size(); displacement++) {
-            int sos_number = sos_numbers[displacement];
-            for (int i = 0; i < sos_number; i++) {
-                for (int j = 0; j < sos_dim; j++) {
-                    for (int k = 0; k < sos_dim; k++) {
-                        // TODO: uncomment fix
-//                        std::cout << (*linearMatrixCoefficients[displacement * sos_number + i])(j, k) << " ";
-                    }
-                    std::cout << std::endl;
-                }
-            }
-            std::cout << " == " << rhss[displacement] << std::endl;
+        if (symbolToId[symbolId] < 0) {
+            symbolToId[symbolId] = getOrCreate(environment.getSymbolName(symbolId));
         }
+        return symbolToId[symbolId];
     }
-    std::shared_ptr<ndarray<int,1>> nint(const std::vector<int> &X)    { return new_array_ptr<int>(X); }
-
 
-    std::map<std::string, double> getSolution2() {
-        return sdpProblemRef->getSolutionAsMap();
+    const std::string& getName(int id) const {
+        return names[id];
     }
 
-
-private:
-
-
-    void build() {
-//        int sos_number_sum = std::accumulate(sos_numbers.begin(), sos_numbers.end(), 0);
-
-
-        allSosIndicies = std::set<int>();
-        sosReindexFlat = std::map<int, int>();
-        sosReindexFlat = std::map<int, int>();
-
-        for (auto& linearMatrixCoefficient: linearMatrixCoefficients) {
-            for (auto it: linearMatrixCoefficient.sosIndexToIndexInArr) {
-                allSosIndicies.insert(it.first);
-            }
-        }
-
-        int allSosCounter = 0;
-        for (auto it: allSosIndicies) {
-            sosReindexFlat[it] = allSosCounter;
-            sosReindexBack[allSosCounter] = it;
-            allSosCounter++;
-        }
-
-
-//        allSosMatrices = M->variable(fus::Domain::inPSDCone(sos_dim, allSosIndicies.size()));
-
-//        fus::Variable::t hackVariable = M->variable(fus::Domain::greaterThan(0.0, 1));
-//        fus::Variable::t hackVariable = M->variable(fus::Domain::unbounded(1));
-
-
-        // TODO(@Sergei) Let's hope it knows how to encode it
-//        positiveLinear = std::make_shared<fus::Variable::t>(M->variable(fus::Domain::greaterThan(0.0, 2 * linear_vars_names.size())));
-//        positiveLinear = std::make_shared<fus::Variable::t>(M->variable(fus::Domain::unbounded(2 * linear_vars_names.size())));
-        std::vector<std::string> linear_vars_names_list;
-
-        for (auto& name: linear_vars_names) {
-            linear_vars_name_to_index[name] = linear_vars_names_list.size();
-            linear_vars_names_list.push_back(name);
-        }
-
-
-        sdpProblemRef = std::make_unique<SdpProblem>(sos_dim);
-        auto& sdpProblem = *sdpProblemRef;
-
-        for (int linearMatrixExpressionIdx = 0; linearMatrixExpressionIdx < linearMatrixCoefficients.size(); linearMatrixExpressionIdx++) {
-            sdpProblem.startNewCondition();
-
-            auto& linearMatrixExpression = linearMatrixCoefficients[linearMatrixExpressionIdx];
-            auto scalarVariables = linearScalarCoefficients[linearMatrixExpressionIdx].getAllUsedVariables();
-            auto constantPart = -rhss[linearMatrixExpressionIdx];
-
-            auto sosIndicies = linearMatrixExpression.getSosIndicies();
-            for (int sosIndicie : sosIndicies)  {
-                auto currentMatrixCoefficient = linearMatrixExpression.getMatrixBySosIndex(sosIndicie);
-                for (int row = 0; row < sos_dim; row++) {
-                    for (int col = 0; col < sos_dim; col++) {
-                        sdpProblem.addSdpConstrainedVariable(sosIndicie, row, col, (*currentMatrixCoefficient)(row, col));
-                    }
-                }
-            }
-
-            for (auto& scalarVariableName: scalarVariables) {
-                auto coeff = linearScalarCoefficients[linearMatrixExpressionIdx].getCoefficientByVariableName(scalarVariableName);
-                sdpProblem.addUnconstrainedVariable(scalarVariableName, coeff.first * 1.0 / coeff.second);
-            }
-
-            sdpProblem.addConstant(static_cast<double>(constantPart));
-
-            sdpProblem.endCondition(LinearMatrixExpressionType::IN_RANGE, 1e-6);
-//            sdpProblem.endCondition(LinearMatrixExpressionType::EQ);
-        }
-
-        // TODO: remove
-//        sdpProblem.startNewCondition();
-//        sdpProblem.addUnconstrainedVariable("_coeff_17_T", 1.0);
-//        sdpProblem.addConstant(-0.0000001);
-//        sdpProblem.endCondition(LinearMatrixExpressionType::GEQ);
-
-        // add L1 consrtraints for linear variables
-
-
-#ifdef SOLVER_DEBUG
-        std::cout << "system v1" << std::endl;
-        sdpProblem.printSystem(std::cout, true);
-
-        std::cout << "\n\n=====================================\n=====================================\n\n";
-#endif
-
-
-
+    int size() const {
+        return names.size();
     }
 
-
-    std::vector<int> sos_numbers;
-
-    int sos_dim;
-    int linear_var_number;
-
-
-    struct LinearMatrixExpression {
-        explicit LinearMatrixExpression(int sos_dim): sos_dim(sos_dim) {}
-
-        int getOrCreateAndGetIndexInArr(int sosInd) {
-            if (sosIndexToIndexInArr.find(sosInd) == sosIndexToIndexInArr.end()) {
-                sosIndexToIndexInArr[sosInd] = matrixCoeffitients.size();
-                matrixCoeffitients.push_back(std::make_shared<ndarray<double, 2>>(shape(sos_dim, sos_dim)));
-            }
-            return sosIndexToIndexInArr[sosInd];
-        }
-
-        void addToMatrix(int sosInd, int i, int j, double val) {
-            if (i == j) {
-                (*matrixCoeffitients[getOrCreateAndGetIndexInArr(sosInd)])(i, j) += val;
-            } else {
-                (*matrixCoeffitients[getOrCreateAndGetIndexInArr(sosInd)])(i, j) += val / 2;
-                (*matrixCoeffitients[getOrCreateAndGetIndexInArr(sosInd)])(j, i) += val / 2;
-            }
-        }
-
-        std::shared_ptr<ndarray<double, 2>> getMatrixBySosIndex(int sosInd) {
-            return matrixCoeffitients[sosIndexToIndexInArr[sosInd]];
-        }
-
-        std::vector<int> getSosIndicies() {
-            std::vector<int> ans;
-            for (auto it: sosIndexToIndexInArr) {
-                ans.push_back(it.first);
-            }
-            return ans;
-        }
-
-        std::map<int, int> sosIndexToIndexInArr;
-        std::vector<std::shared_ptr<ndarray<double, 2>>> matrixCoeffitients;
-        int sos_dim;
-    };
-
-
-
-
-    std::vector<LinearMatrixExpression> linearMatrixCoefficients;
-    std::vector<LinearScalarExpression> linearScalarCoefficients;
-
-
-    std::vector<std::map<std::string, std::pair<long long, long long>>> linear_vars_name_to_coefficients;
-    std::set<std::string> linear_vars_names;
-    std::map<std::string, size_t> linear_vars_name_to_index;
-    std::shared_ptr<fus::Variable::t> positiveLinear;
-    std::vector<double> rhss;
-
-    fus::Variable::t allSosMatrices;
-    std::set<int> allSosIndicies;
-    std::map<int, int> sosReindexFlat;
-    std::map<int, int> sosReindexBack;
-
-    std::unique_ptr<SdpProblem> sdpProblemRef;
-
+private:
+    std::unordered_map<std::string, int> nameToId;
+    std::vector<std::string> names;
+    const SymbolicEnvironment* environment = nullptr;
+    std::vector<int> symbolToId;
 };
 
 std::vector<QMonomial> getMonomialVecotor(const QMonomial& x, const QMonomial& y, const int highestPower);
 
-class SolverCsdp {
+// the coefficient matching equalities of the estimator as an SdpProblem, solved by one of the SdpBackend
+class Solver {
 private:
     struct LinearScalarExpression {
 
-        static long long gcdll(long long a, long long b) {
-            if (a == 0) {
-                return b;
-            }
-            return gcdll(b % a, a);
-        }
-
-        static std::pair<long long, long long> addTwoFractions(std::pair<long long, long long> a, std::pair<long long, long long> b) {
-            long long newEnumer = a.first * b.second + b.first * a.second;
-            long long newDenom = a.second * b.second;
-            long long gcd = gcdll(newEnumer, newDenom);
-            return std::make_pair(newEnumer / gcd, newDenom / gcd);
-        }
-
-        int getVariableIndexOrCreate(std::string varName) {
-            if (variableNameToCoefficient.find(varName) == variableNameToCoefficient.end()) {
-                variableNameToCoefficient[varName] = variableNames.size();
-                variableNames.push_back(varName);
-                coefficients.push_back(std::make_pair(0, 1));
+        // variable is the id in freeVariables
+        int getVariableIndexOrCreate(int variable) {
+            auto inserted = variableToIndex.emplace(variable, variables.size());
+            if (inserted.second) {
+                variables.push_back(variable);
+                coefficients.push_back(0.0);
             }
-            return variableNameToCoefficient[varName];
+            return inserted.first->second;
         }
 
-        std::vector<std::string> getAllUsedVariables() {
-            return variableNames;
+        const std::vector<int>& getAllUsedVariables() const {
+            return variables;
         }
 
-        std::pair<long long, long long> getCoefficientByVariableName(std::string varName) {
-            return coefficients[variableNameToCoefficient[varName]];
+        // of the k-th variable of getAllUsedVariables()
+        double getCoefficient(int k) const {
+            return coefficients[k];
         }
 
-        void addCoeff(std::string varName, long long enumer, long long demon) {
-            int varIdx = getVariableIndexOrCreate(varName);
-            coefficients[varIdx] = addTwoFractions(coefficients[varIdx], std::make_pair(enumer, demon));
+        void addCoeff(int variable, double coefficient) {
+            coefficients[getVariableIndexOrCreate(variable)] += coefficient;
         }
 
-        std::map<std::string, long long> variableNameToCoefficient;
-        std::vector<std::string> variableNames;
-        std::vector<std::pair<long long, long long>> coefficients;
+        std::map<int, int> variableToIndex;
+        std::vector<int> variables;
+        std::vector<double> coefficients;
     };
 
 
 public:
-    SolverCsdp(int sos_dim, int linear_var_number, const std::string& instance_name) : sos_dim(sos_dim),
-                                                                                        linear_var_number(linear_var_number) {
+    Solver(int sos_dim, SdpEngine engine) : sos_dim(sos_dim), backend(createSdpBackend(engine)) {
     }
 
-    ~SolverCsdp() {
+    // any engine, also one createSdpBackend does not know about
+    Solver(int sos_dim, std::unique_ptr<SdpBackend> backend) : sos_dim(sos_dim), backend(std::move(backend)) {
     }
 
+    // a row is sum of coefficient * gram entry + sum of coefficient * free variable + constant == 0, the gram entries
+    // come with their indices already
+    void addLinearEqualityConstraints(const SparseConstraintSystem& system) {
+        for (const auto& blockSize: system.blockSizes) {
+            setSosDim(blockSize.first, blockSize.second);
+        }
 
+        for (int row = 0; row < system.getNumberOfRows(); row++) {
+            linearMatrixCoefficients.emplace_back(sos_dim);
+            linearScalarCoefficients.emplace_back();
 
-
-    int getMaxLvarIndex(const QPolynomial& qpoly) {
-        int maxLvarIndex = -1;
-
-        for (const auto& monom: qpoly.getMonomials()) {
-            if (monom.isConstant()) {
-                continue;
-            }
-            if (!monom.isLinear()) {
-                throw std::runtime_error("Not a linear variable");
+            for (size_t k = system.gramRowStart[row]; k < system.gramRowStart[row + 1]; k++) {
+                const auto& entry = system.gramEntries[k];
+                linearMatrixCoefficients.back().addToMatrix(entry.block, getSosDim(entry.block), entry.row, entry.col,
+                                                            entry.coefficient.toDouble());
             }
 
-            std::string const name = monom.getNameIfLinear();
-            if (name[0] != 'l' or name[1] != '_') {
-                continue;
+            for (size_t k = system.freeRowStart[row]; k < system.freeRowStart[row + 1]; k++) {
+                const auto& entry = system.freeEntries[k];
+                linearScalarCoefficients.back().addCoeff(freeVariables.getOrCreate(*system.environment, entry.symbolId),
+                                                         entry.coefficient.toDouble());
             }
 
-            auto tokens = parseLVarName(name);
-            maxLvarIndex = std::max(maxLvarIndex, tokens[0]);
-        }
-
-        if (maxLvarIndex == -1) {
-            throw std::runtime_error("No linear variables");
+            rhss.push_back(-system.constants[row].toDouble());
         }
-        return maxLvarIndex;
     }
 
 
 
-    void addLinearEqualityConstraint(const QPolynomial& lhs) {
-        // TODO(@sergey): add auto remapping of lvars to not waste a space
-
-
-
-        double total_rhs = 0;
-        linear_vars_name_to_coefficients.emplace_back();
-        linearMatrixCoefficients.emplace_back(sos_dim);
-        linearScalarCoefficients.emplace_back();
-
-
-
-
-        for (const auto& monom: lhs.getMonomials()) {
-            if (monom.isConstant()) {
-                total_rhs -= monom.getEnumerator() * 1.0 / monom.getDenominator();
-                continue;
-            }
-            if (!monom.isLinear()) {
-                throw std::runtime_error("Not a linear variable");
-            }
-
-            std::string const name = monom.getNameIfLinear();
-
-
-            auto enumer = monom.getEnumerator();
-            auto denom = monom.getDenominator();
-
+    void setPresolve(bool presolve) {
+        this->presolve = presolve;
+    }
 
-            if (name[0] != 'l' or name[1] != '_') { // non-constrained variable (e.g. a), will be encoded as a_p - a_n = a, a_p >= 0, a_n >= 0
-//                auto x  = std::make_shared<Variable::t>(M->variable(std::string(name)));
-//                linear_vars.push_back(x);
-//                linear_vars_name_to_var[name] = x;
-                linear_vars_name_to_coefficients.back()[name] = {monom.getEnumerator(), monom.getDenominator()};
-                linear_vars_names.insert(name);
-                linearScalarCoefficients.back().addCoeff(name, enumer, denom);
-                continue;
+    // writes the sdp instead of solving it, see SdpProblem::writeProblem; it is the presolved one if presolve is on
+    void dump(const std::string& fileName) {
+        build();
+        if (presolve) {
+            presolveRef = std::make_unique<SdpPresolve>(*sdpProblemRef);
+            presolveRef->printStatistics(std::cout);
+            if (presolveRef->isInfeasible()) {
+                throw std::runtime_error("Presolve found the system infeasible, there is nothing to write");
             }
-
-
-            auto tokens = parseLVarName(name);
-
-            debugStream << "name: " << name << std::endl;
-
-
-            // TODO(@Sergei) multiply RHS by it
-//            if (denom != 1) {
-//                throw std::runtime_error("Not a linear variable");
-//            }
-
-            debugStream << "\nadding constraint " << tokens[0] << " " << tokens[1] << " " << tokens[2] << " " << enumer << std::endl;
-            linearMatrixCoefficients.back().addToMatrix(tokens[0], tokens[1], tokens[2], enumer * 1.0 / denom);
-            debugStream << "constraint added\n" << std::endl;
-
         }
-        rhss.push_back(total_rhs);
+        (presolve ? presolveRef->getReduced() : *sdpProblemRef).writeProblem(fileName);
     }
 
-
-
     bool is_feasible() {
         build();
-//        M->setLogHandler([=](const std::string & msg) { std::cout << msg << std::flush; });
-
-        // open file csdp.dat-s for writing
-        std::ofstream csdpFile(".csdp.dat-s");
-        sdpProblemRef->writeCsdp(csdpFile);
-        csdpFile.close();
-
-        // run csdp
-        std::string csdpCommand = "csdp .csdp.dat-s .csdp.result";
-
-        std::cout << "Running CSDP" << std::endl;
-        std::cout << csdpCommand << std::endl;
-        std::system(csdpCommand.c_str());
-        std::cout << "CSDP finished" << std::endl;
-
-        // read csdp result
-        std::ifstream csdpResultFile(".csdp.result");
-        auto answer = sdpProblemRef->readCsdp(csdpResultFile);
-
-        // TODO: increase precision
-        sdpProblemRef->setAllowedError(1e-4);
-        sdpProblemRef->setSolution(answer.first, answer.second);
 
+        if (!presolve) {
+            return solve(*sdpProblemRef);
+        }
 
-        // if not true, setSolution would throw an exception
+        presolveRef = std::make_unique<SdpPresolve>(*sdpProblemRef);
+        presolveRef->printStatistics(std::cout);
+        if (presolveRef->isInfeasible()) {
+            return false;
+        }
+        if (!presolveRef->isSolved() && !solve(presolveRef->getReduced())) {
+            return false;
+        }
+        presolveRef->postsolve();
         return true;
     }
 
-    void print() {
-        for (int displacement = 0; displacement < rhss.size(); displacement++) {
-            int sos_number = sos_numbers[displacement];
-            for (int i = 0; i < sos_number; i++) {
-                for (int j = 0; j < sos_dim; j++) {
-                    for (int k = 0; k < sos_dim; k++) {
-                        // TODO: uncomment fix
-//                        std::cout << (*linearMatrixCoefficients[displacement * sos_number + i])(j, k) << " ";
-                    }
-                    std::cout << std::endl;
-                }
-            }
-            std::cout << " == " << rhss[displacement] << std::endl;
-        }
+    // soses are sos_dim x sos_dim unless set otherwise
+    void setSosDim(int sosIndex, int dim) {
+        sosDims[sosIndex] = dim;
     }
-    std::shared_ptr<ndarray<int,1>> nint(const std::vector<int> &X)    { return new_array_ptr<int>(X); }
 
+    int getSosDim(int sosIndex) const {
+        auto it = sosDims.find(sosIndex);
+        return it == sosDims.end() ? sos_dim : it->second;
+    }
 
-    std::map<std::string, double> getSolution2() {
-        return sdpProblemRef->getSolutionAsMap();
+
+    const SdpProblem::Solution& getSolution() {
+        return sdpProblemRef->getSolution();
+    }
+
+    // of the last solve, the one of the reduced problem if presolve is on
+    const SdpBackendResult& getBackendResult() const {
+        return backendResult;
     }
 
 
 private:
 
 
-    void build() {
-//        int sos_number_sum = std::accumulate(sos_numbers.begin(), sos_numbers.end(), 0);
-
+    bool solve(SdpProblem& problem) {
+        std::cout << "Running " << backend->getName() << std::endl;
+        backendResult = backend->solve(problem);
+        std::cout << backend->getName() << " finished: setup " << backendResult.setupMilliseconds << "ms, solve "
+                  << backendResult.solveMilliseconds << "ms" << std::endl;
+        if (!backendResult.isSolved()) {
+            return false;
+        }
 
-        allSosIndicies = std::set<int>();
-        sosReindexFlat = std::map<int, int>();
-        sosReindexFlat = std::map<int, int>();
+        problem.setAllowedError(backend->getAllowedError());
+        problem.setSolution(backendResult.solution);
+        return true;
+    }
 
+    void build() {
+        std::set<int> allSosIndicies;
         for (auto& linearMatrixCoefficient: linearMatrixCoefficients) {
-            for (auto it: linearMatrixCoefficient.sosIndexToIndexInArr) {
+            for (const auto& it: linearMatrixCoefficient.gramCoefficients) {
                 allSosIndicies.insert(it.first);
             }
         }
 
-        int allSosCounter = 0;
-        for (auto it: allSosIndicies) {
-            sosReindexFlat[it] = allSosCounter;
-            sosReindexBack[allSosCounter] = it;
-            allSosCounter++;
-        }
-
-
-//        allSosMatrices = M->variable(fus::Domain::inPSDCone(sos_dim, allSosIndicies.size()));
-
-//        fus::Variable::t hackVariable = M->variable(fus::Domain::greaterThan(0.0, 1));
-//        fus::Variable::t hackVariable = M->variable(fus::Domain::unbounded(1));
-
-
-        // TODO(@Sergei) Let's hope it knows how to encode it
-//        positiveLinear = std::make_shared<fus::Variable::t>(M->variable(fus::Domain::greaterThan(0.0, 2 * linear_vars_names.size())));
-//        positiveLinear = std::make_shared<fus::Variable::t>(M->variable(fus::Domain::unbounded(2 * linear_vars_names.size())));
-        std::vector<std::string> linear_vars_names_list;
-
-        for (auto& name: linear_vars_names) {
-            linear_vars_name_to_index[name] = linear_vars_names_list.size();
-            linear_vars_names_list.push_back(name);
-        }
-
-
         sdpProblemRef = std::make_unique<SdpProblem>(sos_dim);
         auto& sdpProblem = *sdpProblemRef;
+        std::vector<int> freeVariableInnerIndex(freeVariables.size(), -1);
+        for (auto sosIndex: allSosIndicies) {
+            sdpProblem.setMatrixSize(sosIndex, getSosDim(sosIndex));
+        }
 
         for (int linearMatrixExpressionIdx = 0; linearMatrixExpressionIdx < linearMatrixCoefficients.size(); linearMatrixExpressionIdx++) {
             sdpProblem.startNewCondition();
 
             auto& linearMatrixExpression = linearMatrixCoefficients[linearMatrixExpressionIdx];
-            auto scalarVariables = linearScalarCoefficients[linearMatrixExpressionIdx].getAllUsedVariables();
+            const auto& scalarVariables = linearScalarCoefficients[linearMatrixExpressionIdx].getAllUsedVariables();
             auto constantPart = -rhss[linearMatrixExpressionIdx];
 
             auto sosIndicies = linearMatrixExpression.getSosIndicies();
             for (int sosIndicie : sosIndicies)  {
-                auto currentMatrixCoefficient = linearMatrixExpression.getMatrixBySosIndex(sosIndicie);
-                for (int row = 0; row < sos_dim; row++) {
-                    for (int col = 0; col < sos_dim; col++) {
-                        sdpProblem.addSdpConstrainedVariable(sosIndicie, row, col, (*currentMatrixCoefficient)(row, col));
+                const auto& currentMatrixCoefficient = linearMatrixExpression.getMatrixBySosIndex(sosIndicie);
+                for (const auto& entry : currentMatrixCoefficient.entries) {
+                    if (getSosDim(sosIndicie) == 1) {
+                        // a 1x1 psd matrix is a nonnegative scalar, it does not need a block of its own
+                        sdpProblem.addGramScalar(sosIndicie, entry.value);
+                    } else {
+                        sdpProblem.addSdpConstrainedVariable(sosIndicie, entry.row, entry.col, entry.value);
                     }
                 }
             }
 
-            for (auto& scalarVariableName: scalarVariables) {
-                auto coeff = linearScalarCoefficients[linearMatrixExpressionIdx].getCoefficientByVariableName(scalarVariableName);
-                sdpProblem.addUnconstrainedVariable(scalarVariableName, coeff.first * 1.0 / coeff.second);
+            for (int k = 0; k < scalarVariables.size(); k++) {
+                // the names are registered in the order of the first use, as the sdpa output expects
+                auto& innerIndex = freeVariableInnerIndex[scalarVariables[k]];
+                if (innerIndex < 0) {
+                    innerIndex = sdpProblem.encodeOrCreateUnconstrainedVariableNameAsInner(freeVariables.getName(scalarVariables[k]));
+                }
+                auto coeff = linearScalarCoefficients[linearMatrixExpressionIdx].getCoefficient(k);
+                sdpProblem.addUnconstrainedVariableByIndex(innerIndex, coeff);
             }
 
             sdpProblem.addConstant(static_cast<double>(constantPart));
 
-            sdpProblem.endCondition(LinearMatrixExpressionType::EQ);
+            sdpProblem.endCondition(backend->getConditionType(), backend->getConditionRange());
         }
 
         // TODO: remove
@@ -690,45 +283,34 @@ private:
 
     }
 
-    std::vector<int> sos_numbers;
-
     int sos_dim;
-    int linear_var_number;
+    std::map<int, int> sosDims;
 
+    // only the nonzero gram entries of a row are kept, value is the coefficient of l_<sos>_<row>_<col>
     struct LinearMatrixExpression {
         explicit LinearMatrixExpression(int sos_dim): sos_dim(sos_dim) {}
 
-        int getOrCreateAndGetIndexInArr(int sosInd) {
-            if (sosIndexToIndexInArr.find(sosInd) == sosIndexToIndexInArr.end()) {
-                sosIndexToIndexInArr[sosInd] = matrixCoeffitients.size();
-                matrixCoeffitients.push_back(std::make_shared<ndarray<double, 2>>(shape(sos_dim, sos_dim)));
-            }
-            return sosIndexToIndexInArr[sosInd];
-        }
-
-        void addToMatrix(int sosInd, int i, int j, double val) {
-            if (i == j) {
-                (*matrixCoeffitients[getOrCreateAndGetIndexInArr(sosInd)])(i, j) += val;
-            } else {
-                (*matrixCoeffitients[getOrCreateAndGetIndexInArr(sosInd)])(i, j) += val / 2;
-                (*matrixCoeffitients[getOrCreateAndGetIndexInArr(sosInd)])(j, i) += val / 2;
+        void addToMatrix(int sosInd, int dim, int i, int j, double val) {
+            auto matrix = gramCoefficients.find(sosInd);
+            if (matrix == gramCoefficients.end()) {
+                matrix = gramCoefficients.emplace(sosInd, SparseSymmetricMatrix(dim)).first;
             }
+            matrix->second.add(i, j, val);
         }
 
-        std::shared_ptr<ndarray<double, 2>> getMatrixBySosIndex(int sosInd) {
-            return matrixCoeffitients[sosIndexToIndexInArr[sosInd]];
+        const SparseSymmetricMatrix& getMatrixBySosIndex(int sosInd) {
+            return gramCoefficients.at(sosInd);
         }
 
         std::vector<int> getSosIndicies() {
             std::vector<int> ans;
-            for (auto it: sosIndexToIndexInArr) {
+            for (const auto& it: gramCoefficients) {
                 ans.push_back(it.first);
             }
             return ans;
         }
 
-        std::map<int, int> sosIndexToIndexInArr;
-        std::vector<std::shared_ptr<ndarray<double, 2>>> matrixCoeffitients;
+        std::map<int, SparseSymmetricMatrix> gramCoefficients;
         int sos_dim;
     };
 
@@ -739,20 +321,16 @@ private:
     std::vector<LinearScalarExpression> linearScalarCoefficients;
 
 
-    std::vector<std::map<std::string, std::pair<long long, long long>>> linear_vars_name_to_coefficients;
-    std::set<std::string> linear_vars_names;
-    std::map<std::string, size_t> linear_vars_name_to_index;
-
-    // TODO: remove csdp dependecy on fusion
-    std::shared_ptr<fus::Variable::t> positiveLinear;
+    FreeVariableRegistry freeVariables;
     std::vector<double> rhss;
 
-    fus::Variable::t allSosMatrices;
-    std::set<int> allSosIndicies;
-    std::map<int, int> sosReindexFlat;
-    std::map<int, int> sosReindexBack;
-
     std::unique_ptr<SdpProblem> sdpProblemRef;
+    // the backend solves the reduced problem of presolveRef, the solution is written back to sdpProblemRef
+    std::unique_ptr<SdpPresolve> presolveRef;
+    bool presolve = true;
+
+    std::unique_ptr<SdpBackend> backend;
+    SdpBackendResult backendResult;
 
 };
 
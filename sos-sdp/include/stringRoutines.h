@@ -8,10 +8,6 @@
 #include <vector>
 #include <string>
 
-bool isLVar(const std::string& name);
-
-std::vector<int> parseLVarName(std::string name);
-
 void replaceAllInplace(std::string& str, const std::string& from, const std::string& to);
 
 std::string replaceAll(const std::string& str, const std::string& from, const std::string& to);
@@ -10,6 +10,8 @@
 #include <vector>
 #include <set>
 #include <map>
+#include <memory>
+#include <unordered_map>
 #include <stdexcept>
 #include <ostream>
 #include <algorithm>
@@ -18,6 +20,9 @@
 #include <sstream>
 
 #include "hacks.h"
+#include "internTable.h"
+#include "packedExponents.h"
+#include "rational.h"
 
 inline long long gcd_pos(long long a, long long b) {
     while (b != 0) {
@@ -45,6 +50,16 @@ namespace symbolic_ring {
 
     class SymbolicEnvironment;
 
+    class QPolynomial;
+
+    class SymbolicPolynomial;
+
+    class QPolynomialAccumulator;
+
+    class SymbolicPolynomialAccumulator;
+
+    class LinearForm;
+
     class HasSymbolicEnvironment {
     public:
         explicit HasSymbolicEnvironment(SymbolicEnvironment *const environment) : environment(environment) {}
@@ -81,20 +96,19 @@ namespace symbolic_ring {
         virtual long long getDenominator() const = 0;
     };
 
+    // a handle: the id of the symbol in its environment, the name is kept there
     class Symbol : public HasSymbolicEnvironment {
         friend class SymbolicEnvironment;
 
     public:
-        std::string getName() const {
-            return name;
-        }
+        const std::string &getName() const;
 
-//    const SymbolicEnvironment* getEnvironment() const {
-//        return environment;
-//    }
+        int getId() const {
+            return id;
+        }
 
         bool operator==(const Symbol &rhs) const {
-            return name == rhs.name &&
+            return id == rhs.id &&
                    this->viewEnvironment() == rhs.viewEnvironment();
         }
 
@@ -102,11 +116,10 @@ namespace symbolic_ring {
             return !(rhs == *this);
         }
 
+        // by the order of creation
         bool operator<(const Symbol &rhs) const {
-            if (name < rhs.name)
-                return true;
-            if (rhs.name < name)
-                return false;
+            if (id != rhs.id)
+                return id < rhs.id;
             return this->viewEnvironment() < rhs.viewEnvironment();
         }
 
@@ -123,16 +136,14 @@ namespace symbolic_ring {
         }
 
         friend std::ostream &operator<<(std::ostream &os, const Symbol &symbol) {
-            os << symbol.name;
+            os << symbol.getName();
             return os;
         }
 
     private:
-        Symbol(std::string name, SymbolicEnvironment *environment) : name(std::move(name)),
-                                                                     HasSymbolicEnvironment(environment) {}
+        Symbol(int id, SymbolicEnvironment *environment) : HasSymbolicEnvironment(environment), id(id) {}
 
-        const std::string name;
-//    const SymbolicEnvironment* environment;
+        const int id;
     };
 
 
@@ -148,11 +159,9 @@ namespace symbolic_ring {
 
         friend QMonomial mul(const Symbol &l, const QMonomial &r);
 
-        friend QMonomial mul(const QMonomial &l, long long r);
-
-        friend QMonomial mul(long long l, const QMonomial &r);
+        friend QMonomial mul(const QMonomial &l, const Rational &r);
 
-        friend QMonomial div(const QMonomial &l, long long r);
+        friend QMonomial div(const QMonomial &l, const Rational &r);
 
         friend QMonomial add(const QMonomial &l, const QMonomial &r);
 
@@ -160,24 +169,43 @@ namespace symbolic_ring {
 
         friend QMonomial rename(const QMonomial &l, const std::string &old_name, const std::string &new_name);
 
+        friend class QPolynomial;
+
+        friend class LinearForm;
+
+        friend class SymbolicMonomial;
+
+        friend QPolynomial substitute(const QMonomial &monomial, const Symbol &to_substitute, const QPolynomial &polynomial);
+
+        friend SymbolicPolynomial composeInBase(const SymbolicPolynomial &polynomial, const std::vector<Symbol> &symbols,
+                                                const std::vector<QPolynomial> &substitutions);
+
         QMonomial(const Symbol &symbol, unsigned int pow = 1, long long enumerator = 1, long long decominator = 1)
-                : HasSymbolicEnvironment(symbol.viewEnvironment()), enumerator(enumerator), denominator(decominator) {
-//        variables.push_back(symbol.getName());
-//        powers.push_back(1);
-            variables_and_powers.emplace_back(symbol.getName(), pow);
+                : HasSymbolicEnvironment(symbol.viewEnvironment()),
+                  exponents(PackedExponents::single(symbol.getId(), pow)), coefficient(enumerator, decominator) {
         }
 
         QMonomial(const QMonomial &other) : HasSymbolicEnvironment(other.viewEnvironment()) {
-            variables_and_powers = other.variables_and_powers;
-            enumerator = other.enumerator;
-            denominator = other.denominator;
+            exponents = other.exponents;
+            coefficient = other.coefficient;
         }
 
+        QMonomial(QMonomial &&other) noexcept: HasSymbolicEnvironment(other.viewEnvironment()),
+                                               exponents(std::move(other.exponents)),
+                                               coefficient(std::move(other.coefficient)) {}
+
         QMonomial &operator=(const QMonomial &other) {
             if (this != &other) {
-                variables_and_powers = other.variables_and_powers;
-                enumerator = other.enumerator;
-                denominator = other.denominator;
+                exponents = other.exponents;
+                coefficient = other.coefficient;
+            }
+            return *this;
+        }
+
+        QMonomial &operator=(QMonomial &&other) noexcept {
+            if (this != &other) {
+                exponents = std::move(other.exponents);
+                coefficient = std::move(other.coefficient);
             }
             return *this;
         }
@@ -190,13 +218,6 @@ namespace symbolic_ring {
 
         bool operator!=(const QMonomial &rhs) const;
 
-        std::vector<std::pair<std::string, int>> getOrderedVariablesAndPowers() const {
-            auto variables_and_powers_copy = std::vector<std::pair<std::string, int>>(variables_and_powers.begin(),
-                                                                                      variables_and_powers.end());
-            std::sort(variables_and_powers_copy.begin(), variables_and_powers_copy.end());
-            return variables_and_powers_copy;
-        }
-
         bool operator<(const QMonomial &rhs) const;
 
         bool operator>(const QMonomial &rhs) const;
@@ -205,24 +226,38 @@ namespace symbolic_ring {
 
         bool operator>=(const QMonomial &rhs) const;
 
+        // canonical enumerator and denominator, throw if the coefficient does not fit into long long
         long long int getEnumerator() const override;
 
         long long int getDenominator() const override;
 
+        const Rational &getCoefficient() const {
+            return coefficient;
+        }
+
         bool isUnitary() const {
-            return getEnumerator() == getDenominator();
+            return coefficient.isOne();
         }
 
         friend std::ostream &operator<<(std::ostream &os, const QMonomial &monomial);
 
-        const std::vector<std::pair<std::string, int>> &getVariablesAndPowers() const;
+        // names are resolved through the environment, prefer getExponents() on hot paths
+        std::vector<std::pair<std::string, int>> getVariablesAndPowers() const;
+
+        const PackedExponents &getExponents() const {
+            return exponents;
+        }
+
+        unsigned int getDegree() const {
+            return exponents.getDegree();
+        }
 
         bool isLinear() const {
-            return variables_and_powers.size() == 1 && variables_and_powers[0].second == 1;
+            return exponents.size() == 1 && exponents.powerAt(0) == 1;
         }
 
         bool isConstant() const {
-            return variables_and_powers.empty();
+            return exponents.isEmpty();
         }
 
         std::string toString() const {
@@ -232,24 +267,27 @@ namespace symbolic_ring {
         }
 
 
-        std::string getNameIfLinear() const {
-            if (variables_and_powers.size() == 1 && variables_and_powers[0].second == 1) {
-                return variables_and_powers[0].first;
+        std::string getNameIfLinear() const;
+
+        int getSymbolIdIfLinear() const {
+            if (isLinear()) {
+                return exponents.symbolIdAt(0);
             }
             throw std::runtime_error("Not linear " + toString());
         }
 
     private:
         QMonomial(long long enumerator, long long denominator, SymbolicEnvironment *const environment) :
-                enumerator(enumerator),
-                denominator(denominator),
-                HasSymbolicEnvironment(environment) {}
-
-//    std::vector<std::string> variables;
-//    std::vector<int> powers;
-        std::vector<std::pair<std::string, int>> variables_and_powers;
-        long long enumerator;
-        long long denominator;
+                HasSymbolicEnvironment(environment),
+                coefficient(enumerator, denominator) {}
+
+        QMonomial(PackedExponents exponents, Rational coefficient, SymbolicEnvironment *const environment) :
+                HasSymbolicEnvironment(environment),
+                exponents(std::move(exponents)),
+                coefficient(std::move(coefficient)) {}
+
+        PackedExponents exponents;
+        Rational coefficient;
 //    const SymbolicEnvironment* environment;
     };
 
@@ -261,10 +299,14 @@ namespace symbolic_ring {
 
     QMonomial mul(const Symbol &l, const QMonomial &r);
 
+    QMonomial mul(const QMonomial &l, const Rational &r);
+
     QMonomial mul(const QMonomial &l, long long r);
 
     QMonomial mul(long long l, const QMonomial &r);
 
+    QMonomial div(const QMonomial &l, const Rational &r);
+
     QMonomial div(const QMonomial &l, long long r);
 
     QMonomial add(const QMonomial &l, const QMonomial &r);
@@ -285,14 +327,22 @@ namespace symbolic_ring {
 
         friend QPolynomial mul(const QPolynomial &l, const QPolynomial &r);
 
+        friend QPolynomial mul(const QPolynomial &l, const Rational &r);
+
         friend QPolynomial mul(const QPolynomial &l, long long r);
 
         friend QPolynomial mul(long long l, const QPolynomial &r);
 
+        friend QPolynomial div(const QPolynomial &l, const Rational &r);
+
         friend QPolynomial div(const QPolynomial &l, long long r);
 
         friend QPolynomial add(const QPolynomial &l, const QPolynomial &r);
 
+        friend class QPolynomialAccumulator;
+
+        friend class LinearForm;
+
 
 //    const SymbolicEnvironment* getEnvironment() const {
 //        return environment;
@@ -319,6 +369,9 @@ namespace symbolic_ring {
             monomials = other.monomials;
         }
 
+        QPolynomial(QPolynomial &&other) noexcept: HasSymbolicEnvironment(other.viewEnvironment()),
+                                                   monomials(std::move(other.monomials)) {}
+
         QPolynomial &operator=(const QPolynomial &other) {
             if (this != &other) {
                 monomials = other.monomials;
@@ -326,6 +379,26 @@ namespace symbolic_ring {
             return *this;
         }
 
+        QPolynomial &operator=(QPolynomial &&other) noexcept {
+            if (this != &other) {
+                monomials = std::move(other.monomials);
+            }
+            return *this;
+        }
+
+        // in-place arithmetic, the result is reduced the same way as the one of add(..) / mul(..)
+        QPolynomial &operator+=(const QPolynomial &other);
+
+        QPolynomial &operator-=(const QPolynomial &other);
+
+        QPolynomial &operator*=(const QPolynomial &other);
+
+        QPolynomial &operator*=(const Rational &factor);
+
+        QPolynomial &scale(const Rational &factor);
+
+        QPolynomial &negate();
+
         void reduce();
 
         friend std::ostream &operator<<(std::ostream &os, const QPolynomial &polynomial);
@@ -346,6 +419,103 @@ namespace symbolic_ring {
 
     QPolynomial substitute(const QMonomial &monomial, const Symbol &to_substitute, const QPolynomial &polynomial);
 
+    // overloads for temporaries, the left operand is reused instead of copied
+    QPolynomial add(QPolynomial &&l, const QPolynomial &r);
+
+    QPolynomial mul(QPolynomial &&l, const Rational &r);
+
+    QPolynomial mul(QPolynomial &&l, long long r);
+
+
+    // Affine form c + a_1 * u_1 + ... + a_k * u_k in the unknowns (template coefficients, gram matrix entries),
+    // used as the coefficient of SymbolicMonomial. The terms are kept sorted by symbol id, the constant is stored
+    // as the term with CONSTANT_ID, zero terms are dropped.
+    class LinearForm : public HasSymbolicEnvironment {
+    public:
+        static const int CONSTANT_ID = -1;
+
+        struct Term {
+            int symbolId;
+            Rational coefficient;
+        };
+
+        explicit LinearForm(SymbolicEnvironment *environment, const Rational &constant = 0);
+
+        explicit LinearForm(const Symbol &symbol);
+
+        // throws if the polynomial is not affine
+        explicit LinearForm(const QPolynomial &polynomial);
+
+        // accepts unsorted terms, the terms with the same symbol id are summed up
+        static LinearForm fromTerms(SymbolicEnvironment *environment, std::vector<Term> terms);
+
+        LinearForm(const LinearForm &other) : HasSymbolicEnvironment(other.viewEnvironment()), terms(other.terms) {}
+
+        LinearForm(LinearForm &&other) noexcept: HasSymbolicEnvironment(other.viewEnvironment()),
+                                                 terms(std::move(other.terms)) {}
+
+        LinearForm &operator=(const LinearForm &other) {
+            if (this != &other) {
+                terms = other.terms;
+            }
+            return *this;
+        }
+
+        LinearForm &operator=(LinearForm &&other) noexcept {
+            if (this != &other) {
+                terms = std::move(other.terms);
+            }
+            return *this;
+        }
+
+        LinearForm &operator+=(const LinearForm &other);
+
+        LinearForm &scale(const Rational &factor);
+
+        const std::vector<Term> &getTerms() const {
+            return terms;
+        }
+
+        bool isZero() const {
+            return terms.empty();
+        }
+
+        bool isConstant() const {
+            return terms.empty() || (terms.size() == 1 && terms[0].symbolId == CONSTANT_ID);
+        }
+
+        QPolynomial toQPolynomial() const;
+
+        friend LinearForm add(const LinearForm &l, const LinearForm &r);
+
+        friend LinearForm scale(const LinearForm &l, const Rational &factor);
+
+        // one of the factors has to be constant, throws otherwise
+        friend LinearForm mul(const LinearForm &l, const LinearForm &r);
+
+        friend LinearForm substitute(const LinearForm &form, const Symbol &to_substitute, const LinearForm &substitution);
+
+        friend std::ostream &operator<<(std::ostream &os, const LinearForm &form);
+
+        bool operator==(const LinearForm &rhs) const;
+
+        bool operator<(const LinearForm &rhs) const;
+
+    private:
+        LinearForm(SymbolicEnvironment *environment, std::vector<Term> sortedTerms) :
+                HasSymbolicEnvironment(environment), terms(std::move(sortedTerms)) {}
+
+        std::vector<Term> terms;
+    };
+
+    LinearForm add(const LinearForm &l, const LinearForm &r);
+
+    LinearForm scale(const LinearForm &l, const Rational &factor);
+
+    LinearForm mul(const LinearForm &l, const LinearForm &r);
+
+    LinearForm substitute(const LinearForm &form, const Symbol &to_substitute, const LinearForm &substitution);
+
 
     class SymbolicMonomial : public HasSymbolicEnvironment {
     public:
@@ -361,8 +531,11 @@ namespace symbolic_ring {
 
         friend SymbolicMonomial add(const SymbolicMonomial &l, const SymbolicMonomial &r);
 
+        SymbolicMonomial(const QMonomial &qmonomial, const LinearForm &coefficient) :
+                HasSymbolicEnvironment(qmonomial.viewEnvironment()), qmonomial(qmonomial), coefficient(coefficient) {}
+
         SymbolicMonomial(const QMonomial &qmonomial, const QPolynomial &qpolynomial) :
-                qmonomial(qmonomial), qcoefficient(qpolynomial), HasSymbolicEnvironment(qmonomial.viewEnvironment()) {}
+                SymbolicMonomial(qmonomial, LinearForm(qpolynomial)) {}
 
         explicit SymbolicMonomial(const QPolynomial &qpolynomial);
 
@@ -372,23 +545,45 @@ namespace symbolic_ring {
             return qmonomial.isUnitary();
         }
 
-        void unitize() {
-            auto enumer = qmonomial.getEnumerator();
-            auto denom = qmonomial.getDenominator();
+        // moves the rational factor of the base into the coefficient, throws if the base is zero
+        void unitize();
 
-            qmonomial = QMonomial(div(mul(qmonomial, denom), enumer));
-            qcoefficient = QPolynomial(div(mul(qcoefficient, enumer), denom));
-        }
+        SymbolicMonomial(const SymbolicMonomial &other) : HasSymbolicEnvironment(other.viewEnvironment()),
+                                                          qmonomial(other.qmonomial),
+                                                          coefficient(other.coefficient) {}
+
+        SymbolicMonomial(SymbolicMonomial &&other) noexcept: HasSymbolicEnvironment(other.viewEnvironment()),
+                                                             qmonomial(std::move(other.qmonomial)),
+                                                             coefficient(std::move(other.coefficient)) {}
 
         SymbolicMonomial &operator=(const SymbolicMonomial &other) {
             if (this != &other) {
                 qmonomial = other.qmonomial;
-                qcoefficient = other.qcoefficient;
+                coefficient = other.coefficient;
 
             }
             return *this;
         }
 
+        SymbolicMonomial &operator=(SymbolicMonomial &&other) noexcept {
+            if (this != &other) {
+                qmonomial = std::move(other.qmonomial);
+                coefficient = std::move(other.coefficient);
+            }
+            return *this;
+        }
+
+        // the bases have to be similar, see add(..)
+        SymbolicMonomial &operator+=(const SymbolicMonomial &other);
+
+        SymbolicMonomial &operator*=(const SymbolicMonomial &other);
+
+        SymbolicMonomial &operator*=(const Rational &factor);
+
+        SymbolicMonomial &scale(const Rational &factor);
+
+        SymbolicMonomial &negate();
+
         friend std::ostream &operator<<(std::ostream &os, const SymbolicMonomial &monomial);
 
         bool operator==(const SymbolicMonomial &rhs) const;
@@ -405,18 +600,21 @@ namespace symbolic_ring {
 
         const QMonomial &getQmonomial() const;
 
-        const QPolynomial &getQcoefficient() const;
+        const LinearForm &getCoefficient() const;
+
+        // the coefficient converted to a polynomial in the unknowns
+        QPolynomial getQcoefficient() const;
 
 
     private:
         QMonomial qmonomial;
-        QPolynomial qcoefficient;
+        LinearForm coefficient;
     };
 
     class SymbolicPolynomial : HasSymbolicEnvironment {
     public:
-        explicit SymbolicPolynomial(const SymbolicMonomial &monomial) : monomials({monomial}), HasSymbolicEnvironment(
-                monomial.viewEnvironment()) {}
+        explicit SymbolicPolynomial(const SymbolicMonomial &monomial) : HasSymbolicEnvironment(
+                monomial.viewEnvironment()), monomials({monomial}) {}
 
 
         void reduce();
@@ -425,6 +623,9 @@ namespace symbolic_ring {
 
         friend SymbolicPolynomial mul(const SymbolicPolynomial &l, const SymbolicPolynomial &r);
 
+        friend SymbolicPolynomial composeInBase(const SymbolicPolynomial &polynomial, const std::vector<Symbol> &symbols,
+                                                const std::vector<QPolynomial> &substitutions);
+
         friend SymbolicPolynomial mul(const SymbolicPolynomial &l, long long r);
 
         friend SymbolicPolynomial mul(const long long l, const SymbolicPolynomial &r);
@@ -434,6 +635,14 @@ namespace symbolic_ring {
 
         friend SymbolicPolynomial add(const SymbolicPolynomial &l, const SymbolicPolynomial &r, bool needReduce);
 
+        friend class SymbolicPolynomialAccumulator;
+
+        SymbolicPolynomial(const SymbolicPolynomial &other) : HasSymbolicEnvironment(other.viewEnvironment()),
+                                                              monomials(other.monomials) {}
+
+        SymbolicPolynomial(SymbolicPolynomial &&other) noexcept: HasSymbolicEnvironment(other.viewEnvironment()),
+                                                                 monomials(std::move(other.monomials)) {}
+
         SymbolicPolynomial &operator=(const SymbolicPolynomial &other) {
             if (this != &other) {
                 monomials = other.monomials;
@@ -441,12 +650,105 @@ namespace symbolic_ring {
             return *this;
         }
 
+        SymbolicPolynomial &operator=(SymbolicPolynomial &&other) noexcept {
+            if (this != &other) {
+                monomials = std::move(other.monomials);
+            }
+            return *this;
+        }
+
+        // appends the terms without reducing, same as add(.., .., false), call reduce() once all terms are in
+        SymbolicPolynomial &append(const SymbolicPolynomial &other);
+
+        SymbolicPolynomial &append(SymbolicPolynomial &&other);
+
+        // in-place arithmetic, the result is reduced the same way as the one of add(.., .., true) / mul(..)
+        SymbolicPolynomial &operator+=(const SymbolicPolynomial &other);
+
+        SymbolicPolynomial &operator-=(const SymbolicPolynomial &other);
+
+        SymbolicPolynomial &operator*=(const SymbolicPolynomial &other);
+
+        SymbolicPolynomial &operator*=(const Rational &factor);
+
+        SymbolicPolynomial &scale(const Rational &factor);
+
+        SymbolicPolynomial &negate();
+
         std::vector<SymbolicMonomial> getReducedMonomials() const;
 
     private:
         std::vector<SymbolicMonomial> monomials;
     };
 
+    // Collects terms of a QPolynomial, similar monomials are merged on insertion through a hash map
+    // keyed by the exponents, the terms are sorted once in build(). Adding n terms costs O(n) instead of
+    // calling add(..) and reduce() n times.
+    class QPolynomialAccumulator {
+    public:
+        explicit QPolynomialAccumulator(SymbolicEnvironment *environment) : environment(environment) {}
+
+        void add(const QMonomial &monomial);
+
+        void add(QMonomial &&monomial);
+
+        void add(const QPolynomial &polynomial);
+
+        void add(QPolynomial &&polynomial);
+
+        bool isEmpty() const {
+            return terms.empty();
+        }
+
+        // returns zero polynomial if nothing was added
+        QPolynomial build() const &;
+
+        // same as build(), but moves the collected terms out of the accumulator
+        QPolynomial build() &&;
+
+    private:
+        QPolynomial finish(std::vector<QMonomial> monomials) const;
+
+        SymbolicEnvironment *environment;
+        std::vector<QMonomial> terms;
+        std::unordered_map<PackedExponents, size_t, PackedExponentsHash> termIndex;
+    };
+
+    // Same as QPolynomialAccumulator for SymbolicPolynomial. The terms with equal base monomials are unitized
+    // and the terms of their coefficients are collected, the coefficients are merged once in build().
+    class SymbolicPolynomialAccumulator {
+    public:
+        explicit SymbolicPolynomialAccumulator(SymbolicEnvironment *environment) : environment(environment) {}
+
+        void add(const SymbolicMonomial &monomial);
+
+        void add(SymbolicMonomial &&monomial);
+
+        void add(const SymbolicPolynomial &polynomial);
+
+        void add(SymbolicPolynomial &&polynomial);
+
+        // returns zero polynomial if nothing was added
+        SymbolicPolynomial build() const &;
+
+        // same as build(), but moves the collected terms out of the accumulator
+        SymbolicPolynomial build() &&;
+
+    private:
+        struct Term {
+            SymbolicMonomial first;
+            std::vector<LinearForm::Term> unitizedCoefficient;
+            bool merged;
+        };
+
+        static SymbolicMonomial finishTerm(SymbolicEnvironment *environment, const Term &term);
+
+        SymbolicEnvironment *environment;
+        std::vector<Term> terms;
+        std::vector<SymbolicMonomial> zeroTerms;
+        std::unordered_map<PackedExponents, size_t, PackedExponentsHash> termIndex;
+    };
+
     SymbolicPolynomial mul(const SymbolicPolynomial &l, const SymbolicPolynomial &r);
 
     SymbolicPolynomial mul(const SymbolicPolynomial &l, long long r);
@@ -457,38 +759,82 @@ namespace symbolic_ring {
 
     SymbolicPolynomial add(const SymbolicPolynomial &l, const SymbolicPolynomial &r, bool needReduce);
 
+    // overloads for temporaries, the left operand is reused instead of copied
+    SymbolicPolynomial add(SymbolicPolynomial &&l, const SymbolicPolynomial &r, bool needReduce);
+
+    SymbolicPolynomial mul(SymbolicPolynomial &&l, long long r);
+
 
 
     SymbolicPolynomial
     substituteInBase(SymbolicPolynomial polynomial, const Symbol &to_substitute, const QPolynomial &substitution);
 
+    // polynomial with every symbols[i] replaced by substitutions[i] at once, as substituteInBase(..) for one symbol after
+    // the other does when no substitution contains one of the symbols (otherwise it falls back to that). The powers of
+    // every substitution are computed once, the affine ones with multinomial coefficients, and the terms of the result
+    // are collected in one pass
+    SymbolicPolynomial composeInBase(const SymbolicPolynomial &polynomial, const std::vector<Symbol> &symbols,
+                                     const std::vector<QPolynomial> &substitutions);
+
     SymbolicPolynomial
     substituteInCoefficients(SymbolicPolynomial polynomial, const Symbol &to_substitute, const QPolynomial &substitution);
 
     SymbolicPolynomial symbolicPolynomialfromQPolynomialAsBase(const QPolynomial &qpolynomial);
 
+    // safe to use from several threads at once, see InternTable
     class SymbolicEnvironment {
     public:
         SymbolicEnvironment() = default;
 
-        Symbol sym(std::string name) {
-            add(name);
-            return {std::move(name), this};
+        Symbol sym(const std::string &name) {
+            auto inserted = symbols->insert(name);
+            if (!inserted.second) {
+                throw std::runtime_error("Variable " + name + " already exists");
+            }
+            return {inserted.first, this};
         }
 
         Symbol getFreeSymbol(std::string prefix) {
             int freeSymbolCounter = 0;
             std::string candidate = prefix + std::to_string(freeSymbolCounter);
-            while (variables.find(candidate) != variables.end()) {
+            while (isExist(candidate)) {
                 freeSymbolCounter++;
                 candidate = prefix + std::to_string(freeSymbolCounter);
             }
             return sym(candidate);
         }
 
-        Symbol getOrCreate(std::string name) {
-            forceAdd(name);
-            return {name, this};
+        Symbol getOrCreate(const std::string &name) {
+            return {symbols->intern(name), this};
+        }
+
+        // the reference stays valid when other symbols are added
+        const std::string &getSymbolName(int id) const {
+            return symbols->getName(id);
+        }
+
+        // the entry (row, col) of the gram matrix of the block-th sos
+        struct GramEntry {
+            int block = -1; // -1 for the other symbols
+            int row = -1;
+            int col = -1;
+        };
+
+        // l_<block>_<row>_<col>, the name is for printing only, the solvers take the indices with findGramEntry(..); the
+        // entry is stored with the name, so the symbol is safe to make on several threads
+        Symbol getOrCreateGramEntry(int block, int row, int col) {
+            auto name = "l_" + std::to_string(block) + "_" + std::to_string(row) + "_" + std::to_string(col);
+            return {symbols->insert(name, GramEntry{block, row, col}).first, this};
+        }
+
+        // nullptr unless the symbol is made by getOrCreateGramEntry(..), and not by getOrCreate(..) before it
+        const GramEntry *findGramEntry(int id) const {
+            const auto &entry = symbols->getValue(id);
+            return entry.block >= 0 ? &entry : nullptr;
+        }
+
+        int getNumberOfSymbols() const {
+            return symbols->size();
         }
 
         QMonomial qmonomialOne() {
@@ -525,38 +871,19 @@ namespace symbolic_ring {
 
 
     private:
-        std::set<std::string> variables;
+        // symbol ids are dense and given in the order of creation, the monomials store ids only. Behind a pointer, so
+        // that the environment stays movable
+        std::unique_ptr<InternTable<GramEntry>> symbols = std::make_unique<InternTable<GramEntry>>();
 
         bool isExist(const std::string &name) const {
-            return variables.find(name) != variables.end();
-        }
-
-        void forceAdd(const std::string &name) {
-            variables.insert(name);
-        }
-
-        void forceAdd(const std::vector<std::string> &names) {
-            for (const auto &name: names) {
-                forceAdd(name);
-            }
-        }
-
-        bool add(const std::string &name) {
-            if (isExist(name)) {
-                throw std::runtime_error("Variable " + name + " already exists");
-            }
-            forceAdd(name);
-            return true;
-        }
-
-        bool add(const std::vector<std::string> &names) {
-            for (const auto &name: names) {
-                add(name);
-            }
-            return true;
+            return symbols->find(name) >= 0;
         }
     };
 
+    inline const std::string &Symbol::getName() const {
+        return viewEnvironment()->getSymbolName(id);
+    }
+
 //SymbolicPolynomial substituteVar(const SymbolicMonomial& polynomial, const Symbol& var, const SymbolicPolynomial& value);
 //SymbolicPolynomial substituteVar(const SymbolicPolynomial& polynomial, const Symbol& var, const SymbolicPolynomial& value);
 
@@ -26,17 +26,21 @@ int main(int argc, char ** argv) {
 
     // if -help or --help is passed, print help and exit
     if (argc == 2 && (std::string(argv[1]) == "-help" || std::string(argv[1]) == "--help")) {
-        std::string help = "The usage: -inp <filename> -deg <integer> -met [mosek|csdp] -eng [mosek|csdp]"
+        std::string help = "The usage: -inp <filename> -deg <integer> -met [mosek|csdp] -eng [mosek|csdp|native|admm|portfolio]"
                            "\n\t-inp <filename> - the name of the input file"
                            "\n\t-deg <integer> - the degree, in the case of putinar used for generating the "
                            "monomial vector, in the case of handelman used for generating the monoid, default = 2"
-                           "\n\t-eng [mosek|csdp] - the method to use for solving the SDP, default = mosek"
-                           "\n\t-met [putinar|handelman] - the method to use for solving the SDP, default = putinar";
+                           "\n\t-eng [mosek|csdp|native|admm|portfolio] - the method to use for solving the SDP, "
+                           "portfolio runs all of them at once and takes the first answer, default = mosek"
+                           "\n\t-met [putinar|handelman] - the method to use for solving the SDP, default = putinar"
+                           "\n\t-dump <filename> - write the SDP to the file instead of solving it, "
+                           "CBF if the name ends with .cbf, sparse SDPA otherwise"
+                           "\n\t-presolve [on|off] - simplify the SDP before it is solved, default = on";
         std::cout << help << std::endl;
         return 0;
     }
 
-    std::set<std::string> possibleEngines = {"mosek", "csdp"};
+    std::set<std::string> possibleEngines = {"mosek", "csdp", "native", "admm", "portfolio"};
     std::set<std::string> possibleMethods = {"putinar", "handelman"};
 
     bool inputFileFound = false;
@@ -55,6 +59,12 @@ int main(int argc, char ** argv) {
     std::string solverEngine = "mosek";
     const std::string solverEnginePrefix = "-eng";
 
+    std::string dumpFileName;
+    const std::string dumpFileNamePrefix = "-dump";
+
+    std::string presolve = "on";
+    const std::string presolvePrefix = "-presolve";
+
     for (int i = 1; i < argc; i++) {
         std::string arg = argv[i];
         if (arg.substr(0, inputFileNamePrefix.size()) == inputFileNamePrefix) {
@@ -73,6 +83,12 @@ int main(int argc, char ** argv) {
             solverEngine = argv[i + 1];
             solverEngineFound = true;
         }
+        if (arg.substr(0, dumpFileNamePrefix.size()) == dumpFileNamePrefix) {
+            dumpFileName = argv[i + 1];
+        }
+        if (arg.substr(0, presolvePrefix.size()) == presolvePrefix) {
+            presolve = argv[i + 1];
+        }
     }
 
     if (possibleEngines.count(solverEngine) == 0) {
@@ -119,23 +135,46 @@ int main(int argc, char ** argv) {
     }
 
 
+    if (solverEngine == "native") {
+        config.setSdpEngine(SdpEngine::NATIVE);
+    } else if (solverEngine == "admm") {
+        config.setSdpEngine(SdpEngine::ADMM);
+    } else if (solverEngine == "portfolio") {
+        config.setSdpEngine(SdpEngine::PORTFOLIO);
+    }
+
+    config.setDumpFile(dumpFileName);
+
+    if (presolve != "on" && presolve != "off") {
+        std::cout << "Unknown presolve option: " << presolve << ", possible options: on off" << std::endl;
+    }
+    config.setPresolve(presolve != "off");
+
     estimator.configure(config);
 
     estimator.IAdmitThatThisIsUnsafeAndShouldBeUsedOnlyWithTrustedInput();
 
-    if (solverEngine == "mosek" && method == "putinar") {
+    // csdp, native, admm and the portfolio solve the same SdpProblem, it is also the one that is dumped
+    bool sdpProblemEngine = solverEngine == "csdp" || solverEngine == "native" || solverEngine == "admm" ||
+                            solverEngine == "portfolio" || !dumpFileName.empty();
+
+    if (sdpProblemEngine && method == "putinar") {
+        estimator.solveWithPutinarCsdp();
+    } else if (sdpProblemEngine && method == "handelman") {
+        estimator.solveWithHandelmanCsdp(highDegreeMonomial);
+    } else if (solverEngine == "mosek" && method == "putinar") {
         estimator.solveWithPutinarMosek();
     } else if (solverEngine == "mosek" && method == "handelman") {
         estimator.solveWithHandelmanMosek(highDegreeMonomial);
-    } else if (solverEngine == "csdp" && method == "putinar") {
-        estimator.solveWithPutinarCsdp();
-    } else if (solverEngine == "csdp" && method == "handelman") {
-        estimator.solveWithHandelmanCsdp(highDegreeMonomial);
     } else {
         std::cout << "Unknown method or solver engine: " << method << " " << solverEngine << std::endl;
         return 1;
     }
 
+    if (!dumpFileName.empty()) {
+        return 0;
+    }
+
 
     if (!estimator.isFeasible()) {
         std::cout << "\n\n===========================================================\n";
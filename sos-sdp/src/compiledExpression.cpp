@@ -0,0 +1,199 @@
+//
+// Created by sergey on 27.08.23.
+//
+
+#include "compiledExpression.h"
+
+CompiledExpression::CompiledExpression(const ExpressionElement& expression, EvaluationContext& context) {
+    typeTag = compile(expression, context);
+}
+
+void CompiledExpression::emit(Instruction instruction, int pushedQ, int pushedSymbolic) {
+    code.push_back(instruction);
+    depthQ += pushedQ;
+    depthSymbolic += pushedSymbolic;
+    maxDepthQ = std::max(maxDepthQ, depthQ);
+    maxDepthSymbolic = std::max(maxDepthSymbolic, depthSymbolic);
+}
+
+void CompiledExpression::emitSymbolic(OpCode opCode, TypeTag left, TypeTag right) {
+    Instruction instruction{opCode, true};
+    instruction.leftQ = left == QPOLYNOMIAL;
+    instruction.rightQ = right == QPOLYNOMIAL;
+    int poppedQ = instruction.leftQ + instruction.rightQ;
+    emit(instruction, -poppedQ, 1 - (2 - poppedQ));
+}
+
+// the same types and casts as ExpressionElement::getTypeTag() and evaluate(..) of the nodes
+TypeTag CompiledExpression::compile(const ExpressionElement& expression, EvaluationContext& context) {
+    const auto& children = expression.getChildren();
+
+    switch (expression.getType()) {
+        case CONSTANT: {
+            Instruction instruction{OpCode::CONSTANT};
+            instruction.value = static_cast<const Constant&>(expression).getValue();
+            emit(instruction, 1, 0);
+            return QPOLYNOMIAL;
+        }
+        case VARIABLE: {
+            Instruction instruction{OpCode::VARIABLE};
+            instruction.nameId = context.getNameId(expression.getName());
+            emit(instruction, 1, 0);
+            return QPOLYNOMIAL;
+        }
+        case FUNCTION: {
+            for (const auto& child: children) {
+                if (compile(*child, context) != QPOLYNOMIAL) {
+                    throw std::runtime_error("Wrong type tag");
+                }
+            }
+            Instruction instruction{OpCode::CALL, true};
+            instruction.nameId = context.getNameId(expression.getName());
+            instruction.count = static_cast<int>(children.size());
+            emit(instruction, -instruction.count, 1);
+            return SYMBOLIC_POLYNOMIAL;
+        }
+        case BINARY_OPERATION: {
+            const auto& operation = expression.getName();
+            auto left = compile(*children[0], context);
+            auto right = compile(*children[1], context);
+            bool symbolic = left == SYMBOLIC_POLYNOMIAL || right == SYMBOLIC_POLYNOMIAL;
+            if (symbolic && operation == "/") {
+                Instruction instruction{OpCode::FAIL};
+                instruction.nameId = static_cast<int>(messages.size());
+                messages.emplace_back("Wrong type tag");
+                emit(instruction, 0, 0);
+                return SYMBOLIC_POLYNOMIAL;
+            }
+            OpCode opCode = operation == "+" ? OpCode::ADD : operation == "-" ? OpCode::SUB :
+                            operation == "*" ? OpCode::MUL : OpCode::DIV;
+            if (symbolic) {
+                emitSymbolic(opCode, left, right);
+                return SYMBOLIC_POLYNOMIAL;
+            }
+            emit({opCode, false}, -1, 0);
+            return QPOLYNOMIAL;
+        }
+        case UNARY_OPERATION: {
+            auto type = compile(*children[0], context);
+            if (expression.getName() == "-") {
+                emit({OpCode::NEGATE, type == SYMBOLIC_POLYNOMIAL}, 0, 0);
+            }
+            return type;
+        }
+        case BINARY_RELATION: {
+            if (!code.empty() || depthQ != 0 || depthSymbolic != 0) {
+                throw std::runtime_error("Cannot compile a relation inside an expression");
+            }
+            const auto& relation = expression.getName();
+            auto left = compile(*children[0], context);
+            auto right = compile(*children[1], context);
+            emitSymbolic(OpCode::RELATION, left, right);
+            code.back().swapped = relation == "<" || relation == "<=";
+            return SYMBOLIC_POLYNOMIAL;
+        }
+    }
+    throw std::runtime_error("Cannot compile " + expression.toString());
+}
+
+EvaluationResult CompiledExpression::evaluate(EvaluationContext& context) const {
+    auto& env = context.getEnvironment();
+    std::vector<symbolic_ring::QPolynomial> stackQ;
+    std::vector<symbolic_ring::SymbolicPolynomial> stackSymbolic;
+    stackQ.reserve(maxDepthQ);
+    stackSymbolic.reserve(maxDepthSymbolic);
+    std::vector<symbolic_ring::QPolynomial> arguments;
+    // the right operand is on top, so it is popped first
+    auto popSymbolic = [&](bool fromQ) {
+        if (fromQ) {
+            auto result = symbolicPolynomialfromQPolynomialAsBase(stackQ.back());
+            stackQ.pop_back();
+            return result;
+        }
+        auto result = std::move(stackSymbolic.back());
+        stackSymbolic.pop_back();
+        return result;
+    };
+
+    for (const auto& instruction: code) {
+        switch (instruction.code) {
+            case OpCode::CONSTANT:
+                stackQ.push_back(mul(env.qPolynomialOne(), instruction.value));
+                break;
+            case OpCode::VARIABLE:
+                stackQ.push_back(context.getVariableQPolynomial(instruction.nameId));
+                break;
+            case OpCode::CALL: {
+                auto arity = context.getSymbolicPolynomialWithOrderedArguments(instruction.nameId).getOrderedArguments().size();
+                if (arity > static_cast<size_t>(instruction.count)) {
+                    throw std::runtime_error("Wrong number of arguments");
+                }
+                arguments.clear();
+                auto first = stackQ.end() - instruction.count;
+                std::move(first, first + arity, std::back_inserter(arguments));
+                stackQ.erase(first, stackQ.end());
+                stackSymbolic.push_back(context.evaluateFunctionCall(instruction.nameId, std::move(arguments)));
+                break;
+            }
+            case OpCode::NEGATE:
+                if (instruction.symbolic) {
+                    stackSymbolic.back().negate();
+                } else {
+                    stackQ.back() = mul(std::move(stackQ.back()), -1);
+                }
+                break;
+            case OpCode::RELATION: {
+                auto right = popSymbolic(instruction.rightQ);
+                auto left = popSymbolic(instruction.leftQ);
+                if (instruction.swapped) {
+                    right -= left;
+                    stackSymbolic.push_back(std::move(right));
+                } else {
+                    left -= right;
+                    stackSymbolic.push_back(std::move(left));
+                }
+                break;
+            }
+            case OpCode::FAIL:
+                throw std::runtime_error(messages[instruction.nameId]);
+            default:
+                if (instruction.symbolic) {
+                    auto right = popSymbolic(instruction.rightQ);
+                    auto left = popSymbolic(instruction.leftQ);
+                    if (instruction.code == OpCode::ADD) {
+                        left += right;
+                    } else if (instruction.code == OpCode::SUB) {
+                        left -= right;
+                    } else {
+                        left = mul(left, right);
+                    }
+                    stackSymbolic.push_back(std::move(left));
+                } else {
+                    auto right = std::move(stackQ.back());
+                    stackQ.pop_back();
+                    auto& left = stackQ.back();
+                    if (instruction.code == OpCode::ADD) {
+                        left += right;
+                    } else if (instruction.code == OpCode::SUB) {
+                        left -= right;
+                    } else if (instruction.code == OpCode::MUL) {
+                        left = mul(left, right);
+                    } else {
+                        const auto& monomials = right.getMonomials();
+                        if (monomials.size() != 1) {
+                            throw std::runtime_error("Division by non-monomial");
+                        }
+                        if (!monomials[0].isConstant()) {
+                            throw std::runtime_error("Division by non-constant");
+                        }
+                        left = div(left, monomials[0].getCoefficient());
+                    }
+                }
+        }
+    }
+
+    if (typeTag == SYMBOLIC_POLYNOMIAL) {
+        return EvaluationResult(std::move(stackSymbolic.back()));
+    }
+    return EvaluationResult(std::move(stackQ.back()));
+}
@@ -0,0 +1,187 @@
+//
+// Created by sergey on 21.08.23.
+//
+
+#include "csdpLibrary.h"
+#include "sdpExport.h"
+
+#include <stdexcept>
+
+#ifdef USE_CSDP_LIBRARY
+
+#include <algorithm>
+#include <cstdlib>
+#include <new>
+#include <tuple>
+
+extern "C" {
+#include <declarations.h>
+}
+
+bool csdpLibraryAvailable() {
+    return true;
+}
+
+// csdp frees the problem with free(), so everything handed to it is allocated with malloc; all its arrays are 1-based
+template<typename T>
+static T* allocate(size_t count) {
+    auto result = static_cast<T*>(std::calloc(count, sizeof(T)));
+    if (result == nullptr) {
+        throw std::bad_alloc();
+    }
+    return result;
+}
+
+NativeSdpResult solveWithCsdpLibrary(const NativeSdpProblem& problem) {
+    SdpaLayout layout(problem);
+    int blocks = problem.blockSizes.size();
+    int freeBlock = layout.freeBlock;
+    int numberOfBlocks = layout.blockSizes.size();
+    int k = problem.constraints.size();
+    const auto& sizes = layout.blockSizes;
+
+    // the objective is zero
+    struct blockmatrix C;
+    C.nblocks = numberOfBlocks;
+    C.blocks = allocate<struct blockrec>(numberOfBlocks + 1);
+    int n = 0;
+    for (int block = 1; block <= numberOfBlocks; ++block) {
+        int size = sizes[block - 1];
+        auto& rec = C.blocks[block];
+        if (size > 0) {
+            rec.blockcategory = MATRIX;
+            rec.blocksize = size;
+            rec.data.mat = allocate<double>(size * size);
+        } else {
+            rec.blockcategory = DIAG;
+            rec.blocksize = -size;
+            rec.data.vec = allocate<double>(-size + 1);
+        }
+        n += rec.blocksize;
+    }
+
+    double* a = allocate<double>(k + 1);
+    auto constraints = allocate<struct constraintmatrix>(k + 1);
+    std::vector<std::tuple<int, int, int, double>> entries; // block, i, j, value; 1-based upper triangle
+    for (int c = 1; c <= k; ++c) {
+        const auto& constraint = problem.constraints[c - 1];
+        a[c] = constraint.rhs;
+        constraints[c].blocks = nullptr;
+
+        entries.clear();
+        for (const auto& entry: constraint.entries) {
+            if (entry.block < 0 || entry.block >= blocks) {
+                throw std::runtime_error("Unknown block " + std::to_string(entry.block));
+            }
+            if (entry.value == 0.0) {
+                continue;
+            }
+            entries.emplace_back(layout.blockNumbers[entry.block], std::min(entry.row, entry.col) + 1,
+                                 std::max(entry.row, entry.col) + 1, entry.value);
+        }
+        for (const auto& entry: constraint.freeEntries) {
+            if (entry.second == 0.0) {
+                continue;
+            }
+            entries.emplace_back(freeBlock, 2 * entry.first + 1, 2 * entry.first + 1, entry.second);
+            entries.emplace_back(freeBlock, 2 * entry.first + 2, 2 * entry.first + 2, -entry.second);
+        }
+        std::sort(entries.begin(), entries.end());
+
+        // one sparseblock per block, the list is built from the back so that the blocks are in increasing order
+        for (size_t end = entries.size(); end > 0;) {
+            int block = std::get<0>(entries[end - 1]);
+            size_t begin = end;
+            while (begin > 0 && std::get<0>(entries[begin - 1]) == block) {
+                --begin;
+            }
+
+            auto sparse = allocate<struct sparseblock>(1);
+            sparse->blocknum = block;
+            sparse->blocksize = C.blocks[block].blocksize;
+            sparse->constraintnum = c;
+            sparse->issparse = 1;
+            sparse->nextbyblock = nullptr;
+            sparse->entries = allocate<double>(end - begin + 1);
+            sparse->iindices = allocate<int>(end - begin + 1);
+            sparse->jindices = allocate<int>(end - begin + 1);
+            int count = 0;
+            for (size_t p = begin; p < end; ++p) {
+                int i = std::get<1>(entries[p]), j = std::get<2>(entries[p]);
+                if (count > 0 && sparse->iindices[count] == i && sparse->jindices[count] == j) {
+                    sparse->entries[count] += std::get<3>(entries[p]);
+                } else {
+                    ++count;
+                    sparse->iindices[count] = i;
+                    sparse->jindices[count] = j;
+                    sparse->entries[count] = std::get<3>(entries[p]);
+                }
+            }
+            sparse->numentries = count;
+            sparse->next = constraints[c].blocks;
+            constraints[c].blocks = sparse;
+            end = begin;
+        }
+    }
+
+    struct blockmatrix X, Z;
+    double* y;
+    double primalObjective, dualObjective;
+    initsoln(n, k, C, a, constraints, &X, &y, &Z);
+    int code = easy_sdp(n, k, C, a, constraints, 0.0, &X, &y, &Z, &primalObjective, &dualObjective);
+
+    NativeSdpResult result;
+    switch (code) {
+        case 0:
+            result.status = NativeSdpStatus::SOLVED;
+            break;
+        case 3:
+            result.status = NativeSdpStatus::SOLVED_INACCURATE;
+            break;
+        case 1:
+            result.status = NativeSdpStatus::PRIMAL_INFEASIBLE;
+            break;
+        default:
+            result.status = NativeSdpStatus::NOT_CONVERGED;
+    }
+
+    result.blocks.resize(blocks);
+    for (int block = 0; block < blocks; ++block) {
+        const auto& rec = X.blocks[layout.blockNumbers[block]];
+        int d = rec.blocksize;
+        auto& values = result.blocks[block];
+        if (rec.blockcategory == DIAG) {
+            values.assign(rec.data.vec + 1, rec.data.vec + d + 1);
+            continue;
+        }
+        values.resize(d * d);
+        for (int i = 1; i <= d; ++i) {
+            for (int j = 1; j <= d; ++j) {
+                values[(i - 1) * d + j - 1] = rec.data.mat[ijtok(i, j, d)];
+            }
+        }
+    }
+    for (int v = 0; v < problem.numberOfFreeVariables; ++v) {
+        const double* pairs = X.blocks[freeBlock].data.vec;
+        result.freeVariables.push_back(pairs[2 * v + 1] - pairs[2 * v + 2]);
+    }
+    // csdp's dual is A^T y - C == Z >= 0
+    for (int c = 1; c <= k; ++c) {
+        result.y.push_back(-y[c]);
+    }
+
+    free_prob(n, k, C, a, constraints, X, y, Z);
+    return result;
+}
+
+#else
+
+bool csdpLibraryAvailable() {
+    return false;
+}
+
+NativeSdpResult solveWithCsdpLibrary(const NativeSdpProblem& problem) {
+    throw std::runtime_error("The project is built without the csdp library");
+}
+
+#endif
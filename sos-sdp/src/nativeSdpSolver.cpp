@@ -0,0 +1,1541 @@
+//
+// Created by sergey on 14.08.23.
+//
+
+#include "nativeSdpSolver.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <limits>
+#include <numeric>
+#include <set>
+#include <stdexcept>
+
+// dense helpers, a d x d matrix is stored row by row
+
+static void multiply(const std::vector<double>& A, const std::vector<double>& B, std::vector<double>& C, int d) {
+    C.assign(d * d, 0.0);
+    for (int i = 0; i < d; ++i) {
+        for (int k = 0; k < d; ++k) {
+            double a = A[i * d + k];
+            if (a == 0.0) {
+                continue;
+            }
+            for (int j = 0; j < d; ++j) {
+                C[i * d + j] += a * B[k * d + j];
+            }
+        }
+    }
+}
+
+static bool cholesky(const std::vector<double>& A, std::vector<double>& L, int d) {
+    L.assign(d * d, 0.0);
+    for (int j = 0; j < d; ++j) {
+        double s = A[j * d + j];
+        for (int k = 0; k < j; ++k) {
+            s -= L[j * d + k] * L[j * d + k];
+        }
+        if (!(s > 0.0)) {
+            return false;
+        }
+        L[j * d + j] = std::sqrt(s);
+        for (int i = j + 1; i < d; ++i) {
+            double t = A[i * d + j];
+            for (int k = 0; k < j; ++k) {
+                t -= L[i * d + k] * L[j * d + k];
+            }
+            L[i * d + j] = t / L[j * d + j];
+        }
+    }
+    return true;
+}
+
+// B := L^{-1} B for every column of B
+static void solveLower(const std::vector<double>& L, std::vector<double>& B, int d) {
+    for (int c = 0; c < d; ++c) {
+        for (int i = 0; i < d; ++i) {
+            double t = B[i * d + c];
+            for (int k = 0; k < i; ++k) {
+                t -= L[i * d + k] * B[k * d + c];
+            }
+            B[i * d + c] = t / L[i * d + i];
+        }
+    }
+}
+
+static bool invertSpd(const std::vector<double>& A, std::vector<double>& inverse, int d) {
+    std::vector<double> L;
+    if (!cholesky(A, L, d)) {
+        return false;
+    }
+    // A^{-1} = L^{-T} L^{-1} = W^T W for W = L^{-1}
+    std::vector<double> W(d * d, 0.0);
+    for (int i = 0; i < d; ++i) {
+        W[i * d + i] = 1.0;
+    }
+    solveLower(L, W, d);
+    inverse.assign(d * d, 0.0);
+    for (int i = 0; i < d; ++i) {
+        for (int j = i; j < d; ++j) {
+            double s = 0.0;
+            for (int k = std::max(i, j); k < d; ++k) {
+                s += W[k * d + i] * W[k * d + j];
+            }
+            inverse[i * d + j] = s;
+            inverse[j * d + i] = s;
+        }
+    }
+    return true;
+}
+
+// cyclic jacobi rotations, S is destroyed
+static double minEigenvalue(std::vector<double>& S, int d) {
+    for (int sweep = 0; sweep < 100; ++sweep) {
+        double off = 0.0, norm = 0.0;
+        for (int i = 0; i < d; ++i) {
+            for (int j = 0; j < d; ++j) {
+                (i == j ? norm : off) += S[i * d + j] * S[i * d + j];
+            }
+        }
+        if (off <= 1e-28 * (norm + off) || off == 0.0) {
+            break;
+        }
+        for (int p = 0; p < d; ++p) {
+            for (int q = p + 1; q < d; ++q) {
+                double apq = S[p * d + q];
+                if (apq == 0.0) {
+                    continue;
+                }
+                double theta = (S[q * d + q] - S[p * d + p]) / (2 * apq);
+                double t = (theta >= 0 ? 1.0 : -1.0) / (std::abs(theta) + std::sqrt(theta * theta + 1));
+                double c = 1 / std::sqrt(t * t + 1), s = t * c;
+                for (int k = 0; k < d; ++k) {
+                    double skp = S[k * d + p], skq = S[k * d + q];
+                    S[k * d + p] = c * skp - s * skq;
+                    S[k * d + q] = s * skp + c * skq;
+                }
+                for (int k = 0; k < d; ++k) {
+                    double spk = S[p * d + k], sqk = S[q * d + k];
+                    S[p * d + k] = c * spk - s * sqk;
+                    S[q * d + k] = s * spk + c * sqk;
+                }
+            }
+        }
+    }
+    double result = std::numeric_limits<double>::infinity();
+    for (int i = 0; i < d; ++i) {
+        result = std::min(result, S[i * d + i]);
+    }
+    return result;
+}
+
+// right-looking blocked cholesky of the lower triangle of the n x n row major A, the upper triangle is not touched
+static bool blockedCholesky(std::vector<double>& A, int n) {
+    const int blockSize = 64;
+    for (int k0 = 0; k0 < n; k0 += blockSize) {
+        int k1 = std::min(n, k0 + blockSize);
+
+        for (int k = k0; k < k1; ++k) {
+            double s = A[(size_t) k * n + k];
+            for (int p = k0; p < k; ++p) {
+                s -= A[(size_t) k * n + p] * A[(size_t) k * n + p];
+            }
+            if (!(s > 0.0)) {
+                return false;
+            }
+            A[(size_t) k * n + k] = std::sqrt(s);
+            for (int i = k + 1; i < k1; ++i) {
+                double t = A[(size_t) i * n + k];
+                for (int p = k0; p < k; ++p) {
+                    t -= A[(size_t) i * n + p] * A[(size_t) k * n + p];
+                }
+                A[(size_t) i * n + k] = t / A[(size_t) k * n + k];
+            }
+        }
+
+#pragma omp parallel for schedule(static)
+        for (int i = k1; i < n; ++i) {
+            for (int k = k0; k < k1; ++k) {
+                double t = A[(size_t) i * n + k];
+                for (int p = k0; p < k; ++p) {
+                    t -= A[(size_t) i * n + p] * A[(size_t) k * n + p];
+                }
+                A[(size_t) i * n + k] = t / A[(size_t) k * n + k];
+            }
+        }
+
+#pragma omp parallel for schedule(dynamic, 16)
+        for (int i = k1; i < n; ++i) {
+            const double* li = &A[(size_t) i * n + k0];
+            for (int j = k1; j <= i; ++j) {
+                const double* lj = &A[(size_t) j * n + k0];
+                double t = 0.0;
+                for (int p = 0; p < k1 - k0; ++p) {
+                    t += li[p] * lj[p];
+                }
+                A[(size_t) i * n + j] -= t;
+            }
+        }
+    }
+    return true;
+}
+
+static double dot(const std::vector<double>& a, const std::vector<double>& b) {
+    double result = 0.0;
+    for (size_t i = 0; i < a.size(); ++i) {
+        result += a[i] * b[i];
+    }
+    return result;
+}
+
+NativeSdpSolver::NativeSdpSolver(const NativeSdpProblem& problem, const NativeSdpSettings& settings)
+        : m(problem.constraints.size()), numberOfFree(problem.numberOfFreeVariables), n(0),
+          blockSizes(problem.blockSizes), blockRows(problem.blockSizes.size()),
+          freeColumns(problem.numberOfFreeVariables), settings(settings) {
+    for (int block = 0; block < blockSizes.size(); ++block) {
+        if (blockSizes[block] == 0) {
+            throw std::runtime_error("Empty block " + std::to_string(block));
+        }
+        n += dim(block);
+    }
+
+    for (int i = 0; i < m; ++i) {
+        const auto& constraint = problem.constraints[i];
+        b.push_back(constraint.rhs);
+
+        for (const auto& entry: constraint.entries) {
+            if (entry.block < 0 || entry.block >= blockSizes.size()) {
+                throw std::runtime_error("Unknown block " + std::to_string(entry.block));
+            }
+            int row = std::min(entry.row, entry.col), col = std::max(entry.row, entry.col);
+            if (row < 0 || col >= dim(entry.block) || (!isPsd(entry.block) && row != col)) {
+                throw std::runtime_error("Wrong entry position in block " + std::to_string(entry.block));
+            }
+            auto& rows = blockRows[entry.block];
+            if (rows.empty() || rows.back().constraint != i) {
+                rows.push_back({i, {}});
+            }
+            rows.back().entries.push_back({row, col, entry.value});
+        }
+
+        for (const auto& entry: constraint.freeEntries) {
+            if (entry.first < 0 || entry.first >= numberOfFree) {
+                throw std::runtime_error("Unknown free variable " + std::to_string(entry.first));
+            }
+            freeColumns[entry.first].emplace_back(i, entry.second);
+        }
+    }
+}
+
+NativeSdpSolver::BlockMatrix NativeSdpSolver::zeroBlocks() const {
+    BlockMatrix result(blockSizes.size());
+    for (int block = 0; block < blockSizes.size(); ++block) {
+        result[block].assign(isPsd(block) ? dim(block) * dim(block) : dim(block), 0.0);
+    }
+    return result;
+}
+
+NativeSdpSolver::BlockMatrix NativeSdpSolver::identityBlocks(double scale) const {
+    auto result = zeroBlocks();
+    for (int block = 0; block < blockSizes.size(); ++block) {
+        int d = dim(block);
+        for (int i = 0; i < d; ++i) {
+            result[block][isPsd(block) ? i * d + i : i] = scale;
+        }
+    }
+    return result;
+}
+
+std::vector<double> NativeSdpSolver::applyA(const BlockMatrix& V) const {
+    std::vector<double> result(m, 0.0);
+    for (int block = 0; block < blockSizes.size(); ++block) {
+        int d = dim(block);
+        const auto& v = V[block];
+        for (const auto& row: blockRows[block]) {
+            double s = 0.0;
+            for (const auto& entry: row.entries) {
+                if (!isPsd(block)) {
+                    s += entry.value * v[entry.row];
+                } else if (entry.row == entry.col) {
+                    s += entry.value * v[entry.row * d + entry.row];
+                } else {
+                    s += entry.value * (v[entry.row * d + entry.col] + v[entry.col * d + entry.row]);
+                }
+            }
+            result[row.constraint] += s;
+        }
+    }
+    return result;
+}
+
+NativeSdpSolver::BlockMatrix NativeSdpSolver::applyAT(const std::vector<double>& coefficients) const {
+    auto result = zeroBlocks();
+    for (int block = 0; block < blockSizes.size(); ++block) {
+        int d = dim(block);
+        auto& v = result[block];
+        for (const auto& row: blockRows[block]) {
+            double c = coefficients[row.constraint];
+            for (const auto& entry: row.entries) {
+                if (!isPsd(block)) {
+                    v[entry.row] += c * entry.value;
+                } else {
+                    v[entry.row * d + entry.col] += c * entry.value;
+                    if (entry.row != entry.col) {
+                        v[entry.col * d + entry.row] += c * entry.value;
+                    }
+                }
+            }
+        }
+    }
+    return result;
+}
+
+std::vector<double> NativeSdpSolver::applyF(const std::vector<double>& values) const {
+    std::vector<double> result(m, 0.0);
+    for (int k = 0; k < numberOfFree; ++k) {
+        for (const auto& it: freeColumns[k]) {
+            result[it.first] += it.second * values[k];
+        }
+    }
+    return result;
+}
+
+std::vector<double> NativeSdpSolver::applyFT(const std::vector<double>& values) const {
+    std::vector<double> result(numberOfFree, 0.0);
+    for (int k = 0; k < numberOfFree; ++k) {
+        for (const auto& it: freeColumns[k]) {
+            result[k] += it.second * values[it.first];
+        }
+    }
+    return result;
+}
+
+// M_ij = <A_i, X A_j Z^{-1}>, only the blocks where both A_i and A_j are nonzero contribute.
+// The lower triangle is accumulated and mirrored to the upper one, which survives the factorization
+void NativeSdpSolver::assembleSchurComplement() {
+    schur.assign((size_t) m * m, 0.0);
+
+    for (int block = 0; block < blockSizes.size(); ++block) {
+        const auto& rows = blockRows[block];
+        const auto& x = X[block];
+        const auto& zinv = Zinv[block];
+        int d = dim(block);
+        int count = rows.size();
+
+        if (!isPsd(block)) {
+#pragma omp parallel
+            {
+                std::vector<double> w(d, 0.0);
+#pragma omp for schedule(dynamic, 8)
+                for (int jj = 0; jj < count; ++jj) {
+                    for (const auto& entry: rows[jj].entries) {
+                        w[entry.row] += entry.value * x[entry.row] * zinv[entry.row];
+                    }
+                    int j = rows[jj].constraint;
+                    for (int ii = jj; ii < count; ++ii) {
+                        double s = 0.0;
+                        for (const auto& entry: rows[ii].entries) {
+                            s += entry.value * w[entry.row];
+                        }
+                        schur[(size_t) rows[ii].constraint * m + j] += s;
+                    }
+                    for (const auto& entry: rows[jj].entries) {
+                        w[entry.row] = 0.0;
+                    }
+                }
+            }
+            continue;
+        }
+
+#pragma omp parallel
+        {
+            std::vector<double> P(d * d), G(d * d);
+            std::vector<char> touched(d);
+            std::vector<int> columns;
+#pragma omp for schedule(dynamic, 4)
+            for (int jj = 0; jj < count; ++jj) {
+                // P = X A_j has nonzero columns only where A_j has entries
+                columns.clear();
+                auto addColumn = [&](int target, int source, double value) {
+                    if (!touched[target]) {
+                        touched[target] = 1;
+                        columns.push_back(target);
+                        for (int r = 0; r < d; ++r) {
+                            P[r * d + target] = 0.0;
+                        }
+                    }
+                    for (int r = 0; r < d; ++r) {
+                        P[r * d + target] += value * x[r * d + source];
+                    }
+                };
+                for (const auto& entry: rows[jj].entries) {
+                    addColumn(entry.col, entry.row, entry.value);
+                    if (entry.row != entry.col) {
+                        addColumn(entry.row, entry.col, entry.value);
+                    }
+                }
+
+                // G = P Z^{-1}
+                std::fill(G.begin(), G.end(), 0.0);
+                for (int r = 0; r < d; ++r) {
+                    for (int q: columns) {
+                        double p = P[r * d + q];
+                        for (int s = 0; s < d; ++s) {
+                            G[r * d + s] += p * zinv[q * d + s];
+                        }
+                    }
+                }
+                for (int q: columns) {
+                    touched[q] = 0;
+                }
+
+                int j = rows[jj].constraint;
+                for (int ii = jj; ii < count; ++ii) {
+                    double s = 0.0;
+                    for (const auto& entry: rows[ii].entries) {
+                        if (entry.row == entry.col) {
+                            s += entry.value * G[entry.row * d + entry.row];
+                        } else {
+                            s += entry.value * (G[entry.row * d + entry.col] + G[entry.col * d + entry.row]);
+                        }
+                    }
+                    schur[(size_t) rows[ii].constraint * m + j] += s;
+                }
+            }
+        }
+    }
+
+    for (int i = 0; i < m; ++i) {
+        for (int j = 0; j < i; ++j) {
+            schur[(size_t) j * m + i] = schur[(size_t) i * m + j];
+        }
+    }
+}
+
+// the matrix is singular if some constraints are dependent, then a small multiple of the identity is added
+bool NativeSdpSolver::factorSchurComplement() {
+    auto& diagonal = schurDiagonal;
+    diagonal.resize(m);
+    double maxDiagonal = 1.0;
+    for (int i = 0; i < m; ++i) {
+        diagonal[i] = schur[(size_t) i * m + i];
+        maxDiagonal = std::max(maxDiagonal, diagonal[i]);
+    }
+
+    double shift = 0.0;
+    while (!blockedCholesky(schur, m)) {
+        shift = shift == 0.0 ? 1e-14 * maxDiagonal : shift * 100;
+        if (shift > 1e-4 * maxDiagonal) {
+            return false;
+        }
+        for (int i = 0; i < m; ++i) {
+            for (int j = 0; j < i; ++j) {
+                schur[(size_t) i * m + j] = schur[(size_t) j * m + i];
+            }
+            schur[(size_t) i * m + i] = diagonal[i] + shift;
+        }
+    }
+
+    if (numberOfFree == 0) {
+        return true;
+    }
+
+    // F^T M^{-1} F for the elimination of the free variables
+    MinvF.assign(numberOfFree, std::vector<double>());
+    for (int k = 0; k < numberOfFree; ++k) {
+        MinvF[k].assign(m, 0.0);
+        for (const auto& it: freeColumns[k]) {
+            MinvF[k][it.first] += it.second;
+        }
+        solveSchurComplement(MinvF[k]);
+    }
+    std::vector<double> S(numberOfFree * numberOfFree);
+    double maxS = 1.0;
+    for (int k = 0; k < numberOfFree; ++k) {
+        for (int l = 0; l < numberOfFree; ++l) {
+            double s = 0.0;
+            for (const auto& it: freeColumns[k]) {
+                s += it.second * MinvF[l][it.first];
+            }
+            S[k * numberOfFree + l] = s;
+        }
+        maxS = std::max(maxS, S[k * numberOfFree + k]);
+    }
+    double freeShift = 0.0;
+    while (!cholesky(S, schurFreeFactor, numberOfFree)) {
+        double next = freeShift == 0.0 ? 1e-14 * maxS : freeShift * 100;
+        if (next > 1e-4 * maxS) {
+            return false;
+        }
+        for (int k = 0; k < numberOfFree; ++k) {
+            S[k * numberOfFree + k] += next - freeShift;
+        }
+        freeShift = next;
+    }
+    return true;
+}
+
+void NativeSdpSolver::solveSchurComplement(std::vector<double>& rhs) const {
+    for (int i = 0; i < m; ++i) {
+        double t = rhs[i];
+        const double* li = &schur[(size_t) i * m];
+        for (int k = 0; k < i; ++k) {
+            t -= li[k] * rhs[k];
+        }
+        rhs[i] = t / li[i];
+    }
+    for (int i = m - 1; i >= 0; --i) {
+        rhs[i] /= schur[(size_t) i * m + i];
+        double t = rhs[i];
+        for (int k = 0; k < i; ++k) {
+            rhs[k] -= schur[(size_t) i * m + k] * t;
+        }
+    }
+}
+
+void NativeSdpSolver::solveFactored(const std::vector<double>& r1, const std::vector<double>& r2,
+                                    std::vector<double>& dy, std::vector<double>& du) const {
+    dy = r1;
+    solveSchurComplement(dy);
+
+    du.assign(numberOfFree, 0.0);
+    if (numberOfFree == 0) {
+        return;
+    }
+
+    // F^T M^{-1} F du = F^T M^{-1} r1 - r2, dy = M^{-1} (r1 - F du)
+    du = applyFT(dy);
+    for (int k = 0; k < numberOfFree; ++k) {
+        du[k] -= r2[k];
+    }
+    for (int k = 0; k < numberOfFree; ++k) {
+        double t = du[k];
+        for (int l = 0; l < k; ++l) {
+            t -= schurFreeFactor[k * numberOfFree + l] * du[l];
+        }
+        du[k] = t / schurFreeFactor[k * numberOfFree + k];
+    }
+    for (int k = numberOfFree - 1; k >= 0; --k) {
+        double t = du[k];
+        for (int l = k + 1; l < numberOfFree; ++l) {
+            t -= schurFreeFactor[l * numberOfFree + k] * du[l];
+        }
+        du[k] = t / schurFreeFactor[k * numberOfFree + k];
+    }
+    for (int k = 0; k < numberOfFree; ++k) {
+        for (int i = 0; i < m; ++i) {
+            dy[i] -= MinvF[k][i] * du[k];
+        }
+    }
+}
+
+// M dy + F du == r1, F^T dy == r2; M gets ill-conditioned close to the optimum,
+// so the solution is refined with the residuals against the unfactored M
+void NativeSdpSolver::solveNewtonSystem(const std::vector<double>& r1, const std::vector<double>& r2,
+                                        std::vector<double>& dy, std::vector<double>& du) const {
+    solveFactored(r1, r2, dy, du);
+
+    for (int step = 0; step < 2; ++step) {
+        std::vector<double> residual1(m), residual2 = applyFT(dy);
+        auto Fdu = applyF(du);
+#pragma omp parallel for schedule(static)
+        for (int i = 0; i < m; ++i) {
+            // the upper triangle and schurDiagonal keep M
+            double s = schurDiagonal[i] * dy[i];
+            for (int j = 0; j < i; ++j) {
+                s += schur[(size_t) j * m + i] * dy[j];
+            }
+            for (int j = i + 1; j < m; ++j) {
+                s += schur[(size_t) i * m + j] * dy[j];
+            }
+            residual1[i] = r1[i] - s - Fdu[i];
+        }
+        for (int k = 0; k < numberOfFree; ++k) {
+            residual2[k] = r2[k] - residual2[k];
+        }
+
+        std::vector<double> correctionY, correctionU;
+        solveFactored(residual1, residual2, correctionY, correctionU);
+        for (int i = 0; i < m; ++i) {
+            dy[i] += correctionY[i];
+        }
+        for (int k = 0; k < numberOfFree; ++k) {
+            du[k] += correctionU[k];
+        }
+    }
+}
+
+NativeSdpSolver::Direction NativeSdpSolver::computeDirection(const BlockMatrix& rcZinv) {
+    int blocks = blockSizes.size();
+
+    // H = rc Z^{-1} - X Rd Z^{-1}
+    BlockMatrix H(blocks);
+#pragma omp parallel for schedule(dynamic)
+    for (int block = 0; block < blocks; ++block) {
+        int d = dim(block);
+        if (!isPsd(block)) {
+            H[block].resize(d);
+            for (int i = 0; i < d; ++i) {
+                H[block][i] = rcZinv[block][i] - X[block][i] * Rd[block][i] * Zinv[block][i];
+            }
+            continue;
+        }
+        std::vector<double> T, XRdZinv;
+        multiply(X[block], Rd[block], T, d);
+        multiply(T, Zinv[block], XRdZinv, d);
+        H[block] = rcZinv[block];
+        for (int i = 0; i < d * d; ++i) {
+            H[block][i] -= XRdZinv[i];
+        }
+    }
+
+    auto r1 = applyA(H);
+    for (int i = 0; i < m; ++i) {
+        r1[i] = rp[i] - r1[i];
+    }
+
+    Direction direction;
+    solveNewtonSystem(r1, rf, direction.dy, direction.du);
+
+    // dZ = Rd - A^T dy, dX = rc Z^{-1} - X dZ Z^{-1}
+    direction.dZ = applyAT(direction.dy);
+    direction.dX.resize(blocks);
+#pragma omp parallel for schedule(dynamic)
+    for (int block = 0; block < blocks; ++block) {
+        int d = dim(block);
+        auto& dZ = direction.dZ[block];
+        for (size_t i = 0; i < dZ.size(); ++i) {
+            dZ[i] = Rd[block][i] - dZ[i];
+        }
+        auto& dX = direction.dX[block];
+        if (!isPsd(block)) {
+            dX.resize(d);
+            for (int i = 0; i < d; ++i) {
+                dX[i] = rcZinv[block][i] - X[block][i] * dZ[i] * Zinv[block][i];
+            }
+            continue;
+        }
+        std::vector<double> T, XdZZinv;
+        multiply(X[block], dZ, T, d);
+        multiply(T, Zinv[block], XdZZinv, d);
+        dX.resize(d * d);
+        for (int i = 0; i < d; ++i) {
+            for (int j = 0; j <= i; ++j) {
+                double s = (rcZinv[block][i * d + j] + rcZinv[block][j * d + i]
+                            - XdZZinv[i * d + j] - XdZZinv[j * d + i]) / 2;
+                dX[i * d + j] = s;
+                dX[j * d + i] = s;
+            }
+        }
+    }
+    return direction;
+}
+
+// the largest step a with V + a dV >= 0, V is positive definite
+double NativeSdpSolver::maxStep(const BlockMatrix& V, const BlockMatrix& dV) const {
+    double result = std::numeric_limits<double>::infinity();
+    int blocks = blockSizes.size();
+#pragma omp parallel for schedule(dynamic) reduction(min:result)
+    for (int block = 0; block < blocks; ++block) {
+        int d = dim(block);
+        if (!isPsd(block)) {
+            for (int i = 0; i < d; ++i) {
+                if (dV[block][i] < 0) {
+                    result = std::min(result, -V[block][i] / dV[block][i]);
+                }
+            }
+            continue;
+        }
+        // the smallest eigenvalue of L^{-1} dV L^{-T} for V = L L^T
+        std::vector<double> L;
+        if (!cholesky(V[block], L, d)) {
+            result = 0.0;
+            continue;
+        }
+        std::vector<double> T = dV[block];
+        solveLower(L, T, d);
+        std::vector<double> W(d * d);
+        for (int i = 0; i < d; ++i) {
+            for (int j = 0; j < d; ++j) {
+                W[i * d + j] = T[j * d + i];
+            }
+        }
+        solveLower(L, W, d);
+        for (int i = 0; i < d; ++i) {
+            for (int j = 0; j < i; ++j) {
+                double s = (W[i * d + j] + W[j * d + i]) / 2;
+                W[i * d + j] = s;
+                W[j * d + i] = s;
+            }
+        }
+        double lambda = minEigenvalue(W, d);
+        if (lambda < 0) {
+            result = std::min(result, -1 / lambda);
+        }
+    }
+    return result;
+}
+
+static double blockDot(const std::vector<std::vector<double>>& A, const std::vector<std::vector<double>>& B) {
+    double result = 0.0;
+    for (size_t block = 0; block < A.size(); ++block) {
+        result += dot(A[block], B[block]);
+    }
+    return result;
+}
+
+NativeSdpResult NativeSdpSolver::solve() {
+    int blocks = blockSizes.size();
+
+    // the starting point of csdp
+    double maxRatio = 0.0, maxNorm = 0.0;
+    {
+        std::vector<double> norms(m, 0.0);
+        for (int block = 0; block < blocks; ++block) {
+            for (const auto& row: blockRows[block]) {
+                for (const auto& entry: row.entries) {
+                    norms[row.constraint] += entry.value * entry.value * (entry.row == entry.col ? 1 : 2);
+                }
+            }
+        }
+        for (const auto& column: freeColumns) {
+            for (const auto& it: column) {
+                norms[it.first] += it.second * it.second;
+            }
+        }
+        for (int i = 0; i < m; ++i) {
+            norms[i] = std::sqrt(norms[i]);
+            maxRatio = std::max(maxRatio, (1 + std::abs(b[i])) / (1 + norms[i]));
+            maxNorm = std::max(maxNorm, norms[i]);
+        }
+    }
+    int total = std::max(n, 1);
+    X = identityBlocks(10 * total * std::max(maxRatio, 1.0));
+    Z = identityBlocks(10 * (1 + maxNorm) / std::sqrt(total));
+    y.assign(m, 0.0);
+    u.assign(numberOfFree, 0.0);
+
+    NativeSdpResult result, best;
+    best.primalInfeasibility = std::numeric_limits<double>::infinity();
+    double normB = std::sqrt(dot(b, b));
+
+    for (int iteration = 0; ; ++iteration) {
+        result.iterations = iteration;
+
+        Zinv.resize(blocks);
+        bool inverted = true;
+#pragma omp parallel for schedule(dynamic) reduction(&&:inverted)
+        for (int block = 0; block < blocks; ++block) {
+            if (isPsd(block)) {
+                inverted = invertSpd(Z[block], Zinv[block], dim(block)) && inverted;
+            } else {
+                Zinv[block].resize(dim(block));
+                for (int i = 0; i < dim(block); ++i) {
+                    Zinv[block][i] = 1 / Z[block][i];
+                }
+            }
+        }
+
+        // residuals of A(X) + F u == b, A^T y + Z == 0, F^T y == 0
+        rp = applyA(X);
+        auto Fu = applyF(u);
+        for (int i = 0; i < m; ++i) {
+            rp[i] = b[i] - rp[i] - Fu[i];
+        }
+        Rd = applyAT(y);
+        for (int block = 0; block < blocks; ++block) {
+            for (size_t i = 0; i < Rd[block].size(); ++i) {
+                Rd[block][i] = -Rd[block][i] - Z[block][i];
+            }
+        }
+        rf = applyFT(y);
+        for (auto& it: rf) {
+            it = -it;
+        }
+
+        double gap = blockDot(X, Z);
+        double mu = gap / total;
+        double bty = dot(b, y);
+        result.primalInfeasibility = std::sqrt(dot(rp, rp)) / (1 + normB);
+        result.dualInfeasibility = std::sqrt(blockDot(Rd, Rd) + dot(rf, rf));
+        result.gap = gap / (1 + std::abs(bty));
+
+        if (settings.verbose) {
+            std::cout << "Iter: " << std::setw(3) << iteration << std::scientific << std::setprecision(2)
+                      << " pinf: " << result.primalInfeasibility << " dinf: " << result.dualInfeasibility
+                      << " gap: " << result.gap << " mu: " << mu << " bty: " << bty
+                      << std::defaultfloat << std::endl;
+        }
+
+        // the objective is zero, so any interior X with a small residual is optimal; stopping before mu gets tiny
+        // also keeps X away from the boundary of the cone
+        if (result.primalInfeasibility < settings.tolerance) {
+            result.status = NativeSdpStatus::SOLVED;
+            break;
+        }
+        // y / b^T y certifies that there is no X: b^T y' = 1, A^T y' <= 0, F^T y' = 0
+        if (bty > 0 && result.dualInfeasibility < settings.tolerance * bty) {
+            result.status = NativeSdpStatus::PRIMAL_INFEASIBLE;
+            break;
+        }
+        if (result.primalInfeasibility < best.primalInfeasibility) {
+            best.primalInfeasibility = result.primalInfeasibility;
+            best.blocks = X;
+            best.freeVariables = u;
+            best.y = y;
+            best.iterations = iteration;
+        }
+        // on a feasible set without interior the newton system runs out of accuracy close to the boundary,
+        // after that the residual only grows
+        bool diverged = result.primalInfeasibility > 1e3 * best.primalInfeasibility;
+        bool cancelled = settings.cancel != nullptr && settings.cancel->load();
+        if (iteration >= settings.maxIterations || !inverted || diverged || cancelled) {
+            break;
+        }
+
+        assembleSchurComplement();
+        if (!factorSchurComplement()) {
+            break;
+        }
+
+        // predictor, rc = -X Z
+        BlockMatrix minusX = X;
+        for (auto& block: minusX) {
+            for (auto& it: block) {
+                it = -it;
+            }
+        }
+        auto predictor = computeDirection(minusX);
+        double alphaP = std::min(1.0, maxStep(X, predictor.dX));
+        double alphaD = std::min(1.0, maxStep(Z, predictor.dZ));
+
+        BlockMatrix nextX = X, nextZ = Z;
+        for (int block = 0; block < blocks; ++block) {
+            for (size_t i = 0; i < X[block].size(); ++i) {
+                nextX[block][i] += alphaP * predictor.dX[block][i];
+                nextZ[block][i] += alphaD * predictor.dZ[block][i];
+            }
+        }
+        double sigma = std::min(1.0, std::pow(blockDot(nextX, nextZ) / std::max(gap, 1e-300), 3));
+
+        // corrector, rc = sigma mu I - X Z - dX dZ
+        BlockMatrix rcZinv(blocks);
+#pragma omp parallel for schedule(dynamic)
+        for (int block = 0; block < blocks; ++block) {
+            int d = dim(block);
+            if (!isPsd(block)) {
+                rcZinv[block].resize(d);
+                for (int i = 0; i < d; ++i) {
+                    rcZinv[block][i] = (sigma * mu - predictor.dX[block][i] * predictor.dZ[block][i]) * Zinv[block][i]
+                                       - X[block][i];
+                }
+                continue;
+            }
+            std::vector<double> dXdZ, T;
+            multiply(predictor.dX[block], predictor.dZ[block], dXdZ, d);
+            multiply(dXdZ, Zinv[block], T, d);
+            rcZinv[block].resize(d * d);
+            for (int i = 0; i < d * d; ++i) {
+                rcZinv[block][i] = sigma * mu * Zinv[block][i] - X[block][i] - T[i];
+            }
+        }
+        auto corrector = computeDirection(rcZinv);
+        alphaP = std::min(1.0, settings.stepFraction * maxStep(X, corrector.dX));
+        alphaD = std::min(1.0, settings.stepFraction * maxStep(Z, corrector.dZ));
+
+        for (int block = 0; block < blocks; ++block) {
+            for (size_t i = 0; i < X[block].size(); ++i) {
+                X[block][i] += alphaP * corrector.dX[block][i];
+                Z[block][i] += alphaD * corrector.dZ[block][i];
+            }
+        }
+        for (int k = 0; k < numberOfFree; ++k) {
+            u[k] += alphaP * corrector.du[k];
+        }
+        for (int i = 0; i < m; ++i) {
+            y[i] += alphaD * corrector.dy[i];
+        }
+    }
+
+    if (result.status == NativeSdpStatus::NOT_CONVERGED) {
+        if (best.primalInfeasibility < settings.acceptableTolerance) {
+            best.status = NativeSdpStatus::SOLVED_INACCURATE;
+            best.dualInfeasibility = result.dualInfeasibility;
+            best.gap = result.gap;
+            if (settings.verbose) {
+                std::cout << "Partial success: the residual stalled at " << best.primalInfeasibility
+                          << " in iteration " << best.iterations << std::endl;
+            }
+        }
+        return best.status == NativeSdpStatus::SOLVED_INACCURATE ? best : result;
+    }
+
+    result.blocks = X;
+    result.freeVariables = u;
+    result.y = y;
+    return result;
+}
+
+// householder tridiagonalization and the implicit ql method (tred2 and tql2 of EISPACK), the eigenvectors replace
+// the columns of V
+static void symmetricEigen(std::vector<double>& V, std::vector<double>& eigenvalues, int n) {
+    auto& d = eigenvalues;
+    d.assign(n, 0.0);
+    std::vector<double> e(n, 0.0);
+
+    for (int j = 0; j < n; ++j) {
+        d[j] = V[(n - 1) * n + j];
+    }
+    for (int i = n - 1; i > 0; --i) {
+        double scale = 0.0, h = 0.0;
+        for (int k = 0; k < i; ++k) {
+            scale += std::abs(d[k]);
+        }
+        if (scale == 0.0) {
+            e[i] = d[i - 1];
+            for (int j = 0; j < i; ++j) {
+                d[j] = V[(i - 1) * n + j];
+                V[i * n + j] = 0.0;
+                V[j * n + i] = 0.0;
+            }
+        } else {
+            for (int k = 0; k < i; ++k) {
+                d[k] /= scale;
+                h += d[k] * d[k];
+            }
+            double f = d[i - 1];
+            double g = f > 0 ? -std::sqrt(h) : std::sqrt(h);
+            e[i] = scale * g;
+            h -= f * g;
+            d[i - 1] = f - g;
+            for (int j = 0; j < i; ++j) {
+                e[j] = 0.0;
+            }
+            for (int j = 0; j < i; ++j) {
+                f = d[j];
+                V[j * n + i] = f;
+                g = e[j] + V[j * n + j] * f;
+                for (int k = j + 1; k <= i - 1; ++k) {
+                    g += V[k * n + j] * d[k];
+                    e[k] += V[k * n + j] * f;
+                }
+                e[j] = g;
+            }
+            f = 0.0;
+            for (int j = 0; j < i; ++j) {
+                e[j] /= h;
+                f += e[j] * d[j];
+            }
+            double hh = f / (h + h);
+            for (int j = 0; j < i; ++j) {
+                e[j] -= hh * d[j];
+            }
+            for (int j = 0; j < i; ++j) {
+                f = d[j];
+                g = e[j];
+                for (int k = j; k <= i - 1; ++k) {
+                    V[k * n + j] -= f * e[k] + g * d[k];
+                }
+                d[j] = V[(i - 1) * n + j];
+                V[i * n + j] = 0.0;
+            }
+        }
+        d[i] = h;
+    }
+
+    for (int i = 0; i < n - 1; ++i) {
+        V[(n - 1) * n + i] = V[i * n + i];
+        V[i * n + i] = 1.0;
+        double h = d[i + 1];
+        if (h != 0.0) {
+            for (int k = 0; k <= i; ++k) {
+                d[k] = V[k * n + i + 1] / h;
+            }
+            for (int j = 0; j <= i; ++j) {
+                double g = 0.0;
+                for (int k = 0; k <= i; ++k) {
+                    g += V[k * n + i + 1] * V[k * n + j];
+                }
+                for (int k = 0; k <= i; ++k) {
+                    V[k * n + j] -= g * d[k];
+                }
+            }
+        }
+        for (int k = 0; k <= i; ++k) {
+            V[k * n + i + 1] = 0.0;
+        }
+    }
+    for (int j = 0; j < n; ++j) {
+        d[j] = V[(n - 1) * n + j];
+        V[(n - 1) * n + j] = 0.0;
+    }
+    V[(n - 1) * n + n - 1] = 1.0;
+    e[0] = 0.0;
+
+    for (int i = 1; i < n; ++i) {
+        e[i - 1] = e[i];
+    }
+    e[n - 1] = 0.0;
+
+    double f = 0.0, tst1 = 0.0;
+    const double eps = std::numeric_limits<double>::epsilon();
+    for (int l = 0; l < n; ++l) {
+        tst1 = std::max(tst1, std::abs(d[l]) + std::abs(e[l]));
+        int m = l;
+        while (m < n && std::abs(e[m]) > eps * tst1) {
+            ++m;
+        }
+        if (m > l) {
+            for (int iteration = 0; iteration < 64 && std::abs(e[l]) > eps * tst1; ++iteration) {
+                double g = d[l];
+                double p = (d[l + 1] - g) / (2.0 * e[l]);
+                double r = std::hypot(p, 1.0);
+                if (p < 0) {
+                    r = -r;
+                }
+                d[l] = e[l] / (p + r);
+                d[l + 1] = e[l] * (p + r);
+                double dl1 = d[l + 1];
+                double h = g - d[l];
+                for (int i = l + 2; i < n; ++i) {
+                    d[i] -= h;
+                }
+                f += h;
+
+                p = d[m];
+                double c = 1.0, c2 = c, c3 = c;
+                double el1 = e[l + 1];
+                double s = 0.0, s2 = 0.0;
+                for (int i = m - 1; i >= l; --i) {
+                    c3 = c2;
+                    c2 = c;
+                    s2 = s;
+                    g = c * e[i];
+                    h = c * p;
+                    r = std::hypot(p, e[i]);
+                    e[i + 1] = s * r;
+                    s = e[i] / r;
+                    c = p / r;
+                    p = c * d[i] - s * g;
+                    d[i + 1] = h + s * (c * g + s * d[i]);
+                    for (int k = 0; k < n; ++k) {
+                        h = V[k * n + i + 1];
+                        V[k * n + i + 1] = s * V[k * n + i] + c * h;
+                        V[k * n + i] = c * V[k * n + i] - s * h;
+                    }
+                }
+                p = -s * s2 * c3 * el1 * e[l] / dl1;
+                e[l] = s * p;
+                d[l] = c * p;
+            }
+        }
+        d[l] += f;
+        e[l] = 0.0;
+    }
+}
+
+NativeAdmmSolver::NativeAdmmSolver(const NativeSdpProblem& problem, const NativeAdmmSettings& settings)
+        : m(problem.constraints.size()), numberOfVariables(0), numberOfFree(problem.numberOfFreeVariables),
+          blockSizes(problem.blockSizes), settings(settings) {
+    for (int block = 0; block < blockSizes.size(); ++block) {
+        int size = blockSizes[block];
+        if (size == 0) {
+            throw std::runtime_error("Empty block " + std::to_string(block));
+        }
+        blockOffsets.push_back(numberOfVariables);
+        numberOfVariables += size > 0 ? size * (size + 1) / 2 : -size;
+    }
+    blockOffsets.push_back(numberOfVariables);
+    numberOfVariables += numberOfFree;
+
+    const double sqrt2 = std::sqrt(2.0);
+    rowStart.assign(1, 0);
+    std::vector<std::pair<int, double>> row;
+    for (int i = 0; i < m; ++i) {
+        const auto& constraint = problem.constraints[i];
+
+        row.clear();
+        for (const auto& entry: constraint.entries) {
+            if (entry.block < 0 || entry.block >= blockSizes.size()) {
+                throw std::runtime_error("Unknown block " + std::to_string(entry.block));
+            }
+            int size = blockSizes[entry.block];
+            int d = size > 0 ? size : -size;
+            int r = std::min(entry.row, entry.col), c = std::max(entry.row, entry.col);
+            if (r < 0 || c >= d || (size < 0 && r != c)) {
+                throw std::runtime_error("Wrong entry position in block " + std::to_string(entry.block));
+            }
+            if (size < 0) {
+                row.emplace_back(blockOffsets[entry.block] + r, entry.value);
+            } else {
+                // <A, X> counts an off-diagonal entry twice, the svec variable is sqrt(2) X_rc
+                row.emplace_back(blockOffsets[entry.block] + r * d - r * (r - 1) / 2 + c - r,
+                                 r == c ? entry.value : sqrt2 * entry.value);
+            }
+        }
+        for (const auto& entry: constraint.freeEntries) {
+            if (entry.first < 0 || entry.first >= numberOfFree) {
+                throw std::runtime_error("Unknown free variable " + std::to_string(entry.first));
+            }
+            row.emplace_back(blockOffsets.back() + entry.first, entry.second);
+        }
+
+        std::sort(row.begin(), row.end());
+        size_t first = columns.size();
+        for (const auto& it: row) {
+            if (columns.size() > first && columns.back() == it.first) {
+                values.back() += it.second;
+            } else {
+                columns.push_back(it.first);
+                values.push_back(it.second);
+            }
+        }
+        double norm = 0.0;
+        size_t last = first;
+        for (size_t k = first; k < columns.size(); ++k) {
+            if (values[k] != 0.0) {
+                columns[last] = columns[k];
+                values[last++] = values[k];
+                norm += values[k] * values[k];
+            }
+        }
+        columns.resize(last);
+        values.resize(last);
+
+        rowScale.push_back(norm > 0.0 ? 1 / std::sqrt(norm) : 1.0);
+        if (norm == 0.0 && constraint.rhs != 0.0) {
+            infeasibleRows.push_back(i);
+        }
+        for (size_t k = first; k < last; ++k) {
+            values[k] *= rowScale.back();
+        }
+        b.push_back(constraint.rhs * rowScale.back());
+        rowStart.push_back(columns.size());
+    }
+
+    factorKkt();
+}
+
+std::vector<double> NativeAdmmSolver::multiplyA(const std::vector<double>& x) const {
+    std::vector<double> result(m);
+#pragma omp parallel for schedule(static)
+    for (int i = 0; i < m; ++i) {
+        double s = 0.0;
+        for (size_t k = rowStart[i]; k < rowStart[i + 1]; ++k) {
+            s += values[k] * x[columns[k]];
+        }
+        result[i] = s;
+    }
+    return result;
+}
+
+std::vector<double> NativeAdmmSolver::multiplyAT(const std::vector<double>& y) const {
+    std::vector<double> result(numberOfVariables, 0.0);
+    for (int i = 0; i < m; ++i) {
+        for (size_t k = rowStart[i]; k < rowStart[i + 1]; ++k) {
+            result[columns[k]] += values[k] * y[i];
+        }
+    }
+    return result;
+}
+
+// the nodes are the variables followed by the rows, a variable is adjacent to the rows it appears in
+void NativeAdmmSolver::factorKkt() {
+    int n = numberOfVariables + m;
+
+    std::vector<std::vector<std::pair<int, double>>> variableRows(numberOfVariables);
+    std::vector<std::vector<int>> adjacency(n);
+    for (int i = 0; i < m; ++i) {
+        for (size_t k = rowStart[i]; k < rowStart[i + 1]; ++k) {
+            variableRows[columns[k]].emplace_back(i, values[k]);
+            adjacency[columns[k]].push_back(numberOfVariables + i);
+            adjacency[numberOfVariables + i].push_back(columns[k]);
+        }
+    }
+
+    // minimum degree on the explicit elimination graph, the neighbours of a node when it is eliminated are the
+    // pattern of its column of L; a free variable that appears in many rows goes last, so the fill it causes
+    // stays among the free variables
+    std::set<std::pair<size_t, int>> queue;
+    for (int v = 0; v < n; ++v) {
+        queue.emplace(adjacency[v].size(), v);
+    }
+    std::vector<int> order;
+    order.reserve(n);
+    std::vector<std::vector<int>> patterns(n);
+    std::vector<int> merged;
+    while (!queue.empty()) {
+        int v = queue.begin()->second;
+        queue.erase(queue.begin());
+        order.push_back(v);
+        for (int u: adjacency[v]) {
+            queue.erase({adjacency[u].size(), u});
+            merged.clear();
+            std::set_union(adjacency[u].begin(), adjacency[u].end(), adjacency[v].begin(), adjacency[v].end(),
+                           std::back_inserter(merged));
+            merged.erase(std::remove_if(merged.begin(), merged.end(), [u, v](int w) {
+                return w == u || w == v;
+            }), merged.end());
+            adjacency[u].swap(merged);
+            queue.emplace(adjacency[u].size(), u);
+        }
+        patterns[v].swap(adjacency[v]);
+    }
+
+    permutation.assign(n, 0);
+    for (int k = 0; k < n; ++k) {
+        permutation[order[k]] = k;
+    }
+    factorColumnStart.assign(1, 0);
+    factorRowIndex.clear();
+    for (int k = 0; k < n; ++k) {
+        size_t first = factorRowIndex.size();
+        for (int u: patterns[order[k]]) {
+            factorRowIndex.push_back(permutation[u]);
+        }
+        std::sort(factorRowIndex.begin() + first, factorRowIndex.end());
+        factorColumnStart.push_back(factorRowIndex.size());
+        std::vector<int>().swap(patterns[order[k]]);
+    }
+
+    // the rows of L, for the left-looking factorization
+    std::vector<size_t> factorRowStart(n + 1, 0);
+    for (int i: factorRowIndex) {
+        factorRowStart[i + 1]++;
+    }
+    std::partial_sum(factorRowStart.begin(), factorRowStart.end(), factorRowStart.begin());
+    std::vector<int> factorRowColumns(factorRowIndex.size());
+    {
+        std::vector<size_t> next(factorRowStart.begin(), factorRowStart.end() - 1);
+        for (int j = 0; j < n; ++j) {
+            for (size_t q = factorColumnStart[j]; q < factorColumnStart[j + 1]; ++q) {
+                factorRowColumns[next[factorRowIndex[q]]++] = j;
+            }
+        }
+    }
+
+    // the quasi-definite matrix has an L D L^T factorization for every ordering
+    factorValues.assign(factorRowIndex.size(), 0.0);
+    factorDiagonal.assign(n, 0.0);
+    std::vector<size_t> nextEntry(factorColumnStart.begin(), factorColumnStart.end() - 1);
+    std::vector<double> work(n, 0.0);
+    for (int k = 0; k < n; ++k) {
+        int v = order[k];
+        if (v < numberOfVariables) {
+            work[k] = 1.0;
+            for (const auto& it: variableRows[v]) {
+                int i = permutation[numberOfVariables + it.first];
+                if (i > k) {
+                    work[i] = it.second;
+                }
+            }
+        } else {
+            work[k] = -settings.regularization;
+            int row = v - numberOfVariables;
+            for (size_t p = rowStart[row]; p < rowStart[row + 1]; ++p) {
+                int i = permutation[columns[p]];
+                if (i > k) {
+                    work[i] = values[p];
+                }
+            }
+        }
+
+        for (size_t r = factorRowStart[k]; r < factorRowStart[k + 1]; ++r) {
+            int j = factorRowColumns[r];
+            size_t p = nextEntry[j]++;
+            double lkj = factorValues[p];
+            double t = lkj * factorDiagonal[j];
+            work[k] -= lkj * t;
+            for (size_t q = p + 1; q < factorColumnStart[j + 1]; ++q) {
+                work[factorRowIndex[q]] -= factorValues[q] * t;
+            }
+        }
+
+        double pivot = work[k];
+        work[k] = 0.0;
+        if (pivot == 0.0 || !std::isfinite(pivot)) {
+            throw std::runtime_error("Zero pivot in the kkt factorization");
+        }
+        factorDiagonal[k] = pivot;
+        for (size_t q = factorColumnStart[k]; q < factorColumnStart[k + 1]; ++q) {
+            factorValues[q] = work[factorRowIndex[q]] / pivot;
+            work[factorRowIndex[q]] = 0.0;
+        }
+    }
+}
+
+void NativeAdmmSolver::solveFactoredKkt(std::vector<double>& rhs) const {
+    int n = numberOfVariables + m;
+    std::vector<double> x(n);
+    for (int v = 0; v < n; ++v) {
+        x[permutation[v]] = rhs[v];
+    }
+    for (int k = 0; k < n; ++k) {
+        double t = x[k];
+        for (size_t q = factorColumnStart[k]; q < factorColumnStart[k + 1]; ++q) {
+            x[factorRowIndex[q]] -= factorValues[q] * t;
+        }
+    }
+    for (int k = 0; k < n; ++k) {
+        x[k] /= factorDiagonal[k];
+    }
+    for (int k = n - 1; k >= 0; --k) {
+        double t = x[k];
+        for (size_t q = factorColumnStart[k]; q < factorColumnStart[k + 1]; ++q) {
+            t -= factorValues[q] * x[factorRowIndex[q]];
+        }
+        x[k] = t;
+    }
+    for (int v = 0; v < n; ++v) {
+        rhs[v] = x[permutation[v]];
+    }
+}
+
+void NativeAdmmSolver::solveKkt(std::vector<double>& rhs) const {
+    const std::vector<double> original = rhs;
+    solveFactoredKkt(rhs);
+
+    std::vector<double> x(numberOfVariables), y(m), residual(numberOfVariables + m);
+    for (int step = 0; step < 2; ++step) {
+        std::copy(rhs.begin(), rhs.begin() + numberOfVariables, x.begin());
+        std::copy(rhs.begin() + numberOfVariables, rhs.end(), y.begin());
+        auto Ax = multiplyA(x);
+        auto ATy = multiplyAT(y);
+        for (int j = 0; j < numberOfVariables; ++j) {
+            residual[j] = original[j] - x[j] - ATy[j];
+        }
+        for (int i = 0; i < m; ++i) {
+            residual[numberOfVariables + i] = original[numberOfVariables + i] - Ax[i];
+        }
+        solveFactoredKkt(residual);
+        for (size_t k = 0; k < rhs.size(); ++k) {
+            rhs[k] += residual[k];
+        }
+    }
+}
+
+void NativeAdmmSolver::projectCone(std::vector<double>& v) const {
+    const double sqrt2 = std::sqrt(2.0);
+    int blocks = blockSizes.size();
+#pragma omp parallel for schedule(dynamic)
+    for (int block = 0; block < blocks; ++block) {
+        double* x = &v[blockOffsets[block]];
+        int d = blockSizes[block];
+        if (d < 0) {
+            for (int i = 0; i < -d; ++i) {
+                x[i] = std::max(x[i], 0.0);
+            }
+            continue;
+        }
+
+        std::vector<double> S(d * d), eigenvalues;
+        for (int r = 0, index = 0; r < d; ++r) {
+            for (int c = r; c < d; ++c, ++index) {
+                S[r * d + c] = S[c * d + r] = r == c ? x[index] : x[index] / sqrt2;
+            }
+        }
+        symmetricEigen(S, eigenvalues, d);
+
+        std::vector<int> negative, positive;
+        for (int k = 0; k < d; ++k) {
+            (eigenvalues[k] < 0 ? negative : positive).push_back(k);
+        }
+        if (negative.empty()) {
+            continue;
+        }
+        // either the positive part is rebuilt or the negative one is subtracted, whichever has less eigenvectors
+        bool rebuild = positive.size() < negative.size();
+        const auto& used = rebuild ? positive : negative;
+        for (int r = 0, index = 0; r < d; ++r) {
+            for (int c = r; c < d; ++c, ++index) {
+                double s = 0.0;
+                for (int k: used) {
+                    s += eigenvalues[k] * S[r * d + k] * S[c * d + k];
+                }
+                if (r != c) {
+                    s *= sqrt2;
+                }
+                x[index] = rebuild ? s : x[index] - s;
+            }
+        }
+    }
+}
+
+std::vector<double> NativeAdmmSolver::packResult(const NativeSdpResult& result) const {
+    if (result.blocks.size() != blockSizes.size() || result.freeVariables.size() != numberOfFree ||
+        (!result.y.empty() && result.y.size() != m)) {
+        throw std::runtime_error("The warm start does not fit the problem");
+    }
+
+    const double sqrt2 = std::sqrt(2.0);
+    std::vector<double> x(numberOfVariables, 0.0);
+    for (int block = 0; block < blockSizes.size(); ++block) {
+        int d = blockSizes[block];
+        const auto& X = result.blocks[block];
+        if (X.size() != (d > 0 ? d * d : -d)) {
+            throw std::runtime_error("The warm start does not fit block " + std::to_string(block));
+        }
+        double* v = &x[blockOffsets[block]];
+        if (d < 0) {
+            std::copy(X.begin(), X.end(), v);
+            continue;
+        }
+        for (int r = 0, index = 0; r < d; ++r) {
+            for (int c = r; c < d; ++c, ++index) {
+                v[index] = r == c ? X[r * d + r] : sqrt2 * (X[r * d + c] + X[c * d + r]) / 2;
+            }
+        }
+    }
+    std::copy(result.freeVariables.begin(), result.freeVariables.end(), x.begin() + blockOffsets.back());
+
+    // z = x - A^T y at a fixed point of the iteration
+    if (!result.y.empty()) {
+        std::vector<double> scaled(m);
+        for (int i = 0; i < m; ++i) {
+            scaled[i] = result.y[i] / rowScale[i];
+        }
+        auto ATy = multiplyAT(scaled);
+        for (int j = 0; j < numberOfVariables; ++j) {
+            x[j] -= ATy[j];
+        }
+    }
+    return x;
+}
+
+void NativeAdmmSolver::unpackResult(const std::vector<double>& x, NativeSdpResult& result) const {
+    const double sqrt2 = std::sqrt(2.0);
+    result.blocks.assign(blockSizes.size(), std::vector<double>());
+    for (int block = 0; block < blockSizes.size(); ++block) {
+        int d = blockSizes[block];
+        const double* v = &x[blockOffsets[block]];
+        auto& X = result.blocks[block];
+        if (d < 0) {
+            X.assign(v, v - d);
+            continue;
+        }
+        X.assign(d * d, 0.0);
+        for (int r = 0, index = 0; r < d; ++r) {
+            for (int c = r; c < d; ++c, ++index) {
+                X[r * d + c] = X[c * d + r] = r == c ? v[index] : v[index] / sqrt2;
+            }
+        }
+    }
+    result.freeVariables.assign(x.begin() + blockOffsets.back(), x.end());
+}
+
+NativeSdpResult NativeAdmmSolver::solve() {
+    return run(std::vector<double>(numberOfVariables, 0.0));
+}
+
+NativeSdpResult NativeAdmmSolver::solve(const NativeSdpResult& warmStart) {
+    return run(packResult(warmStart));
+}
+
+NativeSdpResult NativeAdmmSolver::run(std::vector<double> z) {
+    NativeSdpResult result;
+    result.y.assign(m, 0.0);
+
+    // 0 == b_i is a certificate on its own
+    if (!infeasibleRows.empty()) {
+        int i = infeasibleRows.front();
+        result.status = NativeSdpStatus::PRIMAL_INFEASIBLE;
+        result.y[i] = b[i] > 0 ? 1.0 : -1.0;
+        unpackResult(std::vector<double>(numberOfVariables, 0.0), result);
+        return result;
+    }
+
+    double normB = 0.0;
+    for (int i = 0; i < m; ++i) {
+        normB += b[i] * b[i] / (rowScale[i] * rowScale[i]);
+    }
+    normB = std::sqrt(normB);
+
+    if (settings.verbose) {
+        std::cout << "ADMM: " << numberOfVariables << " variables, " << m << " constraints, " << values.size()
+                  << " nonzeros, " << factorRowIndex.size() << " in the kkt factor" << std::endl;
+    }
+
+    std::vector<double> kkt(numberOfVariables + m), xA(numberOfVariables), xK(numberOfVariables);
+    for (int iteration = 0; ; ++iteration) {
+        result.iterations = iteration;
+
+        // xA = P_A(z), the multiplier of A x == b gives y
+        std::copy(z.begin(), z.end(), kkt.begin());
+        std::copy(b.begin(), b.end(), kkt.begin() + numberOfVariables);
+        solveKkt(kkt);
+        std::copy(kkt.begin(), kkt.begin() + numberOfVariables, xA.begin());
+        for (int j = 0; j < numberOfVariables; ++j) {
+            xK[j] = 2 * xA[j] - z[j];
+        }
+        projectCone(xK);
+
+        if (iteration % settings.checkInterval == 0 || iteration >= settings.maxIterations) {
+            auto residual = multiplyA(xK);
+            double s = 0.0;
+            for (int i = 0; i < m; ++i) {
+                double r = (residual[i] - b[i]) / rowScale[i];
+                s += r * r;
+            }
+            result.primalInfeasibility = std::sqrt(s) / (1 + normB);
+
+            // if the sets do not intersect, xA - xK tends to the shortest vector between them, which is A^T y
+            // for y with A^T y in -K and b^T y > 0
+            std::vector<double> displacement(numberOfVariables + m, 0.0);
+            double distance = 0.0;
+            for (int j = 0; j < numberOfVariables; ++j) {
+                displacement[j] = xA[j] - xK[j];
+                distance += displacement[j] * displacement[j];
+            }
+            solveKkt(displacement);
+            std::vector<double> certificate(displacement.begin() + numberOfVariables, displacement.end());
+            double bty = dot(b, certificate);
+            auto violation = multiplyAT(certificate);
+            projectCone(violation);
+            result.dualInfeasibility = std::sqrt(dot(violation, violation));
+            result.gap = std::sqrt(distance);
+
+            if (settings.verbose) {
+                std::cout << "Iter: " << std::setw(5) << iteration << std::scientific << std::setprecision(2)
+                          << " pinf: " << result.primalInfeasibility << " dist: " << result.gap
+                          << " bty: " << bty << " dinf: " << result.dualInfeasibility
+                          << std::defaultfloat << std::endl;
+            }
+
+            if (result.primalInfeasibility < settings.tolerance) {
+                result.status = NativeSdpStatus::SOLVED;
+                break;
+            }
+            if (bty > 0 && result.dualInfeasibility < settings.tolerance * bty) {
+                result.status = NativeSdpStatus::PRIMAL_INFEASIBLE;
+                for (int i = 0; i < m; ++i) {
+                    result.y[i] = certificate[i] * rowScale[i];
+                }
+                unpackResult(xK, result);
+                return result;
+            }
+            if (iteration >= settings.maxIterations) {
+                result.status = NativeSdpStatus::NOT_CONVERGED;
+                break;
+            }
+        }
+
+        if (settings.cancel != nullptr && settings.cancel->load()) {
+            result.status = NativeSdpStatus::NOT_CONVERGED;
+            break;
+        }
+
+        for (int j = 0; j < numberOfVariables; ++j) {
+            z[j] += settings.relaxation * (xK[j] - xA[j]);
+        }
+    }
+
+    // z - xA == A^T lambda, and A^T y == -(z - xA) at a fixed point
+    unpackResult(xK, result);
+    for (int i = 0; i < m; ++i) {
+        result.y[i] = -kkt[numberOfVariables + i] * rowScale[i];
+    }
+    return result;
+}
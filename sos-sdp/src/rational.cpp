@@ -0,0 +1,449 @@
+//
+// Created by sergey on 16.10.23.
+//
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "rational.h"
+
+namespace symbolic_ring {
+
+    namespace {
+        unsigned __int128 absWide(__int128 value) {
+            return value < 0 ? -(unsigned __int128) value : (unsigned __int128) value;
+        }
+
+        unsigned __int128 gcdWide(unsigned __int128 a, unsigned __int128 b) {
+            while (b != 0) {
+                auto t = a % b;
+                a = b;
+                b = t;
+            }
+            return a;
+        }
+
+        bool fitsInInt64(__int128 value) {
+            return value >= std::numeric_limits<int64_t>::min() && value <= std::numeric_limits<int64_t>::max();
+        }
+    }
+
+    BigInt::BigInt(__int128 value) : negative(value < 0) {
+        auto magnitude = absWide(value);
+        while (magnitude != 0) {
+            limbs.push_back((uint32_t) magnitude);
+            magnitude >>= 32;
+        }
+    }
+
+    bool BigInt::fitsInInt64() const {
+        if (limbs.size() > 2) {
+            return false;
+        }
+        unsigned __int128 magnitude = 0;
+        for (int i = (int) limbs.size() - 1; i >= 0; --i) {
+            magnitude = (magnitude << 32) | limbs[i];
+        }
+        auto limit = (unsigned __int128) std::numeric_limits<int64_t>::max() + (negative ? 1 : 0);
+        return magnitude <= limit;
+    }
+
+    int64_t BigInt::toInt64() const {
+        if (!fitsInInt64()) {
+            throw std::runtime_error("BigInt " + toString() + " does not fit into int64");
+        }
+        unsigned __int128 magnitude = 0;
+        for (int i = (int) limbs.size() - 1; i >= 0; --i) {
+            magnitude = (magnitude << 32) | limbs[i];
+        }
+        return (int64_t) (negative ? -(__int128) magnitude : (__int128) magnitude);
+    }
+
+    double BigInt::toDouble() const {
+        double result = 0;
+        for (int i = (int) limbs.size() - 1; i >= 0; --i) {
+            result = result * 4294967296.0 + limbs[i];
+        }
+        return negative ? -result : result;
+    }
+
+    std::string BigInt::toString() const {
+        if (limbs.empty()) {
+            return "0";
+        }
+        std::string digits;
+        auto magnitude = limbs;
+        while (!magnitude.empty()) {
+            uint64_t remainder = 0;
+            for (int i = (int) magnitude.size() - 1; i >= 0; --i) {
+                uint64_t current = (remainder << 32) | magnitude[i];
+                magnitude[i] = (uint32_t) (current / 1000000000u);
+                remainder = current % 1000000000u;
+            }
+            trim(magnitude);
+            for (int i = 0; i < 9 && (!magnitude.empty() || remainder != 0); ++i) {
+                digits.push_back((char) ('0' + remainder % 10));
+                remainder /= 10;
+            }
+        }
+        if (negative) {
+            digits.push_back('-');
+        }
+        std::reverse(digits.begin(), digits.end());
+        return digits;
+    }
+
+    BigInt BigInt::operator-() const {
+        BigInt result = *this;
+        result.negative = !result.limbs.empty() && !negative;
+        return result;
+    }
+
+    int BigInt::compareMagnitude(const std::vector<uint32_t> &l, const std::vector<uint32_t> &r) {
+        if (l.size() != r.size()) {
+            return l.size() < r.size() ? -1 : 1;
+        }
+        for (int i = (int) l.size() - 1; i >= 0; --i) {
+            if (l[i] != r[i]) {
+                return l[i] < r[i] ? -1 : 1;
+            }
+        }
+        return 0;
+    }
+
+    std::vector<uint32_t> BigInt::addMagnitude(const std::vector<uint32_t> &l, const std::vector<uint32_t> &r) {
+        std::vector<uint32_t> result(std::max(l.size(), r.size()) + 1, 0);
+        uint64_t carry = 0;
+        for (size_t i = 0; i < result.size(); ++i) {
+            uint64_t sum = carry;
+            sum += i < l.size() ? l[i] : 0;
+            sum += i < r.size() ? r[i] : 0;
+            result[i] = (uint32_t) sum;
+            carry = sum >> 32;
+        }
+        trim(result);
+        return result;
+    }
+
+    std::vector<uint32_t> BigInt::subMagnitude(const std::vector<uint32_t> &l, const std::vector<uint32_t> &r) {
+        std::vector<uint32_t> result(l.size(), 0);
+        int64_t borrow = 0;
+        for (size_t i = 0; i < l.size(); ++i) {
+            int64_t diff = (int64_t) l[i] - borrow - (i < r.size() ? r[i] : 0);
+            borrow = diff < 0 ? 1 : 0;
+            result[i] = (uint32_t) (diff + (borrow << 32));
+        }
+        trim(result);
+        return result;
+    }
+
+    void BigInt::trim(std::vector<uint32_t> &limbs) {
+        while (!limbs.empty() && limbs.back() == 0) {
+            limbs.pop_back();
+        }
+    }
+
+    BigInt operator+(const BigInt &l, const BigInt &r) {
+        BigInt result;
+        if (l.negative == r.negative) {
+            result.limbs = BigInt::addMagnitude(l.limbs, r.limbs);
+            result.negative = l.negative;
+        } else if (BigInt::compareMagnitude(l.limbs, r.limbs) >= 0) {
+            result.limbs = BigInt::subMagnitude(l.limbs, r.limbs);
+            result.negative = l.negative;
+        } else {
+            result.limbs = BigInt::subMagnitude(r.limbs, l.limbs);
+            result.negative = r.negative;
+        }
+        result.negative = result.negative && !result.limbs.empty();
+        return result;
+    }
+
+    BigInt operator-(const BigInt &l, const BigInt &r) {
+        return l + (-r);
+    }
+
+    BigInt operator*(const BigInt &l, const BigInt &r) {
+        BigInt result;
+        if (l.isZero() || r.isZero()) {
+            return result;
+        }
+        result.limbs.assign(l.limbs.size() + r.limbs.size(), 0);
+        for (size_t i = 0; i < l.limbs.size(); ++i) {
+            uint64_t carry = 0;
+            for (size_t j = 0; j < r.limbs.size(); ++j) {
+                uint64_t current = (uint64_t) l.limbs[i] * r.limbs[j] + result.limbs[i + j] + carry;
+                result.limbs[i + j] = (uint32_t) current;
+                carry = current >> 32;
+            }
+            result.limbs[i + r.limbs.size()] = (uint32_t) carry;
+        }
+        BigInt::trim(result.limbs);
+        result.negative = l.negative != r.negative;
+        return result;
+    }
+
+    void divMod(const BigInt &l, const BigInt &r, BigInt &quotient, BigInt &remainder) {
+        if (r.isZero()) {
+            throw std::runtime_error("Division by zero");
+        }
+        quotient = BigInt();
+        remainder = BigInt();
+
+        if (r.limbs.size() == 1) {
+            // short division
+            uint64_t divisor = r.limbs[0];
+            uint64_t rest = 0;
+            quotient.limbs.assign(l.limbs.size(), 0);
+            for (int i = (int) l.limbs.size() - 1; i >= 0; --i) {
+                uint64_t current = (rest << 32) | l.limbs[i];
+                quotient.limbs[i] = (uint32_t) (current / divisor);
+                rest = current % divisor;
+            }
+            BigInt::trim(quotient.limbs);
+            if (rest != 0) {
+                remainder.limbs.push_back((uint32_t) rest);
+            }
+        } else if (BigInt::compareMagnitude(l.limbs, r.limbs) >= 0) {
+            // Knuth's algorithm D: the divisor is shifted so that its top bit is set, then every limb of the quotient
+            // is estimated from the top limbs of the rest, it is off by at most 2
+            int n = (int) r.limbs.size();
+            int m = (int) l.limbs.size();
+            int shift = __builtin_clz(r.limbs.back());
+            std::vector<uint32_t> v(n), u(m + 1);
+            for (int i = n - 1; i > 0; --i) {
+                v[i] = (uint32_t) (((uint64_t) r.limbs[i] << shift) | ((uint64_t) r.limbs[i - 1] >> (32 - shift)));
+            }
+            v[0] = r.limbs[0] << shift;
+            u[m] = (uint32_t) ((uint64_t) l.limbs[m - 1] >> (32 - shift));
+            for (int i = m - 1; i > 0; --i) {
+                u[i] = (uint32_t) (((uint64_t) l.limbs[i] << shift) | ((uint64_t) l.limbs[i - 1] >> (32 - shift)));
+            }
+            u[0] = l.limbs[0] << shift;
+
+            const uint64_t base = (uint64_t) 1 << 32;
+            quotient.limbs.assign(m - n + 1, 0);
+            for (int j = m - n; j >= 0; --j) {
+                uint64_t top = ((uint64_t) u[j + n] << 32) | u[j + n - 1];
+                uint64_t estimate = top / v[n - 1];
+                uint64_t rest = top % v[n - 1];
+                while (estimate >= base || estimate * v[n - 2] > ((rest << 32) | u[j + n - 2])) {
+                    --estimate;
+                    rest += v[n - 1];
+                    if (rest >= base) {
+                        break;
+                    }
+                }
+
+                // u[j..j+n] -= estimate * v
+                int64_t borrow = 0;
+                uint64_t carry = 0;
+                for (int i = 0; i < n; ++i) {
+                    uint64_t product = estimate * v[i] + carry;
+                    carry = product >> 32;
+                    int64_t difference = (int64_t) u[i + j] - borrow - (uint32_t) product;
+                    u[i + j] = (uint32_t) difference;
+                    borrow = difference < 0 ? 1 : 0;
+                }
+                int64_t difference = (int64_t) u[j + n] - borrow - (int64_t) carry;
+                u[j + n] = (uint32_t) difference;
+
+                if (difference < 0) {
+                    // the estimate was one too large, v is added back
+                    --estimate;
+                    carry = 0;
+                    for (int i = 0; i < n; ++i) {
+                        uint64_t sum = (uint64_t) u[i + j] + v[i] + carry;
+                        u[i + j] = (uint32_t) sum;
+                        carry = sum >> 32;
+                    }
+                    u[j + n] += (uint32_t) carry;
+                }
+                quotient.limbs[j] = (uint32_t) estimate;
+            }
+            BigInt::trim(quotient.limbs);
+
+            remainder.limbs.resize(n);
+            for (int i = 0; i < n; ++i) {
+                remainder.limbs[i] = (uint32_t) (((uint64_t) u[i] >> shift) | ((uint64_t) u[i + 1] << (32 - shift)));
+            }
+            BigInt::trim(remainder.limbs);
+        } else {
+            remainder.limbs = l.limbs;
+        }
+
+        quotient.negative = !quotient.limbs.empty() && l.negative != r.negative;
+        remainder.negative = !remainder.limbs.empty() && l.negative;
+    }
+
+    BigInt operator/(const BigInt &l, const BigInt &r) {
+        BigInt quotient, remainder;
+        divMod(l, r, quotient, remainder);
+        return quotient;
+    }
+
+    BigInt gcd(BigInt l, BigInt r) {
+        l.negative = false;
+        r.negative = false;
+        while (!r.isZero()) {
+            BigInt quotient, remainder;
+            divMod(l, r, quotient, remainder);
+            l = std::move(r);
+            r = std::move(remainder);
+        }
+        return l;
+    }
+
+    int compare(const BigInt &l, const BigInt &r) {
+        if (l.negative != r.negative) {
+            return l.negative ? -1 : 1;
+        }
+        int magnitude = BigInt::compareMagnitude(l.limbs, r.limbs);
+        return l.negative ? -magnitude : magnitude;
+    }
+
+
+    Rational Rational::fromWide(__int128 enumerator, __int128 denominator) {
+        if (denominator == 0) {
+            throw std::runtime_error("Zero denominator");
+        }
+        if (denominator < 0) {
+            if (enumerator == std::numeric_limits<__int128>::min() ||
+                denominator == std::numeric_limits<__int128>::min()) {
+                return fromBig(-BigInt(enumerator), -BigInt(denominator));
+            }
+            enumerator = -enumerator;
+            denominator = -denominator;
+        }
+
+        Rational result;
+        if (enumerator == 0) {
+            return result;
+        }
+        if (fitsInInt64(enumerator) && fitsInInt64(denominator)) {
+            result.num = (int64_t) enumerator;
+            result.den = (int64_t) denominator;
+            result.reduced = denominator == 1;
+            return result;
+        }
+
+        auto divisor = (__int128) gcdWide(absWide(enumerator), (unsigned __int128) denominator);
+        enumerator /= divisor;
+        denominator /= divisor;
+        if (fitsInInt64(enumerator) && fitsInInt64(denominator)) {
+            result.num = (int64_t) enumerator;
+            result.den = (int64_t) denominator;
+            result.reduced = true;
+            return result;
+        }
+        return fromBig(BigInt(enumerator), BigInt(denominator));
+    }
+
+    Rational Rational::fromBig(BigInt enumerator, BigInt denominator) {
+        if (denominator.isZero()) {
+            throw std::runtime_error("Zero denominator");
+        }
+        if (denominator.isNegative()) {
+            enumerator = -enumerator;
+            denominator = -denominator;
+        }
+
+        Rational result;
+        if (enumerator.isZero()) {
+            return result;
+        }
+        auto divisor = gcd(enumerator, denominator);
+        enumerator = enumerator / divisor;
+        denominator = denominator / divisor;
+
+        if (enumerator.fitsInInt64() && denominator.fitsInInt64()) {
+            result.num = enumerator.toInt64();
+            result.den = denominator.toInt64();
+            result.reduced = true;
+            return result;
+        }
+        result.big = std::make_shared<const Big>(Big{std::move(enumerator), std::move(denominator)});
+        return result;
+    }
+
+    Rational::Big Rational::toBig() const {
+        if (big) {
+            return *big;
+        }
+        return {BigInt(num), BigInt(den)};
+    }
+
+    Rational Rational::addBig(const Rational &l, const Rational &r) {
+        auto lb = l.toBig();
+        auto rb = r.toBig();
+        return fromBig(lb.num * rb.den + rb.num * lb.den, lb.den * rb.den);
+    }
+
+    Rational Rational::mulBig(const Rational &l, const Rational &r) {
+        auto lb = l.toBig();
+        auto rb = r.toBig();
+        return fromBig(lb.num * rb.num, lb.den * rb.den);
+    }
+
+    Rational Rational::divBig(const Rational &l, const Rational &r) {
+        auto lb = l.toBig();
+        auto rb = r.toBig();
+        return fromBig(lb.num * rb.den, lb.den * rb.num);
+    }
+
+    int Rational::compareBig(const Rational &l, const Rational &r) {
+        auto lb = l.toBig();
+        auto rb = r.toBig();
+        return compare(lb.num * rb.den, rb.num * lb.den);
+    }
+
+    Rational Rational::normalized() const {
+        if (big || reduced) {
+            return *this;
+        }
+        auto divisor = (int64_t) gcdWide(absWide(num), (unsigned __int128) den);
+        Rational result;
+        result.num = num / divisor;
+        result.den = den / divisor;
+        result.reduced = true;
+        return result;
+    }
+
+    long long Rational::getEnumerator() const {
+        if (big) {
+            throw std::runtime_error("Rational " + toString() + " does not fit into long long");
+        }
+        return normalized().num;
+    }
+
+    long long Rational::getDenominator() const {
+        if (big) {
+            throw std::runtime_error("Rational " + toString() + " does not fit into long long");
+        }
+        return normalized().den;
+    }
+
+    double Rational::toDouble() const {
+        if (big) {
+            return big->num.toDouble() / big->den.toDouble();
+        }
+        return (double) num / (double) den;
+    }
+
+    std::string Rational::toString() const {
+        if (big) {
+            return big->num.toString() + "/" + big->den.toString();
+        }
+        auto canonical = normalized();
+        return std::to_string(canonical.num) + "/" + std::to_string(canonical.den);
+    }
+
+    Rational Rational::operator-() const {
+        if (big) {
+            return fromBig(-big->num, big->den);
+        }
+        return fromWide(-(__int128) num, den);
+    }
+
+} // end of symbolic_ring namespace
@@ -0,0 +1,538 @@
+//
+// Created by sergey on 27.08.23.
+//
+
+#include "sdpBackend.h"
+#include "csdpLibrary.h"
+
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <thread>
+
+#include <fcntl.h>
+#include <signal.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "fusion.h"
+
+extern char** environ;
+
+namespace fus = mosek::fusion;
+using namespace monty;
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+double millisecondsSince(Clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+// for the parallel regions started by the calling thread, the other threads keep their own setting
+void useThreads(int threads) {
+#ifdef _OPENMP
+    if (threads > 0) {
+        omp_set_num_threads(threads);
+    }
+#endif
+}
+
+const char* statusName(SdpBackendStatus status) {
+    switch (status) {
+        case SdpBackendStatus::SOLVED:
+            return "solved";
+        case SdpBackendStatus::INFEASIBLE:
+            return "infeasible";
+        case SdpBackendStatus::FAILED:
+            return "failed";
+    }
+    return "";
+}
+
+void setFromNativeResult(SdpProblem& problem, const NativeSdpResult& native, SdpBackendResult& result) {
+    result.iterations = native.iterations;
+    switch (native.status) {
+        case NativeSdpStatus::SOLVED:
+        case NativeSdpStatus::SOLVED_INACCURATE:
+            result.status = SdpBackendStatus::SOLVED;
+            result.solution = problem.toRawSolution(native);
+            break;
+        case NativeSdpStatus::PRIMAL_INFEASIBLE:
+            result.status = SdpBackendStatus::INFEASIBLE;
+            break;
+        case NativeSdpStatus::NOT_CONVERGED:
+            result.status = SdpBackendStatus::FAILED;
+            break;
+    }
+}
+
+// X, u and y of the result have the sizes the problem asks for
+bool fitsProblem(const NativeSdpResult& result, const NativeSdpProblem& problem) {
+    if (result.blocks.size() != problem.blockSizes.size() ||
+        result.freeVariables.size() != problem.numberOfFreeVariables ||
+        (!result.y.empty() && result.y.size() != problem.constraints.size())) {
+        return false;
+    }
+    for (int block = 0; block < problem.blockSizes.size(); ++block) {
+        int d = problem.blockSizes[block];
+        if (result.blocks[block].size() != (d > 0 ? d * d : -d)) {
+            return false;
+        }
+    }
+    return !result.blocks.empty();
+}
+
+// all conditions of the given type make a single constraint A_1 vec(X_1) + ... + F u + N v + c,
+// the coefficients are collected as sparse matrices over all rows at once
+void addMosekConstraints(SdpProblem& problem, fus::Model::t& M, LinearMatrixExpressionType type,
+                         const std::vector<fus::Variable::t>& X, fus::Variable::t unconstrained,
+                         fus::Variable::t nonnegative) {
+    const auto& conditions = problem.getConditions();
+    std::vector<int> rows;
+    for (int i = 0; i < conditions.size(); ++i) {
+        if (conditions[i].type == type) {
+            rows.push_back(i);
+        }
+    }
+    if (rows.empty()) {
+        return;
+    }
+    int m = rows.size();
+
+    struct Triplets {
+        void add(int i, int j, double value) {
+            subi.push_back(i);
+            subj.push_back(j);
+            val.push_back(value);
+        }
+
+        fus::Matrix::t toMatrix(int rows, int cols) {
+            return fus::Matrix::sparse(rows, cols, new_array_ptr<int>(subi), new_array_ptr<int>(subj),
+                                       new_array_ptr<double>(val));
+        }
+
+        std::vector<int> subi, subj;
+        std::vector<double> val;
+    };
+
+    std::vector<Triplets> matrixTriplets(X.size());
+    Triplets freeTriplets, nonnegativeTriplets;
+    std::vector<double> constants(m), lower(m), upper(m);
+
+    for (int r = 0; r < m; ++r) {
+        const auto& condition = conditions[rows[r]];
+
+        // X_j is flattened row by row, the lower triangle is mirrored from the upper one
+        for (const auto& matrixIndex_matrix : condition.matrixCoefficients) {
+            int d = problem.getMatrixSize(matrixIndex_matrix.first);
+            auto& triplets = matrixTriplets[matrixIndex_matrix.first];
+            for (const auto& entry : matrixIndex_matrix.second.entries) {
+                triplets.add(r, entry.row * d + entry.col, entry.value);
+                if (entry.row != entry.col) {
+                    triplets.add(r, entry.col * d + entry.row, entry.value);
+                }
+            }
+        }
+        for (const auto& index_coefficient : condition.freeCoefficients) {
+            freeTriplets.add(r, index_coefficient.first, index_coefficient.second);
+        }
+        for (const auto& index_coefficient : condition.nonnegativeCoefficients) {
+            nonnegativeTriplets.add(r, index_coefficient.first, index_coefficient.second);
+        }
+
+        constants[r] = condition.constantPart;
+        lower[r] = -condition.withinRange;
+        upper[r] = condition.withinRange;
+    }
+
+    std::vector<fus::Expression::t> sumlist;
+    for (int j = 0; j < X.size(); ++j) {
+        if (!matrixTriplets[j].val.empty()) {
+            int d = problem.getMatrixSize(j);
+            sumlist.push_back(fus::Expr::mul(matrixTriplets[j].toMatrix(m, d * d), fus::Expr::flatten(X[j])));
+        }
+    }
+    if (!freeTriplets.val.empty()) {
+        sumlist.push_back(fus::Expr::mul(freeTriplets.toMatrix(m, problem.getNumberOfUnconstrainedVariables()),
+                                         unconstrained));
+    }
+    if (!nonnegativeTriplets.val.empty()) {
+        sumlist.push_back(fus::Expr::mul(nonnegativeTriplets.toMatrix(m, problem.getNumberOfNonnegativeVariables()),
+                                         nonnegative));
+    }
+    sumlist.push_back(fus::Expr::constTerm(new_array_ptr<double>(constants)));
+    auto expression = fus::Expr::add(new_array_ptr(sumlist));
+
+    switch (type) {
+        case LinearMatrixExpressionType::GEQ:
+            M->constraint(expression, fus::Domain::greaterThan(0.0));
+            break;
+        case LinearMatrixExpressionType::EQ:
+            M->constraint(expression, fus::Domain::equalsTo(0.0));
+            break;
+        case LinearMatrixExpressionType::IN_RANGE:
+            M->constraint(expression, fus::Domain::inRange(new_array_ptr<double>(lower), new_array_ptr<double>(upper)));
+            break;
+        case LinearMatrixExpressionType::UNKNOWN:
+            throw std::runtime_error("UNKNOWN condition is not supported");
+    }
+}
+
+} // namespace
+
+SdpBackendResult MosekSdpBackend::solve(SdpProblem& problem) {
+    // the code taken from https://docs.mosek.com/latest/cxxfusion/tutorial-sdo-shared.html and modified
+    SdpBackendResult result;
+    auto start = Clock::now();
+
+    // the model is disposed on every way out, and interrupt() does not reach it after that
+    struct Model {
+        explicit Model(MosekSdpBackend& backend) : backend(backend) {
+            std::lock_guard<std::mutex> lock(backend.modelMutex);
+            auto model = M;
+            backend.breakModel = [model]() { model->breakSolver(); };
+        }
+
+        ~Model() {
+            {
+                std::lock_guard<std::mutex> lock(backend.modelMutex);
+                backend.breakModel = nullptr;
+            }
+            M->dispose();
+        }
+
+        MosekSdpBackend& backend;
+        fus::Model::t M = new fus::Model("sdp");
+    } model(*this);
+    auto& M = model.M;
+
+    int n = problem.getNumberOfSdpMatrices();
+    std::vector<fus::Variable::t> X;
+    for (int j = 0; j < n; ++j) {
+        X.push_back(M->variable(fus::Domain::inPSDCone(problem.getMatrixSize(j))));
+    }
+    fus::Variable::t unconstrained = M->variable(fus::Domain::unbounded(problem.getNumberOfUnconstrainedVariables()));
+    fus::Variable::t nonnegative = M->variable(fus::Domain::greaterThan(0.0, problem.getNumberOfNonnegativeVariables()));
+
+    for (auto type : {LinearMatrixExpressionType::EQ, LinearMatrixExpressionType::GEQ, LinearMatrixExpressionType::IN_RANGE}) {
+        addMosekConstraints(problem, M, type, X, unconstrained, nonnegative);
+    }
+    M->objective(fus::ObjectiveSense::Minimize, fus::Expr::constTerm(0.0));
+
+    if (verbose) {
+        M->setLogHandler([ = ](const std::string & msg) { std::cout << msg << std::flush; } );
+        M->writeTask("sdosdo.ptf"); // Save problem in readable format
+    }
+    M->setSolverParam("presolveUse", "off");
+    if (threads > 0) {
+        M->setSolverParam("numThreads", threads);
+    }
+    result.setupMilliseconds = millisecondsSince(start);
+
+    if (cancelled) {
+        return result;
+    }
+    start = Clock::now();
+    M->solve();
+    result.solveMilliseconds = millisecondsSince(start);
+
+    auto status = M->getProblemStatus();
+    if (status == fus::ProblemStatus::PrimalInfeasible) {
+        result.status = SdpBackendStatus::INFEASIBLE;
+        return result;
+    }
+    if (status != fus::ProblemStatus::PrimalAndDualFeasible && status != fus::ProblemStatus::PrimalFeasible) {
+        return result;
+    }
+
+    result.status = SdpBackendStatus::SOLVED;
+    auto& solution = result.solution;
+    for (int j = 0; j < n; ++j) {
+        int d = problem.getMatrixSize(j);
+        solution.matrices.emplace_back(d, std::vector<double>(d));
+        auto Xj = *(X[j]->level());
+        for (int s1 = 0; s1 < d; s1++) {
+            for (int s2 = 0; s2 < d; s2++) {
+                solution.matrices[j][s1][s2] = Xj[s1 * d + s2];
+            }
+        }
+    }
+    for (int i = 0; i < problem.getNumberOfUnconstrainedVariables(); ++i) {
+        solution.unconstrainedVariables.push_back((*unconstrained->level())[i]);
+    }
+    for (int i = 0; i < problem.getNumberOfNonnegativeVariables(); ++i) {
+        solution.nonnegativeVariables.push_back((*nonnegative->level())[i]);
+    }
+    return result;
+}
+
+void MosekSdpBackend::interrupt() {
+    std::lock_guard<std::mutex> lock(modelMutex);
+    if (breakModel) {
+        breakModel();
+    }
+}
+
+SdpBackendResult CsdpSdpBackend::solve(SdpProblem& problem) {
+    SdpBackendResult result;
+    auto start = Clock::now();
+
+    if (useLibrary && csdpLibraryAvailable()) {
+        auto native = problem.getNativeProblem();
+        result.setupMilliseconds = millisecondsSince(start);
+
+        start = Clock::now();
+        useThreads(threads);
+        auto solved = solveWithCsdpLibrary(native);
+        result.solveMilliseconds = millisecondsSince(start);
+
+        setFromNativeResult(problem, solved, result);
+        return result;
+    }
+
+    // the files of this run, the portfolio may run several solves at once; base only reserves the name
+    char base[] = ".csdp.XXXXXX";
+    int descriptor = mkstemp(base);
+    if (descriptor < 0) {
+        std::cout << "Cannot create the files for csdp: " << std::strerror(errno) << std::endl;
+        return result;
+    }
+    close(descriptor);
+    std::string problemFile = std::string(base) + ".dat-s";
+    std::string resultFile = std::string(base) + ".result";
+    struct Files {
+        ~Files() {
+            for (const auto& file : files) {
+                unlink(file.c_str());
+            }
+        }
+
+        std::vector<std::string> files;
+    } files{{base, problemFile, resultFile}};
+
+    std::ofstream csdpFile(problemFile);
+    problem.writeCsdp(csdpFile);
+    csdpFile.close();
+    result.setupMilliseconds = millisecondsSince(start);
+
+    if (verbose) {
+        std::cout << "csdp " << problemFile << " " << resultFile << std::endl;
+    }
+
+    // csdp takes the number of threads from the environment
+    std::vector<std::string> environment;
+    for (char** variable = environ; *variable != nullptr; ++variable) {
+        if (threads <= 0 || std::strncmp(*variable, "OMP_NUM_THREADS=", 16) != 0) {
+            environment.emplace_back(*variable);
+        }
+    }
+    if (threads > 0) {
+        environment.push_back("OMP_NUM_THREADS=" + std::to_string(threads));
+    }
+    std::vector<char*> envp;
+    for (auto& variable : environment) {
+        envp.push_back(&variable[0]);
+    }
+    envp.push_back(nullptr);
+
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    if (!verbose) {
+        posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, "/dev/null", O_WRONLY, 0);
+    }
+    char* argv[] = {const_cast<char*>("csdp"), &problemFile[0], &resultFile[0], nullptr};
+
+    // only a result written by this run is read
+    unlink(resultFile.c_str());
+    start = Clock::now();
+    pid_t pid;
+    int error = posix_spawnp(&pid, "csdp", &actions, nullptr, argv, envp.data());
+    posix_spawn_file_actions_destroy(&actions);
+    if (error != 0) {
+        std::cout << "Cannot run csdp: " << std::strerror(error) << std::endl;
+        return result;
+    }
+    int status;
+    while (waitpid(pid, &status, WNOHANG) == 0) {
+        if (cancelled) {
+            kill(pid, SIGKILL);
+            waitpid(pid, &status, 0);
+            result.solveMilliseconds = millisecondsSince(start);
+            return result;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    result.solveMilliseconds = millisecondsSince(start);
+
+    // the exit codes of csdp, as solveWithCsdpLibrary reads the ones of easy_sdp: 0 solved, 3 partial success,
+    // 1 primal infeasible, the rest are failures
+    if (!WIFEXITED(status)) {
+        return result;
+    }
+    switch (WEXITSTATUS(status)) {
+        case 0:
+        case 3:
+            result.status = SdpBackendStatus::SOLVED;
+            result.solution = problem.readCsdpFile(resultFile);
+            break;
+        case 1:
+            result.status = SdpBackendStatus::INFEASIBLE;
+            break;
+        default:
+            break;
+    }
+    return result;
+}
+
+SdpBackendResult NativeSdpBackend::solve(SdpProblem& problem) {
+    SdpBackendResult result;
+    auto start = Clock::now();
+    auto native = problem.getNativeProblem();
+    result.setupMilliseconds = millisecondsSince(start);
+
+    auto settings = this->settings;
+    settings.cancel = &cancelled;
+
+    start = Clock::now();
+    useThreads(threads);
+    auto solved = NativeSdpSolver(native, settings).solve();
+    result.solveMilliseconds = millisecondsSince(start);
+
+    setFromNativeResult(problem, solved, result);
+    return result;
+}
+
+SdpBackendResult AdmmSdpBackend::solve(SdpProblem& problem) {
+    SdpBackendResult result;
+    auto settings = this->settings;
+    settings.cancel = &cancelled;
+
+    auto start = Clock::now();
+    useThreads(threads);
+    auto native = problem.getNativeProblem();
+    NativeAdmmSolver solver(native, settings); // the factorization is a part of the setup
+    result.setupMilliseconds = millisecondsSince(start);
+
+    auto warmStart = getWarmStart();
+    start = Clock::now();
+    auto solved = fitsProblem(warmStart, native) ? solver.solve(warmStart) : solver.solve();
+    result.solveMilliseconds = millisecondsSince(start);
+
+    // a certificate of infeasibility is no point to start from
+    if (solved.status != NativeSdpStatus::PRIMAL_INFEASIBLE && !cancelled) {
+        setWarmStart(solved);
+    }
+    setFromNativeResult(problem, solved, result);
+    return result;
+}
+
+SdpBackendResult PortfolioSdpBackend::solve(SdpProblem& problem) {
+    auto start = Clock::now();
+    int n = backends.size();
+    int available = threads > 0 ? threads : std::max<int>(1, std::thread::hardware_concurrency());
+    for (auto& backend : backends) {
+        backend->clearCancel();
+        backend->setThreads(std::max(1, available / n));
+    }
+    winner = -1;
+    if (cancelled) {
+        return SdpBackendResult();
+    }
+
+    std::mutex mutex;
+    std::vector<SdpBackendResult> results(n);
+    std::vector<double> violations(n, std::numeric_limits<double>::infinity());
+    std::vector<std::thread> workers;
+    for (int i = 0; i < n; ++i) {
+        workers.emplace_back([&, i]() {
+            SdpBackendResult result;
+            try {
+                result = backends[i]->solve(problem);
+            } catch (const std::exception& e) {
+                std::lock_guard<std::mutex> lock(mutex);
+                std::cout << backends[i]->getName() << " failed: " << e.what() << std::endl;
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(mutex);
+                std::cout << backends[i]->getName() << " failed" << std::endl;
+            }
+            double violation = result.isSolved() ? problem.getMaxViolation(result.solution)
+                                                  : std::numeric_limits<double>::infinity();
+
+            std::lock_guard<std::mutex> lock(mutex);
+            bool conclusive = violation <= backends[i]->getAllowedError() ||
+                              result.status == SdpBackendStatus::INFEASIBLE;
+            results[i] = std::move(result);
+            violations[i] = violation;
+            if (conclusive && winner < 0) {
+                winner = i;
+                for (int j = 0; j < n; ++j) {
+                    if (j != i) {
+                        backends[j]->cancel();
+                    }
+                }
+            }
+        });
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+
+    // a solution outside the allowed error of its backend is no answer, Solver would take it without a check
+    for (int i = 0; i < n; ++i) {
+        std::cout << (i == winner ? "* " : "  ") << backends[i]->getName() << ": " << statusName(results[i].status)
+                  << ", setup " << results[i].setupMilliseconds << "ms, solve " << results[i].solveMilliseconds
+                  << "ms";
+        if (results[i].isSolved()) {
+            std::cout << ", violation " << violations[i];
+        }
+        std::cout << std::endl;
+    }
+
+    SdpBackendResult result;
+    if (winner >= 0) {
+        result = std::move(results[winner]);
+    }
+    result.setupMilliseconds = 0.0;
+    result.solveMilliseconds = millisecondsSince(start);
+    return result;
+}
+
+std::unique_ptr<SdpBackend> createSdpBackend(SdpEngine engine) {
+    switch (engine) {
+        case SdpEngine::MOSEK:
+            return std::unique_ptr<SdpBackend>(new MosekSdpBackend());
+        case SdpEngine::CSDP:
+            return std::unique_ptr<SdpBackend>(new CsdpSdpBackend());
+        case SdpEngine::NATIVE: {
+            NativeSdpSettings settings;
+            settings.verbose = true;
+            return std::unique_ptr<SdpBackend>(new NativeSdpBackend(settings));
+        }
+        case SdpEngine::ADMM: {
+            NativeAdmmSettings settings;
+            settings.verbose = true;
+            return std::unique_ptr<SdpBackend>(new AdmmSdpBackend(settings));
+        }
+        case SdpEngine::PORTFOLIO: {
+            // the engines run at once, their logs would be mixed up
+            std::vector<std::unique_ptr<SdpBackend>> backends;
+            backends.emplace_back(new MosekSdpBackend(false));
+            // the linked csdp cannot be cancelled and would hold the race until it ends, the binary is killed
+            backends.emplace_back(new CsdpSdpBackend(false, false));
+            backends.emplace_back(new NativeSdpBackend());
+            backends.emplace_back(new AdmmSdpBackend());
+            return std::unique_ptr<SdpBackend>(new PortfolioSdpBackend(std::move(backends)));
+        }
+    }
+    throw std::runtime_error("Unknown sdp engine");
+}
@@ -2,4 +2,319 @@
 // Created by sergey on 31.05.23.
 //
 
-#include "sdpEncoder.h"
\ No newline at end of file
+#include "sdpEncoder.h"
+
+#include <algorithm>
+#include <iterator>
+#include <numeric>
+#include <tuple>
+#include <unordered_set>
+
+GramTemplate::GramTemplate(const std::vector<QMonomial> &basis) : basis(basis) {
+    if (basis.empty()) {
+        throw std::runtime_error("Empty list");
+    }
+    std::unordered_map<PackedExponents, int, PackedExponentsHash> productIndex;
+    entries.reserve(basis.size() * (basis.size() + 1) / 2);
+
+    for (int i = 0; i < basis.size(); i++) {
+        for (int j = i; j < basis.size(); j++) {
+            auto product = mul(basis[i], basis[j]);
+            Rational coefficient = product.getCoefficient();
+            if (i != j) {
+                coefficient *= 2;
+            }
+
+            auto inserted = productIndex.emplace(product.getExponents(), static_cast<int>(productMonomials.size()));
+            if (inserted.second) {
+                productMonomials.push_back(product.isUnitary() ? product : div(product, product.getCoefficient()));
+            }
+            entries.push_back({i, j, inserted.first->second, coefficient});
+        }
+    }
+}
+
+SymbolicPolynomial getSos(const GramTemplate &gram, int id) {
+    auto env = gram.viewEnvironment();
+
+    std::vector<std::vector<LinearForm::Term>> productTerms(gram.getProductMonomials().size());
+    for (const auto &entry: gram.getEntries()) {
+        auto l_ij = env->getOrCreateGramEntry(id, entry.row, entry.col);
+        productTerms[entry.productIndex].push_back({l_ij.getId(), entry.coefficient});
+    }
+
+    SymbolicPolynomialAccumulator result(env);
+    result.add(env->symbolicPolynomialZero());
+    for (int p = 0; p < productTerms.size(); p++) {
+        result.add(SymbolicMonomial(gram.getProductMonomials()[p],
+                                    LinearForm::fromTerms(env, std::move(productTerms[p]))));
+    }
+    return std::move(result).build();
+}
+
+std::vector<std::vector<QMonomial>> pruneSosBases(const std::vector<std::vector<QMonomial>> &bases,
+                                                  const std::vector<SymbolicPolynomial> &multipliers,
+                                                  const SymbolicPolynomial &target) {
+    if (bases.size() != multipliers.size()) {
+        throw std::runtime_error("Every sos needs a multiplier");
+    }
+
+    struct MultiplierTerm {
+        PackedExponents exponents;
+        int sign; // 0 if the coefficient is not constant
+    };
+
+    std::vector<std::vector<MultiplierTerm>> multiplierTerms(multipliers.size());
+    for (int k = 0; k < multipliers.size(); k++) {
+        for (const auto &term: multipliers[k].getReducedMonomials()) {
+            const auto &form = term.getCoefficient();
+            if (form.isZero() || term.getQmonomial().getCoefficient().isZero()) {
+                continue;
+            }
+            int sign = form.isConstant() ? form.getTerms()[0].coefficient.sign() *
+                                           term.getQmonomial().getCoefficient().sign() : 0;
+            multiplierTerms[k].push_back({term.getQmonomial().getExponents(), sign});
+        }
+    }
+
+    std::unordered_set<PackedExponents, PackedExponentsHash> targetRows;
+    for (const auto &term: target.getReducedMonomials()) {
+        if (!term.getCoefficient().isZero() && !term.getQmonomial().getCoefficient().isZero()) {
+            targetRows.insert(term.getQmonomial().getExponents());
+        }
+    }
+
+    struct Row {
+        bool mixed = false;
+        int sign = 0;
+        std::vector<std::pair<int, int>> diagonals; // (sos, basis index)
+    };
+
+    std::vector<std::vector<bool>> active(bases.size());
+    for (int k = 0; k < bases.size(); k++) {
+        active[k].assign(bases[k].size(), true);
+    }
+
+    bool changed = true;
+    while (changed) {
+        changed = false;
+
+        std::unordered_map<PackedExponents, Row, PackedExponentsHash> rows;
+        for (int k = 0; k < bases.size(); k++) {
+            const auto &basis = bases[k];
+            for (int i = 0; i < basis.size(); i++) {
+                if (!active[k][i]) {
+                    continue;
+                }
+                for (int j = i; j < basis.size(); j++) {
+                    if (!active[k][j]) {
+                        continue;
+                    }
+                    auto product = mul(basis[i].getExponents(), basis[j].getExponents());
+                    for (const auto &term: multiplierTerms[k]) {
+                        auto &row = rows[mul(product, term.exponents)];
+                        // the square of a basis monomial has a positive coefficient, so a diagonal entry has the sign of the term
+                        if (i != j || term.sign == 0 || (row.sign != 0 && row.sign != term.sign)) {
+                            row.mixed = true;
+                            continue;
+                        }
+                        row.sign = term.sign;
+                        row.diagonals.emplace_back(k, i);
+                    }
+                }
+            }
+        }
+
+        for (const auto &it: rows) {
+            if (it.second.mixed || targetRows.count(it.first) != 0) {
+                continue;
+            }
+            for (const auto &diagonal: it.second.diagonals) {
+                if (active[diagonal.first][diagonal.second]) {
+                    active[diagonal.first][diagonal.second] = false;
+                    changed = true;
+                }
+            }
+        }
+    }
+
+    std::vector<std::vector<QMonomial>> result(bases.size());
+    for (int k = 0; k < bases.size(); k++) {
+        for (int i = 0; i < bases[k].size(); i++) {
+            if (active[k][i]) {
+                result[k].push_back(bases[k][i]);
+            }
+        }
+    }
+    return result;
+}
+
+void ConstraintAssembler::startGroup() {
+    currentGroupRows.clear();
+    if (groupStarts.back() != static_cast<int>(rowMonomials.size())) {
+        groupStarts.push_back(static_cast<int>(rowMonomials.size()));
+    }
+}
+
+void ConstraintAssembler::append(ConstraintAssembler &&other) {
+    int rowOffset = static_cast<int>(rowMonomials.size());
+    currentGroupRows.clear();
+    for (int start: other.groupStarts) {
+        if (groupStarts.back() != rowOffset + start) {
+            groupStarts.push_back(rowOffset + start);
+        }
+    }
+    std::move(other.rowMonomials.begin(), other.rowMonomials.end(), std::back_inserter(rowMonomials));
+    std::move(other.rowConstants.begin(), other.rowConstants.end(), std::back_inserter(rowConstants));
+    gramTriplets.reserve(gramTriplets.size() + other.gramTriplets.size());
+    for (auto &triplet: other.gramTriplets) {
+        triplet.row += rowOffset;
+        gramTriplets.push_back(std::move(triplet));
+    }
+    freeTriplets.reserve(freeTriplets.size() + other.freeTriplets.size());
+    for (auto &triplet: other.freeTriplets) {
+        triplet.row += rowOffset;
+        freeTriplets.push_back(std::move(triplet));
+    }
+    for (const auto &block: other.blockSizes) {
+        blockSizes[block.first] = block.second;
+    }
+}
+
+int ConstraintAssembler::getOrCreateRow(const PackedExponents &monomial) {
+    auto inserted = currentGroupRows.emplace(monomial, static_cast<int>(rowMonomials.size()));
+    if (inserted.second) {
+        rowMonomials.push_back(monomial);
+        rowConstants.emplace_back(0);
+    }
+    return inserted.first->second;
+}
+
+void ConstraintAssembler::addSosProduct(int block, const GramTemplate &gram, const SymbolicPolynomial &multiplier) {
+    blockSizes[block] = gram.size();
+
+    const auto &products = gram.getProductMonomials();
+    std::vector<int> productRows(products.size());
+
+    for (const auto &term: multiplier.getReducedMonomials()) {
+        const auto &form = term.getCoefficient();
+        if (!form.isConstant()) {
+            throw std::runtime_error("Coefficient is not linear");
+        }
+        if (form.isZero()) {
+            continue;
+        }
+        Rational termCoefficient = term.getQmonomial().getCoefficient() * form.getTerms()[0].coefficient;
+        if (termCoefficient.isZero()) {
+            continue;
+        }
+        const auto &termExponents = term.getQmonomial().getExponents();
+
+        for (int p = 0; p < products.size(); p++) {
+            productRows[p] = getOrCreateRow(mul(products[p].getExponents(), termExponents));
+        }
+        for (const auto &entry: gram.getEntries()) {
+            gramTriplets.push_back({productRows[entry.productIndex],
+                                    {block, entry.row, entry.col, entry.coefficient * termCoefficient}});
+        }
+    }
+}
+
+void ConstraintAssembler::addPolynomial(const SymbolicPolynomial &polynomial, const Rational &factor) {
+    for (const auto &term: polynomial.getReducedMonomials()) {
+        Rational baseCoefficient = term.getQmonomial().getCoefficient() * factor;
+        if (baseCoefficient.isZero()) {
+            continue;
+        }
+        int row = getOrCreateRow(term.getQmonomial().getExponents());
+        for (const auto &it: term.getCoefficient().getTerms()) {
+            if (it.symbolId == LinearForm::CONSTANT_ID) {
+                rowConstants[row] += it.coefficient * baseCoefficient;
+            } else {
+                freeTriplets.push_back({row, {it.symbolId, it.coefficient * baseCoefficient}});
+            }
+        }
+    }
+}
+
+// counting sort of the triplets by their final row, then the entries of every row are sorted and merged
+template<typename Triplet, typename Entry, typename Less, typename Same>
+static void tripletsToCsr(const std::vector<Triplet> &triplets, const std::vector<int> &finalRow, int rows,
+                         std::vector<size_t> &rowStart, std::vector<Entry> &entries, Less less, Same same) {
+    std::vector<size_t> position(rows + 1, 0);
+    for (const auto &it: triplets) {
+        position[finalRow[it.row] + 1]++;
+    }
+    std::partial_sum(position.begin(), position.end(), position.begin());
+
+    std::vector<Entry> sorted(triplets.size());
+    std::vector<size_t> next(position.begin(), position.end() - 1);
+    for (const auto &it: triplets) {
+        sorted[next[finalRow[it.row]]++] = it.entry;
+    }
+
+    rowStart.assign(1, 0);
+    entries.clear();
+    entries.reserve(sorted.size());
+    for (int row = 0; row < rows; row++) {
+        std::sort(sorted.begin() + position[row], sorted.begin() + position[row + 1], less);
+        for (size_t k = position[row]; k < position[row + 1]; k++) {
+            if (entries.size() > rowStart.back() && same(entries.back(), sorted[k])) {
+                entries.back().coefficient += sorted[k].coefficient;
+            } else {
+                entries.push_back(sorted[k]);
+            }
+        }
+        // merged entries may cancel out, the symbolic path drops them as well
+        auto firstOfRow = entries.begin() + rowStart.back();
+        entries.erase(std::remove_if(firstOfRow, entries.end(), [](const Entry &entry) {
+            return entry.coefficient.isZero();
+        }), entries.end());
+        rowStart.push_back(entries.size());
+    }
+}
+
+SparseConstraintSystem ConstraintAssembler::build() const {
+    int rows = static_cast<int>(rowMonomials.size());
+
+    std::vector<int> order(rows);
+    std::iota(order.begin(), order.end(), 0);
+    for (int group = 0; group < groupStarts.size(); group++) {
+        int end = group + 1 < groupStarts.size() ? groupStarts[group + 1] : rows;
+        std::sort(order.begin() + groupStarts[group], order.begin() + end, [this](int l, int r) {
+            return rowMonomials[l] < rowMonomials[r];
+        });
+    }
+    std::vector<int> finalRow(rows);
+    for (int i = 0; i < rows; i++) {
+        finalRow[order[i]] = i;
+    }
+
+    SparseConstraintSystem system;
+    system.environment = environment;
+    system.blockSizes = blockSizes;
+    system.constants.reserve(rows);
+    for (int i = 0; i < rows; i++) {
+        system.constants.push_back(rowConstants[order[i]]);
+    }
+
+    using GramEntry = SparseConstraintSystem::GramEntry;
+    tripletsToCsr(gramTriplets, finalRow, rows, system.gramRowStart, system.gramEntries,
+                  [](const GramEntry &l, const GramEntry &r) {
+                      return std::tie(l.block, l.row, l.col) < std::tie(r.block, r.row, r.col);
+                  },
+                  [](const GramEntry &l, const GramEntry &r) {
+                      return l.block == r.block && l.row == r.row && l.col == r.col;
+                  });
+
+    using FreeEntry = SparseConstraintSystem::FreeEntry;
+    tripletsToCsr(freeTriplets, finalRow, rows, system.freeRowStart, system.freeEntries,
+                  [](const FreeEntry &l, const FreeEntry &r) {
+                      return l.symbolId < r.symbolId;
+                  },
+                  [](const FreeEntry &l, const FreeEntry &r) {
+                      return l.symbolId == r.symbolId;
+                  });
+
+    return system;
+}
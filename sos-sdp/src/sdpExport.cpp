@@ -0,0 +1,417 @@
+//
+// Created by sergey on 24.08.23.
+//
+
+#include "sdpExport.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define SDP_EXPORT_MMAP 1
+#endif
+
+SdpaLayout::SdpaLayout(const NativeSdpProblem& problem) {
+    bool freePlaced = problem.numberOfFreeVariables == 0;
+    for (int size: problem.blockSizes) {
+        if (size == 0) {
+            throw std::runtime_error("Empty block");
+        }
+        if (size < 0 && !freePlaced) {
+            blockSizes.push_back(-2 * problem.numberOfFreeVariables);
+            freeBlock = blockSizes.size();
+            freePlaced = true;
+        }
+        blockSizes.push_back(size);
+        blockNumbers.push_back(blockSizes.size());
+    }
+    if (!freePlaced) {
+        blockSizes.push_back(-2 * problem.numberOfFreeVariables);
+        freeBlock = blockSizes.size();
+    }
+}
+
+namespace {
+
+// collects the output in a buffer, an ostream call per number is what makes writing slow
+class BufferedWriter {
+public:
+    explicit BufferedWriter(std::ostream& os) : os(os) {
+        buffer.reserve(capacity);
+    }
+
+    ~BufferedWriter() {
+        flush();
+    }
+
+    BufferedWriter& operator<<(const char* text) {
+        buffer.insert(buffer.end(), text, text + std::strlen(text));
+        return check();
+    }
+
+    BufferedWriter& operator<<(char c) {
+        buffer.push_back(c);
+        return check();
+    }
+
+    BufferedWriter& operator<<(long long value) {
+        char digits[24];
+        int length = 0;
+        unsigned long long magnitude = value < 0 ? 0ULL - value : value;
+        do {
+            digits[length++] = static_cast<char>('0' + magnitude % 10);
+            magnitude /= 10;
+        } while (magnitude != 0);
+        if (value < 0) {
+            buffer.push_back('-');
+        }
+        while (length > 0) {
+            buffer.push_back(digits[--length]);
+        }
+        return check();
+    }
+
+    BufferedWriter& operator<<(int value) {
+        return *this << static_cast<long long>(value);
+    }
+
+    BufferedWriter& operator<<(double value) {
+        char digits[32];
+        int length = std::snprintf(digits, sizeof(digits), "%.17g", value);
+        buffer.insert(buffer.end(), digits, digits + length);
+        return check();
+    }
+
+    void flush() {
+        os.write(buffer.data(), buffer.size());
+        buffer.clear();
+    }
+
+private:
+    BufferedWriter& check() {
+        if (buffer.size() >= capacity) {
+            flush();
+        }
+        return *this;
+    }
+
+    static const size_t capacity = 1 << 20;
+    std::ostream& os;
+    std::vector<char> buffer;
+};
+
+}
+
+void writeSdpa(const NativeSdpProblem& problem, std::ostream& os) {
+    SdpaLayout layout(problem);
+    BufferedWriter out(os);
+
+    out << static_cast<int>(problem.constraints.size()) << '\n';
+    out << static_cast<int>(layout.blockSizes.size()) << '\n';
+    for (int size: layout.blockSizes) {
+        out << size << ' ';
+    }
+    out << '\n';
+    for (const auto& constraint: problem.constraints) {
+        out << constraint.rhs << ' ';
+    }
+    out << '\n';
+
+    // the objective is zero, the entries go in the order of the blocks
+    std::vector<const NativeSdpProblem::Entry*> entries;
+    for (int i = 0; i < problem.constraints.size(); ++i) {
+        const auto& constraint = problem.constraints[i];
+        entries.clear();
+        for (const auto& entry: constraint.entries) {
+            if (entry.value != 0.0) {
+                entries.push_back(&entry);
+            }
+        }
+        std::stable_sort(entries.begin(), entries.end(), [&layout](const NativeSdpProblem::Entry* l,
+                                                                   const NativeSdpProblem::Entry* r) {
+            return layout.blockNumbers[l->block] < layout.blockNumbers[r->block];
+        });
+
+        auto entry = entries.begin();
+        auto writeBlocksBefore = [&](int block) {
+            for (; entry != entries.end() && layout.blockNumbers[(*entry)->block] < block; ++entry) {
+                out << i + 1 << ' ' << layout.blockNumbers[(*entry)->block] << ' '
+                    << std::min((*entry)->row, (*entry)->col) + 1 << ' '
+                    << std::max((*entry)->row, (*entry)->col) + 1 << ' ' << (*entry)->value << '\n';
+            }
+        };
+
+        if (layout.freeBlock != 0) {
+            writeBlocksBefore(layout.freeBlock);
+            for (const auto& free: constraint.freeEntries) {
+                if (free.second == 0.0) {
+                    continue;
+                }
+                out << i + 1 << ' ' << layout.freeBlock << ' ' << 2 * free.first + 1 << ' ' << 2 * free.first + 1
+                    << ' ' << free.second << '\n';
+                out << i + 1 << ' ' << layout.freeBlock << ' ' << 2 * free.first + 2 << ' ' << 2 * free.first + 2
+                    << ' ' << -free.second << '\n';
+            }
+        }
+        writeBlocksBefore(static_cast<int>(layout.blockSizes.size()) + 1);
+    }
+}
+
+// psd blocks are PSDVAR, the free variables and then the diagonal blocks are the scalar variables
+void writeCbf(const NativeSdpProblem& problem, std::ostream& os) {
+    std::vector<int> psdIndex(problem.blockSizes.size(), -1), scalarOffset(problem.blockSizes.size(), -1);
+    std::vector<int> psdSizes;
+    int numberOfScalars = problem.numberOfFreeVariables;
+    for (int block = 0; block < problem.blockSizes.size(); ++block) {
+        int size = problem.blockSizes[block];
+        if (size > 0) {
+            psdIndex[block] = psdSizes.size();
+            psdSizes.push_back(size);
+        } else {
+            scalarOffset[block] = numberOfScalars;
+            numberOfScalars -= size;
+        }
+    }
+    int numberOfNonnegative = numberOfScalars - problem.numberOfFreeVariables;
+
+    size_t matrixCoordinates = 0, scalarCoordinates = 0, constants = 0;
+    for (const auto& constraint: problem.constraints) {
+        for (const auto& entry: constraint.entries) {
+            if (entry.value != 0.0) {
+                (psdIndex[entry.block] >= 0 ? matrixCoordinates : scalarCoordinates) += 1;
+            }
+        }
+        for (const auto& free: constraint.freeEntries) {
+            scalarCoordinates += free.second != 0.0;
+        }
+        constants += constraint.rhs != 0.0;
+    }
+
+    BufferedWriter out(os);
+    int m = problem.constraints.size();
+    out << "VER\n1\n\nOBJSENSE\nMIN\n\n";
+    if (!psdSizes.empty()) {
+        out << "PSDVAR\n" << static_cast<int>(psdSizes.size()) << '\n';
+        for (int size: psdSizes) {
+            out << size << '\n';
+        }
+        out << '\n';
+    }
+    if (numberOfScalars > 0) {
+        int cones = (problem.numberOfFreeVariables > 0) + (numberOfNonnegative > 0);
+        out << "VAR\n" << numberOfScalars << ' ' << cones << '\n';
+        if (problem.numberOfFreeVariables > 0) {
+            out << "F " << problem.numberOfFreeVariables << '\n';
+        }
+        if (numberOfNonnegative > 0) {
+            out << "L+ " << numberOfNonnegative << '\n';
+        }
+        out << '\n';
+    }
+    out << "CON\n" << m << " 1\nL= " << m << "\n\n";
+
+    // <F, X> counts an off-diagonal coordinate twice, as <A_i, X> does; cbf takes the lower triangle
+    if (matrixCoordinates > 0) {
+        out << "FCOORD\n" << static_cast<long long>(matrixCoordinates) << '\n';
+        for (int i = 0; i < m; ++i) {
+            for (const auto& entry: problem.constraints[i].entries) {
+                if (entry.value != 0.0 && psdIndex[entry.block] >= 0) {
+                    out << i << ' ' << psdIndex[entry.block] << ' ' << std::max(entry.row, entry.col) << ' '
+                        << std::min(entry.row, entry.col) << ' ' << entry.value << '\n';
+                }
+            }
+        }
+        out << '\n';
+    }
+    if (scalarCoordinates > 0) {
+        out << "ACOORD\n" << static_cast<long long>(scalarCoordinates) << '\n';
+        for (int i = 0; i < m; ++i) {
+            for (const auto& free: problem.constraints[i].freeEntries) {
+                if (free.second != 0.0) {
+                    out << i << ' ' << free.first << ' ' << free.second << '\n';
+                }
+            }
+            for (const auto& entry: problem.constraints[i].entries) {
+                if (entry.value != 0.0 && psdIndex[entry.block] < 0) {
+                    out << i << ' ' << scalarOffset[entry.block] + entry.row << ' ' << entry.value << '\n';
+                }
+            }
+        }
+        out << '\n';
+    }
+    // A x + b in L=, so b is -rhs
+    if (constants > 0) {
+        out << "BCOORD\n" << static_cast<long long>(constants) << '\n';
+        for (int i = 0; i < m; ++i) {
+            if (problem.constraints[i].rhs != 0.0) {
+                out << i << ' ' << -problem.constraints[i].rhs << '\n';
+            }
+        }
+        out << '\n';
+    }
+}
+
+namespace {
+
+// whitespace separated numbers of [begin, end), the buffer does not have to end with a zero; like operator>>,
+// it stops at the first token that is not a number
+class NumberReader {
+public:
+    NumberReader(const char* begin, const char* end) : position(begin), end(end) {
+    }
+
+    bool next(double& value) {
+        skipSpaces();
+        if (position == end) {
+            return false;
+        }
+        // strtod needs a terminated string
+        char token[64];
+        size_t length = 0;
+        while (position != end && !isSpace(*position) && length + 1 < sizeof(token)) {
+            token[length++] = *position++;
+        }
+        token[length] = '\0';
+        char* parsed;
+        value = std::strtod(token, &parsed);
+        if (parsed != token + length) {
+            position = end;
+            return false;
+        }
+        return true;
+    }
+
+    bool next(int& value) {
+        skipSpaces();
+        if (position == end) {
+            return false;
+        }
+        bool negative = *position == '-';
+        if (negative || *position == '+') {
+            ++position;
+        }
+        if (position == end || *position < '0' || *position > '9') {
+            position = end;
+            return false;
+        }
+        long long result = 0;
+        while (position != end && *position >= '0' && *position <= '9') {
+            result = result * 10 + (*position++ - '0');
+        }
+        value = static_cast<int>(negative ? -result : result);
+        return true;
+    }
+
+private:
+    static bool isSpace(char c) {
+        return c == ' ' || c == '\n' || c == '\t' || c == '\r';
+    }
+
+    void skipSpaces() {
+        while (position != end && isSpace(*position)) {
+            ++position;
+        }
+    }
+
+    const char* position;
+    const char* end;
+};
+
+}
+
+NativeSdpResult readSdpaSolution(const NativeSdpProblem& problem, const char* begin, const char* end) {
+    SdpaLayout layout(problem);
+
+    // sdpa block -> problem block
+    std::vector<int> problemBlock(layout.blockSizes.size() + 1, -1);
+    for (int block = 0; block < problem.blockSizes.size(); ++block) {
+        problemBlock[layout.blockNumbers[block]] = block;
+    }
+
+    NativeSdpResult result;
+    result.status = NativeSdpStatus::SOLVED;
+    result.blocks.resize(problem.blockSizes.size());
+    for (int block = 0; block < problem.blockSizes.size(); ++block) {
+        int size = problem.blockSizes[block];
+        result.blocks[block].assign(size > 0 ? size * size : -size, 0.0);
+    }
+    result.freeVariables.assign(problem.numberOfFreeVariables, 0.0);
+
+    NumberReader reader(begin, end);
+    result.y.resize(problem.constraints.size());
+    for (auto& y: result.y) {
+        // csdp's dual is A^T y - C == Z >= 0
+        if (reader.next(y)) {
+            y = -y;
+        }
+    }
+
+    int matrix, block, row, col;
+    double value;
+    while (reader.next(matrix) && reader.next(block) && reader.next(row) && reader.next(col) && reader.next(value)) {
+        if (matrix != 2) {
+            continue;
+        }
+        if (block < 1 || block > layout.blockSizes.size()) {
+            throw std::runtime_error("unexpected block " + std::to_string(block));
+        }
+        int size = layout.blockSizes[block - 1];
+        int d = size > 0 ? size : -size;
+        if (row < 1 || col < 1 || row > d || col > d || (size < 0 && row != col)) {
+            throw std::runtime_error("unexpected rowIdx and colIdx");
+        }
+        --row;
+        --col;
+        if (block == layout.freeBlock) {
+            result.freeVariables[row / 2] += row % 2 == 0 ? value : -value;
+        } else if (size > 0) {
+            auto& X = result.blocks[problemBlock[block]];
+            X[row * d + col] = value;
+            X[col * d + row] = value;
+        } else {
+            result.blocks[problemBlock[block]][row] = value;
+        }
+    }
+    return result;
+}
+
+NativeSdpResult readSdpaSolution(const NativeSdpProblem& problem, std::istream& inp) {
+    std::string content((std::istreambuf_iterator<char>(inp)), std::istreambuf_iterator<char>());
+    return readSdpaSolution(problem, content.data(), content.data() + content.size());
+}
+
+NativeSdpResult readSdpaSolutionFile(const NativeSdpProblem& problem, const std::string& fileName) {
+#ifdef SDP_EXPORT_MMAP
+    int descriptor = open(fileName.c_str(), O_RDONLY);
+    if (descriptor >= 0) {
+        struct stat info;
+        if (fstat(descriptor, &info) == 0 && info.st_size > 0) {
+            void* data = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+            if (data != MAP_FAILED) {
+                close(descriptor);
+                const char* begin = static_cast<const char*>(data);
+                try {
+                    auto result = readSdpaSolution(problem, begin, begin + info.st_size);
+                    munmap(data, info.st_size);
+                    return result;
+                } catch (...) {
+                    munmap(data, info.st_size);
+                    throw;
+                }
+            }
+        }
+        close(descriptor);
+    }
+#endif
+    std::ifstream inp(fileName);
+    return readSdpaSolution(problem, inp);
+}
@@ -0,0 +1,460 @@
+//
+// Created by sergey on 27.08.23.
+//
+
+#include "sdpPresolve.h"
+
+#include <algorithm>
+#include <cmath>
+#include <unordered_map>
+
+SdpPresolve::SdpPresolve(SdpProblem& problem, double tolerance) : problem(problem), tolerance(tolerance) {
+    collectRows();
+    statistics.rows = rows.size();
+
+    // every step can make new singletons and duplicates, so it is repeated until nothing changes
+    bool changed = true;
+    while (changed && !infeasible) {
+        changed = false;
+        for (int row = 0; row < rows.size() && !infeasible; ++row) {
+            changed |= presolveRow(row);
+        }
+        if (!infeasible) {
+            changed |= substituteColumnSingletons();
+        }
+        if (!changed && !infeasible) {
+            changed = removeDuplicateRows();
+        }
+    }
+
+    if (!infeasible) {
+        buildReduced();
+    }
+}
+
+void SdpPresolve::collectRows() {
+    int numberOfMatrices = problem.getNumberOfSdpMatrices();
+    gramLineColumns.resize(numberOfMatrices);
+    gramLineRemoved.resize(numberOfMatrices);
+    for (int matrix = 0; matrix < numberOfMatrices; ++matrix) {
+        gramLineColumns[matrix].resize(problem.getMatrixSize(matrix));
+        gramLineRemoved[matrix].assign(problem.getMatrixSize(matrix), false);
+    }
+
+    std::unordered_map<long long, int> matrixColumns;
+    std::vector<int> freeColumns(problem.getNumberOfUnconstrainedVariables(), -1);
+    std::vector<int> nonnegativeColumns(problem.getNumberOfNonnegativeVariables(), -1);
+
+    auto addColumn = [this](const Column& column) {
+        columns.push_back(column);
+        columnRows.emplace_back();
+        return static_cast<int>(columns.size()) - 1;
+    };
+
+    for (const auto& condition : problem.getConditions()) {
+        if (condition.type == LinearMatrixExpressionType::UNKNOWN) {
+            throw std::runtime_error("UNKNOWN condition is not supported");
+        }
+
+        Row row;
+        for (const auto& index_matrix : condition.matrixCoefficients) {
+            int matrix = index_matrix.first;
+            for (const auto& entry : index_matrix.second.entries) {
+                if (entry.value == 0.0) {
+                    continue;
+                }
+                long long key = (static_cast<long long>(matrix) << 42) | (static_cast<long long>(entry.row) << 21) | entry.col;
+                auto inserted = matrixColumns.emplace(key, static_cast<int>(columns.size()));
+                if (inserted.second) {
+                    int column = addColumn({ColumnKind::MATRIX, matrix, entry.row, entry.col});
+                    gramLineColumns[matrix][entry.row].push_back(column);
+                    if (entry.row != entry.col) {
+                        gramLineColumns[matrix][entry.col].push_back(column);
+                    }
+                }
+                row.terms.emplace_back(inserted.first->second, entry.row == entry.col ? entry.value : 2 * entry.value);
+            }
+        }
+        for (const auto& index_coefficient : condition.freeCoefficients) {
+            if (index_coefficient.second == 0.0) {
+                continue;
+            }
+            auto& column = freeColumns[index_coefficient.first];
+            if (column < 0) {
+                column = addColumn({ColumnKind::FREE, index_coefficient.first, 0, 0});
+            }
+            row.terms.emplace_back(column, index_coefficient.second);
+        }
+        for (const auto& index_coefficient : condition.nonnegativeCoefficients) {
+            if (index_coefficient.second == 0.0) {
+                continue;
+            }
+            auto& column = nonnegativeColumns[index_coefficient.first];
+            if (column < 0) {
+                column = addColumn({ColumnKind::NONNEGATIVE, index_coefficient.first, 0, 0});
+            }
+            row.terms.emplace_back(column, index_coefficient.second);
+        }
+        std::sort(row.terms.begin(), row.terms.end());
+
+        row.constant = condition.constantPart;
+        row.type = condition.type;
+        row.withinRange = condition.withinRange;
+        for (const auto& term : row.terms) {
+            columnRows[term.first].push_back(rows.size());
+        }
+        rows.push_back(std::move(row));
+    }
+
+    columnCount.resize(columns.size());
+    for (int column = 0; column < columns.size(); ++column) {
+        columnCount[column] = columnRows[column].size();
+    }
+    columnRemoved.assign(columns.size(), false);
+}
+
+bool SdpPresolve::presolveRow(int r) {
+    auto& row = rows[r];
+    if (row.removed) {
+        return false;
+    }
+    // how far the value of the row may be from zero
+    double slack = tolerance + (row.type == LinearMatrixExpressionType::IN_RANGE ? row.withinRange : 0.0);
+
+    if (row.terms.empty()) {
+        bool satisfied = row.type == LinearMatrixExpressionType::GEQ ? row.constant >= -tolerance
+                                                                      : std::abs(row.constant) <= slack;
+        if (!satisfied) {
+            infeasible = true;
+            return false;
+        }
+        removeRow(r);
+        statistics.emptyRows++;
+        return true;
+    }
+
+    if (row.terms.size() != 1 || row.type == LinearMatrixExpressionType::GEQ) {
+        return false;
+    }
+    int column = row.terms[0].first;
+    double value = -row.constant / row.terms[0].second;
+    const auto& info = columns[column];
+
+    switch (info.kind) {
+        case ColumnKind::FREE:
+            removeRow(r);
+            fixColumn(column, value);
+            statistics.fixedVariables++;
+            return true;
+        case ColumnKind::NONNEGATIVE:
+            if (value < 0) {
+                // zero is the closest nonnegative value, it is fine if the row still holds
+                if (std::abs(row.constant) > slack) {
+                    infeasible = row.type == LinearMatrixExpressionType::EQ;
+                    return false;
+                }
+                value = 0;
+            }
+            removeRow(r);
+            fixColumn(column, value);
+            statistics.fixedVariables++;
+            return true;
+        case ColumnKind::MATRIX:
+            // only a zero diagonal entry tells something about the rest of the matrix
+            if (info.row != info.col || std::abs(value) > tolerance) {
+                if (info.row == info.col && value < -tolerance && row.type == LinearMatrixExpressionType::EQ) {
+                    infeasible = true;
+                }
+                return false;
+            }
+            removeRow(r);
+            zeroGramLine(info.index, info.row);
+            return true;
+    }
+    return false;
+}
+
+// a free variable of a single row makes that row hold whatever the other variables are
+bool SdpPresolve::substituteColumnSingletons() {
+    bool changed = false;
+    for (int column = 0; column < columns.size(); ++column) {
+        if (columns[column].kind != ColumnKind::FREE || columnRemoved[column] || columnCount[column] != 1) {
+            continue;
+        }
+        for (int r : columnRows[column]) {
+            if (rows[r].removed) {
+                continue;
+            }
+            PostsolveStep step{column, 0.0, rows[r].constant, {}};
+            for (const auto& term : rows[r].terms) {
+                if (term.first == column) {
+                    step.coefficient = term.second;
+                } else {
+                    step.terms.push_back(term);
+                }
+            }
+            steps.push_back(std::move(step));
+            removeRow(r);
+            break;
+        }
+        columnRemoved[column] = true;
+        statistics.substitutedVariables++;
+        changed = true;
+    }
+    return changed;
+}
+
+// rows with the same variables and proportional coefficients, e.g. the ones of an implication that is written twice
+bool SdpPresolve::removeDuplicateRows() {
+    bool changed = false;
+    std::unordered_map<size_t, std::vector<int>> buckets;
+
+    for (int r = 0; r < rows.size(); ++r) {
+        const auto& row = rows[r];
+        if (row.removed || row.terms.empty() || row.type == LinearMatrixExpressionType::GEQ) {
+            continue;
+        }
+        size_t hash = static_cast<size_t>(row.type);
+        for (const auto& term : row.terms) {
+            hash = hash * 1000003 + term.first;
+        }
+
+        auto& bucket = buckets[hash];
+        bool duplicate = false;
+        for (int other : bucket) {
+            const auto& candidate = rows[other];
+            if (candidate.type != row.type || candidate.terms.size() != row.terms.size()) {
+                continue;
+            }
+            double ratio = row.terms[0].second / candidate.terms[0].second;
+            bool parallel = true;
+            for (int k = 0; k < row.terms.size() && parallel; ++k) {
+                parallel = row.terms[k].first == candidate.terms[k].first &&
+                           std::abs(row.terms[k].second - ratio * candidate.terms[k].second) <= 1e-12 * std::abs(row.terms[k].second);
+            }
+            // a scaled IN_RANGE row has a range of its own
+            if (!parallel || (row.type == LinearMatrixExpressionType::IN_RANGE &&
+                              (row.withinRange != candidate.withinRange || std::abs(std::abs(ratio) - 1) > 1e-12))) {
+                continue;
+            }
+            if (std::abs(row.constant - ratio * candidate.constant) <= tolerance * std::max(1.0, std::abs(row.constant))) {
+                duplicate = true;
+                break;
+            }
+            if (row.type == LinearMatrixExpressionType::EQ) {
+                infeasible = true;
+                return false;
+            }
+        }
+
+        if (duplicate) {
+            removeRow(r);
+            statistics.duplicateRows++;
+            changed = true;
+        } else {
+            bucket.push_back(r);
+        }
+    }
+    return changed;
+}
+
+void SdpPresolve::fixColumn(int column, double value) {
+    steps.push_back({column, 1.0, -value, {}});
+    columnRemoved[column] = true;
+    for (int r : columnRows[column]) {
+        auto& row = rows[r];
+        if (row.removed) {
+            continue;
+        }
+        auto term = std::lower_bound(row.terms.begin(), row.terms.end(), std::make_pair(column, -HUGE_VAL));
+        if (term != row.terms.end() && term->first == column) {
+            row.constant += term->second * value;
+            row.terms.erase(term);
+            columnCount[column]--;
+        }
+    }
+}
+
+// X_ii == 0 and X >= 0 give a zero row and column i
+void SdpPresolve::zeroGramLine(int matrix, int line) {
+    gramLineRemoved[matrix][line] = true;
+    statistics.removedGramLines++;
+    for (int column : gramLineColumns[matrix][line]) {
+        if (columnRemoved[column]) {
+            continue;
+        }
+        columnRemoved[column] = true;
+        for (int r : columnRows[column]) {
+            auto& row = rows[r];
+            if (row.removed) {
+                continue;
+            }
+            auto term = std::lower_bound(row.terms.begin(), row.terms.end(), std::make_pair(column, -HUGE_VAL));
+            if (term != row.terms.end() && term->first == column) {
+                row.terms.erase(term);
+                columnCount[column]--;
+            }
+        }
+    }
+}
+
+void SdpPresolve::removeRow(int r) {
+    rows[r].removed = true;
+    for (const auto& term : rows[r].terms) {
+        columnCount[term.first]--;
+    }
+}
+
+void SdpPresolve::buildReduced() {
+    reduced = std::make_unique<SdpProblem>(problem.getMatrixSize());
+
+    std::vector<int> outerIndex(gramLineRemoved.size());
+    reducedLine.resize(gramLineRemoved.size());
+    for (int matrix = 0; matrix < gramLineRemoved.size(); ++matrix) {
+        outerIndex[matrix] = problem.decodeMatrixIndexFromInner(matrix);
+        int size = 0;
+        reducedLine[matrix].assign(gramLineRemoved[matrix].size(), -1);
+        for (int line = 0; line < gramLineRemoved[matrix].size(); ++line) {
+            if (!gramLineRemoved[matrix][line]) {
+                reducedLine[matrix][line] = size++;
+            }
+        }
+        if (size > 0) {
+            reduced->setMatrixSize(outerIndex[matrix], size);
+        }
+    }
+
+    std::vector<std::string> names(columns.size());
+    for (int column = 0; column < columns.size(); ++column) {
+        if (columns[column].kind == ColumnKind::FREE) {
+            names[column] = problem.decodeUnconstrainedVariableNameFromInner(columns[column].index);
+        } else if (columns[column].kind == ColumnKind::NONNEGATIVE) {
+            names[column] = problem.getNonnegativeVariableName(columns[column].index);
+        }
+    }
+
+    for (const auto& row : rows) {
+        if (row.removed) {
+            continue;
+        }
+        reduced->startNewCondition();
+        for (const auto& term : row.terms) {
+            const auto& info = columns[term.first];
+            switch (info.kind) {
+                case ColumnKind::MATRIX:
+                    reduced->addSdpConstrainedVariable(outerIndex[info.index], reducedLine[info.index][info.row],
+                                                       reducedLine[info.index][info.col], term.second);
+                    break;
+                case ColumnKind::FREE:
+                    reduced->addUnconstrainedVariable(names[term.first], term.second);
+                    break;
+                case ColumnKind::NONNEGATIVE:
+                    if (problem.getNonnegativeVariableGramIndex(info.index) >= 0) {
+                        reduced->addGramScalar(problem.getNonnegativeVariableGramIndex(info.index), term.second);
+                    } else {
+                        reduced->addNonnegativeVariable(names[term.first], term.second);
+                    }
+                    break;
+            }
+        }
+        reduced->addConstant(row.constant);
+        reduced->endCondition(row.type, row.type == LinearMatrixExpressionType::IN_RANGE ? row.withinRange : 0.0);
+    }
+}
+
+void SdpPresolve::postsolve() {
+    if (infeasible) {
+        throw std::runtime_error("Presolve found the problem infeasible, there is nothing to postsolve");
+    }
+
+    SdpProblem::RawSolution raw;
+    for (int matrix = 0; matrix < reducedLine.size(); ++matrix) {
+        int size = reducedLine[matrix].size();
+        raw.matrices.emplace_back(size, std::vector<double>(size, 0.0));
+    }
+    raw.unconstrainedVariables.assign(problem.getNumberOfUnconstrainedVariables(), 0.0);
+    raw.nonnegativeVariables.assign(problem.getNumberOfNonnegativeVariables(), 0.0);
+
+    // the variables that are not in the reduced problem stay zero until the steps below
+    if (!isSolved()) {
+        const auto& solution = reduced->getSolution();
+        for (int matrix = 0; matrix < reducedLine.size(); ++matrix) {
+            auto reducedMatrix = solution.matrices.find(problem.decodeMatrixIndexFromInner(matrix));
+            if (reducedMatrix == solution.matrices.end()) {
+                continue;
+            }
+            const auto& lines = reducedLine[matrix];
+            for (int i = 0; i < lines.size(); ++i) {
+                for (int j = 0; j < lines.size(); ++j) {
+                    if (lines[i] >= 0 && lines[j] >= 0) {
+                        raw.matrices[matrix][i][j] = reducedMatrix->second[lines[i]][lines[j]];
+                    }
+                }
+            }
+        }
+        for (int i = 0; i < raw.unconstrainedVariables.size(); ++i) {
+            auto value = solution.unconstrainedVariables.find(problem.decodeUnconstrainedVariableNameFromInner(i));
+            if (value != solution.unconstrainedVariables.end()) {
+                raw.unconstrainedVariables[i] = value->second;
+            }
+        }
+        for (int i = 0; i < raw.nonnegativeVariables.size(); ++i) {
+            // the 1x1 gram matrices are reported as matrices
+            int gramIndex = problem.getNonnegativeVariableGramIndex(i);
+            if (gramIndex >= 0) {
+                auto matrix = solution.matrices.find(gramIndex);
+                if (matrix != solution.matrices.end()) {
+                    raw.nonnegativeVariables[i] = matrix->second[0][0];
+                }
+                continue;
+            }
+            auto value = solution.nonnegativeVariables.find(problem.getNonnegativeVariableName(i));
+            if (value != solution.nonnegativeVariables.end()) {
+                raw.nonnegativeVariables[i] = value->second;
+            }
+        }
+    }
+
+    std::vector<double> values(columns.size());
+    for (int column = 0; column < columns.size(); ++column) {
+        const auto& info = columns[column];
+        switch (info.kind) {
+            case ColumnKind::MATRIX:
+                values[column] = raw.matrices[info.index][info.row][info.col];
+                break;
+            case ColumnKind::FREE:
+                values[column] = raw.unconstrainedVariables[info.index];
+                break;
+            case ColumnKind::NONNEGATIVE:
+                values[column] = raw.nonnegativeVariables[info.index];
+                break;
+        }
+    }
+
+    for (auto step = steps.rbegin(); step != steps.rend(); ++step) {
+        double sum = step->constant;
+        for (const auto& term : step->terms) {
+            sum += term.second * values[term.first];
+        }
+        values[step->column] = -sum / step->coefficient;
+        const auto& info = columns[step->column];
+        if (info.kind == ColumnKind::FREE) {
+            raw.unconstrainedVariables[info.index] = values[step->column];
+        } else {
+            raw.nonnegativeVariables[info.index] = values[step->column];
+        }
+    }
+
+    problem.setSolution(raw);
+}
+
+void SdpPresolve::printStatistics(std::ostream& os) const {
+    if (infeasible) {
+        os << "Presolve: the system is infeasible" << std::endl;
+        return;
+    }
+    os << "Presolve: " << reduced->getNumberOfConditions() << " of " << statistics.rows << " rows are left, removed "
+       << statistics.emptyRows << " empty and " << statistics.duplicateRows << " duplicate rows, fixed "
+       << statistics.fixedVariables << " variables, substituted " << statistics.substitutedVariables
+       << " free variables, removed " << statistics.removedGramLines << " gram matrix rows" << std::endl;
+}
@@ -9,33 +9,6 @@
 #include <iomanip>
 #include "stringRoutines.h"
 
-bool isLVar(const std::string& name) {
-    std::string prefix = "l_";
-    if (name.substr(0, prefix.size()) != prefix) {
-        return false;
-    }
-    return true;
-}
-
-std::vector<int> parseLVarName(std::string name) {
-    // l_1_2_3 -> (1, 2, 3)
-    std::string prefix = "l_";
-    if (name.substr(0, prefix.size()) != prefix) {
-        throw std::runtime_error("Not a linear variable");
-    }
-    name = name.substr(prefix.size());
-    std::vector<int> tokens;
-    std::string token;
-    std::istringstream tokenStream(name);
-    while (std::getline(tokenStream, token, '_')) {
-        tokens.push_back(std::stoi(token));
-    }
-    if (tokens.size() != 3) {
-        throw std::runtime_error("Not a linear variable");
-    }
-    return {tokens[0], tokens[1], tokens[2]};
-}
-
 void replaceAllInplace(std::string& str, const std::string& from, const std::string& to) {
     if(from.empty())
         return;
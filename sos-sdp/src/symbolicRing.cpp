@@ -4,6 +4,7 @@
 
 #include <sstream>
 #include <iostream>
+#include <functional>
 
 #include "symbolicRing.h"
 
@@ -35,66 +36,15 @@ namespace symbolic_ring {
             throw std::runtime_error("Different environments");
         }
         QMonomial result = l;
-//    result.variables.clear();
-//    result.powers.clear();
-        result.variables_and_powers.clear();
-        if (isMultiplicationSafe(result.enumerator, r.enumerator) && isMultiplicationSafe(result.denominator, r.denominator)) {
-            result.enumerator *= r.enumerator;
-            result.denominator *= r.denominator;
-            auto gcd_result = gcd_pos(result.enumerator, result.denominator);
-            if (gcd_result == 0) {
-                throw_line("GCD is zero");
-            }
-            result.enumerator /= gcd_result;
-            result.denominator /= gcd_result;
-        } else {
-            double resultCoeff = (double) result.enumerator / (double) result.denominator;
-            double rCoeff = (double) r.enumerator / (double) r.denominator;
-            double newCoeff = resultCoeff * rCoeff;
-            Fractionizer::fractionize<double, long long>(newCoeff, result.enumerator, result.denominator);
-        }
-        // result.enumerator *= r.enumerator;
-        // result.denominator *= r.denominator;
-
-        // auto gcd_result = gcd_pos(result.enumerator, result.denominator);
-        // if (gcd_result == 0) {
-        //    throw_line("GCD is zero");
-        //}
-        // result.enumerator /= gcd_result;
-        // result.denominator /= gcd_result;
-
+        result.coefficient = l.coefficient * r.coefficient;
 
         // early return if zero
-        if (result.enumerator == 0) {
+        if (result.coefficient.isZero()) {
+            result.exponents = PackedExponents();
             return result;
         }
 
-        std::set<std::string> all_variables;
-        for (auto &var: l.variables_and_powers) {
-            all_variables.insert(var.first);
-        }
-        //    all_variables.insert(l.variables.begin(), l.variables.end());
-        for (auto &var: r.variables_and_powers) {
-            all_variables.insert(var.first);
-        }
-        //all_variables.insert(r.variables.begin(), r.variables.end());
-
-        result.variables_and_powers = std::vector<std::pair<std::string, int>>();
-
-        std::map<std::string, int> index_of_variable;
-        for (auto &var: all_variables) {
-            result.variables_and_powers.emplace_back(var, 0);
-            index_of_variable[var] = result.variables_and_powers.size() - 1;
-        }
-
-        for (auto &var: l.variables_and_powers) {
-            result.variables_and_powers[index_of_variable[var.first]].second += var.second;
-        }
-
-        for (auto &var: r.variables_and_powers) {
-            result.variables_and_powers[index_of_variable[var.first]].second += var.second;
-        }
-
+        result.exponents = mul(l.exponents, r.exponents);
         return result;
     }
 
@@ -111,186 +61,78 @@ namespace symbolic_ring {
         return mul(QMonomial(l), QMonomial(r));
     }
 
-    QMonomial mul(const QMonomial &l, long long r) {
+    QMonomial mul(const QMonomial &l, const Rational &r) {
         auto result = l;
-        if (isMultiplicationSafe(result.enumerator, r)) {
-            result.enumerator *= r;
-            auto gcd_result = gcd_pos(result.enumerator, result.denominator);
-            if (gcd_result == 0) {
-                throw_line("GCD is zero");
-            }
-            result.enumerator /= gcd_result;
-            result.denominator /= gcd_result;
-            return result;
-        }
-
-        double resultCoeff = (double) result.enumerator / (double) result.denominator;
-        double rCoeff = (double) r;
-        double newCoeff = resultCoeff * rCoeff;
-
-        Fractionizer::fractionize<double, long long>(newCoeff, result.enumerator, result.denominator);
-
+        result.coefficient = l.coefficient * r;
         return result;
     }
 
+    QMonomial mul(const QMonomial &l, long long r) {
+        return mul(l, Rational(r));
+    }
+
     QMonomial mul(long long l, const QMonomial &r) {
         return mul(r, l);
     }
 
-    QMonomial div(const QMonomial &l, long long r) {
-        if (isMultiplicationSafe(l.denominator, r)) {
-            auto result = l;
-            result.denominator *= r;
-            auto gcd_result = gcd_pos(result.enumerator, result.denominator);
-            if (gcd_result == 0) {
-                throw_line("GCD is zero");
-            }
-            result.enumerator /= gcd_result;
-            result.denominator /= gcd_result;
-            return result;
-        }
+    QMonomial div(const QMonomial &l, const Rational &r) {
         auto result = l;
-        double resultCoeff = (double) l.enumerator / (double) l.denominator;
-        double rCoeff = 1.0 / (double) r;
-        double newCoeff = resultCoeff * rCoeff;
-        Fractionizer::fractionize<double, long long>(newCoeff, result.enumerator, result.denominator);
+        result.coefficient = l.coefficient / r;
         return result;
     }
 
+    QMonomial div(const QMonomial &l, long long r) {
+        return div(l, Rational(r));
+    }
+
     bool isSimilar(const QMonomial &l, const QMonomial &r) {
         if (l.viewEnvironment() != r.viewEnvironment()) {
             throw std::runtime_error("Different environments");
         }
-        if (l.getEnumerator() == 0 || r.getEnumerator() == 0) {
+        if (l.coefficient.isZero() || r.coefficient.isZero()) {
             return true;
         }
-        auto l_vars = l.variables_and_powers;
-        auto r_vars = r.variables_and_powers;
-        std::sort(l_vars.begin(), l_vars.end());
-        std::sort(r_vars.begin(), r_vars.end());
-        return l_vars == r_vars;
+        return l.exponents == r.exponents;
     }
 
     QMonomial add(const QMonomial &l, const QMonomial &r) {
 #ifdef SYM_RING_CPP_DEBUG
         std::cout << "add: " << l << " + " << r << std::endl;
 #endif
+        if (l.viewEnvironment() != r.viewEnvironment()) {
+            throw std::runtime_error("Different environments");
+        }
 
-        auto result = l;
-        try {
-            if (l.viewEnvironment() != r.viewEnvironment()) {
-                throw std::runtime_error("Different environments");
-            }
-
-            if (!isSimilar(l, r)) {
-                throw std::runtime_error("Different variables and powers");
-            }
-
-            if (l.getEnumerator() == 0) {
-                return r;
-            }
-
-            if (r.getEnumerator() == 0) {
-                return l;
-            }
-
-            // this part causing overflows
-//
-//        result.enumerator = l.enumerator * r.denominator + r.enumerator * l.denominator;
-//        result.denominator = l.denominator * r.denominator;
-//        auto gcd_result = gcd_pos(result.enumerator, result.denominator);
-//        if (gcd_result == 0) {
-//            throw_line("GCD is zero");
-//        }
-//
-//        result.enumerator /= gcd_result;
-//        result.denominator /= gcd_result;
-
-// so instead we do this
-            auto gcd_result = gcd_pos(l.denominator, r.denominator);
-            if (gcd_result == 0) {
-                throw_line("GCD is zero");
-            }
-            auto lcm_result = lcm_pos(l.denominator, r.denominator);
-            if (lcm_result == 0) {
-                throw_line("LCM is zero");
-            }
-
-            assertMultiplicationSafe(l.enumerator, lcm_result / l.denominator);
-            assertMultiplicationSafe(r.enumerator, lcm_result / r.denominator);
-
-            result.enumerator =
-                    l.enumerator * (lcm_result / l.denominator) + r.enumerator * (lcm_result / r.denominator);
-            result.denominator = lcm_result;
-            gcd_result = gcd_pos(result.enumerator, result.denominator);
-            if (gcd_result == 0) {
-                throw_line("GCD is zero");
-            }
-
-            result.enumerator /= gcd_result;
-            result.denominator /= gcd_result;
-
-            return result;
-        } catch (std::exception &e) {
-            std::cerr << "precision of long long is not enough" << std::endl;
-            if (l.viewEnvironment() != r.viewEnvironment()) {
-                throw std::runtime_error("Different environments");
-            }
-
-            if (!isSimilar(l, r)) {
-                throw std::runtime_error("Different variables and powers");
-            }
-
-            if (l.getEnumerator() == 0) {
-                return r;
-            }
-
-            if (r.getEnumerator() == 0) {
-                return l;
-            }
-
-            double lCoeff = (double) l.getEnumerator() / (double) l.getDenominator();
-            double rCoeff = (double) r.getEnumerator() / (double) r.getDenominator();
+        if (!isSimilar(l, r)) {
+            throw std::runtime_error("Different variables and powers");
+        }
 
-            double resultCoeff = lCoeff + rCoeff;
-            Fractionizer::fractionize<double, long long>(resultCoeff, result.enumerator, result.denominator);
+        if (l.coefficient.isZero()) {
+            return r;
+        }
 
-            return result;
+        if (r.coefficient.isZero()) {
+            return l;
         }
+
+        auto result = l;
+        result.coefficient = l.coefficient + r.coefficient;
+        return result;
     }
 
 
     bool QMonomial::operator==(const QMonomial &rhs) const {
-
-        std::vector<std::pair<std::string, int>> variables_and_powers_lhs = this->variables_and_powers;
-        std::vector<std::pair<std::string, int>> variables_and_powers_rhs = rhs.variables_and_powers;
-
-        std::sort(variables_and_powers_lhs.begin(), variables_and_powers_lhs.end());
-        std::sort(variables_and_powers_rhs.begin(), variables_and_powers_rhs.end());
-
-        return variables_and_powers_lhs == variables_and_powers_rhs &&
-               enumerator * rhs.denominator == denominator * rhs.enumerator &&
+        return exponents == rhs.exponents &&
+               coefficient == rhs.coefficient &&
                this->viewEnvironment() == rhs.viewEnvironment();
     }
 
     bool QMonomial::operator!=(const QMonomial &rhs) const {
-        std::vector<std::pair<std::string, int>> variables_and_powers_lhs = this->variables_and_powers;
-        std::vector<std::pair<std::string, int>> variables_and_powers_rhs = rhs.variables_and_powers;
-
-        std::sort(variables_and_powers_lhs.begin(), variables_and_powers_lhs.end());
-        std::sort(variables_and_powers_rhs.begin(), variables_and_powers_rhs.end());
-
-        return !(variables_and_powers_lhs == variables_and_powers_rhs);
+        return exponents != rhs.exponents;
     }
 
     bool QMonomial::operator<(const QMonomial &rhs) const {
-        std::vector<std::pair<std::string, int>> variables_and_powers_lhs = this->variables_and_powers;
-        std::vector<std::pair<std::string, int>> variables_and_powers_rhs = rhs.variables_and_powers;
-
-        std::sort(variables_and_powers_lhs.begin(), variables_and_powers_lhs.end());
-        std::sort(variables_and_powers_rhs.begin(), variables_and_powers_rhs.end());
-
-        return variables_and_powers_lhs < variables_and_powers_rhs;
+        return exponents < rhs.exponents;
     }
 
 
@@ -307,40 +149,54 @@ namespace symbolic_ring {
     }
 
     long long int QMonomial::getEnumerator() const {
-        return enumerator;
+        return coefficient.getEnumerator();
     }
 
     long long int QMonomial::getDenominator() const {
-        return denominator;
+        return coefficient.getDenominator();
     }
 
 
     std::ostream &operator<<(std::ostream &os, const QMonomial &monomial) {
-        os << "(" << monomial.enumerator << "/" << monomial.denominator << ")";
-        for (auto &var: monomial.variables_and_powers) {
-            os << "*" << var.first << "**(" << var.second << ")";
+        os << "(" << monomial.coefficient << ")";
+        const auto &exponents = monomial.exponents;
+        for (int i = 0; i < exponents.size(); ++i) {
+            os << "*" << monomial.viewEnvironment()->getSymbolName(exponents.symbolIdAt(i))
+               << "**(" << exponents.powerAt(i) << ")";
         }
 
         return os;
     }
 
-    const std::vector<std::pair<std::string, int>> &QMonomial::getVariablesAndPowers() const {
+    std::vector<std::pair<std::string, int>> QMonomial::getVariablesAndPowers() const {
+        std::vector<std::pair<std::string, int>> variables_and_powers;
+        variables_and_powers.reserve(exponents.size());
+        for (int i = 0; i < exponents.size(); ++i) {
+            variables_and_powers.emplace_back(viewEnvironment()->getSymbolName(exponents.symbolIdAt(i)),
+                                              exponents.powerAt(i));
+        }
         return variables_and_powers;
     }
 
+    std::string QMonomial::getNameIfLinear() const {
+        return viewEnvironment()->getSymbolName(getSymbolIdIfLinear());
+    }
+
     QMonomial rename(const QMonomial &l, const std::string &old_name, const std::string &new_name) {
         auto result = l;
         auto new_var = l.getEnvironment()->getOrCreate(new_name); // creating new variable
+        auto old_var = l.getEnvironment()->getOrCreate(old_name);
 
-        for (auto &var: result.variables_and_powers) {
-            if (var.first == new_name) {
-                throw std::runtime_error("Renaming clash");
-            }
+        if (l.exponents.powerOf(new_var.getId()) != 0) {
+            throw std::runtime_error("Renaming clash");
+        }
 
-            if (var.first == old_name) {
-                var.first = new_name;
-            }
+        std::vector<std::pair<int, int>> ids_and_powers;
+        for (int i = 0; i < l.exponents.size(); ++i) {
+            int id = l.exponents.symbolIdAt(i);
+            ids_and_powers.emplace_back(id == old_var.getId() ? new_var.getId() : id, l.exponents.powerAt(i));
         }
+        result.exponents = PackedExponents::fromPairs(ids_and_powers);
         return result;
     }
 
@@ -358,29 +214,58 @@ namespace symbolic_ring {
     }
 
     void QPolynomial::reduce() {
-        auto monomials_copy = monomials;
-        std::sort(monomials_copy.begin(), monomials_copy.end());
-        monomials.clear();
-
-        if (monomials_copy.empty()) {
+        if (monomials.empty()) {
             return;
         }
 
+        QPolynomialAccumulator accumulator(getEnvironment());
+        accumulator.add(std::move(*this));
+        monomials = std::move(accumulator).build().monomials;
+    }
 
-        if (monomials_copy[0].getEnumerator() == 0) {
-            monomials.push_back(this->getEnvironment()->qmonomialZero());
-        } else {
-            monomials.push_back(monomials_copy[0]);
+    QPolynomial &QPolynomial::operator+=(const QPolynomial &other) {
+        if (viewEnvironment() != other.viewEnvironment()) {
+            throw std::runtime_error("Different environments");
         }
+        monomials.insert(monomials.end(), other.monomials.begin(), other.monomials.end());
+        reduce();
+        return *this;
+    }
 
-        for (int i = 1; i < monomials_copy.size(); ++i) {
-            if (monomials_copy[i].getOrderedVariablesAndPowers() ==
-                monomials_copy[i - 1].getOrderedVariablesAndPowers()) {
-                monomials.back() = add(monomials.back(), monomials_copy[i]);
-            } else {
-                monomials.push_back(monomials_copy[i]);
-            }
+    QPolynomial &QPolynomial::operator-=(const QPolynomial &other) {
+        if (viewEnvironment() != other.viewEnvironment()) {
+            throw std::runtime_error("Different environments");
         }
+        auto size = monomials.size();
+        monomials.insert(monomials.end(), other.monomials.begin(), other.monomials.end());
+        for (auto i = size; i < monomials.size(); ++i) {
+            monomials[i].coefficient = -monomials[i].coefficient;
+        }
+        reduce();
+        return *this;
+    }
+
+    QPolynomial &QPolynomial::operator*=(const QPolynomial &other) {
+        return *this = mul(*this, other);
+    }
+
+    QPolynomial &QPolynomial::operator*=(const Rational &factor) {
+        return scale(factor);
+    }
+
+    QPolynomial &QPolynomial::scale(const Rational &factor) {
+        if (factor.isZero()) {
+            monomials.assign(1, getEnvironment()->qmonomialZero());
+            return *this;
+        }
+        for (auto &monomial: monomials) {
+            monomial.coefficient *= factor;
+        }
+        return *this;
+    }
+
+    QPolynomial &QPolynomial::negate() {
+        return scale(-1);
     }
 
 
@@ -388,26 +273,83 @@ namespace symbolic_ring {
         if (l.viewEnvironment() != r.viewEnvironment()) {
             throw std::runtime_error("Different environments");
         }
-        QPolynomial result = l;
-        result.monomials.clear();
+        QPolynomialAccumulator accumulator(l.getEnvironment());
 
         for (auto &monomial_l: l.monomials) {
             for (auto &monomial_r: r.monomials) {
-                result.monomials.push_back(mul(monomial_l, monomial_r));
+                accumulator.add(mul(monomial_l, monomial_r));
             }
         }
-        result.reduce();
-        return result;
+        if (accumulator.isEmpty()) {
+            auto result = l;
+            result.monomials.clear();
+            return result;
+        }
+        return std::move(accumulator).build();
     }
 
     QPolynomial add(const QPolynomial &l, const QPolynomial &r) {
-        if (l.viewEnvironment() != r.viewEnvironment()) {
+        QPolynomial result = l;
+        result += r;
+        return result;
+    }
+
+    QPolynomial add(QPolynomial &&l, const QPolynomial &r) {
+        l += r;
+        return std::move(l);
+    }
+
+    void QPolynomialAccumulator::add(const QMonomial &monomial) {
+        add(QMonomial(monomial));
+    }
+
+    void QPolynomialAccumulator::add(QMonomial &&monomial) {
+        if (monomial.viewEnvironment() != environment) {
             throw std::runtime_error("Different environments");
         }
-        QPolynomial result = l;
-        result.monomials.insert(result.monomials.end(), r.monomials.begin(), r.monomials.end());
+        auto it = termIndex.find(monomial.getExponents());
+        if (it == termIndex.end()) {
+            termIndex.emplace(monomial.getExponents(), terms.size());
+            terms.push_back(std::move(monomial));
+        } else {
+            terms[it->second] = symbolic_ring::add(terms[it->second], monomial);
+        }
+    }
 
-        result.reduce();
+    void QPolynomialAccumulator::add(const QPolynomial &polynomial) {
+        for (auto &monomial: polynomial.monomials) {
+            add(monomial);
+        }
+    }
+
+    void QPolynomialAccumulator::add(QPolynomial &&polynomial) {
+        for (auto &monomial: polynomial.monomials) {
+            add(std::move(monomial));
+        }
+    }
+
+    QPolynomial QPolynomialAccumulator::build() const &{
+        return finish(terms);
+    }
+
+    QPolynomial QPolynomialAccumulator::build() &&{
+        termIndex.clear();
+        return finish(std::move(terms));
+    }
+
+    QPolynomial QPolynomialAccumulator::finish(std::vector<QMonomial> monomials) const {
+        auto result = environment->qPolynomialZero();
+        if (monomials.empty()) {
+            return result;
+        }
+
+        result.monomials = std::move(monomials);
+        std::sort(result.monomials.begin(), result.monomials.end());
+
+        // a vanished leading term is kept as the canonical zero
+        if (result.monomials[0].getCoefficient().isZero()) {
+            result.monomials[0] = environment->qmonomialZero();
+        }
         return result;
     }
 
@@ -436,46 +378,249 @@ namespace symbolic_ring {
         return !(*this < rhs);
     }
 
-    QPolynomial mul(const QPolynomial &l, long long int r) {
-        if (r == 0) {
+    QPolynomial mul(const QPolynomial &l, const Rational &r) {
+        if (r.isZero()) {
             return l.viewEnvironment()->qPolynomialZero();
         }
         QPolynomial result = l;
-        for (auto &monomial: result.monomials) {
-            monomial = mul(monomial, r);
-        }
+        result.scale(r);
         return result;
     }
 
+    QPolynomial mul(QPolynomial &&l, const Rational &r) {
+        l.scale(r);
+        return std::move(l);
+    }
+
+    QPolynomial mul(QPolynomial &&l, long long int r) {
+        return mul(std::move(l), Rational(r));
+    }
+
+    QPolynomial mul(const QPolynomial &l, long long int r) {
+        return mul(l, Rational(r));
+    }
+
     QPolynomial mul(long long int l, const QPolynomial &r) {
         return mul(r, l);
     }
 
-    QPolynomial div(const QPolynomial &l, long long int r) {
-        if (r == 0) {
+    QPolynomial div(const QPolynomial &l, const Rational &r) {
+        if (r.isZero()) {
             throw std::runtime_error("Division by zero");
         }
         QPolynomial result = l;
-        for (auto &monomial: result.monomials) {
-            monomial = div(monomial, r);
-        }
+        result.scale(Rational(1) / r);
         return result;
     }
 
+    QPolynomial div(const QPolynomial &l, long long int r) {
+        return div(l, Rational(r));
+    }
+
     const std::vector<QMonomial> &QPolynomial::getMonomials() const {
         return monomials;
     }
 
 
 
+    const int LinearForm::CONSTANT_ID;
+
+    LinearForm::LinearForm(SymbolicEnvironment *environment, const Rational &constant) :
+            HasSymbolicEnvironment(environment) {
+        if (!constant.isZero()) {
+            terms.push_back({CONSTANT_ID, constant});
+        }
+    }
+
+    LinearForm::LinearForm(const Symbol &symbol) : HasSymbolicEnvironment(symbol.viewEnvironment()) {
+        terms.push_back({symbol.getId(), 1});
+    }
+
+    LinearForm::LinearForm(const QPolynomial &polynomial) : HasSymbolicEnvironment(polynomial.viewEnvironment()) {
+        std::vector<Term> unsorted;
+        unsorted.reserve(polynomial.monomials.size());
+        for (auto &monomial: polynomial.monomials) {
+            if (monomial.coefficient.isZero()) {
+                continue;
+            }
+            if (monomial.isConstant()) {
+                unsorted.push_back({CONSTANT_ID, monomial.coefficient});
+            } else if (monomial.isLinear()) {
+                unsorted.push_back({monomial.getSymbolIdIfLinear(), monomial.coefficient});
+            } else {
+                throw std::runtime_error("Coefficient is not linear: " + monomial.toString());
+            }
+        }
+        terms = fromTerms(getEnvironment(), std::move(unsorted)).terms;
+    }
+
+    LinearForm LinearForm::fromTerms(SymbolicEnvironment *environment, std::vector<Term> terms) {
+        std::sort(terms.begin(), terms.end(), [](const Term &l, const Term &r) {
+            return l.symbolId < r.symbolId;
+        });
+
+        std::vector<Term> merged;
+        merged.reserve(terms.size());
+        for (auto &term: terms) {
+            if (!merged.empty() && merged.back().symbolId == term.symbolId) {
+                merged.back().coefficient += term.coefficient;
+            } else {
+                merged.push_back(term);
+            }
+        }
+        merged.erase(std::remove_if(merged.begin(), merged.end(), [](const Term &term) {
+            return term.coefficient.isZero();
+        }), merged.end());
+        return {environment, std::move(merged)};
+    }
+
+    QPolynomial LinearForm::toQPolynomial() const {
+        auto env = getEnvironment();
+        auto result = env->qPolynomialZero();
+        if (terms.empty()) {
+            return result;
+        }
+
+        result.monomials.clear();
+        result.monomials.reserve(terms.size());
+        for (auto &term: terms) {
+            auto exponents = term.symbolId == CONSTANT_ID ? PackedExponents() : PackedExponents::single(term.symbolId, 1);
+            result.monomials.push_back(QMonomial(exponents, term.coefficient, env));
+        }
+        return result;
+    }
+
+    LinearForm add(const LinearForm &l, const LinearForm &r) {
+        if (l.viewEnvironment() != r.viewEnvironment()) {
+            throw std::runtime_error("Different environments");
+        }
+        auto env = l.getEnvironment();
+
+        std::vector<LinearForm::Term> merged;
+        merged.reserve(l.terms.size() + r.terms.size());
+        auto lit = l.terms.begin();
+        auto rit = r.terms.begin();
+        while (lit != l.terms.end() && rit != r.terms.end()) {
+            if (lit->symbolId < rit->symbolId) {
+                merged.push_back(*lit++);
+            } else if (rit->symbolId < lit->symbolId) {
+                merged.push_back(*rit++);
+            } else {
+                auto sum = lit->coefficient + rit->coefficient;
+                if (!sum.isZero()) {
+                    merged.push_back({lit->symbolId, sum});
+                }
+                ++lit;
+                ++rit;
+            }
+        }
+        merged.insert(merged.end(), lit, l.terms.end());
+        merged.insert(merged.end(), rit, r.terms.end());
+        return {env, std::move(merged)};
+    }
+
+    LinearForm &LinearForm::operator+=(const LinearForm &other) {
+        return *this = symbolic_ring::add(*this, other);
+    }
+
+    LinearForm &LinearForm::scale(const Rational &factor) {
+        if (factor.isZero()) {
+            terms.clear();
+            return *this;
+        }
+        for (auto &term: terms) {
+            term.coefficient *= factor;
+        }
+        return *this;
+    }
+
+    LinearForm scale(const LinearForm &l, const Rational &factor) {
+        auto result = l;
+        result.scale(factor);
+        return result;
+    }
+
+    LinearForm mul(const LinearForm &l, const LinearForm &r) {
+        if (l.viewEnvironment() != r.viewEnvironment()) {
+            throw std::runtime_error("Different environments");
+        }
+        if (l.isZero() || r.isZero()) {
+            return LinearForm(l.getEnvironment());
+        }
+        if (r.isConstant()) {
+            return scale(l, r.terms[0].coefficient);
+        }
+        if (l.isConstant()) {
+            return scale(r, l.terms[0].coefficient);
+        }
+        std::stringstream message;
+        message << "Coefficient is not linear: (" << l << ") * (" << r << ")";
+        throw std::runtime_error(message.str());
+    }
+
+    LinearForm substitute(const LinearForm &form, const Symbol &to_substitute, const LinearForm &substitution) {
+        auto it = std::find_if(form.terms.begin(), form.terms.end(), [&](const LinearForm::Term &term) {
+            return term.symbolId == to_substitute.getId();
+        });
+        if (it == form.terms.end()) {
+            return form;
+        }
+
+        auto rest = form;
+        rest.terms.erase(rest.terms.begin() + (it - form.terms.begin()));
+        rest += scale(substitution, it->coefficient);
+        return rest;
+    }
+
+    std::ostream &operator<<(std::ostream &os, const LinearForm &form) {
+        if (form.terms.empty()) {
+            os << "(0/1)";
+            return os;
+        }
+        for (int i = 0; i < form.terms.size(); i++) {
+            const auto &term = form.terms[i];
+            os << "(" << term.coefficient << ")";
+            if (term.symbolId != LinearForm::CONSTANT_ID) {
+                os << "*" << form.viewEnvironment()->getSymbolName(term.symbolId) << "**(1)";
+            }
+            if (i != form.terms.size() - 1) {
+                os << " + ";
+            }
+        }
+        return os;
+    }
+
+    bool LinearForm::operator==(const LinearForm &rhs) const {
+        if (terms.size() != rhs.terms.size()) {
+            return false;
+        }
+        for (int i = 0; i < terms.size(); i++) {
+            if (terms[i].symbolId != rhs.terms[i].symbolId || terms[i].coefficient != rhs.terms[i].coefficient) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool LinearForm::operator<(const LinearForm &rhs) const {
+        return std::lexicographical_compare(terms.begin(), terms.end(), rhs.terms.begin(), rhs.terms.end(),
+                                            [](const Term &l, const Term &r) {
+                                                if (l.symbolId != r.symbolId) {
+                                                    return l.symbolId < r.symbolId;
+                                                }
+                                                return l.coefficient < r.coefficient;
+                                            });
+    }
+
+
     SymbolicMonomial::SymbolicMonomial(const QPolynomial &qpolynomial) : SymbolicMonomial(
             qpolynomial.viewEnvironment()->qmonomialOne(), qpolynomial) {}
 
     SymbolicMonomial::SymbolicMonomial(const QMonomial &qmonomial) : SymbolicMonomial(qmonomial,
-                                                                                      qmonomial.viewEnvironment()->qPolynomialOne()) {}
+                                                                                      LinearForm(qmonomial.viewEnvironment(), 1)) {}
 
     std::ostream &operator<<(std::ostream &os, const SymbolicMonomial &monomial) {
-        os << monomial.qmonomial << "*[" << monomial.qcoefficient << "]";
+        os << monomial.qmonomial << "*[" << monomial.coefficient << "]";
         return os;
     }
 
@@ -484,7 +629,7 @@ namespace symbolic_ring {
             throw std::runtime_error("Different environments");
         return static_cast<const HasSymbolicEnvironment &>(*this) == static_cast<const HasSymbolicEnvironment &>(rhs) &&
                qmonomial == rhs.qmonomial &&
-               qcoefficient == rhs.qcoefficient;
+               coefficient == rhs.coefficient;
     }
 
     bool SymbolicMonomial::operator!=(const SymbolicMonomial &rhs) const {
@@ -499,7 +644,7 @@ namespace symbolic_ring {
             return true;
         if (rhs.qmonomial < qmonomial)
             return false;
-        return qcoefficient < rhs.qcoefficient;
+        return coefficient < rhs.coefficient;
     }
 
     bool SymbolicMonomial::operator>(const SymbolicMonomial &rhs) const {
@@ -514,54 +659,88 @@ namespace symbolic_ring {
         return !(*this < rhs);
     }
 
-    SymbolicMonomial mul(const SymbolicMonomial &l, const SymbolicMonomial &r) {
-        if (l.viewEnvironment() != r.viewEnvironment()) {
-            throw std::runtime_error("Different environments");
+    void SymbolicMonomial::unitize() {
+        if (qmonomial.coefficient.isZero()) {
+            throw std::runtime_error("Division by zero");
         }
-        SymbolicMonomial result = l;
-        result.qmonomial = mul(l.qmonomial, r.qmonomial);
-        result.qcoefficient = mul(l.qcoefficient, r.qcoefficient);
-        return result;
+        if (qmonomial.coefficient.isOne()) {
+            return;
+        }
+        coefficient.scale(qmonomial.coefficient);
+        qmonomial.coefficient = 1;
     }
 
-    SymbolicMonomial add(const SymbolicMonomial &l, const SymbolicMonomial &r) {
-        if (l.viewEnvironment() != r.viewEnvironment()) {
+    SymbolicMonomial &SymbolicMonomial::operator+=(const SymbolicMonomial &other) {
+        if (viewEnvironment() != other.viewEnvironment()) {
             throw std::runtime_error("Different environments");
         }
 
-        if (!isSimilar(l.qmonomial, r.qmonomial)) {
+        if (!isSimilar(qmonomial, other.qmonomial)) {
             throw std::runtime_error("Different monomials");
         }
 
-        if (l.qmonomial.getEnumerator() == 0) {
-            return r;
+        if (qmonomial.coefficient.isZero()) {
+            return *this = other;
         }
 
-        if (r.qmonomial.getEnumerator() == 0) {
-            return l;
+        if (other.qmonomial.coefficient.isZero()) {
+            return *this;
+        }
+
+        unitize();
+        coefficient += symbolic_ring::scale(other.coefficient, other.qmonomial.coefficient);
+        return *this;
+    }
+
+    SymbolicMonomial &SymbolicMonomial::operator*=(const SymbolicMonomial &other) {
+        if (viewEnvironment() != other.viewEnvironment()) {
+            throw std::runtime_error("Different environments");
         }
+        qmonomial = mul(qmonomial, other.qmonomial);
+        coefficient = mul(coefficient, other.coefficient);
+        return *this;
+    }
 
-        SymbolicMonomial lhs = l;
-        SymbolicMonomial rhs = r;
+    SymbolicMonomial &SymbolicMonomial::operator*=(const Rational &factor) {
+        return scale(factor);
+    }
 
-        lhs.unitize();
-        rhs.unitize();
+    SymbolicMonomial &SymbolicMonomial::scale(const Rational &factor) {
+        coefficient.scale(factor);
+        return *this;
+    }
 
-        lhs.qcoefficient = add(lhs.qcoefficient, rhs.qcoefficient);
-        return lhs;
+    SymbolicMonomial &SymbolicMonomial::negate() {
+        return scale(-1);
+    }
+
+    SymbolicMonomial mul(const SymbolicMonomial &l, const SymbolicMonomial &r) {
+        SymbolicMonomial result = l;
+        result *= r;
+        return result;
+    }
+
+    SymbolicMonomial add(const SymbolicMonomial &l, const SymbolicMonomial &r) {
+        SymbolicMonomial result = l;
+        result += r;
+        return result;
     }
 
     const QMonomial &SymbolicMonomial::getQmonomial() const {
         return qmonomial;
     }
 
-    const QPolynomial &SymbolicMonomial::getQcoefficient() const {
-        return qcoefficient;
+    const LinearForm &SymbolicMonomial::getCoefficient() const {
+        return coefficient;
+    }
+
+    QPolynomial SymbolicMonomial::getQcoefficient() const {
+        return coefficient.toQPolynomial();
     }
 
     SymbolicMonomial mul(const SymbolicMonomial &l, long long int r) {
         SymbolicMonomial result = l;
-        result.qcoefficient = mul(l.qcoefficient, r);
+        result.scale(r);
         return result;
     }
 
@@ -571,30 +750,172 @@ namespace symbolic_ring {
 
     SymbolicMonomial div(const SymbolicMonomial &l, long long int r) {
         SymbolicMonomial result = l;
-        result.qcoefficient = div(l.qcoefficient, r);
+        if (r == 0) {
+            throw std::runtime_error("Division by zero");
+        }
+        result.scale(Rational(1, r));
         return result;
     }
 
 
     void SymbolicPolynomial::reduce() {
-        auto monomials_copy = monomials;
-        std::sort(monomials_copy.begin(), monomials_copy.end());
-        monomials.clear();
+        if (monomials.empty()) {
+            return;
+        }
+
+        SymbolicPolynomialAccumulator accumulator(getEnvironment());
+        accumulator.add(std::move(*this));
+        monomials = std::move(accumulator).build().monomials;
+    }
+
+    SymbolicPolynomial &SymbolicPolynomial::append(const SymbolicPolynomial &other) {
+        if (viewEnvironment() != other.viewEnvironment()) {
+            throw std::runtime_error("Different environments");
+        }
+        monomials.insert(monomials.end(), other.monomials.begin(), other.monomials.end());
+        return *this;
+    }
+
+    SymbolicPolynomial &SymbolicPolynomial::append(SymbolicPolynomial &&other) {
+        if (viewEnvironment() != other.viewEnvironment()) {
+            throw std::runtime_error("Different environments");
+        }
+        monomials.insert(monomials.end(), std::make_move_iterator(other.monomials.begin()),
+                         std::make_move_iterator(other.monomials.end()));
+        return *this;
+    }
+
+    SymbolicPolynomial &SymbolicPolynomial::operator+=(const SymbolicPolynomial &other) {
+        append(other);
+        reduce();
+        return *this;
+    }
+
+    SymbolicPolynomial &SymbolicPolynomial::operator-=(const SymbolicPolynomial &other) {
+        auto size = monomials.size();
+        append(other);
+        for (auto i = size; i < monomials.size(); ++i) {
+            monomials[i].negate();
+        }
+        reduce();
+        return *this;
+    }
+
+    SymbolicPolynomial &SymbolicPolynomial::operator*=(const SymbolicPolynomial &other) {
+        return *this = mul(*this, other);
+    }
+
+    SymbolicPolynomial &SymbolicPolynomial::operator*=(const Rational &factor) {
+        return scale(factor);
+    }
+
+    SymbolicPolynomial &SymbolicPolynomial::scale(const Rational &factor) {
+        for (auto &monomial: monomials) {
+            monomial.scale(factor);
+        }
+        return *this;
+    }
+
+    SymbolicPolynomial &SymbolicPolynomial::negate() {
+        return scale(-1);
+    }
+
+    void SymbolicPolynomialAccumulator::add(const SymbolicMonomial &monomial) {
+        add(SymbolicMonomial(monomial));
+    }
 
-        if (monomials_copy.empty()) {
+    void SymbolicPolynomialAccumulator::add(SymbolicMonomial &&monomial) {
+        if (monomial.viewEnvironment() != environment) {
+            throw std::runtime_error("Different environments");
+        }
+
+        const auto &qmonomial = monomial.getQmonomial();
+        // zero base is similar to everything, it survives only if there is nothing else
+        if (qmonomial.getCoefficient().isZero()) {
+            if (zeroTerms.empty()) {
+                zeroTerms.push_back(std::move(monomial));
+            }
             return;
         }
 
+        auto unitizedCoefficient = [](const SymbolicMonomial &monomial, std::vector<LinearForm::Term> &out) {
+            auto scaled = scale(monomial.getCoefficient(), monomial.getQmonomial().getCoefficient());
+            out.insert(out.end(), scaled.getTerms().begin(), scaled.getTerms().end());
+        };
+
+        auto it = termIndex.find(qmonomial.getExponents());
+        if (it == termIndex.end()) {
+            termIndex.emplace(qmonomial.getExponents(), terms.size());
+            terms.push_back({std::move(monomial), {}, false});
+            return;
+        }
+
+        auto &term = terms[it->second];
+        if (!term.merged) {
+            unitizedCoefficient(term.first, term.unitizedCoefficient);
+            term.merged = true;
+        }
+        unitizedCoefficient(monomial, term.unitizedCoefficient);
+    }
+
+    void SymbolicPolynomialAccumulator::add(const SymbolicPolynomial &polynomial) {
+        for (auto &monomial: polynomial.monomials) {
+            add(monomial);
+        }
+    }
 
-        monomials.push_back(monomials_copy[0]);
-        for (int i = 1; i < monomials_copy.size(); ++i) {
-            if (isSimilar(monomials.back().getQmonomial(), monomials_copy[i].getQmonomial())) {
-                auto result = add(monomials.back(), monomials_copy[i]);
-                monomials.back() = result;
+    void SymbolicPolynomialAccumulator::add(SymbolicPolynomial &&polynomial) {
+        for (auto &monomial: polynomial.monomials) {
+            add(std::move(monomial));
+        }
+    }
+
+    SymbolicMonomial SymbolicPolynomialAccumulator::finishTerm(SymbolicEnvironment *environment, const Term &term) {
+        const auto &qmonomial = term.first.getQmonomial();
+        auto unitBase = div(qmonomial, qmonomial.getCoefficient());
+        return {unitBase, LinearForm::fromTerms(environment, term.unitizedCoefficient)};
+    }
+
+    SymbolicPolynomial SymbolicPolynomialAccumulator::build() const &{
+        auto result = environment->symbolicPolynomialZero();
+        if (terms.empty()) {
+            if (!zeroTerms.empty()) {
+                result.monomials = zeroTerms;
+            }
+            return result;
+        }
+
+        result.monomials.clear();
+        result.monomials.reserve(terms.size());
+        for (auto &term: terms) {
+            result.monomials.push_back(term.merged ? finishTerm(environment, term) : term.first);
+        }
+        std::sort(result.monomials.begin(), result.monomials.end());
+        return result;
+    }
+
+    SymbolicPolynomial SymbolicPolynomialAccumulator::build() &&{
+        auto result = environment->symbolicPolynomialZero();
+        termIndex.clear();
+        if (terms.empty()) {
+            if (!zeroTerms.empty()) {
+                result.monomials = std::move(zeroTerms);
+            }
+            return result;
+        }
+
+        result.monomials.clear();
+        result.monomials.reserve(terms.size());
+        for (auto &term: terms) {
+            if (term.merged) {
+                result.monomials.push_back(finishTerm(environment, term));
             } else {
-                monomials.push_back(monomials_copy[i]);
+                result.monomials.push_back(std::move(term.first));
             }
         }
+        terms.clear();
+        std::sort(result.monomials.begin(), result.monomials.end());
+        return result;
     }
 
     std::ostream &operator<<(std::ostream &os, const SymbolicPolynomial &polynomial) {
@@ -608,16 +929,16 @@ namespace symbolic_ring {
     }
 
     SymbolicPolynomial add(const SymbolicPolynomial &l, const SymbolicPolynomial &r, bool needReduce) {
-        if (l.viewEnvironment() != r.viewEnvironment()) {
-            throw std::runtime_error("Different environments");
-        }
-
         SymbolicPolynomial result = l;
-        result.monomials.insert(result.monomials.end(), r.monomials.begin(), r.monomials.end());
+        return add(std::move(result), r, needReduce);
+    }
+
+    SymbolicPolynomial add(SymbolicPolynomial &&l, const SymbolicPolynomial &r, bool needReduce) {
+        l.append(r);
         if (needReduce) {
-            result.reduce();
+            l.reduce();
         }
-        return result;
+        return std::move(l);
     }
 
     SymbolicPolynomial mul(const SymbolicPolynomial &l, const SymbolicPolynomial &r) {
@@ -625,24 +946,27 @@ namespace symbolic_ring {
             throw std::runtime_error("Different environments");
         }
 
-        SymbolicPolynomial result = l.viewEnvironment()->symbolicPolynomialZero();
+        SymbolicPolynomialAccumulator accumulator(l.getEnvironment());
+        accumulator.add(l.viewEnvironment()->symbolicPolynomialZero());
         for (auto &monomial: l.monomials) {
             for (auto &monomial1: r.monomials) {
-                result.monomials.push_back(mul(monomial, monomial1));
+                accumulator.add(mul(monomial, monomial1));
             }
         }
-        result.reduce();
-        return result;
+        return std::move(accumulator).build();
     }
 
     SymbolicPolynomial mul(const SymbolicPolynomial &l, const long long int r) {
         SymbolicPolynomial result = l;
-        for (auto &monomial: result.monomials) {
-            monomial = mul(monomial, r);
-        }
+        result.scale(r);
         return result;
     }
 
+    SymbolicPolynomial mul(SymbolicPolynomial &&l, const long long int r) {
+        l.scale(r);
+        return std::move(l);
+    }
+
     SymbolicPolynomial mul(const long long int l, const SymbolicPolynomial &r) {
         return mul(r, l);
     }
@@ -653,32 +977,20 @@ namespace symbolic_ring {
         }
 
         SymbolicPolynomial result = l;
-        for (auto &monomial: result.monomials) {
-            monomial = div(monomial, r);
-        }
+        result.scale(Rational(1, r));
         return result;
     }
 
     QPolynomial substitute(const QMonomial &monomial, const Symbol &to_substitute, const QPolynomial &polynomial) {
         auto env = polynomial.getEnvironment();
-        auto &varsAndPowers = monomial.getVariablesAndPowers();
+        auto power = monomial.exponents.powerOf(to_substitute.getId());
 
-        auto result = env->qPolynomialOne();
-        result = mul(result, monomial.getEnumerator());
-        result = div(result, monomial.getDenominator());
+        // the part of the monomial which is not affected by the substitution
+        auto result = QPolynomial(QMonomial(monomial.exponents.withoutSymbol(to_substitute.getId()),
+                                            monomial.getCoefficient(), env));
 
-        for (auto &varAndPower: varsAndPowers) {
-            auto &var = varAndPower.first;
-            auto &power = varAndPower.second;
-
-            if (var == to_substitute.getName()) {
-                for (int i = 0; i < power; ++i) {
-                    result = mul(result, polynomial);
-                }
-            } else {
-                auto varMonomial = QMonomial(env->getOrCreate(var), power);
-                result = mul(result, varMonomial);
-            }
+        for (int i = 0; i < power; ++i) {
+            result = mul(result, polynomial);
         }
         result.reduce();
         return result;
@@ -692,31 +1004,21 @@ namespace symbolic_ring {
 
         auto base_substituted = substitute(base, to_substitute, polynomial);
 
-        std::vector<SymbolicMonomial> init_vector;
-
-        auto result = env->symbolicPolynomialZero();
+        SymbolicPolynomialAccumulator result(env);
+        result.add(env->symbolicPolynomialZero());
 
         for (const auto &monomial_it: base_substituted.getMonomials()) {
-            result = add(result, SymbolicPolynomial(SymbolicMonomial(monomial_it, coeff)), true);
+            result.add(SymbolicMonomial(monomial_it, coeff));
         }
 
-        return result;
+        return std::move(result).build();
     }
 
     SymbolicMonomial
     substituteInCoefficient(const SymbolicMonomial &monomial, const Symbol &to_substitute, const QPolynomial &polynomial) {
-        auto env = polynomial.getEnvironment();
-        auto base = monomial.getQmonomial();
-        auto coeff = monomial.getQcoefficient();
-
-        auto coeff_monomials = coeff.getMonomials();
-        auto coeff_substituted = env->qPolynomialZero();
+        const auto &coeff = monomial.getCoefficient();
 
-        for (auto &monomial_it: coeff_monomials) {
-            coeff_substituted = add(coeff_substituted, substitute(monomial_it, to_substitute, polynomial));
-        }
-
-        return {base, coeff_substituted};
+        return {monomial.getQmonomial(), substitute(coeff, to_substitute, LinearForm(polynomial))};
     }
 
 
@@ -726,25 +1028,138 @@ namespace symbolic_ring {
         auto env = substitution.viewEnvironment();
         auto monomials = polynomial.getReducedMonomials();
 
-        SymbolicPolynomial result = env->symbolicPolynomialZero();
+        SymbolicPolynomialAccumulator result(env);
+        result.add(env->symbolicPolynomialZero());
 
         for (auto &monomial: monomials) {
-            auto substituted = substituteInBase(monomial, to_substitute, substitution);
-            result = add(result, substituted, true);
+            result.add(substituteInBase(monomial, to_substitute, substitution));
         }
-        return result;
+        return std::move(result).build();
+    }
+
+    // substitution^k for k <= maxPower. The powers of an affine substitution with several terms are expanded directly:
+    // (t_0 + ... + t_m)^k is the sum of k! / (a_0! ... a_m!) * t_0^a_0 * ... * t_m^a_m over a_0 + ... + a_m = k, the
+    // terms have different monomials of degree <= 1, so the products are different monomials as well
+    static std::vector<QPolynomial> getSubstitutionPowers(const QPolynomial &substitution, int maxPower) {
+        auto env = substitution.getEnvironment();
+        std::vector<QPolynomial> powers = {env->qPolynomialOne()};
+        if (maxPower == 0) {
+            return powers;
+        }
+
+        auto reduced = substitution;
+        reduced.reduce();
+        const auto &terms = reduced.getMonomials();
+        bool affine = terms.size() > 1 && std::all_of(terms.begin(), terms.end(), [](const QMonomial &term) {
+            return term.getDegree() <= 1;
+        });
+        if (!affine) {
+            for (int k = 1; k <= maxPower; ++k) {
+                powers.push_back(mul(powers.back(), reduced));
+            }
+            return powers;
+        }
+
+        // binomials[n][r] = n choose r
+        std::vector<std::vector<Rational>> binomials(maxPower + 1);
+        for (int n = 0; n <= maxPower; ++n) {
+            binomials[n].resize(n + 1, 1);
+            for (int r = 1; r < n; ++r) {
+                binomials[n][r] = binomials[n - 1][r - 1] + binomials[n - 1][r];
+            }
+        }
+        // termPowers[j][a] = t_j^a
+        std::vector<std::vector<QMonomial>> termPowers(terms.size(), {env->qmonomialOne()});
+        for (int j = 0; j < terms.size(); ++j) {
+            for (int a = 1; a <= maxPower; ++a) {
+                termPowers[j].push_back(mul(termPowers[j].back(), terms[j]));
+            }
+        }
+
+        int last = static_cast<int>(terms.size()) - 1;
+        for (int k = 1; k <= maxPower; ++k) {
+            QPolynomialAccumulator accumulator(env);
+            // a_0, ..., a_{j - 1} are chosen, current is the product of their powers times the multinomial so far
+            std::function<void(int, int, const QMonomial &)> expand = [&](int j, int remaining, const QMonomial &current) {
+                if (j == last) {
+                    accumulator.add(mul(current, termPowers[j][remaining]));
+                    return;
+                }
+                for (int a = 0; a <= remaining; ++a) {
+                    expand(j + 1, remaining - a, mul(mul(current, termPowers[j][a]), binomials[remaining][a]));
+                }
+            };
+            expand(0, k, env->qmonomialOne());
+            powers.push_back(std::move(accumulator).build());
+        }
+        return powers;
+    }
+
+    SymbolicPolynomial composeInBase(const SymbolicPolynomial &polynomial, const std::vector<Symbol> &symbols,
+                                     const std::vector<QPolynomial> &substitutions) {
+        if (symbols.size() != substitutions.size()) {
+            throw std::runtime_error("The number of substitutions does not match the number of symbols");
+        }
+        auto env = polynomial.getEnvironment();
+
+        bool independent = true;
+        for (const auto &substitution: substitutions) {
+            for (const auto &term: substitution.getMonomials()) {
+                for (const auto &symbol: symbols) {
+                    independent = independent && term.getExponents().powerOf(symbol.getId()) == 0;
+                }
+            }
+        }
+        if (!independent) {
+            auto result = polynomial;
+            for (int i = 0; i < symbols.size(); ++i) {
+                result = substituteInBase(std::move(result), symbols[i], substitutions[i]);
+            }
+            return result;
+        }
+
+        auto monomials = polynomial.getReducedMonomials();
+        std::vector<std::vector<QPolynomial>> powers;
+        for (int i = 0; i < symbols.size(); ++i) {
+            int maxPower = 0;
+            for (const auto &monomial: monomials) {
+                maxPower = std::max(maxPower, monomial.getQmonomial().getExponents().powerOf(symbols[i].getId()));
+            }
+            powers.push_back(getSubstitutionPowers(substitutions[i], maxPower));
+        }
+
+        SymbolicPolynomialAccumulator result(env);
+        result.add(env->symbolicPolynomialZero());
+        for (const auto &monomial: monomials) {
+            const auto &base = monomial.getQmonomial();
+            auto rest = base.exponents;
+            for (const auto &symbol: symbols) {
+                rest = rest.withoutSymbol(symbol.getId());
+            }
+            auto substituted = QPolynomial(QMonomial(std::move(rest), base.getCoefficient(), env));
+            for (int i = 0; i < symbols.size(); ++i) {
+                int power = base.exponents.powerOf(symbols[i].getId());
+                if (power != 0) {
+                    substituted = mul(substituted, powers[i][power]);
+                }
+            }
+            for (const auto &term: substituted.getMonomials()) {
+                result.add(SymbolicMonomial(term, monomial.getCoefficient()));
+            }
+        }
+        return std::move(result).build();
     }
 
     SymbolicPolynomial symbolicPolynomialfromQPolynomialAsBase(const QPolynomial &qpolynomial) {
         auto env = qpolynomial.getEnvironment();
-        auto monomials = qpolynomial.getMonomials();
 
-        SymbolicPolynomial result = env->symbolicPolynomialZero();
+        SymbolicPolynomialAccumulator result(env);
+        result.add(env->symbolicPolynomialZero());
 
-        for (auto &monomial: monomials) {
-            result = add(result, SymbolicPolynomial(SymbolicMonomial(monomial)), true);
+        for (auto &monomial: qpolynomial.getMonomials()) {
+            result.add(SymbolicMonomial(monomial));
         }
-        return result;
+        return std::move(result).build();
     }
 
     SymbolicPolynomial substituteInCoefficients(SymbolicPolynomial polynomial, const Symbol &to_substitute,
@@ -753,13 +1168,13 @@ namespace symbolic_ring {
         auto env = substitution.viewEnvironment();
         auto monomials = polynomial.getReducedMonomials();
 
-        SymbolicPolynomial result = env->symbolicPolynomialZero();
+        SymbolicPolynomialAccumulator result(env);
+        result.add(env->symbolicPolynomialZero());
 
         for (auto &monomial: monomials) {
-            auto substituted = substituteInCoefficient(monomial, to_substitute, substitution);
-            result = add(result, SymbolicPolynomial(substituted), true);
+            result.add(substituteInCoefficient(monomial, to_substitute, substitution));
         }
-        return result;
+        return std::move(result).build();
     }
 
 
@@ -5,6 +5,7 @@
 #include "symbolicRing.h"
 #include "sdpEncoder.h"
 #include "programExpression.h"
+#include "compiledExpression.h"
 #include "tokenizer.h"
 #include "program.h"
 #include "programParser.h"
@@ -14,10 +15,15 @@
 #include "automaitcComplexityEstimator.h"
 #include "hacks.h"
 #include "sdpProblem.h"
+#include "sdpPresolve.h"
+#include "sdpBackend.h"
+#include "csdpLibrary.h"
 #include "templateEngine.h"
 
 //
 #include <gtest/gtest.h>
+#include <thread>
+#include <fusion.h>
 
 using namespace symbolic_ring;
 
@@ -83,6 +89,42 @@ TEST(SymbolicTest, MultiplyMonomials) {
 
 }
 
+TEST(SymbolicTest, PackedExponents) {
+    auto env = SymbolicEnvironment();
+    auto x = env.sym("x");
+    auto y = env.sym("y");
+    auto z = env.sym("z");
+
+    auto xy = mul(QMonomial(x), QMonomial(y));
+    auto yx = mul(QMonomial(y), QMonomial(x));
+    auto xyz2 = mul(xy, QMonomial(z, 2));
+
+    EXPECT_TRUE(xy.getExponents() == yx.getExponents());
+    EXPECT_EQ(xy.getExponents().getHash(), yx.getExponents().getHash());
+    EXPECT_EQ(xyz2.getDegree(), 4u);
+    EXPECT_EQ(xyz2.getExponents().powerOf(z.getId()), 2);
+    EXPECT_EQ(xyz2.getExponents().powerOf(env.sym("w").getId()), 0);
+    EXPECT_EQ(xyz2.getExponents().withoutSymbol(z.getId()), xy.getExponents());
+
+    EXPECT_TRUE(QMonomial(x).isLinear());
+    EXPECT_EQ(QMonomial(y).getNameIfLinear(), "y");
+    EXPECT_FALSE(xy.isLinear());
+
+    // more than PackedExponents::INLINE_CAPACITY variables are stored on the heap
+    auto big = QMonomial(x);
+    auto bigReversed = QMonomial(env.getOrCreate("v7"));
+    for (int i = 0; i < 8; ++i) {
+        big = mul(big, QMonomial(env.getOrCreate("v" + std::to_string(i))));
+    }
+    for (int i = 6; i >= 0; --i) {
+        bigReversed = mul(bigReversed, QMonomial(env.getOrCreate("v" + std::to_string(i))));
+    }
+    bigReversed = mul(bigReversed, QMonomial(x));
+    EXPECT_EQ(big.getExponents().size(), 9);
+    EXPECT_EQ(big, bigReversed);
+    EXPECT_FALSE(big < bigReversed || bigReversed < big);
+}
+
 
 TEST(SymbolicTest, CreateQPolynomial) {
     auto env = SymbolicEnvironment();
@@ -191,6 +233,39 @@ TEST(SymbolicTest, UnitizeSymbolicMonomial) {
 }
 
 
+TEST(SymbolicTest, PolynomialAccumulator) {
+    auto env = SymbolicEnvironment();
+    auto x = env.sym("x");
+    auto y = env.sym("y");
+    auto a = env.sym("a");
+    auto b = env.sym("b");
+
+    QPolynomialAccumulator q(&env);
+    EXPECT_EQ(toString(q.build()), toString(env.qPolynomialZero()));
+
+    q.add(QMonomial(y, 1, 2));
+    q.add(QMonomial(x));
+    q.add(mul(QPolynomial(y), 3));
+    q.add(QMonomial(x, 1, -1));
+
+    auto expected = add(add(QPolynomial(QMonomial(y, 1, 2)), QPolynomial(x)),
+                        add(mul(QPolynomial(y), 3), QPolynomial(QMonomial(x, 1, -1))));
+    EXPECT_EQ(toString(q.build()), toString(expected));
+    EXPECT_EQ(q.build().getMonomials().size(), 2);
+
+    SymbolicPolynomialAccumulator s(&env);
+    s.add(env.symbolicPolynomialZero());
+    s.add(SymbolicMonomial(mul(2, QMonomial(x)), QPolynomial(a)));
+    s.add(SymbolicMonomial(QMonomial(y), QPolynomial(b)));
+    s.add(SymbolicMonomial(QMonomial(x), QPolynomial(b)));
+
+    auto built = s.build();
+    ASSERT_EQ(built.getReducedMonomials().size(), 2);
+    auto reference = SymbolicMonomial(QMonomial(x), add(mul(QPolynomial(a), 2), QPolynomial(b)));
+    EXPECT_EQ(built.getReducedMonomials()[0], reference);
+}
+
+
 TEST(SymbolicTest, SymbolicPolynomialAddition) {
     auto env = SymbolicEnvironment();
     auto x = env.sym("x");
@@ -226,9 +301,161 @@ TEST(SymbolicTest, SymbolicPolynomialMultiplication) {
 
     auto p = SymbolicPolynomial(SymbolicMonomial(px, pa));
     auto q = SymbolicPolynomial(SymbolicMonomial(py, pb));
+    auto r = SymbolicPolynomial(SymbolicMonomial(py, mul(QPolynomial(env.qmonomialOne()), 2)));
+
+    // coefficients are linear forms in the unknowns, a product of two unknowns is rejected
+    ASSERT_THROW(mul(p, q), std::runtime_error);
+    ASSERT_EQ(toString(SymbolicPolynomial(SymbolicMonomial(mul(px, py), mul(pa, 2)))), toString(mul(p, r)));
 
-    ASSERT_EQ(std::string("(3/1)*x^(1)*y^(1)*[(2/1)*a^(1)*b^(1)]"), toString(mul(p, q)));
+}
+
+TEST(SymbolicTest, InPlaceArithmetic) {
+    auto env = SymbolicEnvironment();
+    auto x = env.sym("x");
+    auto y = env.sym("y");
+    auto a = env.sym("a");
+    auto b = env.sym("b");
+
+    auto p = add(QPolynomial(x), mul(QPolynomial(y), 2));
+    auto q = QPolynomial(QMonomial(x, 1, -1, 3));
+
+    auto sum = p;
+    sum += q;
+    EXPECT_EQ(toString(sum), toString(add(p, q)));
+    sum -= q;
+    EXPECT_EQ(toString(sum), toString(p));
+    sum -= p;
+    EXPECT_EQ(toString(sum), toString(add(p, mul(p, -1))));
+
+    auto product = p;
+    product *= q;
+    EXPECT_EQ(toString(product), toString(mul(p, q)));
+    product = p;
+    product.scale(Rational(2, 3)).negate();
+    EXPECT_EQ(toString(product), toString(div(mul(p, -2), 3)));
+    product *= 0;
+    EXPECT_EQ(toString(product), toString(env.qPolynomialZero()));
+
+    // the moved-from temporary is reused
+    auto moved = add(QPolynomial(x), q);
+    EXPECT_EQ(toString(moved), toString(add(QPolynomial(x), QPolynomial(QMonomial(x, 1, -1, 3)))));
+
+    auto sp = SymbolicPolynomial(SymbolicMonomial(mul(3, QMonomial(x)), QPolynomial(a)));
+    auto sq = SymbolicPolynomial(SymbolicMonomial(QMonomial(x), QPolynomial(b)));
+    auto ssum = sp;
+    ssum += sq;
+    EXPECT_EQ(toString(ssum), toString(add(sp, sq, true)));
+    ssum -= sq;
+    EXPECT_EQ(toString(ssum), toString(add(add(sp, sq, true), mul(sq, -1), true)));
+    auto sappended = sp;
+    sappended.append(sq).append(SymbolicPolynomial(sq).negate());
+    sappended.reduce();
+    EXPECT_EQ(toString(sappended), toString(ssum));
+
+    auto monomial = SymbolicMonomial(mul(3, QMonomial(x)), QPolynomial(a));
+    monomial += SymbolicMonomial(QMonomial(x), QPolynomial(b));
+    EXPECT_EQ(monomial, add(SymbolicMonomial(mul(3, QMonomial(x)), QPolynomial(a)),
+                            SymbolicMonomial(QMonomial(x), QPolynomial(b))));
+    monomial *= SymbolicMonomial(QMonomial(y));
+    monomial.negate();
+    EXPECT_EQ(toString(monomial), "(1/1)*x**(1)*y**(1)*[(-3/1)*a**(1) + (-1/1)*b**(1)]");
+}
+
+TEST(SymbolicTest, LinearForm) {
+    auto env = SymbolicEnvironment();
+    auto a = env.sym("a");
+    auto b = env.sym("b");
+    auto c = env.sym("c");
+
+    auto fa = LinearForm(a);
+    auto fb = scale(LinearForm(b), Rational(2, 3));
+    auto sum = add(add(fb, LinearForm(&env, 5)), fa);
+
+    ASSERT_EQ(sum.getTerms().size(), 3);
+    EXPECT_EQ(sum.getTerms()[0].symbolId, LinearForm::CONSTANT_ID);
+    EXPECT_EQ(sum.getTerms()[1].symbolId, a.getId());
+    EXPECT_EQ(sum.getTerms()[2].symbolId, b.getId());
+    EXPECT_EQ(toString(sum), toString(sum.toQPolynomial()));
+    EXPECT_EQ(LinearForm(sum.toQPolynomial()), sum);
+
+    EXPECT_TRUE(add(sum, scale(sum, -1)).isZero());
+    EXPECT_TRUE(LinearForm(&env, Rational(7, 2)).isConstant());
+    EXPECT_EQ(mul(LinearForm(&env, 3), fa), scale(fa, 3));
+    EXPECT_THROW(mul(fa, fb), std::runtime_error);
+    EXPECT_THROW(LinearForm(QPolynomial(mul(a, b))), std::runtime_error);
+
+    // a -> b + c
+    auto substituted = substitute(sum, a, add(LinearForm(b), LinearForm(c)));
+    EXPECT_EQ(substituted, LinearForm::fromTerms(&env, {{LinearForm::CONSTANT_ID, 5}, {b.getId(), Rational(5, 3)},
+                                                        {c.getId(), 1}}));
+}
+
+TEST(RationalTest, Arithmetic) {
+    auto half = Rational(1, 2);
+    auto third = Rational(-2, -6);
+    EXPECT_EQ(half + third, Rational(5, 6));
+    EXPECT_EQ(half - third, Rational(1, 6));
+    EXPECT_EQ(half * third, Rational(1, 6));
+    EXPECT_EQ(half / third, Rational(3, 2));
+    EXPECT_EQ(Rational(2, 4), half);
+    EXPECT_TRUE(Rational(3, -3) < 0);
+    EXPECT_TRUE((half + half).isOne());
+
+    // the canonical form is produced on demand
+    auto unreduced = Rational(6, 1) / Rational(-4, 1);
+    EXPECT_EQ(unreduced.getEnumerator(), -3);
+    EXPECT_EQ(unreduced.getDenominator(), 2);
+    EXPECT_EQ(unreduced.toString(), "-3/2");
+    EXPECT_THROW(half / 0, std::runtime_error);
+    EXPECT_THROW(Rational(1, 0), std::runtime_error);
+}
+
+TEST(RationalTest, Promotion) {
+    auto large = Rational(INT64_MAX);
+    auto square = large * large;
+    EXPECT_TRUE(square.isBig());
+    EXPECT_THROW(square.getEnumerator(), std::runtime_error);
+    EXPECT_EQ(square.toString(), "85070591730234615847396907784232501249/1");
+    EXPECT_DOUBLE_EQ(square.toDouble(), 8.507059173023462e37);
+
+    // demoted back as soon as the value fits into 64 bits
+    auto back = square / large;
+    EXPECT_FALSE(back.isBig());
+    EXPECT_EQ(back, large);
+    EXPECT_EQ(back.getEnumerator(), INT64_MAX);
+
+    auto tiny = Rational(1, INT64_MAX) * Rational(1, INT64_MAX - 1);
+    EXPECT_TRUE(tiny.isBig());
+    EXPECT_TRUE(tiny + (-tiny) == 0);
+    EXPECT_TRUE(Rational(0) < tiny);
+}
+
+TEST(RationalTest, BigDivision) {
+    // (a * b + c) / b == a with the rest c, for divisors of several limbs
+    uint64_t seed = 12345;
+    auto next = [&seed]() {
+        seed = seed * 6364136223846793005ull + 1442695040888963407ull;
+        return (__int128) (seed >> 1);
+    };
+    for (int i = 0; i < 200; i++) {
+        auto a = BigInt(next()) * BigInt(next()) * BigInt(i % 3 == 0 ? 1 : next());
+        auto b = BigInt(next()) * BigInt(i % 2 == 0 ? (__int128) 1 << 31 : next()) + BigInt(i);
+        auto c = BigInt(next() % (i + 1));
+        auto l = i % 4 == 1 ? -(a * b + c) : a * b + c;
+        BigInt quotient, remainder;
+        divMod(l, b, quotient, remainder);
+        EXPECT_EQ(quotient.toString(), (i % 4 == 1 ? -a : a).toString());
+        EXPECT_EQ(remainder.toString(), (i % 4 == 1 ? -c : c).toString());
+    }
 
+    // the top limbs of the divisor and the rest are equal, the estimate has to be corrected
+    BigInt limb = BigInt(0xffffffffll);
+    BigInt base = BigInt((__int128) 1 << 32);
+    auto divisor = (limb * base + limb) * base + BigInt(1);
+    BigInt quotient, remainder;
+    divMod(divisor * limb + divisor - BigInt(1), divisor, quotient, remainder);
+    EXPECT_EQ(quotient.toString(), limb.toString());
+    EXPECT_EQ(remainder.toString(), (divisor - BigInt(1)).toString());
 }
 
 TEST(SymbolicTest, GetSos) {
@@ -241,6 +468,214 @@ TEST(SymbolicTest, GetSos) {
 
 }
 
+TEST(SymbolicTest, GramTemplate) {
+    auto env = SymbolicEnvironment();
+    auto x = QMonomial(env.sym("x"));
+    auto one = env.qmonomialOne();
+    auto xx = mul(x, x);
+
+    // 1, x, x^2 | x, x^2, x^3 | x^2 (twice) | x^3, x^4
+    GramTemplate gram({one, x, mul(xx, 3)});
+    EXPECT_EQ(gram.getEntries().size(), 6);
+    EXPECT_EQ(gram.getProductMonomials().size(), 5);
+    for (const auto &it: gram.getProductMonomials()) {
+        EXPECT_TRUE(it.isUnitary());
+    }
+
+    const auto &entries = gram.getEntries();
+    EXPECT_EQ(entries[2].productIndex, entries[3].productIndex);
+    EXPECT_TRUE(entries[0].coefficient == 1);
+    EXPECT_TRUE(entries[1].coefficient == 2);
+    EXPECT_TRUE(entries[2].coefficient == 6);
+    EXPECT_TRUE(entries[3].coefficient == 1);
+    EXPECT_TRUE(entries[5].coefficient == 9);
+
+    // the x^2 coefficient collects 2 * 3 * l_0_2 + l_1_1
+    auto sos = getSos(gram, 7);
+    auto monomials = sos.getReducedMonomials();
+    ASSERT_EQ(monomials.size(), 5);
+    auto expected = LinearForm::fromTerms(&env, {{env.getOrCreate("l_7_0_2").getId(), 6},
+                                                 {env.getOrCreate("l_7_1_1").getId(), 1}});
+    EXPECT_TRUE(monomials[2].getQmonomial() == xx);
+    EXPECT_TRUE(monomials[2].getCoefficient() == expected);
+
+    // the gram entries carry their indices, the other symbols do not
+    const auto *gramEntry = env.findGramEntry(env.getOrCreate("l_7_0_2").getId());
+    ASSERT_NE(gramEntry, nullptr);
+    EXPECT_EQ(gramEntry->block, 7);
+    EXPECT_EQ(gramEntry->row, 0);
+    EXPECT_EQ(gramEntry->col, 2);
+    EXPECT_EQ(env.findGramEntry(x.getSymbolIdIfLinear()), nullptr);
+}
+
+TEST(SymbolicTest, InternTableConcurrentInsert) {
+    InternTable<int> table;
+    const int names = 5000;
+    std::vector<std::vector<int>> ids(4, std::vector<int>(names));
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; t++) {
+        threads.emplace_back([&, t]() {
+            for (int i = 0; i < names; i++) {
+                int name = t % 2 == 0 ? i : names - 1 - i;
+                ids[t][name] = table.insert("s" + std::to_string(name), name + 1).first;
+            }
+        });
+    }
+    for (auto& thread: threads) {
+        thread.join();
+    }
+
+    // every name got one id, the ids are dense and give the name and the value back
+    ASSERT_EQ(table.size(), names);
+    std::vector<bool> seen(names, false);
+    for (int i = 0; i < names; i++) {
+        for (int t = 1; t < 4; t++) {
+            EXPECT_EQ(ids[t][i], ids[0][i]);
+        }
+        ASSERT_GE(ids[0][i], 0);
+        ASSERT_LT(ids[0][i], names);
+        EXPECT_FALSE(seen[ids[0][i]]);
+        seen[ids[0][i]] = true;
+        EXPECT_EQ(table.getName(ids[0][i]), "s" + std::to_string(i));
+        EXPECT_EQ(table.find("s" + std::to_string(i)), ids[0][i]);
+        EXPECT_EQ(table.getValue(ids[0][i]), i + 1);
+    }
+    EXPECT_EQ(table.find("s" + std::to_string(names)), -1);
+    EXPECT_THROW(table.getName(names), std::out_of_range);
+
+    // a symbol is its id
+    auto env = SymbolicEnvironment();
+    auto x = env.sym("x");
+    auto y = env.sym("y");
+    EXPECT_TRUE(env.getOrCreate("x") == x);
+    EXPECT_TRUE(x < y);
+    EXPECT_EQ(y.getName(), "y");
+    EXPECT_THROW(env.sym("x"), std::runtime_error);
+}
+
+TEST(SymbolicTest, PruneSosBases) {
+    auto env = SymbolicEnvironment();
+    auto x = QMonomial(env.sym("x"));
+    auto y = QMonomial(env.sym("y"));
+    auto one = env.qmonomialOne();
+    auto xx = mul(x, x);
+    auto positive = symbolicPolynomialfromQPolynomialAsBase(QPolynomial(one));
+    auto negative = symbolicPolynomialfromQPolynomialAsBase(mul(QPolynomial(one), -1));
+
+    // x^4 and y^2 only come from squares and do not occur in x^2 + 1, then x^3 loses its only source
+    auto target = symbolicPolynomialfromQPolynomialAsBase(add(QPolynomial(xx), QPolynomial(one)));
+    auto pruned = pruneSosBases({{one, x, xx, y}}, {positive}, target);
+    ASSERT_EQ(pruned.size(), 1);
+    ASSERT_EQ(pruned[0].size(), 2);
+    EXPECT_TRUE(pruned[0][0] == one);
+    EXPECT_TRUE(pruned[0][1] == x);
+
+    // squares with opposite signs may cancel out
+    auto zero = env.symbolicPolynomialZero();
+    pruned = pruneSosBases({{one, x}, {one, x}}, {positive, negative}, zero);
+    ASSERT_EQ(pruned.size(), 2);
+    EXPECT_EQ(pruned[0].size(), 2);
+    EXPECT_EQ(pruned[1].size(), 2);
+
+    pruned = pruneSosBases({{one, x}}, {positive}, zero);
+    EXPECT_TRUE(pruned[0].empty());
+}
+
+TEST(SymbolicTest, ConstraintAssembler) {
+    auto env = SymbolicEnvironment();
+    auto x = QMonomial(env.sym("x"));
+    auto a = env.sym("a");
+    auto one = env.qmonomialOne();
+
+    // (g00 + 2 g01 x + g11 x^2) * (x + 2) - (a x + 3)
+    auto condition = symbolicPolynomialfromQPolynomialAsBase(add(QPolynomial(x), mul(QPolynomial(one), 2)));
+    auto conclusion = add(SymbolicPolynomial(SymbolicMonomial(x, QPolynomial(a))),
+                          SymbolicPolynomial(SymbolicMonomial(mul(QPolynomial(one), 3))), true);
+
+    GramTemplate gram({one, x});
+    ConstraintAssembler assembler(&env);
+    assembler.startGroup();
+    assembler.addSosProduct(0, gram, condition);
+    assembler.addPolynomial(conclusion, -1);
+    assembler.startGroup();
+    assembler.addSosProduct(1, gram, condition);
+    auto system = assembler.build();
+
+    ASSERT_EQ(system.getNumberOfRows(), 8);
+
+    auto gramRow = [&](int row) {
+        std::vector<std::vector<std::string>> result;
+        for (size_t k = system.gramRowStart[row]; k < system.gramRowStart[row + 1]; k++) {
+            const auto &entry = system.gramEntries[k];
+            result.push_back({std::to_string(entry.block), std::to_string(entry.row), std::to_string(entry.col),
+                              entry.coefficient.toString()});
+        }
+        return result;
+    };
+    using Row = std::vector<std::vector<std::string>>;
+
+    EXPECT_EQ(gramRow(0), (Row{{"0", "0", "0", "2/1"}}));
+    EXPECT_EQ(gramRow(1), (Row{{"0", "0", "0", "1/1"}, {"0", "0", "1", "4/1"}}));
+    EXPECT_EQ(gramRow(2), (Row{{"0", "0", "1", "2/1"}, {"0", "1", "1", "2/1"}}));
+    EXPECT_EQ(gramRow(3), (Row{{"0", "1", "1", "1/1"}}));
+    EXPECT_EQ(gramRow(4), (Row{{"1", "0", "0", "2/1"}}));
+
+    EXPECT_TRUE(system.constants[0] == -3);
+    EXPECT_TRUE(system.constants[1] == 0);
+    EXPECT_TRUE(system.constants[4] == 0);
+
+    ASSERT_EQ(system.freeRowStart[2] - system.freeRowStart[1], 1);
+    EXPECT_EQ(system.freeEntries[system.freeRowStart[1]].symbolId, a.getId());
+    EXPECT_TRUE(system.freeEntries[system.freeRowStart[1]].coefficient == -1);
+    EXPECT_EQ(system.freeEntries.size(), 1);
+
+    // the product with a template coefficient is not linear in the unknowns
+    EXPECT_THROW(assembler.addSosProduct(2, GramTemplate({one}), conclusion), std::runtime_error);
+}
+
+TEST(SymbolicTest, ConstraintAssemblerAppend) {
+    auto env = SymbolicEnvironment();
+    auto x = QMonomial(env.sym("x"));
+    auto a = env.sym("a");
+    auto one = env.qmonomialOne();
+
+    auto condition = symbolicPolynomialfromQPolynomialAsBase(add(QPolynomial(x), mul(QPolynomial(one), 2)));
+    auto conclusion = add(SymbolicPolynomial(SymbolicMonomial(x, QPolynomial(a))),
+                          SymbolicPolynomial(SymbolicMonomial(mul(QPolynomial(one), 3))), true);
+    GramTemplate gram({one, x});
+
+    // the same groups once on one assembler, once on an assembler per group appended in order
+    ConstraintAssembler whole(&env);
+    ConstraintAssembler merged(&env);
+    for (int block = 0; block < 3; block++) {
+        ConstraintAssembler part(&env);
+        for (auto* assembler: {&whole, &part}) {
+            assembler->startGroup();
+            assembler->addSosProduct(block, gram, condition);
+            if (block != 1) {
+                assembler->addPolynomial(conclusion, -1);
+            }
+        }
+        merged.append(std::move(part));
+    }
+    auto expected = whole.build();
+    auto system = merged.build();
+
+    ASSERT_EQ(system.getNumberOfRows(), expected.getNumberOfRows());
+    EXPECT_EQ(system.blockSizes, expected.blockSizes);
+    EXPECT_EQ(system.gramRowStart, expected.gramRowStart);
+    EXPECT_EQ(system.freeRowStart, expected.freeRowStart);
+    for (size_t k = 0; k < expected.gramEntries.size(); k++) {
+        EXPECT_EQ(system.gramEntries[k].block, expected.gramEntries[k].block);
+        EXPECT_EQ(system.gramEntries[k].row, expected.gramEntries[k].row);
+        EXPECT_EQ(system.gramEntries[k].col, expected.gramEntries[k].col);
+        EXPECT_TRUE(system.gramEntries[k].coefficient == expected.gramEntries[k].coefficient);
+    }
+    for (int row = 0; row < expected.getNumberOfRows(); row++) {
+        EXPECT_TRUE(system.constants[row] == expected.constants[row]);
+    }
+}
+
 
 TEST(SymbolicTest, TestSubstitute) {
     auto env = SymbolicEnvironment();
@@ -287,6 +722,49 @@ TEST(SymbolicTest, SubstituteInSymbolicPolynomial) {
 
 }
 
+TEST(SymbolicTest, ComposeInBase) {
+    auto env = SymbolicEnvironment();
+    auto u = env.sym("u");
+    auto v = env.sym("v");
+    auto x = QPolynomial(QMonomial(env.sym("x")));
+    auto y = QPolynomial(QMonomial(env.sym("y")));
+    auto a = QPolynomial(env.sym("a"));
+    auto b = QPolynomial(env.sym("b"));
+    auto one = env.qPolynomialOne();
+
+    // [a] * u^3 * v^2 + [b] * u * x + 5 * v^4
+    auto uuu = mul(mul(QMonomial(u), QMonomial(u)), QMonomial(u));
+    auto vv = mul(QMonomial(v), QMonomial(v));
+    auto p = add(SymbolicPolynomial(SymbolicMonomial(mul(uuu, vv), a)),
+                 SymbolicPolynomial(SymbolicMonomial(mul(mul(QMonomial(u), QMonomial(env.getOrCreate("x"))), 1), b)),
+                 true);
+    p = add(p, SymbolicPolynomial(SymbolicMonomial(mul(mul(vv, vv), 5))), true);
+
+    // the scalar of a term may sit on the monomial or in the coefficient, so the difference is compared to zero
+    auto isZero = [](const SymbolicPolynomial& polynomial) {
+        auto monomials = polynomial.getReducedMonomials();
+        return std::all_of(monomials.begin(), monomials.end(), [](const SymbolicMonomial& monomial) {
+            return monomial.getCoefficient().isZero() || monomial.getQmonomial().getCoefficient() == 0;
+        });
+    };
+    auto matchesSequential = [&](const std::vector<QPolynomial>& values) {
+        auto sequential = substituteInBase(substituteInBase(p, u, values[0]), v, values[1]);
+        return isZero(add(composeInBase(p, {u, v}, values), mul(sequential, -1), true));
+    };
+
+    // affine with several terms, u := 2x - y + 3, v := y - 1
+    std::vector<QPolynomial> affine = {add(add(mul(x, 2), mul(y, -1)), mul(one, 3)), add(y, mul(one, -1))};
+    EXPECT_TRUE(matchesSequential(affine));
+
+    // not affine, u := x * y + 1
+    std::vector<QPolynomial> square = {add(mul(x, y), one), mul(x, 2)};
+    EXPECT_TRUE(matchesSequential(square));
+
+    // the substitution of u contains v, one after the other
+    std::vector<QPolynomial> dependent = {add(QPolynomial(QMonomial(v)), one), x};
+    EXPECT_TRUE(matchesSequential(dependent));
+}
+
 TEST(ProgramExpressionTest, BasicProgramExpression1) {
     // transforms x >= y to x - y >= 0
     auto env = SymbolicEnvironment();
@@ -425,6 +903,38 @@ TEST(ProgramExpressionTest, EvaluationExpressionWithQPolynomial) {
 
 }
 
+TEST(ProgramExpressionTest, FunctionCallCache) {
+    auto env = SymbolicEnvironment();
+    auto x = QPolynomial(env.sym("x"));
+    auto y = QPolynomial(env.sym("y"));
+    auto arg = QPolynomial(env.sym("_function_arg_0"));
+    auto a = SymbolicPolynomial(SymbolicMonomial(QPolynomial(env.sym("a"))));
+    auto f = mul(symbolicPolynomialfromQPolynomialAsBase(mul(arg, arg)), a); // [a] * arg^2
+
+    auto ctx = EvaluationContext(&env);
+    ctx.setVariableQPolynomial("x", x);
+    ctx.setVariableQPolynomial("y", y);
+    ctx.setSymbolicPolynomial("f", f, {"_function_arg_0"});
+
+    auto call = [](std::unique_ptr<ExpressionElement> left, std::unique_ptr<ExpressionElement> right) {
+        std::vector<std::unique_ptr<ExpressionElement>> arguments;
+        arguments.push_back(std::make_unique<BinaryOperation>(std::move(left), std::move(right), "-"));
+        return std::make_unique<Function>(std::move(arguments), "f");
+    };
+    // f(x - y) and f(x - y) again in a copy of the context, f(y - x) is another call
+    auto first = call(std::make_unique<Variable>("x"), std::make_unique<Variable>("y"));
+    auto second = call(std::make_unique<Variable>("x"), std::make_unique<Variable>("y"));
+    auto other = call(std::make_unique<Variable>("y"), std::make_unique<Variable>("x"));
+
+    auto expected = toString(first->evaluate(ctx).getSymbolicPolynomial());
+    EvaluationContext copy = ctx;
+    EXPECT_EQ(toString(second->evaluate(copy).getSymbolicPolynomial()), expected);
+    EXPECT_EQ(ctx.getFunctionCallCache().getHits(), 1);
+    EXPECT_EQ(toString(other->evaluate(ctx).getSymbolicPolynomial()), expected);
+    EXPECT_EQ(ctx.getFunctionCallCache().getHits(), 1);
+    EXPECT_EQ(ctx.getFunctionCallCache().getMisses(), 2);
+}
+
 
 TEST(ProgramExpressionTest, TestClone) {
     auto env = SymbolicEnvironment();
@@ -595,6 +1105,30 @@ TEST(TestExpressionParser, TestParsePlus) {
     ASSERT_EQ(expr->toString(), "(x + y)");
 }
 
+TEST(ProgramExpressionTest, CompiledExpression) {
+    auto env = SymbolicEnvironment();
+    auto arg = QPolynomial(env.sym("_function_arg_0"));
+    auto a = SymbolicPolynomial(SymbolicMonomial(QPolynomial(env.sym("a"))));
+    auto ctx = EvaluationContext(&env);
+    ctx.setVariableQPolynomial("x", QPolynomial(env.sym("x")));
+    ctx.setVariableQPolynomial("y", QPolynomial(env.sym("y")));
+    ctx.setSymbolicPolynomial("f", mul(symbolicPolynomialfromQPolynomialAsBase(mul(arg, arg)), a), {"_function_arg_0"});
+
+    for (const auto& source: {"-(x * y - 3) / 2", "x + f(x - y) * (y + 1)", "-f(2 * x) - x", "x * y + 1 <= f(y)",
+                              "f(x) > x - y", "x / 3 == y"}) {
+        auto expr = parseExpression(getExpressionTokensFromString(source));
+        auto compiled = CompiledExpression(*expr, ctx);
+        auto result = compiled.evaluate(ctx);
+        auto expected = expr->evaluate(ctx);
+        ASSERT_EQ(result.getTypeTag(), expected.getTypeTag()) << source;
+        if (expected.getTypeTag() == QPOLYNOMIAL) {
+            EXPECT_EQ(toString(result.getQPolynomial()), toString(expected.getQPolynomial())) << source;
+        } else {
+            EXPECT_EQ(toString(result.getSymbolicPolynomial()), toString(expected.getSymbolicPolynomial())) << source;
+        }
+    }
+}
+
 TEST(TestExpressionParser, TestParseMinus) {
     auto expression_tkns = getExpressionTokensFromString("x - y");
     printTokens(expression_tkns);
@@ -1114,6 +1648,8 @@ TEST(ComplexityEstimator, Estimate8) {
 
 
 namespace mosectest {
+    using namespace monty;
+
     std::shared_ptr<ndarray<int, 1>> nint(const std::vector<int> &X) { return new_array_ptr<int>(X); }
 
     std::shared_ptr<ndarray<double, 1>> ndou(const std::vector<double> &X) { return new_array_ptr<double>(X); }
@@ -1207,7 +1743,10 @@ TEST(TestsdpProblem, Test1) {
 
     problem.printSystem(std::cout);
 
-    problem.solveWithMosek();
+    auto result = MosekSdpBackend().solve(problem);
+    if (result.isSolved()) {
+        problem.setSolution(result.solution);
+    }
 }
 
 TEST(TestsdpProblem, Test2) {
@@ -1226,7 +1765,9 @@ TEST(TestsdpProblem, Test2) {
 
     problem.endCondition(LinearMatrixExpressionType::EQ);
 
-    problem.solveWithMosek();
+    auto result = MosekSdpBackend().solve(problem);
+    ASSERT_TRUE(result.isSolved());
+    problem.setSolution(result.solution);
 
     std::cout << "Problem formulation:" << std::endl;
     problem.printSystem(std::cout);
@@ -1235,6 +1776,33 @@ TEST(TestsdpProblem, Test2) {
     problem.printSolution(std::cout);
 }
 
+TEST(TestsdpProblem, SparseCoefficients) {
+
+    SdpProblem problem(3);
+
+    problem.startNewCondition();
+    problem.addSdpConstrainedVariable(0, 2, 1, 2.0);
+    problem.addSdpConstrainedVariable(0, 1, 1, 1.0);
+    problem.addSdpConstrainedVariable(0, 1, 2, 4.0);
+    problem.addSdpConstrainedVariable(0, 0, 0, -1.0);
+    problem.endCondition(LinearMatrixExpressionType::EQ);
+
+    // only the upper triangle is stored, (2, 1) and (1, 2) are merged
+    const auto& matrix = problem.getConditions()[0].matrixCoefficients.at(0);
+    EXPECT_EQ(matrix.size, 3);
+    ASSERT_EQ(matrix.entries.size(), 3);
+    EXPECT_EQ(matrix.entries[0].row, 0);
+    EXPECT_EQ(matrix.entries[0].value, -1.0);
+    EXPECT_EQ(matrix.entries[1].col, 1);
+    EXPECT_EQ(matrix.entries[2].row, 1);
+    EXPECT_EQ(matrix.entries[2].col, 2);
+    EXPECT_EQ(matrix.entries[2].value, 3.0);
+
+    // -X_00 + X_11 + 6 X_12
+    std::vector<std::vector<double>> x = {{1, 0, 0}, {0, 2, 0.5}, {0, 0.5, 1}};
+    EXPECT_EQ(matrix.dot(x), 4.0);
+}
+
 TEST(TemplateEngineTest, Test1) {
 
     std::string input = "$a + $b = 4";
@@ -1344,7 +1912,7 @@ TEST(Csdp, CsdpRead1) {
 
         auto ans = problem.readCsdp(solutionStream);
 
-        for (auto& matrix: ans.first) {
+        for (auto& matrix: ans.matrices) {
             std::cout << "Matrix:" << std::endl;
             for (auto& row: matrix) {
                 for (auto& elem: row) {
@@ -1354,16 +1922,622 @@ TEST(Csdp, CsdpRead1) {
             }
         }
         std::cout << "Variables:" << std::endl;
-        for (auto& elem: ans.second) {
+        for (auto& elem: ans.unconstrainedVariables) {
             std::cout << elem << " ";
         }
         std::cout << std::endl;
 
-        problem.setSolution(ans.first, ans.second);
+        problem.setSolution(ans);
+
+
+}
+
+TEST(Csdp, CsdpDifferentMatrixSizes) {
+
+    SdpProblem problem(2);
+    problem.setMatrixSize(5, 1);
+
+    problem.startNewCondition();
+    problem.addSdpConstrainedVariable(0, 0, 1, -2.0);
+    problem.addSdpConstrainedVariable(5, 0, 0, 3.0);
+    problem.addUnconstrainedVariable("a", 4.0);
+    problem.addConstant(5.0);
+    problem.endCondition(LinearMatrixExpressionType::EQ);
+
+    EXPECT_THROW(problem.setMatrixSize(5, 2), std::runtime_error);
+    EXPECT_EQ(problem.getMatrixSize(0), 2);
+    EXPECT_EQ(problem.getMatrixSize(1), 1);
+
+    std::stringstream csdp;
+    problem.writeCsdp(csdp);
+    EXPECT_EQ(csdp.str(), "1\n"
+                          "3\n"
+                          "2 1 -2 \n"
+                          "-5 \n"
+                          "1 1 1 2 -1\n"
+                          "1 2 1 1 3\n"
+                          "1 3 1 1 4\n"
+                          "1 3 2 2 -4\n");
+
+    std::stringstream solution("0.0\n"
+                               "2 1 1 1 1.0\n"
+                               "2 1 1 2 0.5\n"
+                               "2 1 2 2 1.0\n"
+                               "2 2 1 1 1.0\n"
+                               "2 3 1 1 2.0\n");
+    auto ans = problem.readCsdp(solution);
+    ASSERT_EQ(ans.matrices.size(), 2);
+    EXPECT_EQ(ans.matrices[0].size(), 2);
+    EXPECT_EQ(ans.matrices[1].size(), 1);
+    EXPECT_EQ(ans.matrices[0][1][0], 0.5);
+    EXPECT_EQ(ans.unconstrainedVariables[0], 2.0);
+}
+
+
+// what Solver does with the answer of a backend
+static bool solveWithBackend(SdpBackend&& backend, SdpProblem& problem) {
+    auto result = backend.solve(problem);
+    if (!result.isSolved()) {
+        return false;
+    }
+    problem.setAllowedError(backend.getAllowedError());
+    problem.setSolution(result.solution);
+    return true;
+}
+
+TEST(Csdp, CsdpLibrary) {
+
+    SdpProblem problem(2);
+
+    // X_00 == 1, X_11 == 2, a + 2 X_01 == 3, v - X_00 == 1
+    problem.startNewCondition();
+    problem.addSdpConstrainedVariable(0, 0, 0, 1.0);
+    problem.addConstant(-1.0);
+    problem.endCondition(LinearMatrixExpressionType::EQ);
+
+    problem.startNewCondition();
+    problem.addSdpConstrainedVariable(0, 1, 1, 1.0);
+    problem.addConstant(-2.0);
+    problem.endCondition(LinearMatrixExpressionType::EQ);
+
+    problem.startNewCondition();
+    problem.addUnconstrainedVariable("a", 1.0);
+    problem.addSdpConstrainedVariable(0, 0, 1, 2.0);
+    problem.addConstant(-3.0);
+    problem.endCondition(LinearMatrixExpressionType::EQ);
+
+    problem.startNewCondition();
+    problem.addNonnegativeVariable("v", 1.0);
+    problem.addSdpConstrainedVariable(0, 0, 0, -1.0);
+    problem.addConstant(-1.0);
+    problem.endCondition(LinearMatrixExpressionType::EQ);
+
+    if (!csdpLibraryAvailable()) {
+        EXPECT_THROW(solveWithCsdpLibrary(problem.getNativeProblem()), std::runtime_error);
+        return;
+    }
+
+    ASSERT_TRUE(solveWithBackend(CsdpSdpBackend(false), problem));
+    auto values = problem.getSolutionAsMap();
+    EXPECT_NEAR(values["l_0_0_0"], 1.0, 1e-6);
+    EXPECT_NEAR(values["l_0_1_1"], 2.0, 1e-6);
+    EXPECT_NEAR(values["a"] + 2 * values["l_0_0_1"], 3.0, 1e-6);
+    EXPECT_NEAR(values["v"], 2.0, 1e-6);
+}
+
+TEST(Csdp, CsdpNonnegativeVariables) {
+
+    SdpProblem problem(2);
+
+    problem.startNewCondition();
+    problem.addSdpConstrainedVariable(0, 0, 0, 1.0);
+    problem.addNonnegativeVariable("l_1_0_0", 3.0);
+    problem.addNonnegativeVariable("l_2_0_0", -1.0);
+    problem.addUnconstrainedVariable("a", 4.0);
+    problem.addUnconstrainedVariable("b", 1.0);
+    problem.addConstant(-5.0);
+    problem.endCondition(LinearMatrixExpressionType::EQ);
+
+    EXPECT_EQ(problem.getNumberOfSdpMatrices(), 1);
+    EXPECT_EQ(problem.getNumberOfNonnegativeVariables(), 2);
+
+    // the free variables and the nonnegative ones make one diagonal block each
+    std::stringstream csdp;
+    problem.writeCsdp(csdp);
+    EXPECT_EQ(csdp.str(), "1\n"
+                          "3\n"
+                          "2 -4 -2 \n"
+                          "5 \n"
+                          "1 1 1 1 1\n"
+                          "1 2 1 1 4\n"
+                          "1 2 2 2 -4\n"
+                          "1 2 3 3 1\n"
+                          "1 2 4 4 -1\n"
+                          "1 3 1 1 3\n"
+                          "1 3 2 2 -1\n");
+
+    std::stringstream solution("0.0\n"
+                               "2 1 1 1 1.0\n"
+                               "2 2 2 2 0.5\n"
+                               "2 2 3 3 4.0\n"
+                               "2 3 1 1 1.0\n"
+                               "2 3 2 2 1.0\n");
+    auto ans = problem.readCsdp(solution);
+    ASSERT_EQ(ans.nonnegativeVariables.size(), 2);
+    EXPECT_EQ(ans.unconstrainedVariables[0], -0.5);
+    EXPECT_EQ(ans.unconstrainedVariables[1], 4.0);
+
+    // 1 + 3 * 1 - 1 + 4 * (-0.5) + 4 - 5 == 0
+    EXPECT_EQ(SdpProblem::evaluateLhsForLinearMatrixExpression(ans.matrices, ans.unconstrainedVariables,
+                                                              ans.nonnegativeVariables,
+                                                              problem.getConditions()[0]), 0.0);
+    problem.setSolution(ans);
+    auto values = problem.getSolutionAsMap();
+    EXPECT_EQ(values["l_1_0_0"], 1.0);
+    EXPECT_EQ(values["l_2_0_0"], 1.0);
+    EXPECT_EQ(values["a"], -0.5);
+    EXPECT_EQ(values["l_0_0_0"], 1.0);
+}
+
+TEST(Csdp, CsdpGramScalars) {
+
+    // 1x1 gram matrices are nonnegative variables that are reported as matrices
+    SdpProblem problem(2);
+    problem.startNewCondition();
+    problem.addSdpConstrainedVariable(0, 0, 0, 1.0);
+    problem.addGramScalar(1, 3.0);
+    problem.addGramScalar(2, -1.0);
+    problem.addUnconstrainedVariable("a", 4.0);
+    problem.addConstant(-3.0);
+    problem.endCondition(LinearMatrixExpressionType::EQ);
+
+    EXPECT_EQ(problem.getNumberOfSdpMatrices(), 1);
+    ASSERT_EQ(problem.getNumberOfNonnegativeVariables(), 2);
+    EXPECT_EQ(problem.getNonnegativeVariableGramIndex(0), 1);
+    EXPECT_EQ(problem.getNonnegativeVariableName(1), "l_2_0_0");
+
+    problem.setSolution({{{1.0, 0.0}, {0.0, 0.0}}}, {0.25}, {0.5, 0.5});
+    const auto &solution = problem.getSolution();
+    EXPECT_TRUE(solution.nonnegativeVariables.empty());
+    ASSERT_EQ(solution.matrices.size(), 3);
+    EXPECT_EQ(solution.matrices.at(1), std::vector<std::vector<double>>({{0.5}}));
+
+    auto values = problem.getSolutionAsMap();
+    EXPECT_EQ(values["l_1_0_0"], 0.5);
+    EXPECT_EQ(values["l_0_1_1"], 0.0);
+
+    std::ostringstream printed;
+    solution.print(printed);
+    EXPECT_NE(printed.str().find("l_2_0_0 0.5\n"), std::string::npos);
+    EXPECT_NE(printed.str().find("a 0.25\n"), std::string::npos);
+}
+
+TEST(NativeSdp, Feasible) {
+
+    SdpProblem problem(2);
+
+    // X_00 == 1, X_11 == 1, 2 X_01 == 1, a + X_00 == 3, v - X_11 == 1
+    problem.startNewCondition();
+    problem.addSdpConstrainedVariable(0, 0, 0, 1.0);
+    problem.addConstant(-1.0);
+    problem.endCondition(LinearMatrixExpressionType::EQ);
+
+    problem.startNewCondition();
+    problem.addSdpConstrainedVariable(0, 1, 1, 1.0);
+    problem.addConstant(-1.0);
+    problem.endCondition(LinearMatrixExpressionType::EQ);
+
+    problem.startNewCondition();
+    problem.addSdpConstrainedVariable(0, 0, 1, 2.0);
+    problem.addConstant(-1.0);
+    problem.endCondition(LinearMatrixExpressionType::EQ);
+
+    problem.startNewCondition();
+    problem.addUnconstrainedVariable("a", 1.0);
+    problem.addSdpConstrainedVariable(0, 0, 0, 1.0);
+    problem.addConstant(-3.0);
+    problem.endCondition(LinearMatrixExpressionType::EQ);
+
+    problem.startNewCondition();
+    problem.addNonnegativeVariable("v", 1.0);
+    problem.addSdpConstrainedVariable(0, 1, 1, -1.0);
+    problem.addConstant(-1.0);
+    problem.endCondition(LinearMatrixExpressionType::EQ);
+
+    ASSERT_TRUE(solveWithBackend(NativeSdpBackend(), problem));
+
+    auto values = problem.getSolutionAsMap();
+    EXPECT_NEAR(values["l_0_0_0"], 1.0, 1e-6);
+    EXPECT_NEAR(values["l_0_1_1"], 1.0, 1e-6);
+    EXPECT_NEAR(values["l_0_0_1"], 0.5, 1e-6);
+    EXPECT_NEAR(values["l_0_1_0"], 0.5, 1e-6);
+    EXPECT_NEAR(values["a"], 2.0, 1e-6);
+    EXPECT_NEAR(values["v"], 2.0, 1e-6);
+}
+
+TEST(NativeSdp, Infeasible) {
+
+    SdpProblem problem(2);
+
+    // X_00 + X_11 == -1 has no psd solution
+    problem.startNewCondition();
+    problem.addSdpConstrainedVariable(0, 0, 0, 1.0);
+    problem.addSdpConstrainedVariable(0, 1, 1, 1.0);
+    problem.addUnconstrainedVariable("a", 0.0);
+    problem.addConstant(1.0);
+    problem.endCondition(LinearMatrixExpressionType::EQ);
+
+    EXPECT_FALSE(solveWithBackend(NativeSdpBackend(), problem));
+    EXPECT_THROW(problem.getSolutionAsMap(), std::runtime_error);
+}
+
+TEST(SdpBackend, NativeAndAdmm) {
+
+    SdpProblem problem(2);
+
+    // X_00 == 1, X_11 == 1, 2 X_01 == 1, a + X_00 == 3, v - X_11 == 1
+    problem.startNewCondition();
+    problem.addSdpConstrainedVariable(0, 0, 0, 1.0);
+    problem.addConstant(-1.0);
+    problem.endCondition(LinearMatrixExpressionType::EQ);
+
+    problem.startNewCondition();
+    problem.addSdpConstrainedVariable(0, 1, 1, 1.0);
+    problem.addConstant(-1.0);
+    problem.endCondition(LinearMatrixExpressionType::EQ);
+
+    problem.startNewCondition();
+    problem.addSdpConstrainedVariable(0, 0, 1, 2.0);
+    problem.addConstant(-1.0);
+    problem.endCondition(LinearMatrixExpressionType::EQ);
 
+    problem.startNewCondition();
+    problem.addUnconstrainedVariable("a", 1.0);
+    problem.addSdpConstrainedVariable(0, 0, 0, 1.0);
+    problem.addConstant(-3.0);
+    problem.endCondition(LinearMatrixExpressionType::EQ);
+
+    problem.startNewCondition();
+    problem.addNonnegativeVariable("v", 1.0);
+    problem.addSdpConstrainedVariable(0, 1, 1, -1.0);
+    problem.addConstant(-1.0);
+    problem.endCondition(LinearMatrixExpressionType::EQ);
+
+    for (auto engine : {SdpEngine::NATIVE, SdpEngine::ADMM}) {
+        auto backend = createSdpBackend(engine);
+        auto result = backend->solve(problem);
+        ASSERT_TRUE(result.isSolved()) << backend->getName();
+        EXPECT_EQ(backend->getConditionType(), LinearMatrixExpressionType::EQ);
+
+        // the backend leaves the problem alone, the values come by the inner indices
+        ASSERT_EQ(result.solution.matrices.size(), 1);
+        ASSERT_EQ(result.solution.unconstrainedVariables.size(), 1);
+        ASSERT_EQ(result.solution.nonnegativeVariables.size(), 1);
+        EXPECT_NEAR(result.solution.matrices[0][0][1], 0.5, 1e-5);
+        EXPECT_NEAR(result.solution.unconstrainedVariables[0], 2.0, 1e-5);
+        EXPECT_NEAR(result.solution.nonnegativeVariables[0], 2.0, 1e-5);
+        EXPECT_GT(result.iterations, 0);
+    }
+    EXPECT_THROW(problem.getSolutionAsMap(), std::runtime_error);
+
+    // admm starts the next solve from the last iterate, here it is the fixed point already
+    AdmmSdpBackend admm;
+    auto cold = admm.solve(problem);
+    ASSERT_TRUE(cold.isSolved());
+    auto warm = admm.solve(problem);
+    ASSERT_TRUE(warm.isSolved());
+    EXPECT_LT(warm.iterations, cold.iterations);
+    admm.setWarmStart(NativeSdpResult());
+    EXPECT_EQ(admm.solve(problem).iterations, cold.iterations);
+
+    SdpProblem infeasible(2);
+    infeasible.startNewCondition();
+    infeasible.addSdpConstrainedVariable(0, 0, 0, 1.0);
+    infeasible.addConstant(1.0);
+    infeasible.endCondition(LinearMatrixExpressionType::EQ);
 
+    auto result = NativeSdpBackend().solve(infeasible);
+    EXPECT_EQ(result.status, SdpBackendStatus::INFEASIBLE);
+    EXPECT_TRUE(result.solution.matrices.empty());
 }
 
+TEST(SdpBackend, Portfolio) {
+
+    // X_00 == 1, 2 X_01 == 1, a + X_11 == 3
+    SdpProblem problem(2);
+    problem.startNewCondition();
+    problem.addSdpConstrainedVariable(0, 0, 0, 1.0);
+    problem.addConstant(-1.0);
+    problem.endCondition(LinearMatrixExpressionType::EQ);
+
+    problem.startNewCondition();
+    problem.addSdpConstrainedVariable(0, 0, 1, 2.0);
+    problem.addConstant(-1.0);
+    problem.endCondition(LinearMatrixExpressionType::EQ);
+
+    problem.startNewCondition();
+    problem.addUnconstrainedVariable("a", 1.0);
+    problem.addSdpConstrainedVariable(0, 1, 1, 1.0);
+    problem.addConstant(-3.0);
+    problem.endCondition(LinearMatrixExpressionType::EQ);
+
+    std::vector<std::unique_ptr<SdpBackend>> backends;
+    backends.emplace_back(new NativeSdpBackend());
+    backends.emplace_back(new AdmmSdpBackend());
+    PortfolioSdpBackend portfolio(std::move(backends));
+    portfolio.setThreads(2);
+
+    auto result = portfolio.solve(problem);
+    ASSERT_TRUE(result.isSolved());
+    EXPECT_FALSE(portfolio.getWinner().empty());
+    EXPECT_LE(problem.getMaxViolation(result.solution), portfolio.getAllowedError());
+    problem.setSolution(result.solution);
+    EXPECT_NEAR(problem.getSolutionAsMap()["l_0_0_1"], 0.5, 1e-5);
+
+    // a cancelled race has no answer
+    portfolio.cancel();
+    EXPECT_EQ(portfolio.solve(problem).status, SdpBackendStatus::FAILED);
+    EXPECT_TRUE(portfolio.getWinner().empty());
+    portfolio.clearCancel();
+
+    SdpProblem infeasible(2);
+    infeasible.startNewCondition();
+    infeasible.addSdpConstrainedVariable(0, 0, 0, 1.0);
+    infeasible.addConstant(1.0);
+    infeasible.endCondition(LinearMatrixExpressionType::EQ);
+    EXPECT_EQ(portfolio.solve(infeasible).status, SdpBackendStatus::INFEASIBLE);
+}
+
+// two blocks and a free variable sharing the constraints
+static NativeSdpProblem nativeTestProblem() {
+    NativeSdpProblem problem;
+    problem.blockSizes = {3, -2};
+    problem.numberOfFreeVariables = 1;
+    problem.constraints.resize(4);
+    problem.constraints[0].entries = {{0, 0, 0, 1.0}, {0, 1, 2, 1.0}, {1, 0, 0, 1.0}};
+    problem.constraints[0].rhs = 2.0;
+    problem.constraints[1].entries = {{0, 1, 1, 1.0}, {0, 2, 2, 1.0}};
+    problem.constraints[1].freeEntries = {{0, -1.0}};
+    problem.constraints[1].rhs = 1.0;
+    problem.constraints[2].entries = {{0, 0, 1, 1.0}, {1, 1, 1, 2.0}};
+    problem.constraints[2].rhs = 0.5;
+    problem.constraints[3].entries = {{0, 2, 2, 1.0}};
+    problem.constraints[3].freeEntries = {{0, 1.0}};
+    problem.constraints[3].rhs = 4.0;
+    return problem;
+}
+
+TEST(NativeSdp, SolverResiduals) {
+
+    // two blocks sharing the constraints, the solution has to satisfy them and stay psd
+    auto problem = nativeTestProblem();
+
+    auto result = NativeSdpSolver(problem).solve();
+    ASSERT_EQ(result.status, NativeSdpStatus::SOLVED);
+
+    const auto& x = result.blocks[0];
+    const auto& diagonal = result.blocks[1];
+    double u = result.freeVariables[0];
+    EXPECT_NEAR(x[0] + 2 * x[5] + diagonal[0], 2.0, 1e-6);
+    EXPECT_NEAR(x[4] + x[8] - u, 1.0, 1e-6);
+    EXPECT_NEAR(2 * x[1] + 2 * diagonal[1], 0.5, 1e-6);
+    EXPECT_NEAR(x[8] + u, 4.0, 1e-6);
+
+    EXPECT_GT(diagonal[0], 0.0);
+    EXPECT_GT(diagonal[1], 0.0);
+    // leading principal minors
+    EXPECT_GT(x[0], 0.0);
+    EXPECT_GT(x[0] * x[4] - x[1] * x[3], 0.0);
+    double determinant = x[0] * (x[4] * x[8] - x[5] * x[7]) - x[1] * (x[3] * x[8] - x[5] * x[6]) +
+                         x[2] * (x[3] * x[7] - x[4] * x[6]);
+    EXPECT_GT(determinant, 0.0);
+}
+
+TEST(NativeAdmm, Feasible) {
+
+    NativeAdmmSettings settings;
+    settings.tolerance = 1e-9;
+    auto result = NativeAdmmSolver(nativeTestProblem(), settings).solve();
+    ASSERT_EQ(result.status, NativeSdpStatus::SOLVED);
+
+    const auto& x = result.blocks[0];
+    const auto& diagonal = result.blocks[1];
+    double u = result.freeVariables[0];
+    EXPECT_NEAR(x[0] + 2 * x[5] + diagonal[0], 2.0, 1e-7);
+    EXPECT_NEAR(x[4] + x[8] - u, 1.0, 1e-7);
+    EXPECT_NEAR(2 * x[1] + 2 * diagonal[1], 0.5, 1e-7);
+    EXPECT_NEAR(x[8] + u, 4.0, 1e-7);
+
+    // the iterate is projected on the cone, so it is psd up to rounding
+    EXPECT_GE(diagonal[0], 0.0);
+    EXPECT_GE(diagonal[1], 0.0);
+    EXPECT_GE(x[0] * x[4] - x[1] * x[3], -1e-12);
+}
+
+TEST(NativeAdmm, Infeasible) {
+
+    SdpProblem problem(2);
+
+    // X_00 + X_11 == -1, 0 == 0
+    problem.startNewCondition();
+    problem.addSdpConstrainedVariable(0, 0, 0, 1.0);
+    problem.addSdpConstrainedVariable(0, 1, 1, 1.0);
+    problem.addUnconstrainedVariable("a", 0.0);
+    problem.addConstant(1.0);
+    problem.endCondition(LinearMatrixExpressionType::EQ);
+
+    EXPECT_EQ(AdmmSdpBackend().solve(problem).status, SdpBackendStatus::INFEASIBLE);
+    auto state = NativeAdmmSolver(problem.getNativeProblem()).solve();
+    ASSERT_EQ(state.status, NativeSdpStatus::PRIMAL_INFEASIBLE);
+    // A^T y <= 0 and b^T y > 0
+    EXPECT_GT(-state.y[0], 0.0);
+}
+
+TEST(NativeAdmm, WarmStart) {
+
+    NativeAdmmSolver solver(nativeTestProblem());
+    auto cold = solver.solve();
+    ASSERT_EQ(cold.status, NativeSdpStatus::SOLVED);
+    EXPECT_GT(cold.iterations, 0);
+
+    // X and y of the result give back the fixed point
+    auto warm = solver.solve(cold);
+    ASSERT_EQ(warm.status, NativeSdpStatus::SOLVED);
+    EXPECT_EQ(warm.iterations, 0);
+
+    // the interior point result fits as well
+    auto interiorPoint = NativeSdpSolver(nativeTestProblem()).solve();
+    EXPECT_EQ(solver.solve(interiorPoint).status, NativeSdpStatus::SOLVED);
+}
+
+TEST(SdpExport, SdpaAndCbf) {
+
+    auto problem = nativeTestProblem();
+    SdpaLayout layout(problem);
+    // the free pair block goes before the diagonal one
+    EXPECT_EQ(layout.blockSizes, std::vector<int>({3, -2, -2}));
+    EXPECT_EQ(layout.blockNumbers, std::vector<int>({1, 3}));
+    EXPECT_EQ(layout.freeBlock, 2);
+
+    std::ostringstream sdpa;
+    writeSdpa(problem, sdpa);
+    std::istringstream sdpaLines(sdpa.str());
+    std::string line;
+    std::getline(sdpaLines, line);
+    EXPECT_EQ(std::stoi(line), 4);
+    std::getline(sdpaLines, line);
+    EXPECT_EQ(std::stoi(line), 3);
+
+    std::ostringstream cbf;
+    writeCbf(problem, cbf);
+    std::string text = cbf.str();
+    EXPECT_NE(text.find("PSDVAR\n1\n3\n"), std::string::npos);
+    EXPECT_NE(text.find("VAR\n3 2\nF 1\nL+ 2\n"), std::string::npos);
+    EXPECT_NE(text.find("CON\n4 1\nL= 4\n"), std::string::npos);
+    EXPECT_NE(text.find("BCOORD\n4\n"), std::string::npos);
+
+    // y is negated back, Z is skipped, the free variable is the difference of its pair, a 0.5 reads exactly
+    const char *solution =
+            "-1 -2 0.5 3\n"
+            "1 1 1 1 7\n"
+            "2 1 1 1 1\n"
+            "2 1 1 2 0.5\n"
+            "2 2 1 1 3\n"
+            "2 2 2 2 1\n"
+            "2 3 2 2 2.5\n";
+    auto result = readSdpaSolution(problem, solution, solution + strlen(solution));
+    EXPECT_EQ(result.y, std::vector<double>({1, 2, -0.5, -3}));
+    EXPECT_EQ(result.blocks[0][0], 1.0);
+    EXPECT_EQ(result.blocks[0][1], 0.5);
+    EXPECT_EQ(result.blocks[0][3], 0.5);
+    EXPECT_EQ(result.blocks[1], std::vector<double>({0, 2.5}));
+    EXPECT_EQ(result.freeVariables, std::vector<double>({2}));
+
+    // a short solution leaves the rest zero, as the stream version did
+    const char *shortSolution = "1 2";
+    result = readSdpaSolution(problem, shortSolution, shortSolution + strlen(shortSolution));
+    EXPECT_EQ(result.y, std::vector<double>({-1, -2, 0, 0}));
+    EXPECT_EQ(result.freeVariables, std::vector<double>({0}));
+}
+
+TEST(SdpPresolve, ReduceAndRestore) {
+
+    SdpProblem problem(2);
+    auto addCondition = [&problem](std::vector<std::tuple<int, int, double>> gram,
+                                   std::vector<std::pair<std::string, double>> free, double constant) {
+        problem.startNewCondition();
+        for (const auto& entry: gram) {
+            problem.addSdpConstrainedVariable(0, std::get<0>(entry), std::get<1>(entry), std::get<2>(entry));
+        }
+        for (const auto& variable: free) {
+            problem.addUnconstrainedVariable(variable.first, variable.second);
+        }
+        problem.addConstant(constant);
+        problem.endCondition(LinearMatrixExpressionType::EQ);
+    };
+
+    addCondition({{0, 0, 1.0}}, {}, 0.0); // X_00 == 0 removes row and column 0
+    addCondition({{0, 1, 2.0}}, {{"a", 1.0}}, -1.0); // then a == 1
+    addCondition({{1, 1, 1.0}}, {{"b", -1.0}}, -2.0);
+    addCondition({{1, 1, 1.0}}, {{"b", -1.0}}, -2.0); // a duplicate
+    addCondition({{1, 1, 2.0}}, {{"b", 2.0}}, -8.0);
+    addCondition({{1, 1, 1.0}}, {{"c", 1.0}}, -5.0); // c is only here
+    addCondition({}, {}, 0.0);
+    problem.startNewCondition();
+    problem.addNonnegativeVariable("v", 2.0);
+    problem.addConstant(-4.0);
+    problem.endCondition(LinearMatrixExpressionType::EQ);
+
+    SdpPresolve presolve(problem);
+    ASSERT_FALSE(presolve.isInfeasible());
+    ASSERT_FALSE(presolve.isSolved());
+    const auto& statistics = presolve.getStatistics();
+    EXPECT_EQ(statistics.rows, 8);
+    EXPECT_EQ(statistics.emptyRows, 1);
+    EXPECT_EQ(statistics.duplicateRows, 1);
+    EXPECT_EQ(statistics.fixedVariables, 2);
+    EXPECT_EQ(statistics.substitutedVariables, 1);
+    EXPECT_EQ(statistics.removedGramLines, 1);
+
+    auto& reduced = presolve.getReduced();
+    EXPECT_EQ(reduced.getNumberOfConditions(), 2);
+    EXPECT_EQ(reduced.getMatrixSize(0), 1);
+    EXPECT_EQ(reduced.getNumberOfNonnegativeVariables(), 0);
+
+    ASSERT_TRUE(solveWithBackend(NativeSdpBackend(), reduced));
+    presolve.postsolve();
+    auto values = problem.getSolutionAsMap();
+    EXPECT_NEAR(values["l_0_0_0"], 0.0, 1e-12);
+    EXPECT_NEAR(values["l_0_0_1"], 0.0, 1e-12);
+    EXPECT_NEAR(values["l_0_1_1"], 3.0, 1e-6);
+    EXPECT_NEAR(values["a"], 1.0, 1e-12);
+    EXPECT_NEAR(values["b"], 1.0, 1e-6);
+    EXPECT_NEAR(values["c"], 2.0, 1e-6);
+    EXPECT_NEAR(values["v"], 2.0, 1e-12);
+
+    // the same row with another right hand side
+    SdpProblem conflicting(2);
+    for (double constant: {-1.0, -2.0}) {
+        conflicting.startNewCondition();
+        conflicting.addSdpConstrainedVariable(0, 0, 1, 1.0);
+        conflicting.addUnconstrainedVariable("a", 1.0);
+        conflicting.addConstant(constant);
+        conflicting.endCondition(LinearMatrixExpressionType::EQ);
+    }
+    conflicting.startNewCondition();
+    conflicting.addUnconstrainedVariable("a", 1.0);
+    conflicting.addSdpConstrainedVariable(0, 1, 1, 1.0);
+    conflicting.endCondition(LinearMatrixExpressionType::EQ);
+    EXPECT_TRUE(SdpPresolve(conflicting).isInfeasible());
+}
+
+TEST(ComplexityEstimatorNative, Estimate1) {
+
+    const char *program =
+            "real n, m1, m2;\n"
+            "function T[1, 1];\n"
+            "if {n >= 1; n ^ 5 == m1; (n / 2) ^ 5 == m2 } => {T(m1) >= 2 * T(m2) + 2}\n"
+            "if {n == 0} => {T(n) >= 1}";
+
+    std::istringstream iss(program);
+    auto p = Program();
+    parse(iss, p, ParseConfig(), true);
+
+    auto estimator = ComplexityEstimator(p);
+    auto config = SolverConfig();
+
+    config.setMethod(AlgorithmFamily::PUTINAR);
+    config.setHighMonomialDegree(2);
+    config.setSdpEngine(SdpEngine::NATIVE);
+
+    estimator.configure(config);
+
+    estimator.IAdmitThatThisIsUnsafeAndShouldBeUsedOnlyWithTrustedInput();
+
+    estimator.solveWithPutinarCsdp();
+
+    EXPECT_TRUE(estimator.isFeasible());
+}
 
 TEST(ComplexityEstimatorCsdp, Estimate1) {
 